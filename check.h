@@ -0,0 +1,77 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+
+
+/*
+ * What the programs that check xplot without a display (see "make
+ * check") all need: numbers that are random enough but come out the
+ * same on every run, and a clock to time things by.  Each of them
+ * includes this once, and needn't use all of it.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <sys/time.h>
+
+#ifdef __GNUC__
+#define CHECK_STATIC static inline
+#else
+#define CHECK_STATIC static
+#endif
+
+static unsigned long seed = 1;
+
+/* The next number; setting seed starts a sequence over. */
+CHECK_STATIC unsigned long rnd(void)
+{
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+  return seed >> 20;
+}
+
+/* A number from lo to hi, both included. */
+CHECK_STATIC int rnd_in(int lo, int hi)
+{
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+  return lo + (int) ((seed >> 33) % (unsigned long) (hi - lo + 1));
+}
+
+CHECK_STATIC double seconds(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+#endif /* CHECK_H */
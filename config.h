@@ -0,0 +1,44 @@
+/* config.h.  Generated automatically by configure.  */
+/* config.h.in.  Generated automatically from configure.in by autoheader.  */
+
+/* Define as __inline if that's what the C compiler calls it.  */
+/* #undef inline */
+
+/* Define if you have the ANSI C header files.  */
+#define STDC_HEADERS 1
+
+/* Define if you can safely include both <sys/time.h> and <time.h>.  */
+#define TIME_WITH_SYS_TIME 1
+
+/* Define if your <sys/time.h> declares struct tm.  */
+/* #undef TM_IN_SYS_TIME */
+
+/* Define if the X Window System is missing or not being used.  */
+/* #undef X_DISPLAY_MISSING */
+
+/* Define if your <time.h> has extern time_t altzone */
+/* #undef HAS_ALTZONE */
+
+/* Define if you have the X11 library (-lX11).  */
+#define HAVE_LIBX11 1
+
+/* Define if you have the m library (-lm).  */
+#define HAVE_LIBM 1
+
+/* Define if you have the Xext library (-lXext).  */
+#define HAVE_LIBXEXT 1
+
+/* Define if you have the pthread library (-lpthread).  */
+#define HAVE_LIBPTHREAD 1
+
+/* Define if you have the z library (-lz).  */
+#define HAVE_LIBZ 1
+
+/* Define if you have the lzma library (-llzma).  */
+#define HAVE_LIBLZMA 1
+
+/* Define if you have the zstd library (-lzstd).  */
+/* #undef HAVE_LIBZSTD */
+
+/* Define if your struct tm has tm_gmtoff */
+#define TM_GMTOFF 1
@@ -30,6 +30,8 @@ the software.  Title to copyright in this software and any associated
 documentation shall at all times remain with M.I.T., and USER agrees
 to preserve same.
 */
+#include <ctype.h>
+#include <string.h>
 #include "xplot.h"
 
 extern struct coord_impl unsigned_impl;
@@ -37,6 +39,7 @@ extern struct coord_impl signed_impl;
 extern struct coord_impl timeval_impl;
 extern struct coord_impl double_impl;
 extern struct coord_impl dtime_impl;
+extern struct coord_impl nstime_impl;
 
 /* kludge kludge.... but at least all this grossness is mostly 
  * confined to the next 16 or so lines */
@@ -46,27 +49,153 @@ struct coord_impl *impls[] = {
   &signed_impl,
   &timeval_impl,
   &double_impl,
-  &dtime_impl
+  &dtime_impl,
+  &nstime_impl
   };
 
+/* s need not be '\0' terminated; any whitespace ends the name */
+static int coord_name_cmp(char *s, char *name)
+{
+  while (*name != '\0' && *s == *name) {
+    s++;
+    name++;
+  }
+  return !(*name == '\0' && (*s == '\0' || isspace((unsigned char) *s)));
+}
+
+/* bytes per coordinate in a command store, indexed by coord_type */
+int coord_size[] = {
+  sizeof(int),			/* U_INT */
+  sizeof(int),			/* INT */
+  sizeof(int64_t),		/* TIMEVAL */
+  sizeof(double),		/* DOUBLE */
+  sizeof(double),		/* DTIME */
+  sizeof(int64_t)		/* NSTIME */
+};
+
 coord_type parse_coord_name(char *s)
 {
-  if (strcmp(s,"unsigned") == 0) return U_INT;
-  else if (strcmp(s,"signed") == 0) return INT;
-  else if (strcmp(s,"timeval") == 0) return TIMEVAL;
-  else if (strcmp(s,"double") == 0) return DOUBLE;
-  else if (strcmp(s,"dtime") == 0) return DTIME;
+  if (coord_name_cmp(s,"unsigned") == 0) return U_INT;
+  else if (coord_name_cmp(s,"signed") == 0) return INT;
+  else if (coord_name_cmp(s,"timeval") == 0) return TIMEVAL;
+  else if (coord_name_cmp(s,"double") == 0) return DOUBLE;
+  else if (coord_name_cmp(s,"dtime") == 0) return DTIME;
+  else if (coord_name_cmp(s,"nstime") == 0) return NSTIME;
   else return ((coord_type) -1);
 }
 
-char *unparse_coord(coord_type ctype,coord c)
+/* the name parse_coord_name() takes for ctype */
+char *coord_name(coord_type ctype)
+{
+  static char *names[] = { "unsigned", "signed", "timeval", "double", "dtime",
+			   "nstime" };
+
+  return names[(int) ctype];
+}
+
+char *unparse_coord(coord_type ctype, coord c, char *buf)
 {
-  return  impls[(int)ctype]->unparse(c);
+  return  impls[(int)ctype]->unparse(c, buf);
 }
 
-coord parse_coord(coord_type ctype,char *s)
+bool parse_coord(coord_type ctype, char *s, coord *c)
 {
-  return  impls[(int)ctype]->parse(s);
+  return  impls[(int)ctype]->parse(s, c);
+}
+
+/* An optionally signed decimal integer from min to max. */
+bool parse_integer(char *s, int64_t min, int64_t max, int64_t *v)
+{
+  uint64_t n = 0;
+  int64_t r;
+  int negative = 0;
+  int digits;
+
+  if (*s == '-' || *s == '+')
+    negative = *s++ == '-';
+  for (digits = 0; (unsigned) (*s - '0') < 10; s++, digits++)
+    n = n * 10 + (*s - '0');
+  /* 18 digits can't overflow, and there are no coords with more */
+  if (digits == 0 || digits > 18 || !coord_tokend(*s))
+    return FALSE;
+  r = negative ? -(int64_t) n : (int64_t) n;
+  if (r < min || r > max)
+    return FALSE;
+  *v = r;
+  return TRUE;
+}
+
+/* the powers of ten a double holds exactly */
+static double exact_powers[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * A decimal number, as atof() takes it in the C locale.  When its
+ * digits fit in a double's 53 bits and it is within 10^22 of them,
+ * which is so for nearly every number in a plot, the one multiply or
+ * divide that makes it is correctly rounded (Clinger's fast path).
+ * Anything else -- long mantissas, big exponents, "inf" and the like
+ * -- is left to strtod(), which is correctly rounded too.  xplot never
+ * sets a locale, so its point is always a '.'.
+ */
+bool parse_decimal(char *s, double *d)
+{
+  char *start = s;
+  char *end;
+  uint64_t w = 0;
+  int e10 = 0;
+  int exp = 0;
+  int digits = 0;
+  int negative = 0;
+  int dropped = 0;
+
+  if (*s == '-' || *s == '+')
+    negative = *s++ == '-';
+  for (; (unsigned) (*s - '0') < 10; s++, digits++) {
+    if (w < 100000000000000000ULL)
+      w = w * 10 + (*s - '0');
+    else {
+      e10++;
+      dropped = 1;
+    }
+  }
+  if (*s == '.') {
+    for (s++; (unsigned) (*s - '0') < 10; s++, digits++) {
+      if (w < 100000000000000000ULL) {
+	w = w * 10 + (*s - '0');
+	e10--;
+      } else
+	dropped = 1;
+    }
+  }
+  if (digits > 0 && (*s == 'e' || *s == 'E')) {
+    int expneg = 0;
+
+    s++;
+    if (*s == '-' || *s == '+')
+      expneg = *s++ == '-';
+    if ((unsigned) (*s - '0') >= 10)
+      goto slow;
+    for (; (unsigned) (*s - '0') < 10; s++)
+      if (exp < 100000)
+	exp = exp * 10 + (*s - '0');
+    e10 += expneg ? -exp : exp;
+  }
+  if (digits == 0 || !coord_tokend(*s) || dropped
+      || w > (1ULL << 53) || e10 < -22 || e10 > 22)
+    goto slow;
+
+  *d = e10 < 0 ? (double) w / exact_powers[-e10]
+    : (double) w * exact_powers[e10];
+  if (negative)
+    *d = -*d;
+  return TRUE;
+
+ slow:
+  *d = strtod(start, &end);
+  return end != start && coord_tokend(*end);
 }
 
 
@@ -83,6 +212,25 @@ double map_coord(coord_type ctype, coord first, coord last, int n, coord c)
   return  impls[(int)ctype]->map(first, last, n, c);
 }
 
+#ifdef MAP_MANY_AVX2
+int cpu_has_avx2(void)
+{
+  static int has = -1;
+
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") != 0;
+  }
+  return has;
+}
+#endif
+
+void map_many_coord(coord_type ctype, coord first, coord last, int n,
+		    char *col, int count, double *out)
+{
+  impls[(int)ctype]->map_many(first, last, n, col, count, out);
+}
+
 coord unmap_coord(coord_type ctype,
 		  coord first, coord last,
 		  int n,
@@ -91,40 +239,71 @@ coord unmap_coord(coord_type ctype,
   return impls[(int)ctype]->unmap(first, last, n, i);
 }
 
+#define MAXTICKS 6
+
+/* how many ticks of level there are from first to last, up to MAXTICKS+1 */
+static int tick_count(coord_type ctype, coord first, coord last, int level)
+{
+  coord step;
+  coord at;
+  int count;
+
+  step = impls[(int)ctype]->tick(level);
+  at = impls[(int)ctype]->round_up(first, step);
+
+  for (count=1; count <= MAXTICKS; count++) {
+    at = impls[(int)ctype]->add(at, step);
+    if (impls[(int)ctype]->cmp(at, last) > 0)
+      break;
+  }
+  return count;
+}
+
+/*
+ * Call pp for the ticks from first to last, at the smallest level that
+ * has no more than MAXTICKS of them.  *level is where to start looking,
+ * the level used the last time (-1 if there wasn't one), and is set to
+ * the level used this time: a drag or a small zoom seldom moves it by
+ * more than one, while looking up from level 0 takes dozens of tries.
+ */
 void cticks(coord_type ctype, coord first, coord last, int horizontal,
-	    void (*pp)(coord c, int labelflag))
+	    int *level, void (*pp)(coord c, int labelflag))
 {
-  int level;
+  int lev;
   int sublevel;
   coord at;
   coord step;
   int count;
   int subcount;
   int maxextrasubticks;
-
-#define MAXTICKS 6
+  int c;
 
   if (horizontal) {
     maxextrasubticks = MAXTICKS + 1;
   } else {
     maxextrasubticks = ( MAXTICKS + 1 ) * 2;
   }
-  /* start with the smallest tick level */
-  for (level = 0; ; level++) {
-    step = impls[(int)ctype]->tick(level);
-    at = impls[(int)ctype]->round_up(first, step);
-    
-    for (count=1; count <= MAXTICKS; count++) {
-      at = impls[(int)ctype]->add(at, step);
-      if (impls[(int)ctype]->cmp(at, last) > 0)
+  /* the higher the level, the fewer the ticks: so if this level's fit,
+     go down while the next one's do, else go up until they fit */
+  lev = *level > 0 ? *level : 0;
+  count = tick_count(ctype, first, last, lev);
+  if (count <= MAXTICKS) {
+    while (lev > 0) {
+      c = tick_count(ctype, first, last, lev - 1);
+      if (c > MAXTICKS)
 	break;
-    } /* count is now number of ticks that fit */
-
-    /* if <=  max allowed, use this level */
-    if (count <= MAXTICKS) break;
+      lev--;
+      count = c;
+    }
+  } else {
+    do {
+      lev++;
+      count = tick_count(ctype, first, last, lev);
+    } while (count > MAXTICKS);
   }
+  *level = lev;
 
-  step = impls[(int)ctype]->tick(level);
+  step = impls[(int)ctype]->tick(lev);
     
   at = impls[(int)ctype]->round_up(first, step);
 
@@ -132,8 +311,8 @@ void cticks(coord_type ctype, coord first, coord last, int horizontal,
     pp(at,1);
     at = impls[(int)ctype]->add(at, step);
   }
-  sublevel = impls[(int)ctype]->subtick(level);
-  if (sublevel != level) {
+  sublevel = impls[(int)ctype]->subtick(lev);
+  if (sublevel != lev) {
 
     step = impls[(int)ctype]->tick(sublevel);
     at = impls[(int)ctype]->round_up(first, step);
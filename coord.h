@@ -42,9 +42,15 @@ to preserve same.
 #endif
 typedef enum {FALSE, TRUE} bool;
 
+/* the room unparse_coord() needs */
+#define COORD_TEXT_MAX 64
+
 struct coord_impl {
-  char  *((*unparse)(coord c));
-  coord (*parse)(char *s);
+  /* c as text, written into buf (COORD_TEXT_MAX bytes); returns where
+     in buf it starts */
+  char  *((*unparse)(coord c, char *buf));
+  /* the coordinate in the token s into *c, or FALSE if s isn't one */
+  bool  (*parse)(char *s, coord *c);
   coord (*zero)(void);
   int   (*cmp)(coord c1, coord c2);
   coord (*add)(coord c1, coord c2);
@@ -55,8 +61,18 @@ struct coord_impl {
   int   (*subtick)(int level);
   double (*map)(coord c1, coord c2, int n, coord c);
   coord (*unmap)(coord c1, coord c2, int n, double x);
+  /* map() for count coordinates kept as in a store column (see
+     load_coord()), into out */
+  void  (*map_many)(coord c1, coord c2, int n, char *col, int count,
+		    double *out);
 };
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* map_many() loops built for AVX2, run where cpu_has_avx2() */
+#define MAP_MANY_AVX2 __attribute__((target("avx2")))
+int cpu_has_avx2(void);
+#endif
+
 #define cmp_coord(ctype, c1, c2) (impls[(int)ctype]->cmp(c1,c2))
 
 #ifdef TCPTRACE
@@ -65,16 +81,19 @@ struct coord_impl {
 #endif /* TCPTRACE */
 
 coord_type parse_coord_name(char *s);
-char *unparse_coord(coord_type ctype, coord c);
-coord parse_coord(coord_type ctype, char *s);
+char *coord_name(coord_type ctype);
+char *unparse_coord(coord_type ctype, coord c, char *buf);
+bool parse_coord(coord_type ctype, char *s, coord *c);
 #ifndef cmp_coord
 int cmp_coord(coord_type ctype, coord c1, coord c2);
 #endif
 double map_coord(coord_type ctype, coord first, coord last, int n, coord c);
 coord unmap_coord(coord_type ctype, coord first, coord last, int n, double i);
+void map_many_coord(coord_type ctype, coord first, coord last, int n,
+		    char *col, int count, double *out);
 coord bump_coord(coord_type ctype, coord c);
 void cticks(coord_type ctype, coord first, coord last, int horizontal,
-	    void (*pp)(coord c, int labelflag));
+	    int *level, void (*pp)(coord c, int labelflag));
 
 void zoom_in_coord(coord_type ctype, coord first, coord last,
 		   int x1, int x2, 
@@ -90,4 +109,63 @@ void drag_coord(coord_type ctype, coord first, coord last,
 extern struct coord_impl *impls[];
 #endif
 
+/*
+ * The parse()s take a token as the input parser hands them out: it
+ * ends at whitespace or a '\0'.  They don't go through the C library,
+ * which is slow and minds the locale; the integer and decimal numbers
+ * in them are read by these.
+ */
+#define coord_tokend(ch) \
+  ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\r' || (ch) == '\0')
+bool parse_integer(char *s, int64_t min, int64_t max, int64_t *v);
+bool parse_decimal(char *s, double *d);
+
+/*
+ * The command stores keep coordinates at their natural width: 4 bytes
+ * for U_INT and INT, 8 for DOUBLE and DTIME, and 8 bytes of nanoseconds
+ * for TIMEVAL and NSTIME.  col points at a column of such values.
+ */
+extern int coord_size[];
+
+static inline coord load_coord(coord_type ctype, char *col, int i)
+{
+  coord r;
+
+  switch (ctype) {
+  case U_INT:
+  case INT:
+    r.i = ((int *) col)[i];
+    break;
+  case TIMEVAL:
+  case NSTIME:
+    r.ns = ((int64_t *) col)[i];
+    break;
+  case DOUBLE:
+  case DTIME:
+  default:
+    r.d = ((double *) col)[i];
+    break;
+  }
+  return r;
+}
+
+static inline void store_coord(coord_type ctype, char *col, int i, coord c)
+{
+  switch (ctype) {
+  case U_INT:
+  case INT:
+    ((int *) col)[i] = c.i;
+    break;
+  case TIMEVAL:
+  case NSTIME:
+    ((int64_t *) col)[i] = c.ns;
+    break;
+  case DOUBLE:
+  case DTIME:
+  default:
+    ((double *) col)[i] = c.d;
+    break;
+  }
+}
+
 #endif /* COORD_H */
@@ -0,0 +1,461 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+
+/*
+ * A check of the number parsing in coord.c that needs no display.
+ * parse_decimal() has to give exactly what strtod() does, both on the
+ * numbers its fast path takes and on those it leaves to strtod(), and
+ * turn down the same tokens; parse_integer() has to agree with
+ * strtoll().  timeval and nstime coordinates, kept in nanoseconds, have
+ * to be parsed and labelled just as xplot did when timevals were a
+ * struct timeval.  map_many() has to map a column of each type just as
+ * map() does each of them, whichever loop the CPU gets.  Then it times
+ * parsing tokens like those in demo.1, at each coord type, against the
+ * atoi() and atof() xplot used to call.
+ *
+ *	coordcheck
+ *
+ * Exits 1 if any number came out different.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include "xplot.h"
+#include "check.h"
+
+void panic(char *s)
+{
+  fprintf(stderr, "coordcheck: %s\n", s);
+  exit(1);
+}
+
+/* n random digits into s, the first not a 0 unless n is 1 */
+static char *digits(char *s, int n)
+{
+  int k;
+
+  for (k = 0; k < n; k++)
+    *s++ = '0' + rnd_in(k == 0 && n > 1 ? 1 : 0, 9);
+  return s;
+}
+
+/*
+ * A token for parse_decimal(): a mantissa of some digits with the
+ * point somewhere in them, maybe an exponent.  Short mantissas and
+ * small exponents are what the fast path is for; long ones and big
+ * exponents, and a few odd tokens, go to strtod().
+ */
+static int make_decimal(char *buf, int slow)
+{
+  static char *odd[] = {
+    "inf", "-inf", "nan", "1e", "1e+", ".", "-", "+.5", "5.", "1x",
+    "0x10", "1e-400", "1e400", "00000000000000000000001", "-0", "1..2",
+    "9007199254740993", "9007199254740992", "4.9e-324", ""
+  };
+  char *s = buf;
+  int n, point;
+
+  if (slow && rnd_in(0, 9) == 0) {
+    strcpy(buf, odd[rnd_in(0, sizeof(odd) / sizeof(odd[0]) - 1)]);
+    return 2;
+  }
+  if (rnd_in(0, 3) == 0)
+    *s++ = "-+"[rnd_in(0, 1)];
+  n = slow ? rnd_in(16, 30) : rnd_in(1, 15);
+  point = rnd_in(0, n);
+  if (point == 0) {
+    *s++ = '.';
+    s = digits(s, n);
+  } else {
+    s = digits(s, point);
+    if (point < n) {
+      *s++ = '.';
+      s = digits(s, n - point);
+    }
+  }
+  if (rnd_in(0, 2) == 0)
+    s += sprintf(s, "%c%d", "eE"[rnd_in(0, 1)],
+		 slow ? rnd_in(-330, 330) : rnd_in(-22 + n, 22 - n));
+  *s = '\0';
+  return slow;
+}
+
+static int check_decimals(void)
+{
+  int bad = 0;
+  int count[3];
+  int k;
+
+  memset(count, 0, sizeof(count));
+  for (k = 0; k < 2000000; k++) {
+    char buf[64];
+    char *end;
+    double got, want;
+    int ok, want_ok;
+    int kind = make_decimal(buf, k & 1);
+
+    count[kind]++;
+    ok = parse_decimal(buf, &got);
+    want = strtod(buf, &end);
+    want_ok = end != buf && coord_tokend(*end);
+    if (ok != want_ok
+	|| (ok && memcmp(&got, &want, sizeof(double)) != 0 && got == got)) {
+      if (bad++ < 10)
+	printf("parse_decimal(\"%s\"): %s %.17g, strtod %s %.17g\n", buf,
+	       ok ? "ok" : "no", got, want_ok ? "ok" : "no", want);
+    }
+  }
+  printf("parse_decimal: %d short, %d long or big, %d odd tokens;"
+	 " %d differ from strtod\n", count[0], count[1], count[2], bad);
+  return bad;
+}
+
+static int check_integers(void)
+{
+  int bad = 0;
+  int k;
+
+  for (k = 0; k < 1000000; k++) {
+    char buf[64];
+    char *s = buf;
+    char *end;
+    int64_t got;
+    long long want;
+    int ok, want_ok;
+
+    if (rnd_in(0, 3) == 0)
+      *s++ = "-+"[rnd_in(0, 1)];
+    s = digits(s, rnd_in(0, 20));
+    if (rnd_in(0, 20) == 0)
+      *s++ = "x. "[rnd_in(0, 2)];
+    *s = '\0';
+
+    ok = parse_integer(buf, INT32_MIN, INT32_MAX, &got);
+    errno = 0;
+    want = strtoll(buf, &end, 10);
+    want_ok = end != buf && coord_tokend(*end) && errno == 0
+      && want >= INT32_MIN && want <= INT32_MAX
+      && (unsigned) (end[-1] - '0') < 10;
+    if (ok != want_ok || (ok && got != want)) {
+      if (bad++ < 10)
+	printf("parse_integer(\"%s\"): %s %lld, strtoll %s %lld\n", buf,
+	       ok ? "ok" : "no", (long long) got, want_ok ? "ok" : "no",
+	       want);
+    }
+  }
+  printf("parse_integer: %d differ from strtoll\n", bad);
+  return bad;
+}
+
+/* timeval_parse() as it was, to places digits after the point; from
+   when it didn't check its token, so only for ones that are fine. */
+static void old_parse(char *s, int places, long long *sec, long *frac)
+{
+  *frac = 0;
+  *sec = atoll(s);
+  while (isdigit(*s)) s++;
+  if (*s == '.') {
+    s++;
+    *frac = atol(s);
+    {
+      int len = 0;
+      while (isdigit(*s++)) len++;
+      while (len < places) (len++, *frac *= 10);
+      while (len > places) (len--, *frac /= 10);
+    }
+  }
+}
+
+/* timeval_unparse() as it was, for a time of sec and usec, into buf;
+   with nanoseconds, as an nstime is labelled, if usec has a fraction. */
+static char *old_unparse(time_t sec, double usec, char *buf)
+{
+  struct tm *tmp = localtime(&sec);
+  long u = (long) usec;
+  char *cp;
+
+  (void) sprintf(buf, "%s", asctime(tmp));
+  if (usec == 0 && tmp->tm_sec == 0 && tmp->tm_min == 0 && tmp->tm_hour == 0) {
+    cp = buf+4;
+    sprintf(cp+7,"midn");
+  } else if (usec == 0 && tmp->tm_sec == 0 && tmp->tm_min == 0 && tmp->tm_hour == 12) {
+    cp = buf+4;
+    sprintf(cp+7,"noon");
+  } else {
+    cp = buf+10;
+    cp[10] = '\0';
+    if (usec != u) {
+      (void) sprintf(cp+9,".%09ld",(long) (usec * 1000 + 0.5));
+      cp += 9;
+    } else if (u != 0) {
+      if (u % 100 == 0) {
+	(void) sprintf(cp+9,".%04u",(unsigned) u/100);
+	cp += 7;
+      } else {
+	(void) sprintf(cp+9,".%06u",(unsigned) u);
+	cp += 9;
+      }
+    }
+  }
+  return cp;
+}
+
+/*
+ * timeval and nstime tokens of up to 10 digits of seconds and 0 to 12
+ * after the point: timevals keep six of them and nstimes nine, the
+ * rest dropped, as timeval_parse() always did to the sixth.  A '-' in
+ * front makes the whole of it negative, which timeval_parse() never
+ * managed, and seconds past what an int64_t of nanoseconds holds are
+ * turned down.  Some times fall on a whole second, midnight or noon, for
+ * the labels that leave the fraction or the time out.
+ */
+static int check_times(void)
+{
+  static char *odd[] = {
+    "", ".", "-", "x", "1x", "1.2x", "1.2.3", "12345678901", "--1", "1e5"
+  };
+  int bad = 0;
+  int nlabels = 0;
+  int k;
+
+  for (k = 0; k < 1000000; k++) {
+    coord_type ctype = k & 1 ? NSTIME : TIMEVAL;
+    int places = ctype == NSTIME ? 9 : 6;
+    int negative = rnd_in(0, 9) == 0;
+    char buf[64], label[64], want[64];
+    char *s = buf;
+    long long sec, ns;
+    long frac;
+    coord c;
+
+    if (negative)
+      *s++ = '-';
+    if (rnd_in(0, 3) == 0) {
+      /* midnight and noon, or near them, in local time */
+      struct tm tm;
+      time_t t;
+
+      memset(&tm, 0, sizeof(tm));
+      tm.tm_year = 70 + rnd_in(0, 60);
+      tm.tm_mday = rnd_in(1, 28);
+      tm.tm_hour = rnd_in(0, 1) * 12;
+      tm.tm_sec = rnd_in(0, 3) ? 0 : rnd_in(0, 59);
+      tm.tm_isdst = -1;
+      t = mktime(&tm);
+      s += sprintf(s, "%lld", (long long) t);
+    } else
+      s = digits(s, rnd_in(1, 10));
+    if (rnd_in(0, 4)) {
+      *s++ = '.';
+      if (rnd_in(0, 2) == 0)
+	s += sprintf(s, "%s", "0000000000" + rnd_in(0, 10));
+      else
+	s = digits(s, rnd_in(0, 12));
+    }
+    *s = '\0';
+
+    old_parse(buf + negative, places, &sec, &frac);
+    if (sec > INT64_MAX / 1000000000 - 1) {
+      /* past what nanoseconds hold in an int64_t */
+      if (parse_coord(ctype, buf, &c) && bad++ < 10)
+	printf("%s parse(\"%s\"): taken\n", coord_name(ctype), buf);
+      continue;
+    }
+    ns = sec * 1000000000LL + frac * (ctype == NSTIME ? 1 : 1000);
+    if (negative)
+      ns = -ns;
+    if (!parse_coord(ctype, buf, &c) || c.ns != ns) {
+      if (bad++ < 10)
+	printf("%s parse(\"%s\"): %lld, not %lld\n", coord_name(ctype),
+	       buf, (long long) c.ns, ns);
+      continue;
+    }
+    if (negative)
+      continue;
+    (void) unparse_coord(ctype, c, label);
+    (void) old_unparse((time_t) sec, ctype == NSTIME ? frac / 1000.0 : frac,
+		       want);
+    nlabels++;
+    if (strcmp(label, want) != 0 && bad++ < 10)
+      printf("%s unparse(\"%s\"): \"%s\", not \"%s\"\n",
+	     coord_name(ctype), buf, label, want);
+  }
+  for (k = 0; k < (int) (sizeof(odd) / sizeof(odd[0])); k++) {
+    coord c;
+
+    if ((parse_coord(TIMEVAL, odd[k], &c) || parse_coord(NSTIME, odd[k], &c))
+	&& bad++ < 10)
+      printf("time parse(\"%s\"): taken\n", odd[k]);
+  }
+  printf("timeval, nstime: 1000000 tokens, %d labels; %d differ from"
+	 " struct timeval\n", nlabels, bad);
+  return bad;
+}
+
+/* A coordinate of type ctype near about, kept as a store column keeps
+   it at col, or far from it now and then. */
+static coord near(coord_type ctype, double about, char *col)
+{
+  coord c;
+
+  switch (ctype) {
+  case U_INT:
+    c.u = rnd_in(0, 9) ? (unsigned) about + rnd_in(0, 1 << 20)
+      : (unsigned) rnd() ^ ((unsigned) rnd() << 16);
+    *(unsigned int *) col = c.u;
+    break;
+  case INT:
+    c.i = rnd_in(0, 9) ? (int) about + rnd_in(-(1 << 20), 1 << 20)
+      : (int) (rnd() ^ (rnd() << 16));
+    *(int *) col = c.i;
+    break;
+  case TIMEVAL:
+  case NSTIME:
+    /* past 2^51 ns from the left edge the AVX2 loop can't convert */
+    c.ns = rnd_in(0, 9) ? (int64_t) about + (int64_t) rnd() * rnd_in(1, 1000)
+      : (int64_t) (rnd() << 20) ^ (int64_t) rnd();
+    *(int64_t *) col = c.ns;
+    break;
+  default:
+    c.d = about + (double) (int) rnd() / (rnd_in(1, 1000));
+    *(double *) col = c.d;
+    break;
+  }
+  return c;
+}
+
+static int check_map_many(void)
+{
+  static coord_type types[] = { U_INT, INT, TIMEVAL, DOUBLE, DTIME, NSTIME };
+  int64_t col[40];
+  double out[40];
+  int bad = 0;
+  int round, k;
+
+  for (round = 0; round < 100000; round++) {
+    coord_type ctype = types[round % 6];
+    double about = (double) (rnd() % 1000000) * 1e3;
+    int count = rnd_in(0, 40);
+    int n = rnd_in(1, 4000);
+    coord first, last;
+
+    do {
+      first = near(ctype, about, (char *) col);
+      last = near(ctype, about, (char *) col);
+    } while (cmp_coord(ctype, first, last) >= 0);
+    for (k = 0; k < count; k++)
+      (void) near(ctype, about, (char *) col + k * (ctype == U_INT
+						   || ctype == INT ? 4 : 8));
+    map_many_coord(ctype, first, last, n, (char *) col, count, out);
+    for (k = 0; k < count; k++) {
+      coord c;
+      double want;
+
+      switch (ctype) {
+      case U_INT: c.u = ((unsigned int *) col)[k]; break;
+      case INT: c.i = ((int *) col)[k]; break;
+      case TIMEVAL: case NSTIME: c.ns = col[k]; break;
+      default: c.d = ((double *) col)[k]; break;
+      }
+      want = map_coord(ctype, first, last, n, c);
+      if (out[k] != want && bad++ < 10)
+	printf("%s map_many(): %.17g, not %.17g\n", coord_name(ctype),
+	       out[k], want);
+    }
+  }
+#ifdef MAP_MANY_AVX2
+  printf("map_many, %s: 100000 columns; %d differ from map()\n",
+	 cpu_has_avx2() ? "AVX2" : "no AVX2", bad);
+#else
+  printf("map_many: 100000 columns; %d differ from map()\n", bad);
+#endif
+  return bad;
+}
+
+#define N 1000000
+#define ROUNDS 5
+
+static char tv[N][24], un[N][12], db[N][24];
+volatile double dsink;
+volatile long lsink;
+
+#define TIME(what, loop) \
+  do { \
+    double t = seconds(); \
+    int r, i; \
+    for (r = 0; r < ROUNDS; r++) \
+      for (i = 0; i < N; i++) \
+	loop; \
+    printf("  %-20s %6.1f ns\n", what, \
+	   (seconds() - t) / ROUNDS / N * 1e9); \
+  } while (0)
+
+/* demo.1 has lines like "darrow 607016118.654052 216000000" */
+static void bench(void)
+{
+  coord c;
+  int i;
+
+  for (i = 0; i < N; i++) {
+    sprintf(tv[i], "%d.%06d", 607016118 + i / 10, (int) ((long) i * 7919 % 1000000));
+    sprintf(un[i], "%u", 216000000u + i * 513u);
+    sprintf(db[i], "%.6f", i * 0.0137);
+  }
+  printf("a token, on %d like demo.1's:\n", N);
+  TIME("timeval atoi() x2", lsink += atoi(tv[i])
+       + atoi(strchr(tv[i], '.') + 1));
+  TIME("timeval parse()", (parse_coord(TIMEVAL, tv[i], &c),
+			     lsink += c.ns));
+  TIME("unsigned atoi()", lsink += atoi(un[i]));
+  TIME("unsigned parse()", (parse_coord(U_INT, un[i], &c),
+			      lsink += c.u));
+  TIME("double atof()", dsink += atof(db[i]));
+  TIME("double parse()", (parse_coord(DOUBLE, db[i], &c),
+			    dsink += c.d));
+}
+
+int main(int argc, char **argv)
+{
+  int bad = 0;
+
+  bad += check_decimals();
+  bad += check_integers();
+  bad += check_times();
+  bad += check_map_many();
+  bench();
+  exit(bad ? 1 : 0);
+}
@@ -35,7 +35,6 @@ to preserve same.
 #include <stdio.h>
 #include "xplot.h"
 
-extern double atof();
 #if defined(linux) || defined(ultrix)
 #define remainder drem
 #endif
@@ -44,39 +43,27 @@ extern double remainder();
 /* basically doubles, but printed rep for time */
 
 char *
-dtime_unparse(coord c)
+dtime_unparse(coord c, char *buf)
 {
-  extern void panic();
-
-  char *r;
-  char buf[50];
-
   if ( fabs(c.d) <= 1E-16 )	/* XXX kludge */
-    (void) sprintf(buf, "0 s");
+    (void) strcpy(buf, "0 s");
   else if ( fabs(c.d) < .9995E-6 )
-    (void) sprintf(buf, "%7.3f ns", c.d * 1E9);
+    (void) snprintf(buf, COORD_TEXT_MAX, "%7.3f ns", c.d * 1E9);
   else if ( fabs(c.d) < .9995E-3 )
-    (void) sprintf(buf, "%7.3f us", c.d * 1E6);
+    (void) snprintf(buf, COORD_TEXT_MAX, "%7.3f us", c.d * 1E6);
   else if ( fabs(c.d) < .9995E0 )
-    (void) sprintf(buf, "%7.3f ms", c.d * 1E3);
+    (void) snprintf(buf, COORD_TEXT_MAX, "%7.3f ms", c.d * 1E3);
   else if  ( fabs(c.d) < .9995E3 )
-    (void) sprintf(buf, "%7.3f  s", c.d);
+    (void) snprintf(buf, COORD_TEXT_MAX, "%7.3f  s", c.d);
   else
-    (void) sprintf(buf, "%7.3f ks", c.d/ 1E3);
-    
-  r = malloc((unsigned) strlen(buf)+1);
-  if (r == 0)
-    panic("malloc returned 0");
-  (void) strcpy(r, buf);
-  return r;
+    (void) snprintf(buf, COORD_TEXT_MAX, "%7.3f ks", c.d/ 1E3);
+  return buf;
 }
 
-coord
-dtime_parse(char *s)
+bool
+dtime_parse(char *s, coord *c)
 {
-  coord r;
-  r.d = atof(s);
-  return r;
+  return parse_decimal(s, &c->d);
 }
 
 coord
@@ -226,6 +213,9 @@ dtime_unmap(coord c1,coord c2, int n, double x)
   return r;
 }
 
+extern void double_map_many(coord c1, coord c2, int n, char *col,
+			    int count, double *out);
+
 struct coord_impl dtime_impl = {
   dtime_unparse,
   dtime_parse,
@@ -238,5 +228,6 @@ struct coord_impl dtime_impl = {
   dtime_tick,
   dtime_subtick,
   dtime_map,
-  dtime_unmap
+  dtime_unmap,
+  double_map_many		/* see double.c */
 };
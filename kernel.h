@@ -0,0 +1,157 @@
+/*
+ * The loops that go over every command of a store, once for each pair
+ * of coord types.  xplot.c includes this with XT defined as an x coord
+ * type, and it includes itself once for each y coord type, so that in
+ * the loops the coordinates are compared in line, at their own widths,
+ * instead of being unpacked into coords and handed to the impls[] of
+ * coord.c one at a time.  See struct kernels in xplot.c.  Loops that
+ * map coordinates to doubles hand whole columns to map_many_coord().
+ */
+
+#ifndef YT
+
+#define YT U_INT
+#include "kernel.h"
+#undef YT
+#define YT INT
+#include "kernel.h"
+#undef YT
+#define YT TIMEVAL
+#include "kernel.h"
+#undef YT
+#define YT DOUBLE
+#include "kernel.h"
+#undef YT
+#define YT DTIME
+#include "kernel.h"
+#undef YT
+#define YT NSTIME
+#include "kernel.h"
+#undef YT
+
+#else /* YT */
+
+#define xtype KTYPE(XT)
+#define ytype KTYPE(YT)
+#define xcol(off) ((xtype *) (base + st->off))
+#define ycol(off) ((ytype *) (base + st->off))
+
+/* Which of the 3 by 3 regions around the view (see in_rect_table) x, y
+   is in. */
+#define region(x, y) \
+  (((y) > y_top ? 0 : (y) < y_bottom ? 6 : 3) \
+   + ((x) < x_left ? 0 : (x) > x_right ? 2 : 1))
+
+/* compute_window_coords() for n commands of a store: items[0] to
+   items[n-1], or from on if items is NULL.  Those that are mapped go
+   on the store's visible list. */
+static void KNAME(map_items)(struct plotter *pl, int kind, int *items,
+			     int from, int n)
+{
+  struct store *st = &pl->stores[kind];
+  xtype x_left, x_right;
+  ytype y_bottom, y_top;
+  int *visible;
+  int k;
+
+  store_coord(XT, (char *) &x_left, 0, pl_x_left);
+  store_coord(XT, (char *) &x_right, 0, pl_x_right);
+  store_coord(YT, (char *) &y_bottom, 0, pl_y_bottom);
+  store_coord(YT, (char *) &y_top, 0, pl_y_top);
+
+  reserve_visible(st, n);
+  visible = st->visible + st->nvisible;
+  for (k = 0; k < n; k++) {
+    int i = items ? items[k] : from + k;
+    char *base = st->chunks[i >> STORE_CHUNK_SHIFT];
+    int j = i & STORE_CHUNK_MASK;
+    int type = ((unsigned char *) (base + st->off_type))[j];
+    unsigned char *flags = st->flags[i >> STORE_CHUNK_SHIFT] + j;
+    int loc1, loc2;
+
+    switch (type) {
+    case TITLE:
+    case XLABEL:
+    case YLABEL:
+      *flags = MAPPED | NEEDS_REDRAW;
+      *visible++ = i;
+      continue;
+    case INVISIBLE:
+      *flags = 0;
+      continue;
+    }
+    loc1 = region(xcol(off_xa)[j], ycol(off_ya)[j]);
+    if ((type == LINE || type == DLINE) && st->off_xb)
+      loc2 = region(xcol(off_xb)[j], ycol(off_yb)[j]);
+    else
+      loc2 = loc1;
+    if (in_rect_table[loc1][loc2] == NO)
+      *flags &= NEEDS_REDRAW;
+    else {
+      *flags = MAPPED | NEEDS_REDRAW;
+      *visible++ = i;
+    }
+  }
+  st->nvisible = visible - st->visible;
+}
+
+/* bound_command() for commands from to to - 1 of a store. */
+static int KNAME(bound_items)(struct plotter *pl, int kind, int from, int to,
+			      struct bounds *b)
+{
+  struct store *st = &pl->stores[kind];
+  xtype x_left, x_right;
+  ytype y_bottom, y_top;
+  int empty = b->empty;
+  int moved = FALSE;
+  int i;
+
+  store_coord(XT, (char *) &x_left, 0, b->x_left);
+  store_coord(XT, (char *) &x_right, 0, b->x_right);
+  store_coord(YT, (char *) &y_bottom, 0, b->y_bottom);
+  store_coord(YT, (char *) &y_top, 0, b->y_top);
+
+#define bound(field, v, op) \
+  if (empty || (v) op field) { \
+    field = (v); \
+    moved = TRUE; \
+  }
+  for (i = from; i < to; i++) {
+    char *base = st->chunks[i >> STORE_CHUNK_SHIFT];
+    int j = i & STORE_CHUNK_MASK;
+    int type = ((unsigned char *) (base + st->off_type))[j];
+
+    if (type == TITLE || type == XLABEL || type == YLABEL)
+      continue;
+    if ((type == LINE || type == DLINE) && st->off_xb) {
+      bound(x_left, xcol(off_xb)[j], <);
+      bound(x_right, xcol(off_xb)[j], >);
+      bound(y_bottom, ycol(off_yb)[j], <);
+      bound(y_top, ycol(off_yb)[j], >);
+      empty = FALSE;
+    }
+    bound(x_left, xcol(off_xa)[j], <);
+    bound(x_right, xcol(off_xa)[j], >);
+    bound(y_bottom, ycol(off_ya)[j], <);
+    bound(y_top, ycol(off_ya)[j], >);
+    empty = FALSE;
+  }
+#undef bound
+
+  if (moved) {
+    b->x_left = load_coord(XT, (char *) &x_left, 0);
+    b->x_right = load_coord(XT, (char *) &x_right, 0);
+    b->y_bottom = load_coord(YT, (char *) &y_bottom, 0);
+    b->y_top = load_coord(YT, (char *) &y_top, 0);
+  }
+  b->empty = empty;
+  return moved;
+}
+
+#undef region
+#undef xcol
+#undef ycol
+#undef xtype
+#undef ytype
+
+#endif /* YT */
@@ -0,0 +1,246 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+
+/*
+ * Times the loops of kernel.h against doing the same a command at a
+ * time, unpacked through a cursor and compared and mapped through the
+ * impls[] of coord.c (bound_command() and compute_window_coords()),
+ * which is how xplot did it before there were kernels.  For each pair
+ * of coord types it makes a plotter of dots and lines, and prints the
+ * ns per command of each, checking that both ways come out the same.
+ *
+ *	kernelbench [commands]
+ *
+ * Exits 1 if they don't.  It includes xplot.c to get at its statics,
+ * and needs no display.
+ */
+
+#define main xplot_main
+#include "xplot.c"
+#undef main
+
+#include "check.h"
+
+static coord random_coord(coord_type ctype)
+{
+  coord c;
+
+  switch (ctype) {
+  case U_INT:
+    c.u = 216000000u + (unsigned) (rnd() % 100000000);
+    break;
+  case INT:
+    c.i = (int) (rnd() % 2000000) - 1000000;
+    break;
+  case TIMEVAL:
+  case NSTIME:
+    c.ns = 607016118000000000LL + (int64_t) (rnd() % 100000000000ULL);
+    break;
+  case DOUBLE:
+  case DTIME:
+  default:
+    c.d = (double) (rnd() % 1000000000) / 1000.0;
+    break;
+  }
+  return c;
+}
+
+static PLOTTER make_plotter(coord_type x_type, coord_type y_type, int n)
+{
+  PLOTTER pl;
+  int k;
+
+  pl = (PLOTTER) malloc(sizeof(*pl));
+  if (pl == 0) fatalerror("malloc returned null");
+  init_plotter(pl, NULL, 1, 0);
+  pl->x_type = x_type;
+  pl->y_type = y_type;
+  init_stores(pl);
+  seed = 1;
+  for (k = 0; k < n; k++) {
+    command c;
+
+    new_command(pl, &c);
+    c.type = k % 2 ? DOT : LINE;
+    c.color = k % 8;
+    c.xa = random_coord(x_type);
+    c.ya = random_coord(y_type);
+    c.xb = random_coord(x_type);
+    c.yb = random_coord(y_type);
+    add_command(pl, &c);
+  }
+  return pl;
+}
+
+static int same_bounds(PLOTTER pl, struct bounds *a, struct bounds *b)
+{
+  return a->empty == b->empty
+    && cmp_coord(pl->x_type, a->x_left, b->x_left) == 0
+    && cmp_coord(pl->x_type, a->x_right, b->x_right) == 0
+    && cmp_coord(pl->y_type, a->y_bottom, b->y_bottom) == 0
+    && cmp_coord(pl->y_type, a->y_top, b->y_top) == 0;
+}
+
+/*
+ * Each way is timed TRIES times and the fastest kept, so that what is
+ * timed is the loop, not the page faults of the first time a new
+ * plotter's visible lists are written, nor whatever else the machine
+ * was doing.
+ */
+#define TRIES 3
+
+/* The fastest of best and the ns a command each of n took since s. */
+static double fastest(double best, double s, int n)
+{
+  double t = (seconds() - s) / n * 1e9;
+
+  return t < best ? t : best;
+}
+
+/* Bound every command both ways; returns how many ns a command each
+   took in t[0] and t[1], and FALSE if the bounds differ. */
+static int time_bounds(PLOTTER pl, int n, double t[2])
+{
+  struct bounds a, b;
+  struct cursor cur;
+  command *c;
+  double s;
+  int kind;
+
+  int r;
+
+  t[0] = t[1] = HUGE_VAL;
+  for (r = 0; r < TRIES; r++) {
+    s = seconds();
+    init_bounds(&a);
+    for (c = first_command(pl, &cur, 0); c != NULL; c = next_command(&cur))
+      (void) bound_command(pl, &a, c);
+    t[0] = fastest(t[0], s, n);
+
+    s = seconds();
+    init_bounds(&b);
+    for (kind = 0; kind < NKINDS; kind++)
+      (void) kernels(pl)->bound_items(pl, kind, 0, pl->stores[kind].n, &b);
+    t[1] = fastest(t[1], s, n);
+  }
+  return same_bounds(pl, &a, &b);
+}
+
+/* Map every command both ways, in the current view; FALSE if they
+   don't agree on which are in it. */
+static int time_map(PLOTTER pl, int n, double t[2])
+{
+  struct cursor cur;
+  command *c;
+  int nmapped = 0;
+  int nvisible = 0;
+  int bad = 0;
+  double s;
+  int kind, k, r;
+
+  t[0] = t[1] = HUGE_VAL;
+  for (r = 0; r < TRIES; r++) {
+    s = seconds();
+    nmapped = 0;
+    for (c = first_command(pl, &cur, 0); c != NULL; c = next_command(&cur)) {
+      compute_window_coords(pl, c);
+      nmapped += c->mapped;
+    }
+    t[0] = fastest(t[0], s, n);
+
+    s = seconds();
+    for (kind = 0; kind < NKINDS; kind++) {
+      pl->stores[kind].nvisible = 0;
+      kernels(pl)->map_items(pl, kind, NULL, 0, pl->stores[kind].n);
+    }
+    t[1] = fastest(t[1], s, n);
+  }
+
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+
+    nvisible += st->nvisible;
+    for (k = 0; k < st->nvisible; k++) {
+      cur.pl = pl;
+      cur.dec = NULL;
+      cur.kind = kind;
+      cur.i = st->visible[k];
+      unpack_command(&cur);
+      compute_window_coords(pl, &cur.c);
+      if (!cur.c.mapped)
+	bad++;
+    }
+  }
+  return bad == 0 && nmapped == nvisible;
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : 200000;
+  int bad = 0;
+  int x, y;
+
+  printf("ns a command, one at a time -> kernel.h, %d dots and lines\n", n);
+  printf("%-16s %17s %17s %17s\n", "", "bounds", "map, all of it",
+	 "map, a ninth");
+  for (x = 0; x < 6; x++)
+    for (y = 0; y < 6; y++) {
+      PLOTTER pl = make_plotter((coord_type) x, (coord_type) y, n);
+      double tb[2], ta[2], tz[2];
+      coord l, r, b, t;
+      int ok;
+
+      set_views(pl);
+      pl->size.x = 1000;
+      pl->size.y = 800;
+      ok = time_bounds(pl, n, tb);
+      ok &= time_map(pl, n, ta);
+      /* the middle of it */
+      l = pl_x_left;
+      r = pl_x_right;
+      b = pl_y_bottom;
+      t = pl_y_top;
+      pl_x_left = unmap_coord(pl->x_type, l, r, 3, 1.0);
+      pl_x_right = unmap_coord(pl->x_type, l, r, 3, 2.0);
+      pl_y_bottom = unmap_coord(pl->y_type, b, t, 3, 1.0);
+      pl_y_top = unmap_coord(pl->y_type, b, t, 3, 2.0);
+      ok &= time_map(pl, n, tz);
+      printf("%-7s %-8s %7.1f -> %5.1f %7.1f -> %5.1f %7.1f -> %5.1f%s\n",
+	     coord_name((coord_type) x), coord_name((coord_type) y),
+	     tb[0], tb[1], ta[0], ta[1], tz[0], tz[1],
+	     ok ? "" : "  DIFFERENT");
+      if (!ok)
+	bad++;
+    }
+  exit(bad ? 1 : 0);
+}
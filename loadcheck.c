@@ -0,0 +1,1480 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+
+/*
+ * Checks of the way xplot loads plot files, and of what it does with
+ * them before they are drawn, that need no display.
+ *
+ *	loadcheck
+ *
+ * Exits 1 if any of them fails.  It includes xplot.c to get at its
+ * statics, with PARSE_CHUNK_MIN, FEED_BLOCK and FOLLOW_MAX made small
+ * enough that the files it makes up, of a few hundred KB, are cut into
+ * dozens of chunks, compressed ones into several blocks, and what is
+ * added to a followed one taken in over several looks.
+ */
+
+#define PARSE_CHUNK_MIN 512
+#define FEED_BLOCK (64 * 1024)
+#define FOLLOW_MAX 4096
+#define main xplot_main
+#include "xplot.c"
+#undef main
+
+#include <limits.h>
+#include <stdarg.h>
+#include <sys/wait.h>
+#include "check.h"
+
+/* A plot file being made up, in memory. */
+struct text {
+  char *p;
+  size_t len;
+  size_t max;
+  int lines;			/* how many it has so far, */
+  int bodies;			/* of which the bodies of text commands */
+};
+
+/* Make sure there is room for n more bytes in t. */
+static void grow(struct text *t, size_t n)
+{
+  char *cp;
+
+  if (t->len + n <= t->max)
+    return;
+  if (t->max == 0)
+    t->max = 64 * 1024;
+  while (t->len + n > t->max)
+    t->max *= 2;
+  cp = (char *) malloc(t->max);
+  if (cp == 0) fatalerror("malloc returned null");
+  if (t->len)
+    memcpy(cp, t->p, t->len);
+  free(t->p);
+  t->p = cp;
+}
+
+static void put(struct text *t, char *fmt, ...)
+{
+  char line[512];
+  va_list ap;
+  char *cp;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsprintf(line, fmt, ap);
+  va_end(ap);
+  grow(t, n);
+  memcpy(t->p + t->len, line, n);
+  t->len += n;
+  for (cp = line; *cp; cp++)
+    if (*cp == '\n')
+      t->lines++;
+}
+
+/* A coordinate of type ctype, as it would be written. */
+static char *coord_token(coord_type ctype, char *buf)
+{
+  switch (ctype) {
+  case U_INT:
+    sprintf(buf, "%lu", rnd() % 100000);
+    break;
+  case INT:
+    sprintf(buf, "%ld", (long) (rnd() % 200000) - 100000);
+    break;
+  case TIMEVAL:
+    sprintf(buf, "%lu.%06lu", 900000000 + rnd() % 1000, rnd() % 1000000);
+    break;
+  case NSTIME:
+    sprintf(buf, "%lu.%09lu", 900000000 + rnd() % 1000,
+	    rnd() % 1000000000);
+    break;
+  case DOUBLE:
+  case DTIME:
+  default:
+    sprintf(buf, "%.3f", (double) (rnd() % 2000000) / 1000.0 - 1000.0);
+    break;
+  }
+  return buf;
+}
+
+/* the bodies of text commands: some would be commands on their own */
+static char *bodies[] = {
+  "a label", "line 1 2 3 4", "new_plotter", "go", "green", "7",
+  "double double", "x 1 2", "", "; not a comment", "ctext 1 2"
+};
+#define NBODIES (sizeof(bodies) / sizeof(bodies[0]))
+
+static char *point_verbs[] = {
+  "x", ".", "+", "box", "diamond", "utick", "dtick", "ltick", "rtick",
+  "htick", "vtick", "uarrow", "darrow", "larrow", "rarrow", "invisible"
+};
+#define NPOINT_VERBS (sizeof(point_verbs) / sizeof(point_verbs[0]))
+
+static char *text_verbs[] = { "atext", "btext", "ctext", "ltext", "rtext" };
+
+/*
+ * Make up a file of nplotters plotters of about n lines each, of every
+ * kind xplot reads, with colours set on lines of their own and text
+ * bodies that look like commands.  If bad is set, the first command
+ * from line bad on is one that doesn't parse; returns the line number
+ * xplot gives it, or 0.  xplot has always counted the lines of a file
+ * without the bodies of the text commands.
+ */
+static int make_plot(struct text *t, int nplotters, int n, int bad)
+{
+  char a[32], b[32], c[32], d[32];
+  int bad_at = 0;
+  int p, k;
+
+  t->len = 0;
+  t->lines = t->bodies = 0;
+  for (p = 0; p < nplotters; p++) {
+    coord_type xt = (coord_type) (rnd() % 6);
+    coord_type yt = rnd() % 3 ? (coord_type) (rnd() % 6) : xt;
+
+    if (p > 0)
+      put(t, "new_plotter\n");
+    put(t, "%s %s\n", coord_name(xt), coord_name(yt));
+    if (xt == yt && rnd() % 2)
+      put(t, "aspect_ratio %g\n", 0.5 + (double) (rnd() % 4));
+    for (k = 0; k < n; k++) {
+      if (bad && !bad_at && t->lines + 1 >= bad) {
+	put(t, "bogus %s\n", coord_token(xt, a));
+	bad_at = t->lines - t->bodies;
+	continue;
+      }
+      switch (rnd() % 20) {
+      case 0:
+	if (rnd() % 2)
+	  put(t, "%s\n", ColorNames[rnd() % NCOLORS]);
+	else
+	  put(t, "%lu\n", rnd() % NCOLORS);
+	break;
+      case 1:
+      case 2:
+	put(t, "%s %s %s\n%s\n", text_verbs[rnd() % 5],
+	    coord_token(xt, a), coord_token(yt, b), bodies[rnd() % NBODIES]);
+	t->bodies++;
+	break;
+      case 3:
+	put(t, "%s\n%s\n", rnd() % 2 ? "title" : rnd() % 2 ? "xlabel"
+	    : "ylabel", bodies[rnd() % NBODIES]);
+	t->bodies++;
+	break;
+      case 4:
+	put(t, "%s\nunits %lu\n", rnd() % 2 ? "xunits" : "yunits",
+	    rnd() % 100);
+	t->bodies++;
+	break;
+      case 5:
+	put(t, rnd() % 2 ? "; a comment\n" : "\n");
+	break;
+      case 6: case 7: case 8: case 9: case 10: case 11:
+	if (rnd() % 4)
+	  put(t, "%s %s %s\n", point_verbs[rnd() % NPOINT_VERBS],
+	      coord_token(xt, a), coord_token(yt, b));
+	else
+	  put(t, "%s %s %s %lu\n", point_verbs[rnd() % NPOINT_VERBS],
+	      coord_token(xt, a), coord_token(yt, b), rnd() % NCOLORS);
+	break;
+      default:
+	put(t, "%s %s %s %s %s", rnd() % 4 ? "line" : "dline",
+	    coord_token(xt, a), coord_token(yt, b), coord_token(xt, c),
+	    coord_token(yt, d));
+	if (rnd() % 4)
+	  put(t, "\n");
+	else
+	  put(t, " %s\n", ColorNames[rnd() % NCOLORS]);
+	break;
+      }
+    }
+  }
+  return bad_at;
+}
+
+/* A regular file with t in it, to be mapped as plot files are. */
+static FILE *file_of(struct text *t)
+{
+  FILE *fp = tmpfile();
+
+  if (fp == NULL || fwrite(t->p, 1, t->len, fp) != t->len
+      || fflush(fp) != 0)
+    fatalerror("can't write a temporary file");
+  rewind(fp);
+  return fp;
+}
+
+static PLOTTER load_text(struct text *t, int threads)
+{
+  FILE *fp = file_of(t);
+  PLOTTER list;
+
+  list = read_plotters(fp, NULL, 0, 0, 0, threads);
+  fclose(fp);
+  return list;
+}
+
+/* The same read from a pipe, as standard input would be. */
+static PLOTTER load_pipe(struct text *t, int threads)
+{
+  int fds[2];
+  pid_t pid;
+  FILE *fp;
+  PLOTTER list;
+
+  if (pipe(fds) != 0)
+    fatalerror("pipe failed");
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0)
+    fatalerror("fork failed");
+  if (pid == 0) {
+    close(fds[0]);
+    if (write(fds[1], t->p, t->len) != (ssize_t) t->len)
+      _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  fp = fdopen(fds[0], "r");
+  if (fp == NULL)
+    fatalerror("fdopen failed");
+  list = read_plotters(fp, NULL, 0, 0, 0, threads);
+  fclose(fp);
+  (void) waitpid(pid, NULL, 0);
+  return list;
+}
+
+static int same_string(char *a, char *b)
+{
+  return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+/* Whether two lists of plotters hold the same commands, in the same
+   places in the input; says where they first differ if not. */
+static int same_plotters(PLOTTER a, PLOTTER b, char *what)
+{
+  struct cursor ca, cb;
+  int np, kind, i;
+
+  for (np = 0; a != NULL && b != NULL; a = a->next, b = b->next, np++) {
+    if (a->x_type != b->x_type || a->y_type != b->y_type
+	|| !same_string(a->x_units, b->x_units)
+	|| !same_string(a->y_units, b->y_units)
+	|| a->aspect_ratio != b->aspect_ratio
+	|| a->current_color != b->current_color
+	|| a->default_color != b->default_color) {
+      printf("%s: plotter %d from the end differs\n", what, np);
+      return FALSE;
+    }
+    ca.pl = a;
+    cb.pl = b;
+    for (kind = 0; kind < NKINDS; kind++) {
+      if (a->stores[kind].n != b->stores[kind].n) {
+	printf("%s: plotter %d from the end has %d commands of kind %d,"
+	       " not %d\n", what, np, b->stores[kind].n, kind,
+	       a->stores[kind].n);
+	return FALSE;
+      }
+      for (i = 0; i < a->stores[kind].n; i++) {
+	command *x = &ca.c, *y = &cb.c;
+
+	ca.kind = cb.kind = kind;
+	ca.i = cb.i = i;
+	unpack_command(&ca);
+	unpack_command(&cb);
+	if (x->type != y->type || x->color != y->color
+	    || x->position != y->position
+	    || store_seq(&a->stores[kind], i) != store_seq(&b->stores[kind], i)
+	    || cmp_coord(a->x_type, x->xa, y->xa) != 0
+	    || cmp_coord(a->y_type, x->ya, y->ya) != 0
+	    || cmp_coord(a->x_type, x->xb, y->xb) != 0
+	    || cmp_coord(a->y_type, x->yb, y->yb) != 0
+	    || !same_string(x->text, y->text)) {
+	  printf("%s: plotter %d from the end, command %d of kind %d"
+		 " differs\n", what, np, i, kind);
+	  return FALSE;
+	}
+      }
+    }
+  }
+  if (a != NULL || b != NULL) {
+    printf("%s: not the same number of plotters\n", what);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* What loading t on threads threads says on stderr before it gives up. */
+static void load_error(struct text *t, int threads, char *out, int max)
+{
+  int fds[2];
+  pid_t pid;
+  int n, len = 0;
+
+  if (pipe(fds) != 0)
+    fatalerror("pipe failed");
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0)
+    fatalerror("fork failed");
+  if (pid == 0) {
+    dup2(fds[1], 2);
+    close(fds[0]);
+    (void) load_text(t, threads);
+    _exit(0);
+  }
+  close(fds[1]);
+  while (len < max - 1 && (n = read(fds[0], out + len, max - 1 - len)) > 0)
+    len += n;
+  out[len] = '\0';
+  close(fds[0]);
+  (void) waitpid(pid, NULL, 0);
+}
+
+/*
+ * The chunked parser has to come out with just what parsing the file a
+ * line at a time does: the colour in force carried from one chunk into
+ * the next, the coord types changed by new_plotter lines in one chunk
+ * and taken up in the next, text bodies that look like commands left
+ * alone wherever a chunk boundary falls, and an error put at the line
+ * it is on.
+ */
+static int check_chunks(void)
+{
+  static int threads[] = { 2, 3, 8, 16 };
+  struct text t;
+  char what[64];
+  char serial[1024], chunked[1024], want[64];
+  int nfiles = 0;
+  int bad = 0;
+  int s, k, line;
+
+  memset(&t, 0, sizeof(t));
+  for (s = 1; s <= 12; s++) {
+    PLOTTER one;
+
+    seed = s;
+    (void) make_plot(&t, 1 + s % 4, 2000 + 1000 * (s % 3), 0);
+    one = load_text(&t, 1);
+    for (k = 0; k < sizeof(threads) / sizeof(threads[0]); k++) {
+      sprintf(what, "file %d on %d threads", s, threads[k]);
+      if (!same_plotters(one, load_text(&t, threads[k]), what))
+	bad++;
+    }
+    nfiles++;
+  }
+
+  for (s = 1; s <= 6; s++) {
+    seed = s;
+    line = make_plot(&t, 3, 3000, s * 1300);
+    load_error(&t, 1, serial, sizeof(serial));
+    sprintf(want, "in line number %d:", line);
+    if (strstr(serial, want) == NULL) {
+      printf("error on line %d: one thread says %s", line, serial);
+      bad++;
+    }
+    for (k = 0; k < sizeof(threads) / sizeof(threads[0]); k++) {
+      load_error(&t, threads[k], chunked, sizeof(chunked));
+      if (strcmp(serial, chunked) != 0) {
+	printf("error on line %d: %d threads say %s", line, threads[k],
+	       chunked);
+	bad++;
+      }
+    }
+  }
+  free(t.p);
+  printf("parse_in_parallel: %d files, 6 errors; %d differ from one"
+	 " thread\n", nfiles, bad);
+  return bad;
+}
+
+/* Where the draw loop puts the ends of a command, one at a time. */
+static void ends_of(PLOTTER pl, command *c, dXPoint *a, dXPoint *b)
+{
+  a->x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, c->xa)
+    + pl->origin.x;
+  a->y = (pl->size.y - 1)
+    - map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, c->ya)
+    + pl->origin.y;
+  if (c->type == LINE || c->type == DLINE) {
+    b->x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, c->xb)
+      + pl->origin.x;
+    b->y = (pl->size.y - 1)
+      - map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, c->yb)
+      + pl->origin.y;
+  } else
+    *b = *a;
+}
+
+/*
+ * With a level of detail, each set of points or segments of one type
+ * and colour that the draw loop would put on the same pixels has to be
+ * cut down to the first of them in the file, and nothing else left
+ * out.  That is checked against the pixels worked out here one command
+ * at a time, on plots drawn small so that there is a lot to leave out.
+ */
+static int check_lod(void)
+{
+  static char *verbs[] = { "x", ".", "box", "line", "dline" };
+  struct text t;
+  int *kept[NKINDS], nkept[NKINDS];
+  int nplots = 0;
+  int ndropped = 0;
+  int bad = 0;
+  int s, kind, k;
+
+  memset(&t, 0, sizeof(t));
+  for (s = 1; s <= 6; s++) {
+    PLOTTER pl;
+
+    seed = 100 + s;
+    t.len = 0;
+    put(&t, "unsigned unsigned\n");
+    for (k = 0; k < 2000; k++) {
+      unsigned long x = rnd() % 1000, y = rnd() % 1000;
+      int v = rnd() % 5;
+
+      if (rnd() % 8 == 0)
+	put(&t, "%s\n", ColorNames[rnd() % 3]);
+      if (v < 3)
+	put(&t, "%s %lu %lu\n", verbs[v], x, y);
+      else
+	put(&t, "%s %lu %lu %lu %lu\n", verbs[v], x, y,
+	    x + rnd() % 50, y + rnd() % 50);
+    }
+    pl = load_text(&t, 1);
+    set_views(pl);
+    pl->origin.x = 70;
+    pl->origin.y = 30;
+    pl->size.x = 10 + 6 * s;
+    pl->size.y = 8 + 4 * s;
+    build_index(pl);
+
+    /* the stores' sets of pixels are kept from the view before */
+    pl->size.x += 7;
+    map_commands(pl, TRUE);
+    map_visible(pl);
+    pl->size.x -= 7;
+    map_commands(pl, TRUE);
+    map_visible(pl);
+    for (kind = 0; kind < TEXTS; kind++) {
+      struct store *st = &pl->stores[kind];
+
+      nkept[kind] = st->nvisible;
+      kept[kind] = (int *) malloc((st->nvisible + 1) * sizeof(int));
+      if (kept[kind] == 0) fatalerror("malloc returned null");
+      memcpy(kept[kind], st->visible, st->nvisible * sizeof(int));
+      for (k = 0; k < st->nvisible; k++)
+	if ((store_flags(st, st->visible[k]) & MAPPED) == 0)
+	  break;
+      if (k < st->nvisible) {
+	printf("level of detail: plot %d, kind %d: a kept one isn't"
+	       " mapped\n", s, kind);
+	bad++;
+      }
+    }
+
+    map_commands(pl, FALSE);
+    map_visible(pl);
+    for (kind = 0; kind < TEXTS; kind++) {
+      struct store *st = &pl->stores[kind];
+      struct cursor cur;
+      int *want;
+      int nwant = 0;
+      int j;
+
+      want = (int *) malloc((st->nvisible + 1) * sizeof(int));
+      if (want == 0) fatalerror("malloc returned null");
+      cur.pl = pl;
+      cur.dec = NULL;
+      cur.kind = kind;
+      /* quadratic, but the plots are small */
+      for (k = 0; k < st->nvisible; k++) {
+	dXPoint a1, a2, b1, b2;
+	int type, color;
+
+	cur.i = st->visible[k];
+	unpack_command(&cur);
+	type = cur.c.type;
+	color = cur.c.color;
+	ends_of(pl, &cur.c, &a1, &a2);
+	if (fabs(a1.x) <= CLAMP && fabs(a1.y) <= CLAMP
+	    && fabs(a2.x) <= CLAMP && fabs(a2.y) <= CLAMP)
+	  for (j = 0; j < k; j++) {
+	    cur.i = st->visible[j];
+	    unpack_command(&cur);
+	    ends_of(pl, &cur.c, &b1, &b2);
+	    if (cur.c.type == type && cur.c.color == color
+		&& rint(b1.x) == rint(a1.x) && rint(b1.y) == rint(a1.y)
+		&& rint(b2.x) == rint(a2.x) && rint(b2.y) == rint(a2.y))
+	      break;
+	  }
+	else
+	  j = k;
+	if (j == k)
+	  want[nwant++] = st->visible[k];
+      }
+      if (nkept[kind] != nwant
+	  || memcmp(kept[kind], want, nwant * sizeof(int)) != 0) {
+	printf("level of detail: plot %d, kind %d keeps %d of %d, not %d\n",
+	       s, kind, nkept[kind], st->nvisible, nwant);
+	bad++;
+      }
+      ndropped += st->nvisible - nkept[kind];
+      free(want);
+      free(kept[kind]);
+    }
+    nplots++;
+  }
+  free(t.p);
+  printf("level of detail: %d plots, %d commands left out; %d differ\n",
+	 nplots, ndropped, bad);
+  return bad;
+}
+
+/*
+ * A view panned to, by whole pixels or not, is drawn just as the same
+ * view would be if the scale had only now been set, that is with every
+ * command where map_coord() puts it, rounded.  Whole pixels reuse what
+ * was mapped at the anchor, see set_anchor(); the rest map afresh.
+ */
+static int check_pan(void)
+{
+  static double pans[][2] = {
+    { 3, 0 }, { 0, -7 }, { 2.37, 0.5 }, { -40, 11 }, { 0.5, 0 },
+    { -0.5, -0.5 }, { 1000, 0 }, { -1000, 250 },
+  };
+  struct text t;
+  PLOTTER pl;
+  int npans = 0;
+  int bad = 0;
+  int p, k, kind;
+
+  memset(&t, 0, sizeof(t));
+  seed = 7;
+  put(&t, "double double\n");
+  for (k = 0; k < 3000; k++) {
+    double x = rnd() % 100000 / 97.0, y = rnd() % 100000 / 89.0;
+
+    if (rnd() % 2)
+      put(&t, "x %.9g %.9g\n", x, y);
+    else
+      put(&t, "line %.9g %.9g %.9g %.9g\n", x, y,
+	  x + rnd() % 1000 / 13.0, y + rnd() % 1000 / 11.0);
+  }
+  pl = load_text(&t, 1);
+  set_views(pl);
+  pl->origin.x = 70;
+  pl->origin.y = 30;
+  pl->size.x = 311;
+  pl->size.y = 203;
+  build_index(pl);
+  map_commands(pl, FALSE);
+  map_visible(pl);
+
+  for (p = 0; p < (int) (sizeof(pans) / sizeof(pans[0])); p++) {
+    coord x_left = unmap_coord(pl->x_type, pl_x_left, pl_x_right,
+			       pl->size.x, pans[p][0]);
+    coord x_right = unmap_coord(pl->x_type, pl_x_left, pl_x_right,
+				pl->size.x, pl->size.x + pans[p][0]);
+    coord y_bottom = unmap_coord(pl->y_type, pl_y_bottom, pl_y_top,
+				 pl->size.y, pans[p][1]);
+    coord y_top = unmap_coord(pl->y_type, pl_y_bottom, pl_y_top,
+			      pl->size.y, pl->size.y + pans[p][1]);
+
+    pl_x_left = x_left;
+    pl_x_right = x_right;
+    pl_y_bottom = y_bottom;
+    pl_y_top = y_top;
+    map_commands(pl, FALSE);
+    map_visible(pl);
+    for (kind = 0; kind < TEXTS; kind++) {
+      struct store *st = &pl->stores[kind];
+      struct cursor cur;
+
+      cur.pl = pl;
+      cur.dec = NULL;
+      cur.kind = kind;
+      for (k = 0; k < st->nvisible; k++) {
+	dXPoint a, b;
+
+	cur.i = st->visible[k];
+	unpack_command(&cur);
+	ends_of(pl, &cur.c, &a, &b);
+	if (rint(st->win_xa[k] + pl->origin.x) != rint(a.x)
+	    || rint((pl->size.y - 1) - st->win_ya[k] + pl->origin.y)
+	       != rint(a.y)
+	    || rint(st->win_xb[k] + pl->origin.x) != rint(b.x)
+	    || rint((pl->size.y - 1) - st->win_yb[k] + pl->origin.y)
+	       != rint(b.y)) {
+	  if (bad < 5)
+	    printf("pan: by %g %g, command %d at %g %g, not %g %g\n",
+		   pans[p][0], pans[p][1], cur.i,
+		   st->win_xa[k] + pl->origin.x,
+		   (pl->size.y - 1) - st->win_ya[k] + pl->origin.y,
+		   a.x, a.y);
+	  bad++;
+	}
+      }
+    }
+    npans++;
+  }
+  free(t.p);
+  printf("pan: %d views, %d commands elsewhere\n", npans, bad);
+  return bad;
+}
+
+/* list written in the binary format, into bin. */
+static void binary_of(PLOTTER list, struct text *bin)
+{
+  FILE *fp = tmpfile();
+  long len;
+
+  if (fp == NULL)
+    fatalerror("can't write a temporary file");
+  write_binary(list, fp);
+  len = ftell(fp);
+  rewind(fp);
+  bin->len = 0;
+  grow(bin, len);
+  bin->len = fread(bin->p, 1, len, fp);
+  fclose(fp);
+}
+
+/* The payload of the first block of records of the given kind, with at
+   least n of them, in the binary file bin, or -1; sets the offsets of
+   its columns in it. */
+static long find_records(struct text *bin, int kind, uint32_t n,
+			 uint64_t *off)
+{
+  static int block_kind[NKINDS] = { XPB_SEGMENTS, XPB_POINTS, XPB_TEXTS };
+  struct xpb_file f;
+  struct plotter types;
+  size_t at = sizeof(f);
+
+  memcpy(&f, bin->p, sizeof(f));
+  while (at + sizeof(struct xpb_block) <= bin->len) {
+    struct xpb_block b;
+
+    memcpy(&b, bin->p + at, sizeof(b));
+    at += sizeof(b);
+    if (b.kind == XPB_PLOTTER) {
+      struct xpb_plotter h;
+
+      memcpy(&h, bin->p + at, sizeof(h));
+      types.x_type = parse_coord_name(h.x_type);
+      types.y_type = parse_coord_name(h.y_type);
+    } else if (b.kind == (uint32_t) block_kind[kind] && b.n >= n) {
+      (void) xpb_columns(&types, kind, b.n, f.version, off);
+      return (long) at;
+    }
+    at += b.size;
+  }
+  return -1;
+}
+
+/*
+ * The binary file bin as an older version would have written it, into
+ * old: without the seq columns, which come last in each block, and for
+ * version 1 with timevals in microseconds.  Dropping the columns moves
+ * the strings after them, so the offsets of those are moved too.
+ */
+static void old_binary(struct text *bin, uint32_t version, struct text *old)
+{
+  struct xpb_file f;
+  struct plotter types;
+  size_t strs[256][3];		/* start, end, and how far it moves */
+  int nstrs = 0;
+  size_t removed = 0;
+  size_t at = sizeof(f);
+  int k;
+
+#define moved(o)   for (k = 0; k < nstrs; k++)     if ((o) >= strs[k][0] && (o) < strs[k][1]) {       (o) -= strs[k][2];       break;     }
+
+  old->len = 0;
+  grow(old, bin->len);
+  memcpy(&f, bin->p, sizeof(f));
+  f.version = version;
+  memcpy(old->p, &f, sizeof(f));
+  old->len = sizeof(f);
+  while (at < bin->len) {
+    struct xpb_block b;
+    char *payload, *out;
+    uint64_t off[XPB_NCOLUMNS];
+    uint64_t was, size;
+    int kind = -1;
+    uint32_t i;
+
+    memcpy(&b, bin->p + at, sizeof(b));
+    payload = bin->p + at + sizeof(b);
+    was = size = b.size;
+    switch (b.kind) {
+    case XPB_SEGMENTS: kind = SEGMENTS; break;
+    case XPB_POINTS: kind = POINTS; break;
+    case XPB_TEXTS: kind = TEXTS; break;
+    case XPB_STRINGS:
+      if (nstrs == 256)
+	fatalerror("too many strings blocks");
+      strs[nstrs][0] = payload - bin->p;
+      strs[nstrs][1] = payload - bin->p + b.size;
+      strs[nstrs][2] = removed;
+      nstrs++;
+      break;
+    }
+    if (kind >= 0) {
+      (void) xpb_columns(&types, kind, b.n, XPB_VERSION, off);
+      size = off[XPB_SEQ];
+    }
+    out = old->p + old->len;
+    b.size = size;
+    memcpy(out, &b, sizeof(b));
+    memcpy(out + sizeof(b), payload, size);
+    out += sizeof(b);
+    if (b.kind == XPB_PLOTTER) {
+      struct xpb_plotter h;
+
+      memcpy(&h, out, sizeof(h));
+      types.x_type = parse_coord_name(h.x_type);
+      types.y_type = parse_coord_name(h.y_type);
+      if (h.x_units)
+	moved(h.x_units);
+      if (h.y_units)
+	moved(h.y_units);
+      memcpy(out, &h, sizeof(h));
+    }
+    if (kind == TEXTS)
+      for (i = 0; i < b.n; i++)
+	moved(((uint64_t *) (out + off[XPB_TEXT]))[i]);
+    if (kind >= 0 && version == 1) {
+      int c;
+
+      for (c = XPB_XA; c <= XPB_YB; c++) {
+	coord_type ctype = c == XPB_XA || c == XPB_XB ? types.x_type
+	  : types.y_type;
+
+	if (ctype == TIMEVAL && (c < XPB_XB || kind == SEGMENTS))
+	  for (i = 0; i < b.n; i++)
+	    ((int64_t *) (out + off[c]))[i] /= 1000;
+      }
+    }
+    old->len += sizeof(b) + size;
+    removed += was - size;
+    at = payload - bin->p + was;
+  }
+#undef moved
+}
+
+/* t loaded as it would be read back from the binary format, which
+   doesn't keep the colour in force at the end of a plotter, as that
+   only matters for parsing more of it. */
+static PLOTTER load_as_binary(struct text *t)
+{
+  PLOTTER list = load_text(t, 1);
+  PLOTTER pl;
+
+  for (pl = list; pl != NULL; pl = pl->next)
+    pl->default_color = pl->current_color = -1;
+  return list;
+}
+
+/* What xplot says, if anything, on reading t as a plot file. */
+static int says(struct text *t, char *what)
+{
+  char out[4096];
+
+  load_error(t, 1, out, sizeof(out));
+  return strstr(out, what) != NULL;
+}
+
+/*
+ * The binary format: a file written by write_binary(), or by xplot
+ * --convert, is read back as the same plotters, mapped or from a pipe,
+ * the order of the commands among the kinds (the seq column) included.
+ * Files as versions 1 and 2 wrote them, without seq and (1) with
+ * timevals in microseconds, are read too, in the order of their
+ * blocks.  Files that are cut short, or that have commands out of
+ * order, unknown types, or strings outside the file are turned down,
+ * saying why.
+ */
+static int check_binary(void)
+{
+  static struct {
+    char *what;			/* done to the file */
+    char *says;			/* what xplot has to say about it */
+  } damage[] = {
+    { "cut in a block header", "truncated block" },
+    { "cut in a block", "bad block size" },
+    { "another version", "unknown version" },
+    { "another byte order", "another byte order" },
+    { "seqs swapped", "commands out of order" },
+    { "an unknown type", "unknown command type" },
+    { "a text past the end", "text outside the file" },
+    { "a text not ended", "text outside the file" },
+  };
+  struct text t, bin, old, bad_bin;
+  int nfiles = 0, ndiffer = 0, nquiet = 0;
+  int p, d;
+
+  memset(&t, 0, sizeof(t));
+  memset(&bin, 0, sizeof(bin));
+  memset(&old, 0, sizeof(old));
+  memset(&bad_bin, 0, sizeof(bad_bin));
+  for (p = 0; p < 4; p++) {
+    PLOTTER want;
+    uint32_t version;
+    char what[64];
+
+    seed = 40 + p;
+    (void) make_plot(&t, 1 + p, 2000, 0);
+    want = load_as_binary(&t);
+    binary_of(want, &bin);
+    sprintf(what, "binary %d", p);
+    if (!same_plotters(want, load_text(&bin, 1), what))
+      ndiffer++;
+    strcat(what, ", piped");
+    if (!same_plotters(want, load_pipe(&bin, 1), what))
+      ndiffer++;
+    nfiles += 2;
+    if (p == 0) {
+      /* and through xplot --convert, on files with names */
+      char from[] = "/tmp/loadcheckXXXXXX", to[] = "/tmp/loadcheckXXXXXX";
+      int fd1 = mkstemp(from), fd2 = mkstemp(to);
+      FILE *fp;
+
+      if (fd1 < 0 || fd2 < 0
+	  || write(fd1, t.p, t.len) != (ssize_t) t.len)
+	fatalerror("can't write a temporary file");
+      close(fd1);
+      close(fd2);
+      convert_file(from, to);
+      fp = fopen(to, "r");
+      if (fp == NULL)
+	fatalerror("can't read a temporary file");
+      if (!same_plotters(want, read_plotters(fp, NULL, 0, 0, 0, 1),
+			 "binary 0, converted"))
+	ndiffer++;
+      fclose(fp);
+      unlink(from);
+      unlink(to);
+      nfiles++;
+    }
+
+    /* the older versions number the commands kind by kind */
+    for (version = 2; version >= 1; version--) {
+      PLOTTER pl;
+      int kind, i;
+
+      old_binary(&bin, version, &old);
+      want = load_as_binary(&t);
+      for (pl = want; pl != NULL; pl = pl->next) {
+	int32_t seq = 0;
+
+	for (kind = 0; kind < NKINDS; kind++)
+	  for (i = 0; i < pl->stores[kind].n; i++)
+	    store_seq(&pl->stores[kind], i) = seq++;
+      }
+      sprintf(what, "binary %d, version %u", p, version);
+      if (!same_plotters(want, load_text(&old, 1), what))
+	ndiffer++;
+      nfiles++;
+    }
+  }
+
+  for (d = 0; d < (int) (sizeof(damage) / sizeof(damage[0])); d++) {
+    uint64_t off[XPB_NCOLUMNS];
+    struct xpb_file f;
+    long at;
+
+    bad_bin.len = 0;
+    grow(&bad_bin, bin.len);
+    memcpy(bad_bin.p, bin.p, bin.len);
+    bad_bin.len = bin.len;
+    switch (d) {
+    case 0:
+      at = find_records(&bad_bin, POINTS, 1, off);
+      bad_bin.len = at - sizeof(struct xpb_block) + 4;
+      break;
+    case 1:
+      at = find_records(&bad_bin, POINTS, 1, off);
+      bad_bin.len = at + 8;
+      break;
+    case 2:
+    case 3:
+      memcpy(&f, bad_bin.p, sizeof(f));
+      if (d == 2)
+	f.version = XPB_VERSION + 1;
+      else
+	f.byte_order = 0x04030201;
+      memcpy(bad_bin.p, &f, sizeof(f));
+      break;
+    case 4:
+      at = find_records(&bad_bin, SEGMENTS, 2, off);
+      {
+	int32_t *seqs = (int32_t *) (bad_bin.p + at + off[XPB_SEQ]);
+	int32_t swap = seqs[0];
+
+	seqs[0] = seqs[1];
+	seqs[1] = swap;
+      }
+      break;
+    case 5:
+      at = find_records(&bad_bin, POINTS, 1, off);
+      bad_bin.p[at + off[XPB_TYPE]] = (char) 200;
+      break;
+    case 6:
+      at = find_records(&bad_bin, TEXTS, 1, off);
+      ((uint64_t *) (bad_bin.p + at + off[XPB_TEXT]))[0] = bad_bin.len + 100;
+      break;
+    case 7:
+      /* a block of a kind that is skipped, of bytes that aren't '\0',
+	 at the end, with a text starting in it */
+      at = find_records(&bad_bin, TEXTS, 1, off);
+      ((uint64_t *) (bad_bin.p + at + off[XPB_TEXT]))[0] =
+	bad_bin.len + sizeof(struct xpb_block);
+      {
+	struct xpb_block b;
+
+	b.kind = 99;
+	b.n = 0;
+	b.size = 8;
+	grow(&bad_bin, sizeof(b) + 8);
+	memcpy(bad_bin.p + bad_bin.len, &b, sizeof(b));
+	memset(bad_bin.p + bad_bin.len + sizeof(b), 'x', 8);
+	bad_bin.len += sizeof(b) + 8;
+      }
+      break;
+    }
+    if (!says(&bad_bin, damage[d].says)) {
+      printf("binary: %s isn't turned down with \"%s\"\n", damage[d].what,
+	     damage[d].says);
+      nquiet++;
+    }
+  }
+  free(t.p);
+  free(bin.p);
+  free(old.p);
+  free(bad_bin.p);
+  printf("binary: %d files, %d differ; %d damaged, %d not turned down\n",
+	 nfiles, ndiffer, d, nquiet);
+  return ndiffer + nquiet;
+}
+
+/* The ways check_compressed() compresses files. */
+enum { Z_ONE, Z_PIECES, Z_UNSIZED, Z_WAYS };
+
+/*
+ * Compress t onto the end of z: all in one, or in pieces of a few KB
+ * each compressed on their own (gzip members, xz streams or zstd
+ * frames, with a skippable frame at the end like the seekable format's
+ * seek table), or for zstd in pieces of which one doesn't say how big
+ * it is.  Returns FALSE if this xplot can't read that format.
+ */
+static int compress_text(struct text *t, int format, int way, struct text *z)
+{
+  size_t piece = way == Z_ONE ? t->len : 3000;
+  size_t at, n;
+  int k;
+
+  for (at = 0, k = 0; at < t->len; at += n, k++) {
+    char *in = t->p + at;
+
+    n = t->len - at < piece ? t->len - at : piece;
+    switch (format) {
+#ifdef HAVE_LIBZ
+    case FEED_GZIP:
+      {
+	z_stream s;
+	size_t bound;
+
+	memset(&s, 0, sizeof(s));
+	if (deflateInit2(&s, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)
+	    != Z_OK)
+	  fatalerror("can't start compressing");
+	bound = deflateBound(&s, n);
+	grow(z, bound);
+	s.next_in = (Bytef *) in;
+	s.avail_in = n;
+	s.next_out = (Bytef *) z->p + z->len;
+	s.avail_out = bound;
+	if (deflate(&s, Z_FINISH) != Z_STREAM_END)
+	  fatalerror("can't compress");
+	z->len += bound - s.avail_out;
+	deflateEnd(&s);
+      }
+      break;
+#endif
+#ifdef HAVE_LIBLZMA
+    case FEED_XZ:
+      {
+	size_t bound = lzma_stream_buffer_bound(n);
+	size_t pos = 0;
+
+	grow(z, bound);
+	if (lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, NULL,
+				    (uint8_t *) in, n,
+				    (uint8_t *) z->p + z->len, &pos, bound)
+	    != LZMA_OK)
+	  fatalerror("can't compress");
+	z->len += pos;
+      }
+      break;
+#endif
+#ifdef HAVE_LIBZSTD
+    case FEED_ZSTD:
+      {
+	ZSTD_CCtx *cc = ZSTD_createCCtx();
+	size_t bound = ZSTD_compressBound(n);
+	size_t r;
+
+	grow(z, bound);
+	ZSTD_CCtx_setParameter(cc, ZSTD_c_checksumFlag, 1);
+	if (way == Z_UNSIZED && k == 2)
+	  ZSTD_CCtx_setParameter(cc, ZSTD_c_contentSizeFlag, 0);
+	r = ZSTD_compress2(cc, z->p + z->len, bound, in, n);
+	if (ZSTD_isError(r))
+	  fatalerror("can't compress");
+	z->len += r;
+	ZSTD_freeCCtx(cc);
+      }
+      break;
+#endif
+    default:
+      return FALSE;
+    }
+  }
+#ifdef HAVE_LIBZSTD
+  if (format == FEED_ZSTD && way != Z_ONE) {
+    static unsigned char skip[] = {
+      0x5e, 0x2a, 0x4d, 0x18, 5, 0, 0, 0, 'x', 'p', 'l', 'o', 't'
+    };
+
+    grow(z, sizeof(skip));
+    memcpy(z->p + z->len, skip, sizeof(skip));
+    z->len += sizeof(skip);
+  }
+#endif
+  return TRUE;
+}
+
+/*
+ * A compressed file, mapped or from a pipe, comes out as the same
+ * plotters as the file it was compressed from, text or binary, in one
+ * piece or several; a zstd file in frames that all say how big they
+ * are is decompressed a frame per thread (see unzstd_frames()), any
+ * other a block at a time.  One that is cut short or has a byte
+ * changed says something on stderr: that it is, or, if what was
+ * decompressed before that was noticed doesn't parse, that.
+ */
+static int check_compressed(void)
+{
+  static char *names[] = { "gzip", "xz", "zstd" };
+  static int threads[] = { 1, 4 };
+  struct text t, bin, z;
+  char formats[64] = "";
+  char out[4096];
+  int nfiles = 0, ndamaged = 0, quiet = 0;
+  int bad = 0;
+  int format, way, b, th;
+
+  memset(&t, 0, sizeof(t));
+  memset(&bin, 0, sizeof(bin));
+  memset(&z, 0, sizeof(z));
+  seed = 11;
+  (void) make_plot(&t, 3, 3000, 0);
+  binary_of(load_text(&t, 1), &bin);
+
+  for (format = FEED_GZIP; format <= FEED_ZSTD; format++) {
+    z.len = 0;
+    if (!compress_text(&t, format, Z_ONE, &z))
+      continue;
+    strcat(formats, " ");
+    strcat(formats, names[format]);
+    for (b = 0; b < 2; b++) {
+      struct text *plain = b ? &bin : &t;
+      PLOTTER want = load_text(plain, 1);
+
+      for (way = Z_ONE; way < Z_WAYS; way++) {
+	if (way == Z_UNSIZED && format != FEED_ZSTD)
+	  continue;
+	z.len = 0;
+	(void) compress_text(plain, format, way, &z);
+	for (th = 0; th < 2; th++) {
+	  char what[64];
+
+	  sprintf(what, "%s%s, way %d, %d thread%s", names[format],
+		  b ? " binary" : "", way, threads[th],
+		  threads[th] == 1 ? "" : "s");
+	  if (!same_plotters(want, load_text(&z, threads[th]), what))
+	    bad++;
+	  strcat(what, ", piped");
+	  if (!same_plotters(want, load_pipe(&z, threads[th]), what))
+	    bad++;
+	  nfiles++;
+	}
+	if (b)
+	  continue;
+
+	/* cut short, then with a byte in the middle changed */
+	z.len = z.len * 2 / 3;
+	load_error(&z, 4, out, sizeof(out));
+	if (out[0] == '\0') {
+	  printf("compressed: %s, way %d, cut short, says nothing\n",
+		 names[format], way);
+	  quiet++;
+	}
+	z.len = 0;
+	(void) compress_text(plain, format, way, &z);
+	z.p[z.len / 2] ^= 0x55;
+	load_error(&z, 4, out, sizeof(out));
+	if (out[0] == '\0') {
+	  printf("compressed: %s, way %d, damaged, says nothing\n",
+		 names[format], way);
+	  quiet++;
+	}
+	ndamaged += 2;
+      }
+    }
+  }
+  free(t.p);
+  free(bin.p);
+  free(z.p);
+  printf("compressed:%s; %d files, %d differ; %d damaged, %d say nothing\n",
+	 formats[0] ? formats : " none", nfiles, bad, ndamaged, quiet);
+  return bad + quiet;
+}
+
+/* t in a file of its own, named name, a copy of "/tmp/loadcheckXXXXXX". */
+static void file_named(struct text *t, char *name)
+{
+  int fd;
+
+  strcpy(name, "/tmp/loadcheckXXXXXX");
+  fd = mkstemp(name);
+  if (fd < 0 || write(fd, t->p, t->len) != (ssize_t) t->len)
+    fatalerror("can't write a temporary file");
+  close(fd);
+}
+
+/* Read the file name in the background, as xplot does without -x, -y
+   or -d2, taking in what the loader reads until it is done. */
+static PLOTTER load_background(char *name)
+{
+  int more;
+
+  the_plotter_list = NULL;
+  start_loading(&name, 1, NULL, FALSE);
+  while (nloading > 0) {
+    more = FALSE;
+    (void) take_loaded(FALSE, &more);
+    if (!more)
+      usleep(1000);
+  }
+  return the_plotter_list;
+}
+
+static pthread_t main_thread;
+
+static void exit_on_main_thread(void)
+{
+  if (!pthread_equal(pthread_self(), main_thread))
+    fprintf(stderr, "exit() from a loader\n");
+}
+
+/* What loading the file name in the background says on stderr, and
+   whether it gave up with exit(1) from the event loop's thread. */
+static int background_error(char *name, char *out, int max)
+{
+  int fds[2];
+  pid_t pid;
+  int n, len = 0;
+  int status;
+
+  if (pipe(fds) != 0)
+    fatalerror("pipe failed");
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0)
+    fatalerror("fork failed");
+  if (pid == 0) {
+    dup2(fds[1], 2);
+    close(fds[0]);
+    main_thread = pthread_self();
+    atexit(exit_on_main_thread);
+    (void) load_background(name);
+    _exit(0);
+  }
+  close(fds[1]);
+  while (len < max - 1 && (n = read(fds[0], out + len, max - 1 - len)) > 0)
+    len += n;
+  out[len] = '\0';
+  close(fds[0]);
+  (void) waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 1;
+}
+
+/*
+ * Loading in the background has to come out with the same plotters as
+ * loading up front, and stop at an error in the input the same way,
+ * reported and exited from the event loop's thread, not the loader's.
+ */
+static int check_background(void)
+{
+  struct text t;
+  char name[32], what[64];
+  char serial[1024], background[1024];
+  int bad = 0;
+  int s;
+
+  memset(&t, 0, sizeof(t));
+  for (s = 1; s <= 6; s++) {
+    seed = s;
+    (void) make_plot(&t, 1 + s % 3, 3000, 0);
+    file_named(&t, name);
+    sprintf(what, "file %d in the background", s);
+    if (!same_plotters(load_text(&t, 1), load_background(name), what))
+      bad++;
+    unlink(name);
+  }
+  for (s = 1; s <= 6; s++) {
+    seed = s;
+    (void) make_plot(&t, 3, 3000, s * 1300);
+    load_error(&t, 1, serial, sizeof(serial));
+    file_named(&t, name);
+    if (!background_error(name, background, sizeof(background))
+	|| strcmp(serial, background) != 0) {
+      printf("error %d in the background: %s", s, background);
+      bad++;
+    }
+    unlink(name);
+  }
+  free(t.p);
+  printf("background: 6 files, 6 errors; %d differ from loading up front\n",
+	 bad);
+  return bad;
+}
+
+/* Whether pl shows view 0, and it is the same as want's. */
+static int same_extent(PLOTTER want, PLOTTER pl)
+{
+  struct view *a = &want->views[0], *b = &pl->views[0];
+
+  return pl->viewno == 1
+    && cmp_coord(pl->x_type, a->x_left, b->x_left) == 0
+    && cmp_coord(pl->x_type, a->x_right, b->x_right) == 0
+    && cmp_coord(pl->y_type, a->y_bottom, b->y_bottom) == 0
+    && cmp_coord(pl->y_type, a->y_top, b->y_top) == 0
+    && cmp_coord(pl->x_type, pl_x_left, b->x_left) == 0
+    && cmp_coord(pl->x_type, pl_x_right, b->x_right) == 0
+    && cmp_coord(pl->y_type, pl_y_bottom, b->y_bottom) == 0
+    && cmp_coord(pl->y_type, pl_y_top, b->y_top) == 0;
+}
+
+/*
+ * With -follow, what is added to a file has to be read into its
+ * plotter just as if it had all been there when the file was loaded,
+ * wherever the writer stops: in the middle of a line, between a text
+ * command and its body, or more than FOLLOW_MAX past the last look.
+ * View 0, and the view showing all of it, have to grow to take it in,
+ * and after a "go" nothing more is read.
+ */
+static int check_follow(void)
+{
+  struct text t;
+  char what[64];
+  int nlooks = 0;
+  int bad = 0;
+  int s;
+
+  memset(&t, 0, sizeof(t));
+  option_follow = TRUE;
+  for (s = 1; s <= 8; s++) {
+    PLOTTER pl, whole;
+    FILE *fp;
+    size_t done, to;
+    int more;
+
+    seed = s;
+    (void) make_plot(&t, 1, 3000, 0);
+    if (s % 2 == 0)
+      put(&t, "go\nx 1 2\nline 1 2 3 4\n");
+
+    /* the first few lines, and then the rest a piece at a time */
+    done = t.len / 8 + rnd_in(0, (int) t.len / 8);
+    while (t.p[done - 1] != '\n')
+      done++;
+    if ((fp = tmpfile()) == NULL
+	|| pwrite(fileno(fp), t.p, done, 0) != (ssize_t) done)
+      fatalerror("can't write a temporary file");
+    pl = read_plotters(fp, NULL, 0, 0, 0, 4);
+    set_views(pl);
+    for (; done < t.len; done = to) {
+      to = done + rnd_in(1, 3 * FOLLOW_MAX);
+      if (to > t.len)
+	to = t.len;
+      if (pwrite(fileno(fp), t.p + done, to - done, done)
+	  != (ssize_t) (to - done))
+	fatalerror("can't write a temporary file");
+      do {
+	more = FALSE;
+	if (pl->follow != NULL) {
+	  (void) follow_plotter(pl, &more);
+	  nlooks++;
+	}
+      } while (more);
+    }
+
+    whole = load_text(&t, 1);
+    set_views(whole);
+    sprintf(what, "followed file %d", s);
+    if (!same_plotters(whole, pl, what))
+      bad++;
+    else if (!same_extent(whole, pl)) {
+      printf("%s: view 0 differs\n", what);
+      bad++;
+    }
+    if ((pl->follow == NULL) != (s % 2 == 0)) {
+      printf("%s: %s\n", what, pl->follow ? "still followed after go"
+	     : "not followed any more");
+      bad++;
+    }
+    if (pl->follow != NULL)
+      stop_follow(pl);
+    fclose(fp);
+  }
+  option_follow = FALSE;
+  free(t.p);
+  printf("follow: 8 files, %d looks; %d differ from loading them whole\n",
+	 nlooks, bad);
+  return bad;
+}
+
+/*
+ * Redoing a zoom with an axis synchronized takes the other plotters
+ * along, whether or not they have anything to redo themselves; one
+ * that doesn't must keep the view it had, to go back to.
+ */
+static int check_redo(void)
+{
+  struct text t;
+  PLOTTER list, a, b;
+  coord left, right, b_left, b_right;
+  int bad = 0;
+
+  memset(&t, 0, sizeof(t));
+  put(&t, "unsigned unsigned\nline 0 0 100 100\n");
+  put(&t, "new_plotter\nunsigned unsigned\nline 0 0 200 200\n");
+  list = load_text(&t, 1);
+  a = list;
+  b = list->next;
+  set_views(a);
+  set_views(b);
+  b_left = b->views[1].x_left;
+  b_right = b->views[1].x_right;
+
+  /* zoom a in and click back out of it */
+  push_view(a);
+  left.u = 10;
+  right.u = 20;
+  a->views[2].x_left = left;
+  a->views[2].x_right = right;
+  pop_view(a);
+
+  if (!redo_view(list, a, TRUE, FALSE)) {
+    printf("redo: nothing to redo\n");
+    bad++;
+  } else if (a->viewno != 2 || b->viewno != 2) {
+    printf("redo: views %d and %d, not 2\n", a->viewno, b->viewno);
+    bad++;
+  } else if (cmp_coord(U_INT, b->views[2].x_left, left) != 0
+	     || cmp_coord(U_INT, b->views[2].x_right, right) != 0) {
+    printf("redo: the other plotter didn't follow\n");
+    bad++;
+  } else if (cmp_coord(U_INT, b->views[1].x_left, b_left) != 0
+	     || cmp_coord(U_INT, b->views[1].x_right, b_right) != 0) {
+    printf("redo: the other plotter lost the view it had\n");
+    bad++;
+  }
+  if (redo_view(list, a, TRUE, FALSE)) {
+    printf("redo: redid what wasn't there\n");
+    bad++;
+  }
+  free(t.p);
+  printf("redo: %d wrong\n", bad);
+  return bad;
+}
+
+/*
+ * A binary file from a pipe, or compressed, is read into one buffer
+ * (see open_input() and slurp_feed()), which for the files xplot is
+ * meant for is past 2 GB, so MALLOC() has to pass a size that big on
+ * as it is.  If the machine can't give that much at all, it isn't
+ * checked.
+ */
+static int check_malloc(void)
+{
+  size_t big = (size_t) INT_MAX + 4097;
+  char *p;
+
+#undef malloc
+  p = malloc(big);
+#define malloc MALLOC
+  if (p == NULL) {
+    printf("MALLOC: can't have %lu bytes here, not checked\n",
+	   (unsigned long) big);
+    return 0;
+  }
+  free(p);
+
+  p = MALLOC(big);
+  p[0] = p[big - 1] = 1;
+  free(p);
+  printf("MALLOC: %lu bytes\n", (unsigned long) big);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int bad = 0;
+
+  bad += check_chunks();
+  bad += check_binary();
+  bad += check_compressed();
+  bad += check_lod();
+  bad += check_pan();
+  bad += check_follow();
+  bad += check_background();
+  bad += check_redo();
+  bad += check_malloc();
+  exit(bad ? 1 : 0);
+}
@@ -0,0 +1,639 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+#include <stdlib.h>
+#include "config.h"
+#include "raster.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+/* the colour and clip a batch of queued lines is drawn with; or, if
+   mask isn't NULL, a queued mask, whose segment is its rectangle */
+struct raster_run {
+  uint32_t pixel;
+  int clip_x1, clip_y1, clip_x2, clip_y2;
+  int thick;
+  const unsigned char *mask;
+};
+
+#define RASTER_QUEUE_MAX (1 << 18)	/* lines queued before drawing them */
+#define RASTER_BAND 32			/* rows in the band a thread draws */
+
+/*
+ * Make a raster.  If pixels is NULL it gets its own, otherwise it draws
+ * into the caller's (a shared memory segment, say), which must hold
+ * width * height of them.  Returns NULL if out of memory.
+ */
+struct raster *raster_new(int width, int height, uint32_t *pixels)
+{
+  struct raster *r;
+
+  r = (struct raster *) malloc(sizeof(*r));
+  if (r == NULL)
+    return NULL;
+  r->width = width;
+  r->height = height;
+  r->own_pixels = (pixels == NULL);
+  if (pixels == NULL) {
+    pixels = (uint32_t *) malloc((size_t) width * height * sizeof(uint32_t)
+				 + 1);
+    if (pixels == NULL) {
+      free(r);
+      return NULL;
+    }
+  }
+  r->pixels = pixels;
+  r->thick = 0;
+  r->threads = 1;
+  r->queue = NULL;
+  r->queue_run = NULL;
+  r->nqueue = 0;
+  r->runs = NULL;
+  r->nruns = 0;
+  r->pool = NULL;
+  raster_clip(r, 0, 0, width, height);
+  return r;
+}
+
+static void stop_pool(struct raster *r);
+
+void raster_free(struct raster *r)
+{
+  if (r == NULL)
+    return;
+  stop_pool(r);
+  if (r->own_pixels)
+    free(r->pixels);
+  free(r->queue);
+  free(r->queue_run);
+  free(r->runs);
+  free(r);
+}
+
+/* Limit drawing to a rectangle (which is cut down to fit the raster). */
+void raster_clip(struct raster *r, int x, int y, int width, int height)
+{
+  r->clip_x1 = x < 0 ? 0 : x;
+  r->clip_y1 = y < 0 ? 0 : y;
+  r->clip_x2 = x + width > r->width ? r->width : x + width;
+  r->clip_y2 = y + height > r->height ? r->height : y + height;
+}
+
+void raster_clear(struct raster *r, uint32_t pixel)
+{
+  uint32_t *p = r->pixels;
+  uint32_t *end = p + (size_t) r->width * r->height;
+
+  /* anything still queued would be covered up anyway */
+  r->nqueue = 0;
+  r->nruns = 0;
+  while (p < end)
+    *p++ = pixel;
+}
+
+/* Fill a rectangle, ignoring the clip. */
+void raster_fill(struct raster *r, int x, int y, int width, int height,
+		 uint32_t pixel)
+{
+  int x1 = x < 0 ? 0 : x;
+  int y1 = y < 0 ? 0 : y;
+  int x2 = x + width > r->width ? r->width : x + width;
+  int y2 = y + height > r->height ? r->height : y + height;
+  int i, j;
+
+  raster_finish(r);
+  for (j = y1; j < y2; j++) {
+    uint32_t *row = r->pixels + (size_t) j * r->width;
+    for (i = x1; i < x2; i++)
+      row[i] = pixel;
+  }
+}
+
+#define plot(r, cr, x, y, pixel) \
+  do { \
+    if ((x) >= (cr)->clip_x1 && (x) < (cr)->clip_x2 \
+	&& (y) >= (cr)->clip_y1 && (y) < (cr)->clip_y2) \
+      (r)->pixels[(size_t) (y) * (r)->width + (x)] = (pixel); \
+  } while (0)
+
+/* The first k >= 0 with (2kd + n) / 2n >= q, i.e. the first step along
+   a line n long in its major direction that has moved q across. */
+static long first_step(int n, int d, int q)
+{
+  if (q <= 0)
+    return 0;
+  if (d == 0)
+    return n + 1L;
+  return ((int64_t) n * (2 * q - 1) + 2 * d - 1) / (2 * d);
+}
+
+/* The steps [*k1, *k2) of a line from a going s (+1 or -1) each step
+   that are at or past lo and before hi. */
+static void steps_between(int a, int s, int lo, int hi, long *k1, long *k2)
+{
+  if (s > 0) {
+    *k1 = lo - a;
+    *k2 = hi - a;
+  } else {
+    *k1 = a - hi + 1;
+    *k2 = a - lo + 1;
+  }
+}
+
+/*
+ * Draw a line from (x1,y1) to (x2,y2), both ends included, the way an
+ * X server draws a thin line with CapProjecting (near enough: servers
+ * are allowed to differ in which pixels they pick).  The colour, clip
+ * and thickness come from cr, which may not be r's own.
+ *
+ * Step k along the major axis moves (2kd + n) / 2n along the minor
+ * one, so rather than stepping up to the clip, the part of the line
+ * inside it is worked out first.  That makes drawing a long line a
+ * band of rows at a time cost no more than drawing it all at once.
+ */
+static void draw_line(struct raster *r, struct raster_run *cr,
+		      int x1, int y1, int x2, int y2)
+{
+  int m = cr->thick ? 1 : 0;	/* how far the brush reaches */
+  uint32_t pixel = cr->pixel;
+  int xmajor = abs(x2 - x1) >= abs(y2 - y1);
+  int a = xmajor ? x1 : y1;	/* the major axis */
+  int b = xmajor ? y1 : x1;	/* and the minor one */
+  int n = xmajor ? abs(x2 - x1) : abs(y2 - y1);
+  int d = xmajor ? abs(y2 - y1) : abs(x2 - x1);
+  int sa = (xmajor ? x2 > x1 : y2 > y1) ? 1 : -1;
+  int sb = (xmajor ? y2 > y1 : x2 > x1) ? 1 : -1;
+  int alo = (xmajor ? cr->clip_x1 : cr->clip_y1) - m;
+  int ahi = (xmajor ? cr->clip_x2 : cr->clip_y2) + m;
+  int blo = (xmajor ? cr->clip_y1 : cr->clip_x1) - m;
+  int bhi = (xmajor ? cr->clip_y2 : cr->clip_x2) + m;
+  long k, k1, k2, kb1, kb2;
+  int64_t v;
+  int q, e;
+
+  steps_between(a, sa, alo, ahi, &k1, &k2);
+  steps_between(b, sb, blo, bhi, &kb1, &kb2);
+  /* those are how far across; turn them into steps along */
+  kb1 = first_step(n, d, (int) kb1);
+  kb2 = first_step(n, d, (int) kb2);
+  if (k1 < kb1) k1 = kb1;
+  if (k2 > kb2) k2 = kb2;
+  if (k1 < 0) k1 = 0;
+  if (k2 > n + 1L) k2 = n + 1L;
+  if (k1 >= k2)
+    return;
+
+  v = 2 * (int64_t) k1 * d + n;
+  q = n > 0 ? (int) (v / (2 * n)) : 0;
+  e = n > 0 ? (int) (v % (2 * n)) : 0;
+  for (k = k1; k < k2; k++) {
+    int x = xmajor ? a + sa * (int) k : b + sb * q;
+    int y = xmajor ? b + sb * q : a + sa * (int) k;
+
+    if (m) {
+      int i, j;
+      for (j = -1; j <= 1; j++)
+	for (i = -1; i <= 1; i++)
+	  plot(r, cr, x + i, y + j, pixel);
+    } else
+      plot(r, cr, x, y, pixel);
+    e += 2 * d;
+    if (e >= 2 * n) {
+      e -= 2 * n;
+      q++;
+    }
+  }
+}
+
+/* The run for drawing with r's clip and thickness in the given colour. */
+static void set_run(struct raster *r, struct raster_run *cr, uint32_t pixel)
+{
+  cr->pixel = pixel;
+  cr->clip_x1 = r->clip_x1;
+  cr->clip_y1 = r->clip_y1;
+  cr->clip_x2 = r->clip_x2;
+  cr->clip_y2 = r->clip_y2;
+  cr->thick = r->thick;
+  cr->mask = NULL;
+}
+
+/* Set the pixels of (x1,y1)-(x2,y2), both included, that cr's mask
+   has set, as far as cr's clip lets it. */
+static void draw_mask(struct raster *r, struct raster_run *cr,
+		      int x1, int y1, int x2, int y2)
+{
+  int width = x2 - x1 + 1;
+  int i1 = x1 < cr->clip_x1 ? cr->clip_x1 : x1;
+  int j1 = y1 < cr->clip_y1 ? cr->clip_y1 : y1;
+  int i2 = x2 + 1 > cr->clip_x2 ? cr->clip_x2 : x2 + 1;
+  int j2 = y2 + 1 > cr->clip_y2 ? cr->clip_y2 : y2 + 1;
+  int i, j;
+
+  for (j = j1; j < j2; j++) {
+    const unsigned char *m = cr->mask + (size_t) (j - y1) * width;
+    uint32_t *row = r->pixels + (size_t) j * r->width;
+
+    for (i = i1; i < i2; i++)
+      if (m[i - x1])
+	row[i] = cr->pixel;
+  }
+}
+
+void raster_line(struct raster *r, int x1, int y1, int x2, int y2,
+		 uint32_t pixel)
+{
+  struct raster_run cr;
+
+  raster_finish(r);
+  set_run(r, &cr, pixel);
+  draw_line(r, &cr, x1, y1, x2, y2);
+}
+
+/* Make sure r has its queue, if it draws with more than one thread.
+   Returns FALSE if it draws here and now instead. */
+static int make_queue(struct raster *r)
+{
+  if (r->threads <= 1)
+    return 0;
+  if (r->queue == NULL) {
+    r->queue = (struct raster_segment *)
+      malloc(RASTER_QUEUE_MAX * sizeof(struct raster_segment));
+    r->queue_run = (int *) malloc(RASTER_QUEUE_MAX * sizeof(int));
+    r->runs = (struct raster_run *)
+      malloc(RASTER_QUEUE_MAX * sizeof(struct raster_run));
+    if (r->queue == NULL || r->queue_run == NULL || r->runs == NULL) {
+      /* out of memory: draw it all here and now instead */
+      free(r->queue);
+      free(r->queue_run);
+      free(r->runs);
+      r->queue = NULL;
+      r->queue_run = NULL;
+      r->runs = NULL;
+      r->threads = 1;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void raster_segments(struct raster *r, struct raster_segment *segs, int n,
+		     uint32_t pixel)
+{
+  struct raster_run cr;
+  int k;
+
+  if (n <= 0)
+    return;
+  if (!make_queue(r)) {
+    set_run(r, &cr, pixel);
+    for (k = 0; k < n; k++)
+      draw_line(r, &cr, segs[k].x1, segs[k].y1, segs[k].x2, segs[k].y2);
+    return;
+  }
+
+  while (n > 0) {
+    int room = RASTER_QUEUE_MAX - r->nqueue;
+    int run;
+
+    if (room == 0) {
+      raster_finish(r);
+      continue;
+    }
+    if (room > n)
+      room = n;
+    run = r->nruns++;
+    set_run(r, &r->runs[run], pixel);
+    for (k = 0; k < room; k++) {
+      r->queue[r->nqueue] = segs[k];
+      r->queue_run[r->nqueue++] = run;
+    }
+    segs += room;
+    n -= room;
+  }
+}
+
+/*
+ * Set the pixels of the width by height rectangle at (x,y) that mask,
+ * width * height bytes row by row, has nonzero.  The mask has to stay
+ * there until it is drawn, which may not be until raster_finish().
+ */
+void raster_mask(struct raster *r, int x, int y, int width, int height,
+		 const unsigned char *mask, uint32_t pixel)
+{
+  struct raster_run cr;
+  struct raster_segment *s;
+  int run;
+
+  if (width <= 0 || height <= 0)
+    return;
+  if (!make_queue(r)) {
+    set_run(r, &cr, pixel);
+    cr.mask = mask;
+    draw_mask(r, &cr, x, y, x + width - 1, y + height - 1);
+    return;
+  }
+  if (r->nqueue == RASTER_QUEUE_MAX)
+    raster_finish(r);
+  run = r->nruns++;
+  set_run(r, &r->runs[run], pixel);
+  r->runs[run].thick = 0;
+  r->runs[run].mask = mask;
+  s = &r->queue[r->nqueue];
+  s->x1 = x;
+  s->y1 = y;
+  s->x2 = x + width - 1;
+  s->y2 = y + height - 1;
+  r->queue_run[r->nqueue++] = run;
+}
+
+/* What the threads drawing a queue share. */
+struct raster_work {
+  struct raster *r;
+  int nbands;
+  int *band_start;		/* the queued lines each band has to draw */
+  int *band_items;
+  int next_band;		/* the next band nobody has started on */
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_t lock;
+#endif
+};
+
+/* Draw the queued lines that reach into one band of rows. */
+static void draw_band(struct raster_work *w, int band)
+{
+  struct raster *r = w->r;
+  int y1 = band * RASTER_BAND;
+  int y2 = y1 + RASTER_BAND;
+  int k;
+
+  for (k = w->band_start[band]; k < w->band_start[band + 1]; k++) {
+    int i = w->band_items[k];
+    struct raster_run cr;
+
+    cr = r->runs[r->queue_run[i]];
+    if (cr.clip_y1 < y1)
+      cr.clip_y1 = y1;
+    if (cr.clip_y2 > y2)
+      cr.clip_y2 = y2;
+    if (cr.mask != NULL)
+      draw_mask(r, &cr, r->queue[i].x1, r->queue[i].y1,
+		r->queue[i].x2, r->queue[i].y2);
+    else
+      draw_line(r, &cr, r->queue[i].x1, r->queue[i].y1,
+		r->queue[i].x2, r->queue[i].y2);
+  }
+}
+
+static void *draw_bands(void *arg)
+{
+  struct raster_work *w = (struct raster_work *) arg;
+  int band;
+
+  for (;;) {
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_lock(&w->lock);
+#endif
+    band = w->next_band++;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_unlock(&w->lock);
+#endif
+    if (band >= w->nbands)
+      break;
+    draw_band(w, band);
+  }
+  return NULL;
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * The threads besides the caller's that draw a raster's queues.  Each
+ * time raster_finish() has one it sets work, bumps generation and
+ * wakes them; each draws bands until there are none left, and the last
+ * to run out wakes raster_finish() again.
+ */
+struct raster_pool {
+  int threads;			/* the raster's threads it was made for */
+  int nthreads;			/* how many of them could be started */
+  pthread_t *tid;
+  pthread_mutex_t lock;
+  pthread_cond_t go;		/* there is work, or quit is set */
+  pthread_cond_t done;		/* busy has come down to 0 */
+  struct raster_work *work;
+  unsigned long generation;	/* how many queues it has been given */
+  int busy;			/* threads still drawing this one */
+  int quit;
+};
+
+static void *pool_thread(void *arg)
+{
+  struct raster_pool *p = (struct raster_pool *) arg;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (p->generation == seen && !p->quit)
+      pthread_cond_wait(&p->go, &p->lock);
+    if (p->quit)
+      break;
+    seen = p->generation;
+    pthread_mutex_unlock(&p->lock);
+    draw_bands(p->work);
+    pthread_mutex_lock(&p->lock);
+    if (--p->busy == 0)
+      pthread_cond_signal(&p->done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+/* Make sure r has threads - 1 threads waiting to draw.  Returns FALSE
+   if it can't have any. */
+static int start_pool(struct raster *r)
+{
+  struct raster_pool *p = r->pool;
+
+  if (p != NULL && p->threads == r->threads)
+    return p->nthreads > 0;
+  stop_pool(r);
+  p = (struct raster_pool *) malloc(sizeof(*p));
+  if (p == NULL)
+    return 0;
+  p->tid = (pthread_t *) malloc((r->threads - 1) * sizeof(pthread_t));
+  if (p->tid == NULL) {
+    free(p);
+    return 0;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->go, NULL);
+  pthread_cond_init(&p->done, NULL);
+  p->threads = r->threads;
+  p->work = NULL;
+  p->generation = 0;
+  p->busy = 0;
+  p->quit = 0;
+  for (p->nthreads = 0; p->nthreads < r->threads - 1; p->nthreads++)
+    if (pthread_create(&p->tid[p->nthreads], NULL, pool_thread, p) != 0)
+      break;
+  r->pool = p;
+  return p->nthreads > 0;
+}
+
+static void stop_pool(struct raster *r)
+{
+  struct raster_pool *p = r->pool;
+  int i;
+
+  if (p == NULL)
+    return;
+  pthread_mutex_lock(&p->lock);
+  p->quit = 1;
+  pthread_cond_broadcast(&p->go);
+  pthread_mutex_unlock(&p->lock);
+  for (i = 0; i < p->nthreads; i++)
+    pthread_join(p->tid[i], NULL);
+  pthread_cond_destroy(&p->go);
+  pthread_cond_destroy(&p->done);
+  pthread_mutex_destroy(&p->lock);
+  free(p->tid);
+  free(p);
+  r->pool = NULL;
+}
+#else
+static void stop_pool(struct raster *r)
+{
+}
+#endif
+
+/* The bands a queued line might touch, as [*b1, *b2). */
+static void line_bands(struct raster *r, int i, int *b1, int *b2)
+{
+  struct raster_segment *s = &r->queue[i];
+  struct raster_run *cr = &r->runs[r->queue_run[i]];
+  int m = cr->thick ? 1 : 0;
+  int y1 = (s->y1 < s->y2 ? s->y1 : s->y2) - m;
+  int y2 = (s->y1 < s->y2 ? s->y2 : s->y1) + m + 1;
+
+  if (y1 < cr->clip_y1)
+    y1 = cr->clip_y1;
+  if (y2 > cr->clip_y2)
+    y2 = cr->clip_y2;
+  if (y1 >= y2) {
+    *b1 = *b2 = 0;
+    return;
+  }
+  *b1 = y1 / RASTER_BAND;
+  *b2 = (y2 - 1) / RASTER_BAND + 1;
+}
+
+/*
+ * Draw everything queued.  The lines are sorted into the bands of rows
+ * they reach, keeping their order, and the bands are handed out to the
+ * threads of r's pool as they become free.
+ */
+void raster_finish(struct raster *r)
+{
+  struct raster_work w;
+  int nbands = (r->height + RASTER_BAND - 1) / RASTER_BAND;
+  int i, b, b1, b2;
+
+  if (r->nqueue == 0)
+    return;
+
+  w.r = r;
+  w.nbands = nbands;
+  w.next_band = 0;
+  w.band_start = (int *) calloc(nbands + 1, sizeof(int));
+  w.band_items = NULL;
+  if (w.band_start != NULL) {
+    for (i = 0; i < r->nqueue; i++) {
+      line_bands(r, i, &b1, &b2);
+      for (b = b1; b < b2; b++)
+	w.band_start[b + 1]++;
+    }
+    for (b = 0; b < nbands; b++)
+      w.band_start[b + 1] += w.band_start[b];
+    w.band_items = (int *) malloc((w.band_start[nbands] + 1) * sizeof(int));
+  }
+  if (w.band_items == NULL) {
+    /* out of memory: one at a time, then */
+    for (i = 0; i < r->nqueue; i++)
+      if (r->runs[r->queue_run[i]].mask != NULL)
+	draw_mask(r, &r->runs[r->queue_run[i]], r->queue[i].x1,
+		  r->queue[i].y1, r->queue[i].x2, r->queue[i].y2);
+      else
+	draw_line(r, &r->runs[r->queue_run[i]], r->queue[i].x1,
+		  r->queue[i].y1, r->queue[i].x2, r->queue[i].y2);
+    free(w.band_start);
+    r->nqueue = 0;
+    r->nruns = 0;
+    return;
+  }
+  for (i = 0; i < r->nqueue; i++) {
+    line_bands(r, i, &b1, &b2);
+    for (b = b1; b < b2; b++)
+      w.band_items[w.band_start[b]++] = i;
+  }
+  /* filling moved each start up to the next one's; move them back */
+  for (b = nbands; b > 0; b--)
+    w.band_start[b] = w.band_start[b - 1];
+  w.band_start[0] = 0;
+
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_init(&w.lock, NULL);
+  if (start_pool(r)) {
+    struct raster_pool *p = r->pool;
+
+    pthread_mutex_lock(&p->lock);
+    p->work = &w;
+    p->busy = p->nthreads;
+    p->generation++;
+    pthread_cond_broadcast(&p->go);
+    pthread_mutex_unlock(&p->lock);
+    /* this thread is one of them */
+    draw_bands(&w);
+    pthread_mutex_lock(&p->lock);
+    while (p->busy > 0)
+      pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+  } else
+    draw_bands(&w);
+  pthread_mutex_destroy(&w.lock);
+#else
+  draw_bands(&w);
+#endif
+
+  free(w.band_start);
+  free(w.band_items);
+  r->nqueue = 0;
+  r->nruns = 0;
+}
@@ -0,0 +1,92 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdint.h>
+
+/* laid out like an XSegment, so those can be passed straight in */
+struct raster_segment {
+  short x1, y1, x2, y2;
+};
+
+/*
+ * A client-side framebuffer and the few drawing operations xplot
+ * needs.  Nothing here knows about X, so it can be used (and timed)
+ * without a display; xplot.c uploads the pixels with XPutImage or
+ * XShmPutImage.  Pixels are whatever 32 bit values the caller uses,
+ * normally 0xAARRGGBB, which is also what a TrueColor X server wants.
+ *
+ * With threads > 1, raster_segments() and raster_mask() only queue
+ * what they are given; it is drawn, a band of rows per thread, when
+ * the queue fills up or raster_finish() is called.  Each band draws
+ * what it has in the order it was queued, so the pixels come out the
+ * same as drawing it all one after the other.  The threads are started
+ * the first time and wait for the next queue until raster_free().
+ */
+struct raster_run;
+struct raster_pool;
+
+struct raster {
+  int width;
+  int height;
+  uint32_t *pixels;		/* width * height of them, row by row */
+  int own_pixels;		/* pixels came from raster_new() */
+  int clip_x1, clip_y1;		/* drawing only touches x1 <= x < x2, */
+  int clip_x2, clip_y2;		/* y1 <= y < y2 */
+  int thick;			/* draw lines 3 pixels wide */
+  int threads;			/* how many to draw with */
+  struct raster_segment *queue;	/* lines not drawn yet */
+  int *queue_run;		/* which run each of them is in */
+  int nqueue;
+  struct raster_run *runs;	/* colour and clip of each raster_segments() */
+  int nruns;
+  struct raster_pool *pool;	/* the threads drawing the queue */
+};
+
+struct raster *raster_new(int width, int height, uint32_t *pixels);
+void raster_free(struct raster *r);
+void raster_clip(struct raster *r, int x, int y, int width, int height);
+void raster_clear(struct raster *r, uint32_t pixel);
+void raster_fill(struct raster *r, int x, int y, int width, int height,
+		 uint32_t pixel);
+void raster_line(struct raster *r, int x1, int y1, int x2, int y2,
+		 uint32_t pixel);
+void raster_segments(struct raster *r, struct raster_segment *segs, int n,
+		     uint32_t pixel);
+void raster_mask(struct raster *r, int x, int y, int width, int height,
+		 const unsigned char *mask, uint32_t pixel);
+void raster_finish(struct raster *r);
+
+#endif /* RASTER_H */
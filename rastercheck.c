@@ -0,0 +1,229 @@
+/* 
+This software is being provided to you, the LICENSEE, by the
+Massachusetts Institute of Technology (M.I.T.) under the following
+license.  By obtaining, using and/or copying this software, you agree
+that you have read, understood, and will comply with these terms and
+conditions:
+
+Permission to use, copy, modify and distribute, including the right to
+grant others the right to distribute at any tier, this software and
+its documentation for any purpose and without fee or royalty is hereby
+granted, provided that you agree to comply with the following
+copyright notice and statements, including the disclaimer, and that
+the same appear on ALL copies of the software and documentation,
+including modifications that you make for internal use or for
+distribution:
+
+Copyright 1992,1993 by the Massachusetts Institute of Technology.
+                    All rights reserved.  
+
+THIS SOFTWARE IS PROVIDED "AS IS", AND M.I.T. MAKES NO REPRESENTATIONS
+OR WARRANTIES, EXPRESS OR IMPLIED.  By way of example, but not
+limitation, M.I.T. MAKES NO REPRESENTATIONS OR WARRANTIES OF
+MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR THAT THE USE
+OF THE LICENSED SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY THIRD
+PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS.
+
+The name of the Massachusetts Institute of Technology or M.I.T. may
+NOT be used in advertising or publicity pertaining to distribution of
+the software.  Title to copyright in this software and any associated
+documentation shall at all times remain with M.I.T., and USER agrees
+to preserve same.
+*/
+
+/*
+ * A check of raster.c that needs no display: raster_line() against a
+ * plain stepper that plots every point of a line and leaves out those
+ * outside the clip, and raster_segments() and raster_mask() drawn on 2,
+ * 3, 4, 8 and 16 threads, up to the most asked for, against the same
+ * drawn on one.  It times drawing them with each number of threads, the
+ * fastest of a few goes, and how many times faster than one that is;
+ * past as many CPUs as there are, it can't be any faster.
+ *
+ *	rastercheck [threads]
+ *
+ * Exits 1 if any pixel came out different.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "raster.h"
+#include "check.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+
+/* Step k of a line n long and d across is (2kd + n) / 2n across. */
+static void ref_line(struct raster *r, int thick, int x1, int y1,
+		     int x2, int y2, uint32_t pixel)
+{
+  int xmajor = abs(x2 - x1) >= abs(y2 - y1);
+  int n = xmajor ? abs(x2 - x1) : abs(y2 - y1);
+  int d = xmajor ? abs(y2 - y1) : abs(x2 - x1);
+  int sa = (xmajor ? x2 > x1 : y2 > y1) ? 1 : -1;
+  int sb = (xmajor ? y2 > y1 : x2 > x1) ? 1 : -1;
+  int m = thick ? 1 : 0;
+  int k, i, j;
+
+  for (k = 0; k <= n; k++) {
+    int q = n > 0 ? (int) ((2 * (long) k * d + n) / (2 * (long) n)) : 0;
+    int x = xmajor ? x1 + sa * k : x1 + sb * q;
+    int y = xmajor ? y1 + sb * q : y1 + sa * k;
+
+    for (j = -m; j <= m; j++)
+      for (i = -m; i <= m; i++)
+	if (x + i >= r->clip_x1 && x + i < r->clip_x2
+	    && y + j >= r->clip_y1 && y + j < r->clip_y2)
+	  r->pixels[(y + j) * r->width + x + i] = pixel;
+  }
+}
+
+static int differ(struct raster *a, struct raster *b)
+{
+  return memcmp(a->pixels, b->pixels,
+		(size_t) a->width * a->height * sizeof(uint32_t)) != 0;
+}
+
+/* Random clips, lines, thicknesses; some lines well outside. */
+static int check_lines(void)
+{
+  struct raster *a = raster_new(WIDTH, HEIGHT, NULL);
+  struct raster *b = raster_new(WIDTH, HEIGHT, NULL);
+  int bad = 0;
+  int t, k;
+
+  for (t = 0; t < 200; t++) {
+    int x = rnd_in(-50, WIDTH), y = rnd_in(-50, HEIGHT);
+    int thick = t & 1;
+
+    raster_clear(a, 0);
+    raster_clear(b, 0);
+    raster_clip(a, x, y, rnd_in(0, WIDTH), rnd_in(0, HEIGHT));
+    b->clip_x1 = a->clip_x1;
+    b->clip_y1 = a->clip_y1;
+    b->clip_x2 = a->clip_x2;
+    b->clip_y2 = a->clip_y2;
+    a->thick = thick;
+    for (k = 0; k < 100; k++) {
+      int x1 = rnd_in(-2000, WIDTH + 2000), y1 = rnd_in(-2000, HEIGHT + 2000);
+      int x2, y2;
+
+      if (k % 4 == 0) {
+	x2 = x1 + rnd_in(-3, 3);	/* short ones, and points */
+	y2 = y1 + rnd_in(-3, 3);
+      } else {
+	x2 = rnd_in(-2000, WIDTH + 2000);
+	y2 = rnd_in(-2000, HEIGHT + 2000);
+      }
+      raster_line(a, x1, y1, x2, y2, (uint32_t) k + 1);
+      ref_line(b, thick, x1, y1, x2, y2, (uint32_t) k + 1);
+    }
+    if (differ(a, b))
+      bad++;
+  }
+  raster_free(a);
+  raster_free(b);
+  printf("raster_line: %d of 200 rasters differ from the stepper\n", bad);
+  return bad;
+}
+
+/* a string's worth of mask, as xplot gets them from the server */
+#define MASK_WIDTH 40
+#define MASK_HEIGHT 13
+static unsigned char mask[MASK_WIDTH * MASK_HEIGHT];
+
+/* Batches of segments in several colours and clips, as xplot queues
+   them, so every band sees lines from more than one run, with masks
+   in between them the way xplot draws strings. */
+static void draw_batches(struct raster *r, struct raster_segment *segs,
+			 int nsegs)
+{
+  int k, n;
+
+  seed = 7;
+  raster_clear(r, 0);
+  for (k = 0; k < nsegs; k += n) {
+    n = rnd_in(1, 5000);
+    if (n > nsegs - k)
+      n = nsegs - k;
+    raster_clip(r, rnd_in(-10, 100), rnd_in(-10, 100),
+		rnd_in(WIDTH / 2, WIDTH), rnd_in(HEIGHT / 2, HEIGHT));
+    r->thick = rnd_in(0, 3) == 0;
+    raster_segments(r, segs + k, n, (uint32_t) rnd_in(1, 0xffffff));
+    if (rnd_in(0, 1))
+      raster_mask(r, rnd_in(-MASK_WIDTH, WIDTH), rnd_in(-MASK_HEIGHT, HEIGHT),
+		  rnd_in(1, MASK_WIDTH), MASK_HEIGHT, mask,
+		  (uint32_t) rnd_in(1, 0xffffff));
+  }
+  raster_finish(r);
+}
+
+#define TRIES 3
+
+int main(int argc, char **argv)
+{
+  int maxthreads = argc > 1 ? atoi(argv[1]) : 16;
+  int nsegs = 1 << 20;
+  struct raster_segment *segs;
+  struct raster *one, *r;
+  double t1 = 0;
+  int ncpus = 1;
+  int bad, threads, k;
+
+  if (maxthreads < 1)
+    maxthreads = 1;
+  bad = check_lines();
+
+  segs = (struct raster_segment *) malloc(nsegs * sizeof(*segs));
+  one = raster_new(WIDTH, HEIGHT, NULL);
+  r = raster_new(WIDTH, HEIGHT, NULL);
+  if (segs == NULL || one == NULL || r == NULL) {
+    fprintf(stderr, "rastercheck: out of memory\n");
+    exit(1);
+  }
+  seed = 3;
+  for (k = 0; k < MASK_WIDTH * MASK_HEIGHT; k++)
+    mask[k] = rnd_in(0, 2) == 0;
+  for (k = 0; k < nsegs; k++) {
+    segs[k].x1 = rnd_in(-100, WIDTH + 100);
+    segs[k].y1 = rnd_in(-100, HEIGHT + 100);
+    segs[k].x2 = segs[k].x1 + rnd_in(-40, 40);
+    segs[k].y2 = segs[k].y1 + rnd_in(-40, 40);
+  }
+
+#ifdef _SC_NPROCESSORS_ONLN
+  ncpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  printf("raster_segments: %d lines, %d CPU%s\n", nsegs, ncpus,
+	 ncpus == 1 ? "" : "s");
+  for (threads = 1; threads <= maxthreads;
+       threads = threads < 4 ? threads + 1 : 2 * threads) {
+    double t = 0;
+    int try;
+
+    r->threads = threads;
+    for (try = 0; try < TRIES; try++) {
+      double s = seconds();
+
+      draw_batches(r, segs, nsegs);
+      s = seconds() - s;
+      if (try == 0 || s < t)
+	t = s;
+    }
+    if (threads == 1) {
+      memcpy(one->pixels, r->pixels, WIDTH * HEIGHT * sizeof(uint32_t));
+      t1 = t;
+    } else if (differ(r, one))
+      bad++;
+    printf("raster_segments: %2d thread%s %7.1f ms, %5.2f times one%s\n",
+	   threads, threads == 1 ? ", " : "s,", t * 1000, t1 / t,
+	   threads > 1 && differ(r, one) ? ", DIFFERENT" : "");
+  }
+  raster_free(one);
+  raster_free(r);
+  free(segs);
+  exit(bad ? 1 : 0);
+}
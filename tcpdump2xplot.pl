@@ -41,6 +41,9 @@ $TimeConvert = 0;
 $ForceRelative = 0;
 $FinThreshold = 1; # seconds
 $GzipOutput = 0;
+$BinaryOutput = 0;
+$NanoTime = 0;
+$TimeType = 'timeval';
 
 # other initializations
 #$Packets;
@@ -55,7 +58,7 @@ sub usage
     return if (!$Usage_first);
     $Usage_first = 0;
     print <<"END_OF_USAGE";
-Usage: $0 [-w] [-s] [-c] [-plot[filename]] [-list[filename]] [-?] [-help]
+Usage: $0 [-w] [-s] [-c] [-b] [-n] [-plot[filename]] [-list[filename]] [-?] [-help]
 -w: plot window.
 -s: break up conversations on syns.
 -f: ignore socket activity after a fin (until socket is re-used)
@@ -68,6 +71,8 @@ Usage: $0 [-w] [-s] [-c] [-plot[filename]] [-list[filename]] [-?] [-help]
 -list[filename]: output the list of generated plot files to filename.
 -r: relative sequence numbers.
 -t: time convert - insure that time is in decimal number of seconds.
+-b: binary - write the plots in xplot's binary format.
+-n: nanoseconds - the times are to the nanosecond (tcpdump --nano).
 -q: quiet - no visible output.
 -?/-help: this message.
 END_OF_USAGE
@@ -102,6 +107,11 @@ sub ReadArg
 	$Quiet = 1;
     } elsif ($arg eq 'z') {
 	$GzipOutput = 1;
+    } elsif ($arg eq 'b') {
+	$BinaryOutput = 1;
+    } elsif ($arg eq 'n') {
+	$NanoTime = 1;
+	$TimeType = 'nstime';
     } else {
 	&usage();
         print "unknown argument \"$arg\".\n";
@@ -125,6 +135,136 @@ sub subTimes
     return ($big - $little);
 }
 
+# Plot output.  In xplot's binary format (see "The binary format" in
+# xplot.c) the points and lines of a plot are kept here, a column at a
+# time, and written out in blocks of $BinBlock.  Times are written as
+# nanoseconds, the way xplot keeps a timeval or an nstime; a timeval
+# keeps only six digits after the point.  Each command is numbered in
+# the order it is plotted, which is the order xplot draws them in.
+$BinBlock = 1024;
+%CommandType = ('dtick', 6, 'utick', 5, 'uarrow', 11, 'darrow', 12,
+		'line', 16, 'title', 19);
+%ColorNumber = ('green', 1);
+
+sub binPad
+{
+    local($data) = @_;
+    return $data . ("\0" x ((8 - length($data) % 8) % 8));
+}
+
+sub binWrite
+{
+    local($fh, $data) = @_;
+    $data = &binPad($data);
+    print $fh $data;
+    $BinOffset{$fh} += length($data);
+}
+
+sub binBlock
+{
+    local($fh, $kind, $n, $data) = @_;
+    &binWrite($fh, pack('L L Q', $kind, $n, length($data)));
+    print $fh $data;
+    $BinOffset{$fh} += length($data);
+}
+
+sub binTime
+{
+    local($time) = @_;
+    local($digits, $scale) = $NanoTime ? (9, 1) : (6, 1000);
+    return $1 * 1000000000 + substr($2.'000000000', 0, $digits) * $scale
+	if ($time =~ /^(\d+)\.?(\d*)$/);
+    return int($time * 1000000000 / $scale + 0.5) * $scale;
+}
+
+sub binFlush
+{
+    local($fh) = @_;
+    local($n);
+    if (($n = $BinPoints{$fh})) {
+	&binBlock($fh, 3, $n, join('', map { &binPad($_) }
+				   $PointX{$fh}, $PointY{$fh},
+				   $PointColor{$fh}, $PointType{$fh},
+				   $PointSeq{$fh}));
+	$BinPoints{$fh} = 0;
+	$PointX{$fh} = $PointY{$fh} = $PointColor{$fh} = $PointType{$fh} = '';
+	$PointSeq{$fh} = '';
+    }
+    if (($n = $BinLines{$fh})) {
+	&binBlock($fh, 2, $n, join('', map { &binPad($_) }
+				   $LineXa{$fh}, $LineYa{$fh},
+				   $LineXb{$fh}, $LineYb{$fh},
+				   $LineColor{$fh}, $LineType{$fh},
+				   $LineSeq{$fh}));
+	$BinLines{$fh} = 0;
+	$LineXa{$fh} = $LineYa{$fh} = $LineXb{$fh} = $LineYb{$fh} = '';
+	$LineColor{$fh} = $LineType{$fh} = $LineSeq{$fh} = '';
+    }
+}
+
+sub plotStart
+{
+    local($fh, $title) = @_;
+    if (!$BinaryOutput) {
+	print $fh "$TimeType signed\ntitle\n$title\n";
+	return;
+    }
+    local($at);
+    $BinOffset{$fh} = 0;
+    &binWrite($fh, pack('a8 L L', "\211xplot\r\n", 3, 0x01020304));
+    $at = $BinOffset{$fh} + 16;
+    &binBlock($fh, 5, 1, &binPad(pack('a* x', $title)));
+    &binBlock($fh, 1, 0, pack('a16 a16 d Q Q', $TimeType, 'signed', 0, 0, 0));
+    &binBlock($fh, 4, 1, join('', map { &binPad($_) }
+			      pack('q', 0), pack('l', 0), pack('Q', $at),
+			      pack('s', -1), pack('C', $CommandType{'title'}),
+			      pack('C', 0), pack('l', 0)));
+    $BinPoints{$fh} = $BinLines{$fh} = 0;
+    $BinSeq{$fh} = 1;
+}
+
+sub plotPoint
+{
+    local($fh, $type, $x, $y) = @_;
+    if (!$BinaryOutput) {
+	print $fh "$type $x $y\n";
+	return;
+    }
+    $PointX{$fh} .= pack('q', &binTime($x));
+    $PointY{$fh} .= pack('l', $y);
+    $PointColor{$fh} .= pack('s', -1);
+    $PointType{$fh} .= pack('C', $CommandType{$type});
+    $PointSeq{$fh} .= pack('l', $BinSeq{$fh}++);
+    &binFlush($fh) if (++$BinPoints{$fh} >= $BinBlock);
+}
+
+sub plotLine
+{
+    local($fh, $xa, $ya, $xb, $yb, $color) = @_;
+    if (!$BinaryOutput) {
+	print $fh "line $xa $ya $xb $yb", ($color ? " $color" : ''), "\n";
+	return;
+    }
+    $LineXa{$fh} .= pack('q', &binTime($xa));
+    $LineYa{$fh} .= pack('l', $ya);
+    $LineXb{$fh} .= pack('q', &binTime($xb));
+    $LineYb{$fh} .= pack('l', $yb);
+    $LineColor{$fh} .= pack('s', $color ? $ColorNumber{$color} : -1);
+    $LineType{$fh} .= pack('C', $CommandType{'line'});
+    $LineSeq{$fh} .= pack('l', $BinSeq{$fh}++);
+    &binFlush($fh) if (++$BinLines{$fh} >= $BinBlock);
+}
+
+sub plotEnd
+{
+    local($fh) = @_;
+    if (!$BinaryOutput) {
+	print $fh "go\n";
+	return;
+    }
+    &binFlush($fh);
+}
+
 sub newConversation
 {
     local($from, $to, $time) = @_;
@@ -144,7 +284,8 @@ sub newConversation
     } else { 
 	open($from, ">$XplotName{$from}") || die "error opening \"$from\" for writing: $!\n";
     }
-    print $from "timeval signed\ntitle\n$from-->$to\n";
+    binmode($from) if ($BinaryOutput);
+    &plotStart($from, "$from-->$to");
 
     # initialize conversation
     $To{$from} = $to;
@@ -158,7 +299,7 @@ sub newConversation
 sub closeOut
 {
     local($from) = @_;
-    print $from "go\n";
+    &plotEnd($from);
     $TotalPackets += $Packets{$from};
     $TotalBytes += $Bytes{$from};
     print "$from: $Packets{$from} packets $Bytes{$from} bytes took ", 
@@ -366,9 +507,9 @@ for ($lineNo = 1; <$Tcpdump>; $lineNo++) {
 	$sendseq -= $FirstSeq{$from.'-'.$to};
 	$sendseqlast -= $FirstSeq{$from.'-'.$to};
     }
-    print $from "darrow $time $sendseq\n";
-    print $from "uarrow $time $sendseqlast\n";
-    print $from "line $time $sendseq $time $sendseqlast\n";
+    &plotPoint($from, 'darrow', $time, $sendseq);
+    &plotPoint($from, 'uarrow', $time, $sendseqlast);
+    &plotLine($from, $time, $sendseq, $time, $sendseqlast);
 
     if ($ack != -1) {
 	$winend = $ack + $window;
@@ -385,12 +526,12 @@ for ($lineNo = 1; <$Tcpdump>; $lineNo++) {
 		$ackSeq -= $FirstSeq{$to.'-'.$from};
 	    }
 
-	    print $to "line $LastAckTime{$to.'-'.$from} $lastAckSeq ";
-	    print $to "$time $lastAckSeq\n";
+	    &plotLine($to, $LastAckTime{$to.'-'.$from}, $lastAckSeq,
+		      $time, $lastAckSeq);
 	    if ($LastAckSeq{$to.'-'.$from} != $ack) {
-		print $to "line $time $lastAckSeq $time $ackSeq\n";
+		&plotLine($to, $time, $lastAckSeq, $time, $ackSeq);
 	    } else {
-		print $to "dtick $time $ackSeq\n";
+		&plotPoint($to, 'dtick', $time, $ackSeq);
 	    }
 
 	    if (exists $opts{'sack'}) {
@@ -415,7 +556,7 @@ for ($lineNo = 1; <$Tcpdump>; $lineNo++) {
 			$start -= $FirstSeq{$to.'-'.$from};
 			$end -= $FirstSeq{$to.'-'.$from};
 
-			print $to "line $time $start $time $end green\n"
+			&plotLine($to, $time, $start, $time, $end, 'green');
 		    }
 		}
 	    }
@@ -432,12 +573,12 @@ for ($lineNo = 1; <$Tcpdump>; $lineNo++) {
 		    $winSeq -= $FirstSeq{$to.'-'.$from};
 		}
 
-		print $to "line $LastAckTime{$to.'-'.$from} $lastWinSeq ";
-		print $to "$time $lastWinSeq\n";
+		&plotLine($to, $LastAckTime{$to.'-'.$from}, $lastWinSeq,
+			  $time, $lastWinSeq);
 		if ($LastWind{$to.'-'.$from} != $winend) {
-		    print $to "line $time $lastWinSeq $time $winSeq\n";
+		    &plotLine($to, $time, $lastWinSeq, $time, $winSeq);
 		} else {
-		    print $to "utick $time $winSeq\n";
+		    &plotPoint($to, 'utick', $time, $winSeq);
 		}
 	    }
 	}
@@ -34,7 +34,12 @@ to preserve same.
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <string.h>
+#include <time.h>
 #include "xplot.h"
+#ifdef MAP_MANY_AVX2
+#include <immintrin.h>
+#endif
 
 #ifndef TM_GMTOFF
 extern time_t timezone;
@@ -49,142 +54,139 @@ extern int daylight;
 extern char *tzname[2];
 
 
-inline static
-void
-timeval_fix(coord *r)
-{
-  while (r->t.tv_usec < 0) {
-    r->t.tv_usec += 1000000;
-    r->t.tv_sec  -= 1;
-  }
+/*
+ * A TIMEVAL is kept as a count of nanoseconds since the epoch in c.ns,
+ * so comparing, adding and subtracting them are single integer
+ * operations.  TIMEVALs stay whole microseconds: parsing drops any
+ * more digits than six after the point, and unmapping rounds to a
+ * microsecond.  NSTIME is the same thing to the nanosecond, for
+ * captures that have their times that finely (tcpdump --nano).
+ */
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_USEC 1000LL
 
-  while (r->t.tv_usec >= 1000000) {
-    r->t.tv_usec -= 1000000;
-    r->t.tv_sec  += 1;
+/* the seconds since the epoch of c, and the nanoseconds past them */
+static void split_time(coord c, time_t *sec, long *nsec)
+{
+  *sec = c.ns / NSEC_PER_SEC;
+  *nsec = c.ns % NSEC_PER_SEC;
+  if (*nsec < 0) {
+    *nsec += NSEC_PER_SEC;
+    *sec -= 1;
   }
 }
 
-
-char *timeval_unparse(coord c)
+/* what asctime() gives, cut down to what a label needs, in buf */
+char *timeval_unparse(coord c, char *buf)
 {
   char *cp;
-  char *r;
-  char buf[50];
-  extern void panic();
   struct tm *tmp;
-  
-  tmp = localtime((time_t *) &(c.t.tv_sec));
+  time_t sec;
+  long nsec;
+
+  split_time(c, &sec, &nsec);
+  tmp = localtime(&sec);
   (void) sprintf(buf,"%s",asctime(tmp));
 
-  if (c.t.tv_usec == 0 && tmp->tm_sec == 0 && tmp->tm_min == 0 && tmp->tm_hour == 0) {
+  if (nsec == 0 && tmp->tm_sec == 0 && tmp->tm_min == 0 && tmp->tm_hour == 0) {
     cp = buf+4;
     sprintf(cp+7,"midn");
-  } else if (c.t.tv_usec == 0 && tmp->tm_sec == 0 && tmp->tm_min == 0 && tmp->tm_hour == 12) {
+  } else if (nsec == 0 && tmp->tm_sec == 0 && tmp->tm_min == 0 && tmp->tm_hour == 12) {
     cp = buf+4;
     sprintf(cp+7,"noon");
   } else {
     cp = buf+10;
     cp[10] = '\0';
-    if (c.t.tv_usec != 0) {
-      if (c.t.tv_usec % 100 == 0) {
-	(void) sprintf(cp+9,".%04u",(unsigned) c.t.tv_usec/100);
+    if (nsec != 0) {
+      if (nsec % 100000 == 0) {
+	(void) sprintf(cp+9,".%04u",(unsigned) (nsec/100000));
 	cp += 7;
+      } else if (nsec % 1000 == 0) {
+	(void) sprintf(cp+9,".%06u",(unsigned) (nsec/1000));
+	cp += 9;
       } else {
-	(void) sprintf(cp+9,".%06u",(unsigned) c.t.tv_usec);
+	(void) sprintf(cp+9,".%09u",(unsigned) nsec);
 	cp += 9;
       }
     }
   }
-  r = malloc((unsigned) strlen(cp)+1);
-  if (r == 0)
-    panic("malloc returned 0");
-  (void) strcpy(r, cp);
-  return r;
+  return cp;
 }
-	 
-coord timeval_parse(char *s)
+
+/* seconds, and maybe a point and a fraction of a second, to within
+   unit nanoseconds; more digits are dropped.  FALSE if s isn't that,
+   or is too far from the epoch for 64 bits of nanoseconds. */
+static bool time_parse(char *s, coord *c, int64_t unit)
 {
-  coord r;
-  extern int atoi();
-
-  r.t.tv_usec = 0;
-
-  /* quick, dirty, and unsafe */
-  r.t.tv_sec = atoi(s);
-  while (isdigit(*s)) s++;
-
-  if (*s == '.') {
-    s++;
-    r.t.tv_usec = atoi(s);
-    
-    {
-      int len = 0;
-      while (isdigit(*s++)) len++;
-      while (len < 6) (len++, r.t.tv_usec *= 10);
-      while (len > 6) (len--, r.t.tv_usec /= 10);
-    }
-  }
-  
-  timeval_fix(&r);
-  return r;
+  static int64_t place[] = { 100000000, 10000000, 1000000, 100000, 10000,
+			     1000, 100, 10, 1 };
+  int64_t sec = 0;
+  int64_t frac = 0;
+  int negative = 0;
+  int digits = 0;
+  int n;
+
+  if (*s == '-' || *s == '+')
+    negative = *s++ == '-';
+  for (; (unsigned) (*s - '0') < 10; s++, digits++)
+    if (digits < 11)
+      sec = sec * 10 + (*s - '0');
+  if (digits > 10 || sec > INT64_MAX / NSEC_PER_SEC - 1)
+    return FALSE;
+  if (*s == '.')
+    for (s++, n = 0; (unsigned) (*s - '0') < 10; s++, n++, digits++)
+      if (n < 9)
+	frac += (*s - '0') * place[n];
+  if (digits == 0 || !coord_tokend(*s))
+    return FALSE;
+  c->ns = sec * NSEC_PER_SEC + frac - frac % unit;
+  if (negative)
+    c->ns = -c->ns;
+  return TRUE;
+}
+
+bool timeval_parse(char *s, coord *c)
+{
+  return time_parse(s, c, NSEC_PER_USEC);
 }
 
 coord timeval_zero(void)
 {
   coord r;
-  r.t.tv_sec = 0;
-  r.t.tv_usec = 0;
+  r.ns = 0;
   return r;
 }
 
 int timeval_cmp(coord c1, coord c2)
 {
-  int r;
-
-  if (c1.t.tv_sec > c2.t.tv_sec) r = 1;
-  else if (c1.t.tv_sec < c2.t.tv_sec) r = -1;
-  else if (c1.t.tv_usec > c2.t.tv_usec) r = 1;
-  else if (c1.t.tv_usec < c2.t.tv_usec) r = -1;
-  else r = 0;
-
-  return r;
+  return (c1.ns > c2.ns) - (c1.ns < c2.ns);
 }
 
 coord timeval_add(coord c1, coord c2)
 {
   coord r;
-
-  r.t.tv_sec  = c1.t.tv_sec  + c2.t.tv_sec;
-  r.t.tv_usec = c1.t.tv_usec + c2.t.tv_usec;
-
-  timeval_fix(&r);
+  r.ns = c1.ns + c2.ns;
   return r;
 }
 
 coord timeval_subtract(coord c1,coord c2)
 {
   coord r;
-
-  timeval_fix(&r);
-
-  if (c2.t.tv_usec > c1.t.tv_usec) {
-    c1.t.tv_sec  -= 1;
-    c1.t.tv_usec += 1000000;
-  }
-
-  r.t.tv_sec  = c1.t.tv_sec  - c2.t.tv_sec;
-  r.t.tv_usec = c1.t.tv_usec - c2.t.tv_usec;
-
+  r.ns = c1.ns - c2.ns;
   return r;
 }
 
-coord timeval_round_down(coord c1, coord c2)
+/* how far ahead of UTC local time is at c, in nanoseconds, so that
+   ticks of a day or more fall on local midnights */
+static int64_t local_offset(coord c)
 {
-  coord r;
   struct tm *tmp;
+  time_t sec;
+  long nsec;
   time_t gmtoff;
 
-  tmp = localtime((time_t *) &(c1.t.tv_sec));
+  split_time(c, &sec, &nsec);
+  tmp = localtime(&sec);
 #ifdef TM_GMTOFF
   gmtoff = tmp->tm_gmtoff;
 #else
@@ -196,164 +198,90 @@ coord timeval_round_down(coord c1, coord c2)
 	gmtoff = 0;
   }
  #endif /* TM_GMTOFF */
-  c1.t.tv_sec += gmtoff;
- 
-  if (c2.t.tv_sec == 0) {
-    r.t.tv_sec = c1.t.tv_sec;
-    r.t.tv_usec = (c1.t.tv_usec - (c1.t.tv_usec % c2.t.tv_usec));
-  } else {
-    r.t.tv_usec = 0;
-    r.t.tv_sec = c1.t.tv_sec - (c1.t.tv_sec % c2.t.tv_sec);
-  }
+  return (int64_t) gmtoff * NSEC_PER_SEC;
+}
 
-  r.t.tv_sec -= gmtoff;
+/* the remainder of c1 over the step c2, in local time */
+static int64_t local_remainder(coord c1, coord c2, int64_t gmtoff)
+{
+  int64_t rem = (c1.ns + gmtoff) % c2.ns;
 
-  timeval_fix(&r);
-  return r;
+  if (rem < 0)
+    rem += c2.ns;
+  return rem;
 }
 
-
-coord timeval_round_up(coord c1, coord c2)
+coord timeval_round_down(coord c1, coord c2)
 {
   coord r;
-  struct tm *tmp;
-  time_t gmtoff;
 
-  tmp = localtime((time_t *) &(c1.t.tv_sec));
-
-#ifdef TM_GMTOFF
-  gmtoff = tmp->tm_gmtoff;
-#else
-  if (tmp->tm_isdst==0) {
-	gmtoff = -timezone;
-  } else if (tmp->tm_isdst==1) {
-	gmtoff = -altzone;
-  } else {
-	gmtoff = 0;
-  }
- #endif /* TM_GMTOFF */
-  c1.t.tv_sec += gmtoff;
- 
-  if (c2.t.tv_sec == 0) {
-    r.t.tv_sec  = c1.t.tv_sec;
-    if (c1.t.tv_usec % c2.t.tv_usec == 0)
-      r.t.tv_usec = c1.t.tv_usec;
-    else {
-      r.t.tv_usec = c1.t.tv_usec + (c2.t.tv_usec -
-				    (c1.t.tv_usec % c2.t.tv_usec));
-      if (r.t.tv_usec >= 1000000) {
-	r.t.tv_usec -= 1000000;
-	r.t.tv_sec  += 1;
-      }
-    }
-  } else {
-    r.t.tv_usec = 0;
-    if (c1.t.tv_sec % c2.t.tv_sec == 0)
-      r.t.tv_sec = c1.t.tv_sec;
-    else
-      r.t.tv_sec = c1.t.tv_sec + (c2.t.tv_sec - (c1.t.tv_sec % c2.t.tv_sec));
-  }
+  r.ns = c1.ns - local_remainder(c1, c2, local_offset(c1));
+  return r;
+}
 
-  r.t.tv_sec -= gmtoff;
+coord timeval_round_up(coord c1, coord c2)
+{
+  coord r;
+  int64_t rem = local_remainder(c1, c2, local_offset(c1));
 
-  timeval_fix(&r);
+  r.ns = rem == 0 ? c1.ns : c1.ns + (c2.ns - rem);
   return r;
-  
-#if 0
-  return timeval_round_down(timeval_add(c1,c2), c2);
-#endif
-
 }
 
-static struct tick_table_s {
-  struct timeval step;
-  int subtick_offset;
-} tick_table[] = {
-  {{ 0, 1 }, 0 },
-  {{ 0, 2 }, -1 },
-  {{ 0, 5 }, -2 },
-
-  {{ 0, 10 }, -2 },
-  {{ 0, 20 }, -2 },
-  {{ 0, 50 }, -2 },
-
-  {{ 0, 100 }, -2 },
-  {{ 0, 200 }, -2 },
-  {{ 0, 500 }, -2 },
-
-  {{ 0, 1000 }, -2 },
-  {{ 0, 2000 }, -2 },
-  {{ 0, 5000 }, -2 },
-
-  {{ 0, 10000 }, -2 },
-  {{ 0, 20000 }, -2 },
-  {{ 0, 50000 }, -2 },
-
-  {{ 0, 100000 }, -2 },
-  {{ 0, 200000 }, -2 },
-  {{ 0, 500000 }, -2 },
-
-  {{ 1, 0 }, -2 },
-  {{ 2, 0 }, -2 },
-  {{ 5, 0 }, -2 },
-  {{ 10, 0 }, -2 },
-  {{ 20, 0 }, -2 },
-  {{ 30, 0 }, -2 },
-
-  {{ 1*60, 0 }, -2 },
-  {{ 2*60, 0 }, -2 },
-  {{ 5*60, 0 }, -2 },
-  {{ 10*60, 0 }, -2 },
-  {{ 20*60, 0 }, -2 },
-  {{ 30*60, 0 }, -2 },
-
-  {{ 1*60*60, 0 }, -2 },
-  {{ 2*60*60, 0 }, -2 },
-  {{ 6*60*60, 0 }, -2 },
-  {{ 12*60*60, 0 }, -2 },
-  {{ 24*60*60, 0 }, -2 },
-  {{ 2*24*60*60, 0 }, -2 },
-  {{ 5*24*60*60, 0 }, -2 },
-  {{ 10*24*60*60, 0 }, -2 },
-  {{ 20*24*60*60, 0 }, -2 },
-  {{ 50*24*60*60, 0 }, -2 },
-  {{ 100*24*60*60, 0 }, -2 },
-  {{ 200*24*60*60, 0 }, -2 },
-  {{ 500*24*60*60, 0 }, -2 },
-  {{ 1000*24*60*60, 0 }, -2 },
-  {{ 2000*24*60*60, 0 }, -2 },
-  {{ 5000*24*60*60, 0 }, -2 },
-  {{ 10000*24*60*60, 0 }, -2 },
+/* The tick steps, finest first.  TIMEVAL's start at a microsecond. */
+#define NS 1LL
+#define US (1000*NS)
+#define MS (1000*US)
+#define SEC (1000*MS)
+static int64_t tick_table[] = {
+  1*NS, 2*NS, 5*NS, 10*NS, 20*NS, 50*NS, 100*NS, 200*NS, 500*NS,
+  1*US, 2*US, 5*US, 10*US, 20*US, 50*US, 100*US, 200*US, 500*US,
+  1*MS, 2*MS, 5*MS, 10*MS, 20*MS, 50*MS, 100*MS, 200*MS, 500*MS,
+  1*SEC, 2*SEC, 5*SEC, 10*SEC, 20*SEC, 30*SEC,
+  1*60*SEC, 2*60*SEC, 5*60*SEC, 10*60*SEC, 20*60*SEC, 30*60*SEC,
+  1*60*60*SEC, 2*60*60*SEC, 6*60*60*SEC, 12*60*60*SEC,
+  24*60*60*SEC, 2*24*60*60*SEC, 5*24*60*60*SEC, 10*24*60*60*SEC,
+  20*24*60*60*SEC, 50*24*60*60*SEC, 100*24*60*60*SEC, 200*24*60*60*SEC,
+  500*24*60*60*SEC, 1000*24*60*60*SEC, 2000*24*60*60*SEC,
+  5000*24*60*60*SEC, 10000*24*60*60*SEC,
 };
-
-coord timeval_tick(int level)
+#define TICK_LEVELS ((int) (sizeof(tick_table) / sizeof(tick_table[0])))
+#define TIMEVAL_FIRST_TICK 9
+#undef NS
+#undef US
+#undef MS
+#undef SEC
+
+static coord time_tick(int level)
 {
   coord r;
-  extern void ianic();
-
+  extern void panic();
 
-  if (level < 0 || level >= (int)(sizeof(tick_table) / sizeof(struct tick_table_s)))
+  if (level < 0 || level >= TICK_LEVELS)
     panic("timeval_tick: level too large");
-  
-  r.t = tick_table[level].step;
-  
-  timeval_fix(&r);
+  r.ns = tick_table[level];
   return r;
 }
 
-int timeval_subtick(int level)
+/* subticks are two levels down, 2/5ths or 1/5th of a tick */
+static int time_subtick(int level, int levels)
 {
-  int r;
   extern void panic();
 
-  if (level < 0 || level >= (int)(sizeof(tick_table) / sizeof(struct tick_table_s)))
+  if (level < 0 || level >= levels)
     panic("timeval_subtick: level too large");
-  
-  r = level + tick_table[level].subtick_offset;
+  return level < 2 ? 0 : level - 2;
+}
 
-  return r;
+coord timeval_tick(int level)
+{
+  return time_tick(level + TIMEVAL_FIRST_TICK);
 }
 
+int timeval_subtick(int level)
+{
+  return time_subtick(level, TICK_LEVELS - TIMEVAL_FIRST_TICK);
+}
 
 double timeval_map(coord c1,coord c2, int n, coord c)
 {
@@ -361,33 +289,86 @@ double timeval_map(coord c1,coord c2, int n, coord c)
   double d;
   double dc;
 
-  d  = (((double) ((int) (c2.t.tv_sec  - c1.t.tv_sec))) * 1000000 +
-        ((double) ((int) (c2.t.tv_usec - c1.t.tv_usec))));
-  dc = (((double) ((int) (c.t.tv_sec   - c1.t.tv_sec))) * 1000000 +
-	((double) ((int) (c.t.tv_usec  - c1.t.tv_usec))));
-    
+  d  = (double) (c2.ns - c1.ns);
+  dc = (double) (c.ns - c1.ns);
   r = dc/d * ((double) n);
-  
+
   return r;
 }
 
-coord timeval_unmap(coord c1,coord c2, int n, double x)
+#ifdef MAP_MANY_AVX2
+/*
+ * Four at a time, up to the last four; returns how many it did.  There
+ * is no conversion from 64 bit ints to doubles before AVX-512, but one
+ * under 2^51 is exact added into the mantissa of 1.5 * 2^52; four not
+ * all that close to first are done one at a time.
+ */
+static MAP_MANY_AVX2 int
+time_map_avx2(int64_t *v, int64_t first, double d, double dn, int count,
+	      double *out)
+{
+  __m256i f = _mm256_set1_epi64x(first);
+  __m256i lo = _mm256_set1_epi64x(-((int64_t) 1 << 51));
+  __m256i hi = _mm256_set1_epi64x(((int64_t) 1 << 51) - 1);
+  __m256d magic = _mm256_set1_pd(6755399441055744.0);
+  __m256d s = _mm256_set1_pd(d);
+  __m256d m = _mm256_set1_pd(dn);
+  int i, k;
+
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m256i x = _mm256_sub_epi64(_mm256_loadu_si256((__m256i *) (v + i)), f);
+    __m256i far = _mm256_or_si256(_mm256_cmpgt_epi64(lo, x),
+				  _mm256_cmpgt_epi64(x, hi));
+
+    if (!_mm256_testz_si256(far, far)) {
+      for (k = i; k < i + 4; k++)
+	out[k] = ((double) (v[k] - first))/d * dn;
+      continue;
+    }
+    x = _mm256_add_epi64(x, _mm256_castpd_si256(magic));
+    _mm256_storeu_pd(out + i,
+		     _mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(_mm256_castsi256_pd(x), magic), s), m));
+  }
+  return i;
+}
+#endif
+
+/* The same for a column of them. */
+void timeval_map_many(coord c1, coord c2, int n, char *col, int count,
+		      double *out)
+{
+  int64_t *v = (int64_t *) col;
+  int64_t first = c1.ns;
+  double d;
+  int i = 0;
+
+  d = (double) (c2.ns - c1.ns);
+#ifdef MAP_MANY_AVX2
+  if (cpu_has_avx2())
+    i = time_map_avx2(v, first, d, (double) n, count, out);
+#endif
+  for (; i < count; i++)
+    out[i] = ((double) (v[i] - first))/d * ((double) n);
+}
+
+static coord time_unmap(coord c1, coord c2, int n, double x, int64_t unit)
 {
   coord r;
   double d;
 
-  d = (((double) (c2.t.tv_sec  - c1.t.tv_sec)) * 1000000 +
-       ((double) (c2.t.tv_usec - c1.t.tv_usec)));
+  d = (double) (c2.ns - c1.ns);
   d /= n;
   d *= x;
-  d += ((double) c1.t.tv_sec * 1000000) + (double) c1.t.tv_usec;
-  
-  r.t.tv_sec = floor(d/1000000.);
-  r.t.tv_usec = rint(d - (((double) floor(d/1000000.)) * 1000000.));
+  r.ns = c1.ns + (int64_t) rint(d / unit) * unit;
 
   return r;
 }
 
+coord timeval_unmap(coord c1,coord c2, int n, double x)
+{
+  return time_unmap(c1, c2, n, x, NSEC_PER_USEC);
+}
+
 struct coord_impl timeval_impl  = {
   timeval_unparse,
   timeval_parse,
@@ -400,5 +381,38 @@ struct coord_impl timeval_impl  = {
   timeval_tick,
   timeval_subtick,
   timeval_map,
-  timeval_unmap
+  timeval_unmap,
+  timeval_map_many
+  };
+
+/* NSTIME differs only in keeping, and ticking, every nanosecond. */
+bool nstime_parse(char *s, coord *c)
+{
+  return time_parse(s, c, 1);
+}
+
+int nstime_subtick(int level)
+{
+  return time_subtick(level, TICK_LEVELS);
+}
+
+coord nstime_unmap(coord c1,coord c2, int n, double x)
+{
+  return time_unmap(c1, c2, n, x, 1);
+}
+
+struct coord_impl nstime_impl  = {
+  timeval_unparse,
+  nstime_parse,
+  timeval_zero,
+  timeval_cmp,
+  timeval_add,
+  timeval_subtract,
+  timeval_round_up,
+  timeval_round_down,
+  time_tick,
+  nstime_subtick,
+  timeval_map,
+  nstime_unmap,
+  timeval_map_many
   };
@@ -32,59 +32,32 @@ to preserve same.
 */
 #include <math.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "xplot.h"
 #include <stdio.h>
-
-#ifdef ultrix
-#define LIBC_ATOI_IS_BROKEN
-#endif
-
-#ifdef linux
-#define LIBC_ATOI_IS_BROKEN
+#ifdef MAP_MANY_AVX2
+#include <immintrin.h>
+#else
+#ifdef __SSE2__
+#include <emmintrin.h>
 #endif
-
-#ifdef LIBC_ATOI_IS_BROKEN
-#include <ctype.h>
 #endif
 
-
-char *unsigned_unparse(coord c)
+char *unsigned_unparse(coord c, char *buf)
 {
-
-  extern void panic();
-
-  char *r;
-  char buf[50];
   (void) sprintf(buf,"%u",c.u);
-  r = malloc((unsigned) strlen(buf)+1);
-  if (r == 0)
-    panic("malloc returned 0");
-  (void) strcpy(r, buf);
-  return r;
+  return buf;
 }
 	 
-coord unsigned_parse(char *s)
+/* negative numbers wrap around, as they always have */
+bool unsigned_parse(char *s, coord *c)
 {
-  coord r;
-#ifndef LIBC_ATOI_IS_BROKEN
-  extern int atoi();
-
-  r.u = atoi(s);
-#else
-  char *p;
-  r.u = 0;
-  p = s;
-
-  while (isdigit(*p)) {
-    r.u *= 10;
-    r.u += (*p - '0');
-    p++;
-  }
-  if (*p != '\0')
-    fprintf(stderr,"warning: unsigned_parse format error in string: %s\n", s);
-#endif  
+  int64_t v;
 
-  return r;
+  if (!parse_integer(s, INT_MIN, UINT_MAX, &v))
+    return FALSE;
+  c->u = (unsigned int) v;
+  return TRUE;
 }
 
 coord unsigned_zero(void)
@@ -210,6 +183,61 @@ double unsigned_map(coord c1,coord c2, int n, coord c)
   return r;
 }
 
+#ifdef MAP_MANY_AVX2
+/* Four at a time, up to the last four; returns how many it did. */
+static MAP_MANY_AVX2 int
+unsigned_map_avx2(unsigned int *v, double first, double scale, int count,
+		  double *out)
+{
+  __m128i flip = _mm_set1_epi32((int) 0x80000000);
+  __m256d top = _mm256_set1_pd(2147483648.0);
+  __m256d f = _mm256_set1_pd(first);
+  __m256d s = _mm256_set1_pd(scale);
+  int i;
+
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((__m128i *) (v + i)), flip);
+    __m256d d = _mm256_add_pd(_mm256_cvtepi32_pd(x), top);
+
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_sub_pd(d, f), s));
+  }
+  return i;
+}
+#endif
+
+/* The same, two or four at a time where the machine can.  SSE2 only
+   converts signed ints, so the top bit is flipped and added back. */
+void unsigned_map_many(coord c1, coord c2, int n, char *col, int count,
+		       double *out)
+{
+  unsigned int *v = (unsigned int *) col;
+  double first = (double) c1.u;
+  double scale = ((double) n) / ((double) (c2.u - c1.u));
+  int i = 0;
+
+#ifdef MAP_MANY_AVX2
+  if (cpu_has_avx2())
+    i = unsigned_map_avx2(v, first, scale, count, out);
+#endif
+#ifdef __SSE2__
+  {
+    __m128i flip = _mm_set1_epi32((int) 0x80000000);
+    __m128d top = _mm_set1_pd(2147483648.0);
+    __m128d f = _mm_set1_pd(first);
+    __m128d s = _mm_set1_pd(scale);
+
+    for (; i + 2 <= count; i += 2) {
+      __m128i x = _mm_xor_si128(_mm_loadl_epi64((__m128i *) (v + i)), flip);
+      __m128d d = _mm_add_pd(_mm_cvtepi32_pd(x), top);
+
+      _mm_storeu_pd(out + i, _mm_mul_pd(_mm_sub_pd(d, f), s));
+    }
+  }
+#endif
+  for (; i < count; i++)
+    out[i] = ((double) v[i] - first) * scale;
+}
+
 coord unsigned_unmap(coord c1, coord c2, int n, double x)
 {
   coord r;
@@ -231,5 +259,6 @@ struct coord_impl unsigned_impl  = {
   unsigned_tick,
   unsigned_subtick,
   unsigned_map,
-  unsigned_unmap
+  unsigned_unmap,
+  unsigned_map_many
   };
@@ -0,0 +1 @@
+char *version_string = "0.90.7_tcptrace1.2.1";
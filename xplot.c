@@ -43,15 +43,39 @@ to preserve same.
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _POSIX_MAPPED_FILES
+#include <sys/mman.h>
+#endif
 
 #include "xplot.h"
 #include "coord.h"
+#include "raster.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifdef HAVE_LIBX11
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
+#ifdef HAVE_LIBXEXT
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
 #else
 #error xplot requires x11
 #endif
@@ -75,8 +99,12 @@ void fatalerror(char *s)
   exit(1);
 }
 
+struct input_source *open_input(FILE *fp, int nthreads);
+void close_input(struct input_source *in);
 int get_input();
+static void index_verbs(void);
 void emit_PS();
+void convert_file(char *from, char *to);
 
 #define min(x,y) (((x)<(y))?(x):(y))
 #define max(x,y) (((x)>(y))?(x):(y))
@@ -109,8 +137,8 @@ static lXPoint lXPoint_from_dXPoint(dXPoint dxp)
   return r;
 }
 
-/* xpcolor_t is a short so it fits in the command struct (60 bytes =
- 64 - malloc overhead (on a mips)
+/* xpcolor_t is a short to keep the command struct small; there can be
+   tens of millions of them.
 */
 
 #define NCOLORS 10
@@ -140,6 +168,10 @@ int	NColors = NCOLORS;
 
 typedef short xpcolor_t;
 
+/*
+ * A command is one thing to draw.  Only the decorations are kept as
+ * commands; the input is packed into the stores, see first_command().
+ */
 typedef struct command_struct {
   struct command_struct *next;
   enum plot_command_type { X, DOT, PLUS, BOX, DIAMOND,
@@ -160,33 +192,270 @@ typedef struct command_struct {
   char *text;
 } command;
 
-#define NUMVIEWS 30
+/*
+ * Arenas hand out memory with a bump pointer and free it all at once.
+ * Commands go in the dataset's arena, decorations in the plotter's.
+ */
+struct arena_block {
+  struct arena_block *next;
+  size_t used;
+  size_t size;
+};
+
+struct arena {
+  struct arena_block *blocks;	/* the block being filled is first */
+  struct arena_block *spare;	/* blocks kept by arena_reset() */
+  size_t block_size;
+};
+
+#define ARENA_ALIGN sizeof(double)
+#define COMMAND_ARENA_BLOCK (1024*1024)
+#define DECORATION_ARENA_BLOCK (8*1024)
+
+/*
+ * The input's commands, a store per kind of primitive and a column per
+ * field, in chunks of STORE_CHUNK.  seq is the place in the input across
+ * all three kinds.  The mapped and redraw flags are the plotter's own.
+ */
+enum store_kind { SEGMENTS, POINTS, TEXTS, NKINDS };
+
+#define STORE_CHUNK_SHIFT 10
+#define STORE_CHUNK (1 << STORE_CHUNK_SHIFT)
+#define STORE_CHUNK_MASK (STORE_CHUNK - 1)
+
+/*
+ * Level of detail: of the points and segments of one type and colour
+ * that land on the same pixels, only the first in the file is drawn.
+ */
+struct pixel_slot {
+  short xa, ya, xb, yb;
+  int attr;			/* type and colour */
+  unsigned int gen;		/* in use if the store's pixel_gen */
+};
+
+/* bits in a store's flags */
+#define MAPPED       0x01
+#define NEEDS_REDRAW 0x02
+
+struct store {
+  int n;			/* number of commands in the store */
+  int nchunks;
+  int maxchunks;
+  char **chunks;		/* base of each chunk's columns */
+  unsigned char **flags;	/* and each one's flags, see below */
+  size_t chunk_bytes;
+  /* where each column starts within a chunk (0 if the kind lacks it) */
+  size_t off_xa, off_ya, off_xb, off_yb;
+  size_t off_text;
+  size_t off_seq;		/* the place in the input, see add_command() */
+  size_t off_color;
+  size_t off_type;
+  size_t off_position;
+  /* spatial index over the first `indexed' commands, see build_index() */
+  int indexed;
+  int grid_nx, grid_ny;
+  int *cell_start;		/* grid_nx * grid_ny + 1 offsets into: */
+  int *cell_items;
+  int *oversize;		/* commands too big for a cell, and titles */
+  int noversize;
+  int *index_refs;		/* stores sharing the index, or NULL */
+  /* the commands mapped in the current view, see map_commands() */
+  int *visible;
+  int nvisible;
+  int maxvisible;
+  /* where the first nwin of them are in the window, see map_visible() */
+  double *win_xa, *win_ya, *win_xb, *win_yb;
+  int nwin;
+  int maxwin;
+  /* and the pixels of those, with a level of detail */
+  struct pixel_slot *pixels;
+  int npixels;
+  int maxpixels;		/* a power of 2, or 0 */
+  unsigned int pixel_gen;
+  /* per chunk, where its commands are at the anchor's scale, or NULL */
+  char **fix;
+  int maxfix;
+};
+
+#define store_column(st, i, off) \
+  ((st)->chunks[(i) >> STORE_CHUNK_SHIFT] + (st)->off)
+#define store_flags(st, i) \
+  ((st)->flags[(i) >> STORE_CHUNK_SHIFT][(i) & STORE_CHUNK_MASK])
+#define store_seq(st, i) \
+  (((int32_t *) store_column(st, i, off_seq))[(i) & STORE_CHUNK_MASK])
+
+/*
+ * Mapped pixels, kept relative to the anchor's view, stay good while
+ * panning by whole pixels; a new scale starts a new epoch.  Commands
+ * within FIX_TIE of halfway between pixels aren't kept.
+ */
+#define FIX_LIMIT ((double) (1 << 30))	/* pixels, either way */
+#define FIX_TIE 1e-6
+#define FIX_FIELDS(st) ((st)->off_xb ? 4 : 2)
+#define fix_column(st, i, field) \
+  (((int32_t *) (st)->fix[(i) >> STORE_CHUNK_SHIFT]) \
+   + (field) * STORE_CHUNK + ((i) & STORE_CHUNK_MASK))
+#define fix_epoch(st, i) \
+  (((uint32_t *) fix_column(st, i, FIX_FIELDS(st)))[0])
+
+struct anchor {
+  uint32_t epoch;		/* 0 until there is one */
+  coord x_left, x_right;
+  coord y_bottom, y_top;
+  dXPoint size;
+  double x0, y0;		/* where its corner is in the current view,
+				   a whole number of pixels */
+};
+
+/*
+ * The grid covers view 0 with about GRID_LOAD commands a cell.  A command
+ * spanning at most two cells each way is filed under its low corner.
+ */
+#define GRID_LOAD 16
+#define GRID_MAX 1024
+
+/* Walks the decorations and then the stores, see first_command(). */
+struct cursor {
+  struct plotter *pl;
+  command *dec;			/* current decoration, if still on those */
+  int at[NKINDS];		/* otherwise how many of each store (or of its
+				   visible list) are left, the current one
+				   included, */
+  int kind;			/* the store the current one is in, */
+  int i;			/* and its index there */
+  int want;			/* only visit commands with these flags */
+  command c;			/* the current command, unpacked */
+};
+
+/*
+ * Lines are queued per GC and sent in one XDrawSegments when the GC
+ * changes, the queue is full, a string is drawn or the loop stops.
+ */
+#define DECORATION_BATCH NCOLORS
+
+struct batch {
+  int g;			/* the GC the queued lines are drawn with */
+  int n;
+  XSegment *segs;
+};
+
+/*
+ * The draw loop checks the clock every DRAW_CHECK commands and stops
+ * after DRAW_BUDGET ms if events are waiting, going on from its cursor.
+ */
+#define DRAW_CHECK 64
+#define DRAW_BUDGET 8
+
+/*
+ * With -raster, strings are drawn from masks got once from the server.
+ */
+#define TEXT_MASK_BUCKETS 256
+
+struct text_mask {
+  struct text_mask *next;
+  char *text;
+  int x, y;			/* where the mask goes, from the origin */
+  int width, height;
+  unsigned char *bits;		/* width * height of them, row by row */
+};
+
+/*
+ * The labelled ticks of an axis last time and this, so that a label
+ * made before is copied instead of unparsed again.
+ */
+struct tick_side {
+  int n;
+  int max;
+  coord *at;
+  char **labels;
+  struct arena arena;		/* the labels */
+};
+
+struct tick_cache {
+  int level;			/* the last from cticks(), or -1 */
+  char *units;			/* the labels were made with */
+  int cur;			/* the side being made */
+  int probe;			/* how far into the other one we are */
+  struct tick_side sides[2];
+};
+
+#define TICK_ARENA_BLOCK (2*1024)
+
+/*
+ * The views a plotter has been zoomed through; view 0 is the extent.
+ * Popped views, and their visible lists, are kept for redo.
+ */
+struct seen {
+  coord x_left, x_right;	/* the view it was for */
+  coord y_bottom, y_top;
+  dXPoint size;			/* at this size */
+  int lod;			/* -1 if nothing was */
+  int n[NKINDS];		/* with this many in the stores */
+  int indexed[NKINDS];
+  int nvisible[NKINDS];
+  int *visible[NKINDS];
+};
+
+struct view {
+  coord x_left, x_right;
+  coord y_bottom, y_top;
+  struct seen *seen;		/* the last time it was left, or NULL */
+};
 
-#define pl_x_left   pl->x_left[pl->viewno]
-#define pl_x_right  pl->x_right[pl->viewno]
-#define pl_y_top    pl->y_top[pl->viewno]
-#define pl_y_bottom pl->y_bottom[pl->viewno]
+#define pl_x_left   pl->views[pl->viewno].x_left
+#define pl_x_right  pl->views[pl->viewno].x_right
+#define pl_y_top    pl->views[pl->viewno].y_top
+#define pl_y_bottom pl->views[pl->viewno].y_bottom
 
 #ifndef WINDOW_COORDS_IN_COMMAND_STRUCT
-#define pspl_x_left   pspl.x_left[pspl.viewno]
-#define pspl_x_right  pspl.x_right[pspl.viewno]
-#define pspl_y_top    pspl.y_top[pspl.viewno]
-#define pspl_y_bottom pspl.y_bottom[pspl.viewno]
+#define pspl_x_left   pspl.views[pspl.viewno].x_left
+#define pspl_x_right  pspl.views[pspl.viewno].x_right
+#define pspl_y_top    pspl.views[pspl.viewno].y_top
+#define pspl_y_bottom pspl.views[pspl.viewno].y_bottom
 #endif
 
+/*
+ * The extent of the commands, which becomes view 0.  A bounds starts
+ * out empty, at zero, which is what a plot with nothing in it shows.
+ */
+struct bounds {
+  bool empty;
+  coord x_left, x_right;
+  coord y_bottom, y_top;
+};
+
+/*
+ * The commands a plotter and its -d2 copy share, freed with the last.
+ * Only the first adds to it, see follow_copy().
+ */
+struct dataset {
+  int refs;
+  struct arena arena;
+  struct plotter *indexer;	/* the last to build an index over it */
+};
+
 typedef struct plotter {
   struct plotter *next;
-  command *commands;
+  struct store stores[NKINDS];
+  command *decorations;
+  struct dataset *data;
+  struct arena decoration_arena;
+  struct tick_cache x_ticks;	/* see axis() */
+  struct tick_cache y_ticks;
+  struct anchor anchor;		/* see map_visible() */
+  coord grid_x_left, grid_x_right;	/* the extent the stores' grids cover */
+  coord grid_y_bottom, grid_y_top;
   coord_type x_type;
   coord_type y_type;
   char *x_units;
   char *y_units;
   double aspect_ratio; /* 0.0 unless specified */
-  int viewno;
-  coord x_left[NUMVIEWS];
-  coord y_bottom[NUMVIEWS];
-  coord x_right[NUMVIEWS];
-  coord y_top[NUMVIEWS];
+  struct view *views;
+  int viewno;			/* the one shown */
+  int nviews;			/* those past it can be gone forward to */
+  int maxviews;
+  struct seen mapped;		/* what the visible lists are for, so far */
+  struct bounds bounds;		/* of the commands read so far */
   dXPoint origin;
   dXPoint size;
   dXPoint mainsize;
@@ -200,17 +469,36 @@ typedef struct plotter {
   int size_changed;
   int new_expose;
   int clean;
+  struct cursor draw;		/* where drawing stopped, */
+  bool draw_stopped;		/* if it stopped before the end */
   GC gcs[NCOLORS];
   GC decgc;
   GC xorgc;
   GC bacgc;
+  struct batch batch;
+  int maxsegs;			/* how many XSegments fit in one request */
+  Pixmap pixmap;		/* back buffer with -pixmap, else None */
+  int pixmap_width;
+  int pixmap_height;
+  bool shift_pending;		/* dragged: try shift_pixmap() */
+  coord shift_x_left;		/* where the view was before the drag */
+  coord shift_y_bottom;
+  struct follow *follow;	/* the file to keep reading with -follow */
+  struct plotter *copy;		/* on the second display, see copy_plotter() */
+  struct raster *raster;	/* drawn into with -raster, else NULL */
+  XImage *image;		/* the raster's pixels, as X sees them */
+#ifdef HAVE_LIBXEXT
+  XShmSegmentInfo shminfo;
+#endif
+  bool shm;			/* image is in shared memory */
+  struct text_mask **text_masks;	/* hashed on the string, or NULL */
   XFontStruct *font_struct;
   XGCValues gcv;
   enum plstate {NORMAL, SLAVE,
 		  ZOOM, HZOOM, VZOOM,
 		  DRAG, HDRAG, VDRAG,
 		  EXITING, PRINTING, FIGING, THINFIGING,
-		  ADVANCING, BACKINGUP,
+		  ADVANCING, BACKINGUP, REDOING,
 		  WEDGED} state;
   struct plotter *master; /* pointer to master when in SLAVE state */
   enum plstate master_state; /* state of master when in SLAVE state */
@@ -233,9 +521,14 @@ typedef struct plotter {
 } *PLOTTER;
 
 PLOTTER the_plotter_list;
+int nloading;			/* files still being read in the background */
 
 int option_thick;
 int option_mono;
+int option_pixmap;
+int option_raster;
+int option_threads = 1;
+int option_follow;
 int global_argc;
 char **global_argv;
 
@@ -244,12 +537,267 @@ int show_dist = 0;
 #endif /* TCPTRACE */
 
 
-command *new_command(struct plotter *pl)
+void arena_init(struct arena *a, size_t block_size)
+{
+  a->blocks = NULL;
+  a->spare = NULL;
+  a->block_size = block_size;
+}
+
+void *arena_alloc(struct arena *a, size_t nbytes)
+{
+  struct arena_block *b = a->blocks;
+  char *p;
+
+  nbytes = (nbytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if (b == NULL || b->size - b->used < nbytes) {
+    if (a->spare != NULL && a->spare->size >= nbytes) {
+      b = a->spare;
+      a->spare = b->next;
+    } else {
+      size_t size = max(a->block_size, nbytes);
+
+      b = (struct arena_block *) malloc(sizeof(*b) + size);
+      if (b == 0) fatalerror("malloc returned null");
+      b->size = size;
+    }
+    b->used = 0;
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+  p = (char *) (b + 1) + b->used;
+  b->used += nbytes;
+  return p;
+}
+
+char *arena_strdup(struct arena *a, char *s, size_t len)
+{
+  char *r = arena_alloc(a, len + 1);
+
+  memcpy(r, s, len);
+  r[len] = '\0';
+  return r;
+}
+
+/* forget everything allocated, but keep the blocks for reuse */
+void arena_reset(struct arena *a)
+{
+  struct arena_block *b;
+
+  while ((b = a->blocks) != NULL) {
+    a->blocks = b->next;
+    b->next = a->spare;
+    a->spare = b;
+  }
+}
+
+void arena_free(struct arena *a)
+{
+  struct arena_block *b;
+
+  arena_reset(a);
+  while ((b = a->spare) != NULL) {
+    a->spare = b->next;
+    free(b);
+  }
+}
+
+/* Take over the blocks of arena from, and whatever was allocated from
+   them; from is left empty. */
+void arena_adopt(struct arena *a, struct arena *from)
+{
+  struct arena_block *b;
+
+  while ((b = from->blocks) != NULL) {
+    from->blocks = b->next;
+    /* behind the block a is filling */
+    if (a->blocks == NULL) {
+      b->next = NULL;
+      a->blocks = b;
+    } else {
+      b->next = a->blocks->next;
+      a->blocks->next = b;
+    }
+  }
+  arena_free(from);
+}
+
+struct dataset *new_dataset(void)
+{
+  struct dataset *d;
+
+  d = (struct dataset *) malloc(sizeof(*d));
+  if (d == 0) fatalerror("malloc returned null");
+  d->refs = 1;
+  arena_init(&d->arena, COMMAND_ARENA_BLOCK);
+  d->indexer = NULL;
+  return d;
+}
+
+void drop_dataset(struct dataset *d)
+{
+  if (--d->refs > 0)
+    return;
+  arena_free(&d->arena);
+  free(d);
+}
+
+/* Lay out the columns of the stores, now that the coord types are known. */
+void init_stores(struct plotter *pl)
+{
+  int xs = coord_size[(int) pl->x_type];
+  int ys = coord_size[(int) pl->y_type];
+  int kind;
+
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+    size_t off = 0;
+
+    st->n = 0;
+    st->nchunks = 0;
+    st->maxchunks = 0;
+    st->chunks = NULL;
+    st->flags = NULL;
+    st->indexed = 0;
+    st->grid_nx = st->grid_ny = 0;
+    st->cell_start = st->cell_items = st->oversize = NULL;
+    st->noversize = 0;
+    st->index_refs = NULL;
+    st->visible = NULL;
+    st->nvisible = st->maxvisible = 0;
+    st->win_xa = st->win_ya = st->win_xb = st->win_yb = NULL;
+    st->nwin = st->maxwin = 0;
+    st->pixels = NULL;
+    st->npixels = st->maxpixels = 0;
+    st->pixel_gen = 0;
+    st->fix = NULL;
+    st->maxfix = 0;
+    st->off_xb = st->off_yb = st->off_text = st->off_position = 0;
+
+    /* widest columns first to keep everything aligned */
+#define column(field, width) (st->field = off, off += (width) * STORE_CHUNK)
+    column(off_xa, xs);
+    column(off_ya, ys);
+    if (kind == SEGMENTS) {
+      column(off_xb, xs);
+      column(off_yb, ys);
+    }
+    if (kind == TEXTS)
+      column(off_text, sizeof(char *));
+    column(off_seq, sizeof(int32_t));
+    column(off_color, sizeof(xpcolor_t));
+    column(off_type, 1);
+    if (kind == TEXTS)
+      column(off_position, 1);
+#undef column
+    st->chunk_bytes = off;
+  }
+}
+
+static enum store_kind kind_of_type(enum plot_command_type type)
+{
+  switch (type) {
+  case LINE:
+  case DLINE:
+    return SEGMENTS;
+  case TEXT:
+  case TITLE:
+  case XLABEL:
+  case YLABEL:
+    return TEXTS;
+  default:
+    return POINTS;
+  }
+}
+
+#define kind_of(c) kind_of_type((c)->type)
+
+/* Make room for maxchunks chunks, and their flags, in a store. */
+static void grow_chunks(struct store *st, int maxchunks)
+{
+  char **chunks;
+  unsigned char **flags;
+
+  chunks = (char **) malloc(maxchunks * sizeof(char *));
+  flags = (unsigned char **) malloc(maxchunks * sizeof(unsigned char *));
+  if (chunks == 0 || flags == 0) fatalerror("malloc returned null");
+  if (st->nchunks) {
+    memcpy(chunks, st->chunks, st->nchunks * sizeof(char *));
+    memcpy(flags, st->flags, st->nchunks * sizeof(unsigned char *));
+  }
+  free(st->chunks);
+  free(st->flags);
+  st->chunks = chunks;
+  st->flags = flags;
+  st->maxchunks = maxchunks;
+}
+
+static unsigned char *new_flags(void)
+{
+  unsigned char *flags;
+
+  flags = (unsigned char *) malloc(STORE_CHUNK);
+  if (flags == 0) fatalerror("malloc returned null");
+  memset(flags, 0, STORE_CHUNK);
+  return flags;
+}
+
+/* Give a store another chunk, once the last one is full. */
+void new_store_chunk(struct plotter *pl, struct store *st)
+{
+  if (st->nchunks == st->maxchunks)
+    grow_chunks(st, st->maxchunks ? 2 * st->maxchunks : 16);
+  st->flags[st->nchunks] = new_flags();
+  st->chunks[st->nchunks++] = arena_alloc(&pl->data->arena, st->chunk_bytes);
+}
+
+static void free_flags(struct store *st)
+{
+  int k;
+
+  for (k = 0; k < st->nchunks; k++)
+    free(st->flags[k]);
+  free(st->flags);
+}
+
+/* The number of commands pl has, which is where the next one goes in
+   the input. */
+static int32_t plotter_seq(struct plotter *pl)
+{
+  return pl->stores[SEGMENTS].n + pl->stores[POINTS].n + pl->stores[TEXTS].n;
+}
+
+/* Append c to the store for its kind. */
+void add_command(struct plotter *pl, command *c)
+{
+  struct store *st = &pl->stores[kind_of(c)];
+  int i = st->n & STORE_CHUNK_MASK;
+  char *base;
+
+  if (i == 0)
+    new_store_chunk(pl, st);
+  base = st->chunks[st->nchunks - 1];
+
+  store_coord(pl->x_type, base + st->off_xa, i, c->xa);
+  store_coord(pl->y_type, base + st->off_ya, i, c->ya);
+  if (st->off_xb) {
+    store_coord(pl->x_type, base + st->off_xb, i, c->xb);
+    store_coord(pl->y_type, base + st->off_yb, i, c->yb);
+  }
+  if (st->off_text) {
+    ((char **) (base + st->off_text))[i] = c->text;
+    ((unsigned char *) (base + st->off_position))[i] = c->position;
+  }
+  ((int32_t *) (base + st->off_seq))[i] = plotter_seq(pl);
+  ((xpcolor_t *) (base + st->off_color))[i] = c->color;
+  ((unsigned char *) (base + st->off_type))[i] = c->type;
+  st->n++;
+}
+
+/* Fill in the defaults for a command that will be added with
+   add_command(). */
+command *new_command(struct plotter *pl, command *c)
 {
-  command *c;
-  
-  c = (command *) malloc(sizeof(command));
-  if (c == 0) fatalerror("malloc returned null");
   c->decoration = FALSE;
 #ifdef WINDOW_COORDS_IN_COMMAND_STRUCT
   c->a.x = 0;
@@ -259,27 +807,163 @@ command *new_command(struct plotter *pl)
 #endif
   c->color = pl->current_color;
   
-  c->xa.d = 0.0;
-  c->ya.d = 0.0;
-  c->xb.d = 0.0;
-  c->yb.d = 0.0;
+  /* all of them: an int is narrower than a double */
+  memset(&c->xa, 0, sizeof(c->xa));
+  memset(&c->ya, 0, sizeof(c->ya));
+  memset(&c->xb, 0, sizeof(c->xb));
+  memset(&c->yb, 0, sizeof(c->yb));
+  c->mapped = FALSE;
+  c->needs_redraw = FALSE;
+  c->position = CENTERED;
+  c->text = NULL;
+  c->next = NULL;
+
+  return c;
+}
+
+command *new_decoration(struct plotter *pl)
+{
+  command *c;
+
+  c = (command *) arena_alloc(&pl->decoration_arena, sizeof(command));
+  c->decoration = TRUE;
+#ifdef WINDOW_COORDS_IN_COMMAND_STRUCT
+  c->a.x = 0;
+  c->a.y = 0;
+  c->b.x = 0;
+  c->b.y = 0;
+#endif
+  c->color = pl->current_color;
+
+  /* all of them: an int is narrower than a double */
+  memset(&c->xa, 0, sizeof(c->xa));
+  memset(&c->ya, 0, sizeof(c->ya));
+  memset(&c->xb, 0, sizeof(c->xb));
+  memset(&c->yb, 0, sizeof(c->yb));
 
-  c->next = pl->commands;
-  pl->commands = c;
+  c->next = pl->decorations;
+  pl->decorations = c;
 
   return c;
 }
 
-void free_command(command *c)
+void drop_decorations(struct plotter *pl)
 {
-  switch(c->type) {
-  case TEXT:
-    free(c->text);
-    break;
-  default:
-    break;
+  pl->draw_stopped = FALSE;
+  pl->decorations = NULL;
+  arena_reset(&pl->decoration_arena);
+}
+
+static void unpack_command(struct cursor *cur)
+{
+  struct plotter *pl = cur->pl;
+  struct store *st = &pl->stores[cur->kind];
+  command *c = &cur->c;
+  char *base = st->chunks[cur->i >> STORE_CHUNK_SHIFT];
+  int i = cur->i & STORE_CHUNK_MASK;
+  int flags = st->flags[cur->i >> STORE_CHUNK_SHIFT][i];
+
+  c->next = NULL;
+  c->type = ((unsigned char *) (base + st->off_type))[i];
+  c->color = ((xpcolor_t *) (base + st->off_color))[i];
+  c->decoration = FALSE;
+  c->mapped = (flags & MAPPED) ? TRUE : FALSE;
+  c->needs_redraw = (flags & NEEDS_REDRAW) ? TRUE : FALSE;
+  c->xa = load_coord(pl->x_type, base + st->off_xa, i);
+  c->ya = load_coord(pl->y_type, base + st->off_ya, i);
+  if (st->off_xb) {
+    c->xb = load_coord(pl->x_type, base + st->off_xb, i);
+    c->yb = load_coord(pl->y_type, base + st->off_yb, i);
+  } else {
+    c->xb = c->xa;
+    c->yb = c->ya;
+  }
+  if (st->off_text) {
+    c->text = ((char **) (base + st->off_text))[i];
+    c->position = ((unsigned char *) (base + st->off_position))[i];
+  } else {
+    c->text = NULL;
+    c->position = CENTERED;
+  }
+}
+
+/*
+ * Draw the command that came last in the input first, so the first is
+ * on top.
+ */
+static command *seek_command(struct cursor *cur)
+{
+  struct plotter *pl = cur->pl;
+  int want = cur->want;
+  int32_t seq, best_seq = -1;
+  int kind, at, i = 0;
+
+  for (; cur->dec != NULL; cur->dec = cur->dec->next)
+    if ((!(want & MAPPED) || cur->dec->mapped)
+	&& (!(want & NEEDS_REDRAW) || cur->dec->needs_redraw))
+      return cur->dec;
+
+  cur->kind = -1;
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+
+    /* only what map_commands() found in the view can be mapped */
+    for (at = cur->at[kind]; at > 0; at--) {
+      i = (want & MAPPED) ? st->visible[at - 1] : at - 1;
+      if ((store_flags(st, i) & want) == want)
+	break;
+    }
+    cur->at[kind] = at;
+    if (at == 0)
+      continue;
+    seq = store_seq(st, i);
+    if (seq > best_seq) {
+      best_seq = seq;
+      cur->kind = kind;
+      cur->i = i;
+    }
   }
-  free((char *)c);
+  if (cur->kind < 0)
+    return NULL;
+  unpack_command(cur);
+  return &cur->c;
+}
+
+/*
+ * Walk the decorations and then the stores, visiting the commands with
+ * all of want in their flags.  Call put_flags() after changing them.
+ */
+command *first_command(struct plotter *pl, struct cursor *cur, int want)
+{
+  int kind;
+
+  cur->pl = pl;
+  cur->want = want;
+  cur->dec = pl->decorations;
+  for (kind = 0; kind < NKINDS; kind++)
+    cur->at[kind] = (want & MAPPED) ? pl->stores[kind].nvisible
+      : pl->stores[kind].n;
+  return seek_command(cur);
+}
+
+command *next_command(struct cursor *cur)
+{
+  if (cur->dec != NULL)
+    cur->dec = cur->dec->next;
+  else
+    cur->at[cur->kind]--;
+  return seek_command(cur);
+}
+
+void put_flags(struct cursor *cur, command *c)
+{
+  struct store *st;
+
+  if (c != &cur->c)
+    return;			/* a decoration, changed in place */
+  st = &cur->pl->stores[cur->kind];
+  store_flags(st, cur->i) =
+    (c->mapped ? MAPPED : 0) | (c->needs_redraw ? NEEDS_REDRAW : 0);
 }
 
 dXPoint tomain(struct plotter *pl, dXPoint xp)
@@ -459,2893 +1143,7055 @@ static void compute_window_coords(struct plotter *pl, command *com)
 
 }
 
-
-static struct plotter *the_plotter_we_are_working_on;    /* C really looses */
-
-char *append_strings_with_space_freeing_first(char *s1, char *s2)
+/* A row or column of a grid of n, the one that d (from map_coord())
+   falls in, clamped onto the grid. */
+#ifdef __GNUC__
+static inline
+#else
+static
+#endif
+int grid_cell(double d, int n)
 {
-  int len2,len;
-  char *r;
-
-  len2 = strlen(s2);
-  if (len2 == 0)
-    return s1;
-  len = strlen(s1) + 1 + len2 + 1;
-  r = (char *) malloc(len);
-  if (r == 0) fatalerror("malloc returned null");
-  strcpy(r, s1);
-  strcat(r, " ");
-  strcat(r, s2);
-  free(s1);
-  return r;
+  if (!(d >= 0.0)) return 0;	/* also catches NaN */
+  if (d >= n) return n - 1;
+  return (int) d;
 }
 
-void doxtick(coord c,int labelflag)
+/* The grid column or row a coordinate falls in, clamped onto the grid. */
+static int grid_x(struct plotter *pl, int nx, coord c)
 {
-  struct plotter *pl = the_plotter_we_are_working_on;
-  command *com = new_command(pl);
-  com->decoration = TRUE;
-  com->type = DTICK;
-  com->xa = c;
-  com->ya = pl_y_bottom;
-  if (labelflag) {
-    com = new_command(pl);
-    com->decoration = TRUE;
-    com->type = TEXT;
-    com->position = BELOW;
-    com->xa = c;
-    com->ya = pl_y_bottom;
-    com->text = unparse_coord(pl->x_type, c);
-    com->text = append_strings_with_space_freeing_first(com->text,
-							pl->x_units);
-  }
+  return grid_cell(map_coord(pl->x_type, pl->grid_x_left, pl->grid_x_right,
+			     nx, c), nx);
 }
-void doytick(coord c,int labelflag)
+
+static int grid_y(struct plotter *pl, int ny, coord c)
 {
-  struct plotter *pl = the_plotter_we_are_working_on;
-  command *com = new_command(pl);
-  com->decoration = TRUE;
-  com->type = LTICK;
-  com->xa = pl_x_left;
-  com->ya = c;
-  if (labelflag) {
-    com = new_command(pl);
-    com->decoration = TRUE;
-    com->type = TEXT;
-    com->position = TO_THE_LEFT;
-    com->xa = pl_x_left;
-    com->ya = c;
-    com->text = unparse_coord(pl->y_type, c);
-    com->text = append_strings_with_space_freeing_first(com->text,
-							pl->y_units);
-  }
+  return grid_cell(map_coord(pl->y_type, pl->grid_y_bottom, pl->grid_y_top,
+			     ny, c), ny);
 }
-void axis(struct plotter *pl)
+
+/* Make room for n more on a store's visible list. */
+static void reserve_visible(struct store *st, int n)
 {
-  command *com;
+  int *visible;
 
-  com = new_command(pl);
-  com->decoration = TRUE;
-  com->type = LINE;
-  com->xa = pl_x_left;
-  com->ya = pl_y_top;
-  com->xb = pl_x_left;
-  com->yb = pl_y_bottom;
+  if (st->nvisible + n <= st->maxvisible)
+    return;
+  if (st->maxvisible == 0)
+    st->maxvisible = 1024;
+  while (st->nvisible + n > st->maxvisible)
+    st->maxvisible = st->maxvisible > INT_MAX / 2 ? INT_MAX
+      : 2 * st->maxvisible;
+  visible = (int *) malloc(st->maxvisible * sizeof(int));
+  if (visible == 0) fatalerror("malloc returned null");
+  if (st->nvisible)
+    memcpy(visible, st->visible, st->nvisible * sizeof(int));
+  free(st->visible);
+  st->visible = visible;
+}
 
-  com = new_command(pl);
-  com->decoration = TRUE;
-  com->type = LINE;
-  com->xa = pl_x_left;
-  com->ya = pl_y_bottom;
-  com->xb = pl_x_right;
-  com->yb = pl_y_bottom;
+/*
+ * The loops over a store's commands, one of each for every pair of
+ * coord types (see kernel.h).  A plotter's are kernels(pl).
+ */
+#define ktype_U_INT unsigned int
+#define ktype_INT int
+#define ktype_TIMEVAL int64_t	/* nanoseconds, see load_coord() */
+#define ktype_DOUBLE double
+#define ktype_DTIME double
+#define ktype_NSTIME int64_t
+#define KTYPE(t) KTYPE_(t)
+#define KTYPE_(t) ktype_##t
+#define KNAME(f) KNAME_(f, XT, YT)
+#define KNAME_(f, x, y) KNAME__(f, x, y)
+#define KNAME__(f, x, y) f##_##x##_##y
+
+struct kernels {
+  void (*map_items)(struct plotter *pl, int kind, int *items, int from,
+		    int n);
+  int (*bound_items)(struct plotter *pl, int kind, int from, int to,
+		     struct bounds *b);
+};
 
-  the_plotter_we_are_working_on = pl;
-  cticks(pl->x_type, pl_x_left, pl_x_right, 1, doxtick);
-  cticks(pl->y_type, pl_y_bottom, pl_y_top, 0, doytick);
+#define XT U_INT
+#include "kernel.h"
+#undef XT
+#define XT INT
+#include "kernel.h"
+#undef XT
+#define XT TIMEVAL
+#include "kernel.h"
+#undef XT
+#define XT DOUBLE
+#include "kernel.h"
+#undef XT
+#define XT DTIME
+#include "kernel.h"
+#undef XT
+#define XT NSTIME
+#include "kernel.h"
+#undef XT
+
+#define KERNELS(x, y) { map_items_##x##_##y, bound_items_##x##_##y }
+#define KERNEL_ROW(x) \
+  { KERNELS(x, U_INT), KERNELS(x, INT), KERNELS(x, TIMEVAL), \
+    KERNELS(x, DOUBLE), KERNELS(x, DTIME), KERNELS(x, NSTIME) }
+
+static struct kernels kernel_table[6][6] = {
+  KERNEL_ROW(U_INT),
+  KERNEL_ROW(INT),
+  KERNEL_ROW(TIMEVAL),
+  KERNEL_ROW(DOUBLE),
+  KERNEL_ROW(DTIME),
+  KERNEL_ROW(NSTIME)
+};
+
+#define kernels(pl) (&kernel_table[(int) (pl)->x_type][(int) (pl)->y_type])
 
+/*
+ * Map run commands of st from i on onto an nx by ny grid over view 0.
+ */
+static void map_grid(struct plotter *pl, struct store *st, int i, int run,
+		     int nx, int ny, double *xa, double *ya,
+		     double *xb, double *yb)
+{
+  map_many_coord(pl->x_type, pl->grid_x_left, pl->grid_x_right, nx,
+		 store_column(st, i, off_xa), run, xa);
+  map_many_coord(pl->y_type, pl->grid_y_bottom, pl->grid_y_top, ny,
+		 store_column(st, i, off_ya), run, ya);
+  if (st->off_xb) {
+    map_many_coord(pl->x_type, pl->grid_x_left, pl->grid_x_right, nx,
+		   store_column(st, i, off_xb), run, xb);
+    map_many_coord(pl->y_type, pl->grid_y_bottom, pl->grid_y_top, ny,
+		   store_column(st, i, off_yb), run, yb);
+  } else {
+    memcpy(xb, xa, run * sizeof(double));
+    memcpy(yb, ya, run * sizeof(double));
+  }
 }
 
-void size_window(struct plotter *pl)
+/* The cell each of the first n commands of a store is filed under on
+   an nx by ny grid over view 0: -1 if it goes on the oversize list, or
+   -2 if it can never be mapped. */
+static void index_cells(struct plotter *pl, struct store *st, int n,
+			int nx, int ny, int *cell)
 {
-  command *c;
-
-  pl->origin.x = 70;
-  pl->origin.y = 30;
-  pl->size.x = pl->mainsize.x - pl->origin.x - 10;
-  pl->size.y = pl->mainsize.y - pl->origin.y - 30;
-  
-  /*************** CAVEAT abstraction violation in emit_PS() code below,
-    caused mostly by hardwired constants above. */
-  while (pl->commands && pl->commands->decoration) {
-    c = pl->commands;
-    pl->commands = pl->commands->next;
-    free_command(c);
+  double xa[STORE_CHUNK], ya[STORE_CHUNK], xb[STORE_CHUNK], yb[STORE_CHUNK];
+  unsigned char *types;
+  int i, k, run;
+
+  for (i = 0; i < n; i += run) {
+    run = min(n - i, STORE_CHUNK);
+    map_grid(pl, st, i, run, nx, ny, xa, ya, xb, yb);
+    types = (unsigned char *) store_column(st, i, off_type);
+    for (k = 0; k < run; k++) {
+      int type = types[k];
+      int x0, x1, y0, y1, t;
+
+      if (type == INVISIBLE) {
+	cell[i + k] = -2;
+	continue;
+      }
+      if (type == TITLE || type == XLABEL || type == YLABEL) {
+	cell[i + k] = -1;
+	continue;
+      }
+      x0 = grid_cell(xa[k], nx);
+      y0 = grid_cell(ya[k], ny);
+      x1 = grid_cell(xb[k], nx);
+      y1 = grid_cell(yb[k], ny);
+      if (x1 < x0) { t = x0; x0 = x1; x1 = t; }
+      if (y1 < y0) { t = y0; y0 = y1; y1 = t; }
+      if (x1 - x0 > 1 || y1 - y0 > 1)
+	cell[i + k] = -1;
+      else
+	cell[i + k] = y0 * nx + x0;
+    }
   }
-
-  axis(pl);
-  
-  for (c = pl->commands; c != NULL; c = c->next)
-    compute_window_coords(pl, c);
-  
-  
 }
 
-lXPoint detent(struct plotter *pl, lXPoint xp)
+/* Let go of a store's index, freeing it unless it is shared. */
+static void free_index(struct store *st)
 {
+  if (st->index_refs != NULL && --*st->index_refs > 0) {
+    st->index_refs = NULL;
+    st->cell_start = st->cell_items = st->oversize = NULL;
+    return;
+  }
+  free(st->index_refs);
+  st->index_refs = NULL;
+  free(st->cell_start);
+  free(st->cell_items);
+  free(st->oversize);
+}
 
-  dXPoint dr;
-  dXPoint dxp;
-  
-  dxp = dXPoint_from_lXPoint(xp);
+/*
+ * A plotter and its copy with the same dataset and view 0 share an index.
+ */
+static int share_index(struct plotter *pl)
+{
+  struct plotter *from = pl->data->indexer;
+  int kind;
+
+  if (from == NULL || from == pl
+      || from->x_type != pl->x_type || from->y_type != pl->y_type
+      || cmp_coord(pl->x_type, from->grid_x_left, pl->views[0].x_left)
+      || cmp_coord(pl->x_type, from->grid_x_right, pl->views[0].x_right)
+      || cmp_coord(pl->y_type, from->grid_y_bottom, pl->views[0].y_bottom)
+      || cmp_coord(pl->y_type, from->grid_y_top, pl->views[0].y_top))
+    return FALSE;
+  for (kind = 0; kind < NKINDS; kind++)
+    if (from->stores[kind].indexed != pl->stores[kind].n)
+      return FALSE;
+
+  pl->grid_x_left = from->grid_x_left;
+  pl->grid_x_right = from->grid_x_right;
+  pl->grid_y_bottom = from->grid_y_bottom;
+  pl->grid_y_top = from->grid_y_top;
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+    struct store *fst = &from->stores[kind];
+
+    free_index(st);
+    if (fst->index_refs == NULL) {
+      fst->index_refs = (int *) malloc(sizeof(int));
+      if (fst->index_refs == 0) fatalerror("malloc returned null");
+      *fst->index_refs = 1;
+    }
+    ++*fst->index_refs;
+    st->index_refs = fst->index_refs;
+    st->indexed = fst->indexed;
+    st->grid_nx = fst->grid_nx;
+    st->grid_ny = fst->grid_ny;
+    st->cell_start = fst->cell_start;
+    st->cell_items = fst->cell_items;
+    st->oversize = fst->oversize;
+    st->noversize = fst->noversize;
+  }
+  return TRUE;
+}
 
-  dxp = tosub(pl, dxp);
+/*
+ * Index the stores over view 0.  Commands added later are looked at by
+ * every map_commands() until it is built again.
+ */
+void build_index(struct plotter *pl)
+{
+  int kind;
 
-  dr.x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
-		   unmap_coord(pl->x_type, pl_x_left, pl_x_right,
-			       pl->size.x, dxp.x));
-  dr.y = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
-		   unmap_coord(pl->y_type, pl_y_bottom, pl_y_top,
-			       pl->size.y, dxp.y));
-  dr = tomain(pl,dr);
+  if (share_index(pl))
+    return;
 
-  return lXPoint_from_dXPoint(dr);
-}  
+  pl->grid_x_left = pl->views[0].x_left;
+  pl->grid_x_right = pl->views[0].x_right;
+  pl->grid_y_bottom = pl->views[0].y_bottom;
+  pl->grid_y_top = pl->views[0].y_top;
+  pl->data->indexer = pl;
+
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+    int n = st->n;
+    int nx, ny, ncells;
+    int *cell;
+    int i, k;
+
+    free_index(st);
+
+    for (nx = 1; nx < GRID_MAX && nx * nx * GRID_LOAD < n; nx *= 2)
+      ;
+    ny = nx;
+    ncells = nx * ny;
+
+    cell = (int *) malloc((n + 1) * sizeof(int));
+    st->cell_start = (int *) malloc((ncells + 1) * sizeof(int));
+    st->cell_items = (int *) malloc((n + 1) * sizeof(int));
+    if (cell == 0 || st->cell_start == 0 || st->cell_items == 0)
+      fatalerror("malloc returned null");
+    for (k = 0; k <= ncells; k++)
+      st->cell_start[k] = 0;
+
+    /* count, then lay the cells out one after the other */
+    st->noversize = 0;
+    index_cells(pl, st, n, nx, ny, cell);
+    for (i = 0; i < n; i++) {
+      if (cell[i] >= 0)
+	st->cell_start[cell[i] + 1]++;
+      else if (cell[i] == -1)
+	st->noversize++;
+    }
+    for (k = 0; k < ncells; k++)
+      st->cell_start[k + 1] += st->cell_start[k];
+
+    st->oversize = (int *) malloc((st->noversize + 1) * sizeof(int));
+    if (st->oversize == 0)
+      fatalerror("malloc returned null");
+    st->noversize = 0;
+    for (i = 0; i < n; i++)
+      if (cell[i] >= 0)
+	st->cell_items[st->cell_start[cell[i]]++] = i;
+      else if (cell[i] == -1)
+	st->oversize[st->noversize++] = i;
+
+    /* filling moved each start up to the next one's; move them back */
+    for (k = ncells; k > 0; k--)
+      st->cell_start[k] = st->cell_start[k - 1];
+    st->cell_start[0] = 0;
+
+    free(cell);
+    st->grid_nx = nx;
+    st->grid_ny = ny;
+    st->indexed = n;
+  }
+}
 
-lXPoint map_pl_pl(struct plotter *pl_from, struct plotter *pl_to, lXPoint xp)
+static int cmp_int(const void *a, const void *b)
 {
+  return *(const int *) a - *(const int *) b;
+}
 
-  dXPoint dr;
-  dXPoint dxp;
-  coord x;
-  coord y;
+/* Start pl with views 0 and 1, showing nothing. */
+void init_views(struct plotter *pl)
+{
+  pl->maxviews = 4;
+  pl->views = (struct view *) malloc(pl->maxviews * sizeof(struct view));
+  if (pl->views == 0) fatalerror("malloc returned null");
+  memset(pl->views, 0, pl->maxviews * sizeof(struct view));
+  pl->nviews = 2;
+  pl->viewno = 0;
+  pl->mapped.lod = -1;
+}
 
-#define pl pl_from
-  dxp = dXPoint_from_lXPoint(xp);
+static void forget_seen(struct view *v)
+{
+  int kind;
 
-  dxp = tosub(pl, dxp);
+  if (v->seen == NULL)
+    return;
+  for (kind = 0; kind < NKINDS; kind++)
+    free(v->seen->visible[kind]);
+  free(v->seen);
+  v->seen = NULL;
+}
 
-  x = unmap_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, dxp.x);
-  y = unmap_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, dxp.y);
-    
-#undef pl
-#define pl pl_to
+/* Throw away the views from n on. */
+static void truncate_views(struct plotter *pl, int n)
+{
+  int k;
 
-  dr.x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, x);
+  for (k = n; k < pl->nviews; k++)
+    forget_seen(&pl->views[k]);
+  if (n < pl->nviews)
+    pl->nviews = n;
+}
 
-  dr.y = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, y);
+/* Keep what the stores' visible lists say is in the view that is being
+   left, if that is the view they were made for. */
+static void leave_view(struct plotter *pl)
+{
+  struct view *v = &pl->views[pl->viewno];
+  struct seen *m = &pl->mapped;
+  struct seen *sn;
+  int kind;
+
+  if (m->lod < 0
+      || xcmp(m->x_left, v->x_left, !=) || xcmp(m->x_right, v->x_right, !=)
+      || ycmp(m->y_bottom, v->y_bottom, !=) || ycmp(m->y_top, v->y_top, !=))
+    return;
+  forget_seen(v);
+  sn = (struct seen *) malloc(sizeof(struct seen));
+  if (sn == 0) fatalerror("malloc returned null");
+  *sn = *m;
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+
+    sn->n[kind] = st->n;
+    sn->indexed[kind] = st->indexed;
+    sn->nvisible[kind] = st->nvisible;
+    sn->visible[kind] = (int *) malloc((st->nvisible + 1) * sizeof(int));
+    if (sn->visible[kind] == 0) fatalerror("malloc returned null");
+    memcpy(sn->visible[kind], st->visible, st->nvisible * sizeof(int));
+  }
+  v->seen = sn;
+}
 
-  dr = tomain(pl,dr);
-#undef pl
+/* Zoom: show a new view after this one, a copy of it to start with.
+   The views that could have been gone forward to are gone. */
+void push_view(struct plotter *pl)
+{
+  leave_view(pl);
+  truncate_views(pl, pl->viewno + 1);
+  if (pl->nviews == pl->maxviews) {
+    struct view *views;
+
+    views = (struct view *) malloc(2 * pl->maxviews * sizeof(struct view));
+    if (views == 0) fatalerror("malloc returned null");
+    memcpy(views, pl->views, pl->nviews * sizeof(struct view));
+    free(pl->views);
+    pl->views = views;
+    pl->maxviews *= 2;
+  }
+  pl->views[pl->nviews] = pl->views[pl->viewno];
+  pl->views[pl->nviews].seen = NULL;
+  pl->nviews++;
+  pl->viewno++;
+}
 
-  return lXPoint_from_dXPoint(dr);
+/* Go back to the view before this one, which must be past view 1. */
+void pop_view(struct plotter *pl)
+{
+  leave_view(pl);
+  pl->viewno--;
 }
 
-#ifndef ScreenNumberOfScreen
-/* X.V11R3 is/was missing this functionality.
-   X Consortium people promissed that this will be 
-   done right and defined as a macro eventually.
-   
-   For now, kludge in a hopefully forward compatible way.
-   */
+/* Go forward to the view a pop_view() left.  Returns FALSE if there is
+   none. */
+int forward_view(struct plotter *pl)
+{
+  if (pl->viewno + 1 >= pl->nviews)
+    return FALSE;
+  leave_view(pl);
+  pl->viewno++;
+  return TRUE;
+}
 
-#define ScreenNumberOfScreen X_ScreenNumberOfScreen
-int X_ScreenNumberOfScreen(Screen *scr)
+/*
+ * Redo in pl, and in the plotters on list synchronized with it.
+ * Returns FALSE if pl had nothing to redo.
+ */
+int redo_view(PLOTTER list, PLOTTER pl, int x_synch, int y_synch)
 {
-  Display *dpy;
-  int i;
-  Screen *iscr;
+  PLOTTER savepl = pl;
 
-  dpy = DisplayOfScreen(scr);
+  if (!forward_view(pl))
+    return FALSE;
+  if (x_synch || y_synch)
+    for (pl = list; pl != NULL; pl = pl->next) {
+      if (pl == savepl)
+	continue;
+      if (!forward_view(pl))
+	push_view(pl);
+      if (x_synch) {
+	pl_x_left = savepl->views[savepl->viewno].x_left;
+	pl_x_right = savepl->views[savepl->viewno].x_right;
+      }
+      if (y_synch) {
+	pl_y_top = savepl->views[savepl->viewno].y_top;
+	pl_y_bottom = savepl->views[savepl->viewno].y_bottom;
+      }
+    }
+  return TRUE;
+}
 
-  for (i=0;i<XScreenCount(dpy);i++) {
-    iscr = ScreenOfDisplay(dpy,i);
-    if (iscr == scr)
-      return i;
+/* If what is in the view was kept when it was last left, and nothing
+   has changed since, put it back on the visible lists. */
+static int back_in_view(struct plotter *pl, int lod)
+{
+  struct seen *sn = pl->views[pl->viewno].seen;
+  int kind;
+  int k;
+
+  if (sn == NULL || sn->lod != lod
+      || sn->size.x != pl->size.x || sn->size.y != pl->size.y
+      || xcmp(sn->x_left, pl_x_left, !=) || xcmp(sn->x_right, pl_x_right, !=)
+      || ycmp(sn->y_bottom, pl_y_bottom, !=) || ycmp(sn->y_top, pl_y_top, !=))
+    return FALSE;
+  for (kind = 0; kind < NKINDS; kind++)
+    if (sn->n[kind] != pl->stores[kind].n
+	|| sn->indexed[kind] != pl->stores[kind].indexed)
+      return FALSE;
+
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+
+    for (k = 0; k < st->nvisible; k++)
+      store_flags(st, st->visible[k]) = 0;
+    st->nvisible = 0;
+    st->nwin = 0;
+    reserve_visible(st, sn->nvisible[kind]);
+    memcpy(st->visible, sn->visible[kind], sn->nvisible[kind] * sizeof(int));
+    st->nvisible = sn->nvisible[kind];
+    for (k = 0; k < st->nvisible; k++)
+      store_flags(st, st->visible[k]) = MAPPED | NEEDS_REDRAW;
   }
-  /* oops */
-  panic("XScreenNumberOfScreen: could not find screen number");
-  return 0;
+  return TRUE;
 }
-#endif
 
-
 /*
- * numwins, nth: specifies how many windows and which one (zero-based)
- * are desired.  This is a hint to new_plotter, which could check resources.
- * If tiling, we stack multiple windows vertically and make them smaller.
+ * Put the commands in the current view on the stores' visible lists,
+ * looking only at what the index offers.  With lod, leave out those
+ * drawn over by others.
  */
-
-void new_plotter(FILE *fp, Display *dpy, int numtiles, int tileno, int lineno)
+void map_commands(struct plotter *pl, int lod)
 {
-  int r = 0;
-  PLOTTER pl;
+  struct kernels *kn = kernels(pl);
+  command *c;
+  int kind;
+  int k;
 
-  do {
-  
-    pl = (PLOTTER) malloc(sizeof(*pl));
-    if (pl == 0) fatalerror("malloc returned null");
-    pl->next = the_plotter_list;
-    the_plotter_list = pl;
-  
-    pl->dpy = dpy;
-    pl->screen = XDefaultScreenOfDisplay(pl->dpy);
+  pl->draw_stopped = FALSE;
+  for (c = pl->decorations; c != NULL; c = c->next)
+    compute_window_coords(pl, c);
 
-    pl->numtiles = numtiles;
-    pl->tileno = tileno;
+  pl->mapped.x_left = pl_x_left;
+  pl->mapped.x_right = pl_x_right;
+  pl->mapped.y_bottom = pl_y_bottom;
+  pl->mapped.y_top = pl_y_top;
+  pl->mapped.size = pl->size;
+  pl->mapped.lod = lod;
+  if (back_in_view(pl, lod))
+    return;
 
-    pl->win = 0;
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
 
-    pl->aspect_ratio = 0.0;
-    pl->viewno = 0;
-    pl->commands = NULL;
-    pl->x_type = INT;
-    pl->y_type = INT;
-    pl->x_units = "";
-    pl->y_units = "";
-    pl->mainsize.x = 0;
-    pl->mainsize.y = 0;
-    pl->size_changed = 0;
-    pl->size.x = 0;
-    pl->size.y = 0;
-    pl->origin.x = 0;
-    pl->origin.y = 0;
-    pl->state = NORMAL;
-    pl->raw_dragstart.x = 0;
-    pl->raw_dragstart.y = 0;
-    pl->dragstart.x = 0;
-    pl->dragstart.y = 0;
-    pl->dragend.x = 0;
-    pl->dragend.y = 0;
-    pl->pointer.x = 0;
-    pl->pointer.y = 0;
-    pl->pointer_marks.x = 0;
-    pl->pointer_marks.y = 0;
-    pl->pointer_marks_on_screen = FALSE;
-    pl->xplot_nagle_atom = None;
-    pl->slave_draw_in_progress = FALSE;
-    pl->slave_motion_pending = FALSE;
-    pl->master_pointer.x = 0;
-    pl->master_pointer.y = 0;
-    pl->buttonsdown = 0;
-    pl->new_expose = 0;
-    pl->clean = 0;
-    pl->default_color = -1;
-    pl->current_color = -1;
-    pl->thick = option_thick? TRUE: FALSE; 
-
-    r = get_input(fp, dpy, lineno, pl);
-    lineno = r;
-  } while (r > 0);
-  
-}
+    for (k = 0; k < st->nvisible; k++)
+      store_flags(st, st->visible[k]) = 0;
+    st->nvisible = 0;
+    st->nwin = 0;
 
-void display_plotter(PLOTTER pl)
-{
-  XSetWindowAttributes attr;
-  Window rootwindow;
+    if (st->indexed > 0) {
+      int nx = st->grid_nx;
+      int x0, x1, y0, y1, x, y;
 
-  if (pl->win != 0) {
-    fprintf(stderr,
-	    "display_plotter called for already-displayed plotter\n");
-    return;
-  }
+      x0 = grid_x(pl, nx, pl_x_left) - 1;
+      x1 = grid_x(pl, nx, pl_x_right);
+      y0 = grid_y(pl, st->grid_ny, pl_y_bottom) - 1;
+      y1 = grid_y(pl, st->grid_ny, pl_y_top);
+      if (x0 < 0) x0 = 0;
+      if (y0 < 0) y0 = 0;
 
-  rootwindow = XRootWindowOfScreen(pl->screen);
+      for (y = y0; y <= y1; y++)
+	for (x = x0; x <= x1; x++) {
+	  int cell = y * nx + x;
 
-  /* set up foreground/background colors */
+	  kn->map_items(pl, kind, st->cell_items + st->cell_start[cell], 0,
+			st->cell_start[cell + 1] - st->cell_start[cell]);
+	}
+      kn->map_items(pl, kind, st->oversize, 0, st->noversize);
+    }
+    kn->map_items(pl, kind, NULL, st->indexed, st->n - st->indexed);
 
-  {
-    Colormap default_cmap = DefaultColormap(pl->dpy, DefaultScreen(pl->dpy));
-    char *foreground_color_name;
-    char *background_color_name;
-    XColor exact_return;
-    int i;
+    /* in file order, for seek_command() */
+    qsort(st->visible, st->nvisible, sizeof(int), cmp_int);
+  }
+}
 
-    foreground_color_name = XGetDefault(pl->dpy, global_argv[0], "foreground");
-    if (!foreground_color_name) foreground_color_name = "white";
-    i = XAllocNamedColor(pl->dpy, default_cmap, foreground_color_name,
-			 &exact_return, &pl->foreground_color);
-    if (i < 0)
-    {
-      fprintf(stderr, "XAllocNamedColor failed for %s: %d\n",
-	      foreground_color_name, i);
+/*
+ * Set pl's offset from its anchor if its view is the anchor's moved by
+ * whole pixels, else start a new anchor.
+ */
+static void set_anchor(struct plotter *pl)
+{
+  struct anchor *an = &pl->anchor;
+  double x0, x1, y0, y1;
+  int kind;
+  int k;
+
+  if (an->epoch != 0
+      && an->size.x == pl->size.x && an->size.y == pl->size.y) {
+    x0 = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
+		   an->x_left);
+    x1 = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
+		   an->x_right);
+    y0 = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
+		   an->y_bottom);
+    y1 = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
+		   an->y_top);
+    /* the same scale and whole pixels, near enough that it won't show */
+    if (fabs((x1 - x0) - pl->size.x) < 1e-6
+	&& fabs((y1 - y0) - pl->size.y) < 1e-6
+	&& fabs(x0 - rint(x0)) < 1e-6 && fabs(y0 - rint(y0)) < 1e-6
+	&& fabs(x0) < FIX_LIMIT && fabs(y0) < FIX_LIMIT) {
+      an->x0 = rint(x0);
+      an->y0 = rint(y0);
       return;
     }
+  }
 
-#if 0
-    ColorNames[0] = strdup(foreground_color_name);
+  an->x_left = pl_x_left;
+  an->x_right = pl_x_right;
+  an->y_bottom = pl_y_bottom;
+  an->y_top = pl_y_top;
+  an->size = pl->size;
+  an->x0 = an->y0 = 0.0;
+  if (++an->epoch == 0) {
+    /* wrapped: forget all the old ones for real */
+    for (kind = 0; kind < NKINDS; kind++) {
+      struct store *st = &pl->stores[kind];
+
+      for (k = 0; k < st->maxfix; k++)
+	if (st->fix[k])
+	  memset(st->fix[k] + FIX_FIELDS(st) * STORE_CHUNK * sizeof(int32_t),
+		 0, STORE_CHUNK * sizeof(uint32_t));
+    }
+    an->epoch = 1;
+  }
+}
+
+/* Make room for st's chunks of fixed-point window coordinates. */
+static void grow_fix(struct store *st)
+{
+  char **fix;
+  int max = st->maxchunks;
+
+  if (max < st->nchunks)
+    max = st->nchunks;
+  fix = (char **) malloc(max * sizeof(char *));
+  if (fix == 0) fatalerror("malloc returned null");
+  if (st->maxfix)
+    memcpy(fix, st->fix, st->maxfix * sizeof(char *));
+  memset(fix + st->maxfix, 0, (max - st->maxfix) * sizeof(char *));
+  free(st->fix);
+  st->fix = fix;
+  st->maxfix = max;
+}
+
+/* How far out of the window the draw loop lets a line go before it
+   cuts it short. */
+#if 1 /* Xqdss has bugs, so we need to clamp at just a few thousand */
+#define CLAMP 3000.0
 #else
-    ColorNames[0] = (char *) malloc(strlen(foreground_color_name) + 1);
-    if (ColorNames[0] == NULL) fatalerror("malloc returned null");
-    strcpy(ColorNames[0], foreground_color_name);
+#define CLAMP 10000.0
 #endif
 
-    background_color_name = XGetDefault(pl->dpy, global_argv[0], "background");
-    if (!background_color_name) background_color_name = "black";
-    i = XAllocNamedColor(pl->dpy, default_cmap, background_color_name,
-			 &exact_return, &pl->background_color);
-    if (i < 0)
-    {
-      fprintf(stderr, "XAllocNamedColor failed for %s: %d\n",
-	      background_color_name, i);
-      return;
+/* Whether the draw loop cuts short a command at these window
+   coordinates (see window_coords()). */
+static int cut_short(struct plotter *pl, double xa, double ya,
+		     double xb, double yb)
+{
+  return !(fabs(xa + pl->origin.x) <= CLAMP
+	   && fabs((pl->size.y - 1) - ya + pl->origin.y) <= CLAMP
+	   && fabs(xb + pl->origin.x) <= CLAMP
+	   && fabs((pl->size.y - 1) - yb + pl->origin.y) <= CLAMP);
+}
+
+/* Start st's set of pixels afresh, with room for n.  The slots are
+   kept from one view to the next, and emptied by a new pixel_gen. */
+static void clear_pixels(struct store *st, int n)
+{
+  int k;
+
+  if (st->maxpixels < 2 * n) {
+    free(st->pixels);
+    if (st->maxpixels < 1024)
+      st->maxpixels = 1024;
+    while (st->maxpixels < 2 * n)
+      st->maxpixels *= 2;
+    st->pixels = (struct pixel_slot *)
+      malloc(st->maxpixels * sizeof(struct pixel_slot));
+    if (st->pixels == 0) fatalerror("malloc returned null");
+    st->pixel_gen = 0;
+  }
+  if (++st->pixel_gen == 1)
+    for (k = 0; k < st->maxpixels; k++)
+      st->pixels[k].gen = 0;
+  st->npixels = 0;
+}
+
+/* Add a command's pixels to st's set.  Returns FALSE if they were in
+   it already. */
+static int add_pixels(struct store *st, struct pixel_slot *p)
+{
+  unsigned int h;
+
+  if (2 * (st->npixels + 1) > st->maxpixels) {
+    struct pixel_slot *old = st->pixels;
+    unsigned int gen = st->pixel_gen;
+    int n = st->maxpixels;
+    int k;
+
+    st->pixels = NULL;
+    clear_pixels(st, n);
+    for (k = 0; k < n; k++)
+      if (old[k].gen == gen)
+	add_pixels(st, &old[k]);
+    free(old);
+  }
+  h = ((unsigned int) (unsigned short) p->xa * 73856093u)
+    ^ ((unsigned int) (unsigned short) p->ya * 19349663u)
+    ^ ((unsigned int) (unsigned short) p->xb * 83492791u)
+    ^ ((unsigned int) (unsigned short) p->yb * 2654435761u)
+    ^ ((unsigned int) p->attr * 40503u);
+  for (;; h++) {
+    struct pixel_slot *sl = &st->pixels[h & (st->maxpixels - 1)];
+
+    if (sl->gen != st->pixel_gen) {
+      *sl = *p;
+      sl->gen = st->pixel_gen;
+      st->npixels++;
+      return TRUE;
     }
-  }      
-        
-  attr.background_pixel = pl->background_color.pixel;
-  attr.border_pixel     = pl->foreground_color.pixel;
-  attr.event_mask       = ButtonReleaseMask|ButtonPressMask|ExposureMask|
-    EnterWindowMask|LeaveWindowMask|PointerMotionMask|PointerMotionHintMask|
-    StructureNotifyMask|VisibilityChangeMask;
-#if 1
-  attr.cursor           = XCreateFontCursor(pl->dpy, XC_crosshair);
-#else
-  attr.cursor           = XCreateFontCursor(pl->dpy, XC_tcross);
-#endif
-  
-  {
-    XColor blk,wht;
-    
-    blk.red = blk.green = blk.blue = 0;
-    wht.red = wht.green = wht.blue = -1;
-    wht.flags = blk.flags = DoRed|DoGreen|DoBlue;
-    
-    XRecolorCursor(pl->dpy, attr.cursor, &wht, &blk);
+    if (sl->xa == p->xa && sl->ya == p->ya && sl->xb == p->xb
+	&& sl->yb == p->yb && sl->attr == p->attr)
+      return FALSE;
   }
-  
-  {
-    char *geom = XGetDefault (pl->dpy, global_argv[0], "geometry");
-    int x = 10, y = 70, borderw = 1;
-    unsigned int width = 400, height = 400;
-    int flags = 0;
-    int i;
+}
 
-    for (i = 1 ; i < global_argc ; i++) {
-      if (strcmp("-geometry", global_argv[i]) == 0) {
-	if (i+1 < global_argc) {
-	  geom = global_argv[i+1];
-	  break;
-	} else {
-	  static int virgin = 1;
-	  if (virgin) {
-	    fprintf(stderr, "-geometry on command line without any following argument\n");
-	    virgin = 0;
-	  }
-	}
+/*
+ * With lod, drop the commands on st's visible list from `from' on that
+ * land on the same pixels as one before them.  Clipped lines stay.
+ */
+static void reduce_visible(struct plotter *pl, struct store *st, int from)
+{
+  int to = from;
+  int k;
+
+  if (from == 0)
+    clear_pixels(st, st->nvisible);
+  for (k = from; k < st->nvisible; k++) {
+    int i = st->visible[k];
+    struct pixel_slot p;
+
+    if (!cut_short(pl, st->win_xa[k], st->win_ya[k],
+		   st->win_xb[k], st->win_yb[k])) {
+      char *base = st->chunks[i >> STORE_CHUNK_SHIFT];
+      int j = i & STORE_CHUNK_MASK;
+
+      p.xa = (short) rint(st->win_xa[k] + pl->origin.x);
+      p.ya = (short) rint((pl->size.y - 1) - st->win_ya[k] + pl->origin.y);
+      p.xb = (short) rint(st->win_xb[k] + pl->origin.x);
+      p.yb = (short) rint((pl->size.y - 1) - st->win_yb[k] + pl->origin.y);
+      p.attr = ((unsigned char *) (base + st->off_type))[j]
+	| (((xpcolor_t *) (base + st->off_color))[j] & 0x7fff) << 8;
+      if (!add_pixels(st, &p)) {
+	store_flags(st, i) = 0;
+	continue;
       }
     }
-    if (geom)
-     {
-	flags = XParseGeometry (geom, &x, &y, &width, &height);
-	if (flags & XValue)
-	  {
-	    if (flags & XNegative)
-	      x += DisplayWidth (pl->dpy, ScreenNumberOfScreen(pl->screen))
-		- width - borderw*2;
-	    else
-	      x += borderw;
-	  }
-	if (flags & YValue)
-	  {
-	    if (flags & YNegative)
-	      y += DisplayHeight (pl->dpy, ScreenNumberOfScreen(pl->screen))
-		- height - borderw*2;
-	    else
-	      y += borderw;
-	  }
-      }
-    
-    if (pl->numtiles > 0) {
-      /* Now we have geometry in x, y, height, width for total xplot area */
-      y += (height * pl->tileno) / pl->numtiles;
-      height = height / pl->numtiles;
-      /* we have now selected the nth 1/numtiles chunk */
-    }
-
-    pl->win = XCreateWindow(pl->dpy, rootwindow, x, y, width, height, borderw,
-			    DefaultDepth(pl->dpy, ScreenNumberOfScreen(pl->screen)),
-			    CopyFromParent, CopyFromParent,
-			    CWBackPixel|CWBorderPixel|CWEventMask|CWCursor,
-			    &attr);
-    
-    pl->xsh.flags = 0;
-    if (flags & (WidthValue | HeightValue))
-      pl->xsh.flags |= USSize;
-    else
-      pl->xsh.flags |= PSize;
-    if (flags & (XValue | YValue))
-      pl->xsh.flags |= USPosition;
-    else
-      pl->xsh.flags |= PPosition;
-    
-    pl->xsh.width = width;
-    pl->xsh.height = height;
-    pl->xsh.x = x;
-    pl->xsh.y = y;
-    XSetStandardProperties(pl->dpy, pl->win, "xplot", "xplot", None,
-			   global_argv, global_argc, &pl->xsh);
-  }
-  
-  XMapRaised(pl->dpy, pl->win);
-  
-  pl->visibility = VisibilityFullyObscured; /* initially true */
-  {
-    char *use_font = XGetDefault (pl->dpy, global_argv[0], "font");
-    pl->font_struct = XLoadQueryFont(pl->dpy, use_font ? use_font : "fixed");
-  }
-  
-  pl->gcv.foreground = pl->foreground_color.pixel;
-  pl->gcv.background = pl->background_color.pixel;
-  pl->gcv.font = pl->font_struct->fid;
-  pl->gcv.line_width = 0;
-  pl->gcv.cap_style = CapProjecting;
-  if (pl->thick) {
-    pl->gcv.line_width = 3;
-    pl->gcv.cap_style = CapRound;
+    st->visible[to] = i;
+    st->win_xa[to] = st->win_xa[k];
+    st->win_ya[to] = st->win_ya[k];
+    st->win_xb[to] = st->win_xb[k];
+    st->win_yb[to] = st->win_yb[k];
+    to++;
   }
-  
-  {
-#define N_DPY_S 2
+  st->nvisible = to;
+}
 
-    static struct dpy_info {
-      unsigned long line_plane_mask;
-      Colormap clr_map;
-      int depth;
-      XColor clr;
-      unsigned long pixel[NCOLORS];
-      int Colors[NCOLORS];
-      int virgin;
-      int warned_color_alloc_failed;
-      Atom xplot_nagle_atom;
-      Display *saved_dpy;
-    } d_i[N_DPY_S];
+/*
+ * Map the visible commands not yet in the window, from the anchor where
+ * it is good and a batch at a time with map_many_coord() otherwise.
+ */
+#define MAP_BATCH 256
 
-    int i;
-    int d;
-    
-    for (d = 0; d < N_DPY_S; d++) {
-      if (pl->dpy == d_i[d].saved_dpy)
-	break;
-      if (d_i[d].saved_dpy == 0) {
-	d_i[d].saved_dpy = pl->dpy;
-	d_i[d].virgin = 1;
-	break;
-      }
+void map_visible(struct plotter *pl)
+{
+  struct anchor *an = &pl->anchor;
+  char buf[MAP_BATCH * sizeof(double)];
+  double fresh[4][MAP_BATCH];
+  int miss[MAP_BATCH];
+  int kind;
+
+  set_anchor(pl);
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
+    int xs = coord_size[(int) pl->x_type];
+    int ys = coord_size[(int) pl->y_type];
+    int nf = FIX_FIELDS(st);
+    int k, m, f, run, nmiss, from;
+    double xa, ya, xb, yb;
+
+    if (st->nwin == st->nvisible)
+      continue;
+    if (st->maxwin < st->nvisible) {
+      free(st->win_xa);
+      free(st->win_ya);
+      free(st->win_xb);
+      free(st->win_yb);
+      /* a column each: together they can be more than an int counts */
+      st->maxwin = st->maxvisible;
+      st->win_xa = (double *) malloc(st->maxwin * sizeof(double));
+      st->win_ya = (double *) malloc(st->maxwin * sizeof(double));
+      st->win_xb = (double *) malloc(st->maxwin * sizeof(double));
+      st->win_yb = (double *) malloc(st->maxwin * sizeof(double));
+      if (st->win_xa == 0 || st->win_ya == 0 || st->win_xb == 0
+	  || st->win_yb == 0)
+	fatalerror("malloc returned null");
+      st->nwin = 0;
     }
-    if (d >= N_DPY_S) {
-      fprintf(stderr, "%s:%d:%s: bug -- pl->dpy != saved_dpy\n",
-	      __FILE__, __LINE__, __FUNCTION__);
-      panic("bug");
+    if (st->maxfix < st->nchunks)
+      grow_fix(st);
+    from = st->nwin;
+
+#define gather(off, size) \
+    for (m = 0; m < nmiss; m++) \
+      memcpy(buf + m * (size), \
+	     store_column(st, st->visible[k + miss[m]], off) \
+	     + (st->visible[k + miss[m]] & STORE_CHUNK_MASK) * (size), (size))
+    for (k = st->nwin; k < st->nvisible; k += run) {
+      run = min(st->nvisible - k, MAP_BATCH);
+
+      /* map the ones that aren't at the anchor yet */
+      nmiss = 0;
+      for (m = 0; m < run; m++) {
+	int i = st->visible[k + m];
+	char **chunk = &st->fix[i >> STORE_CHUNK_SHIFT];
+
+	if (*chunk == NULL) {
+	  *chunk = (char *) malloc(STORE_CHUNK * (nf * sizeof(int32_t)
+						  + sizeof(uint32_t)));
+	  if (*chunk == 0) fatalerror("malloc returned null");
+	  memset(*chunk + nf * STORE_CHUNK * sizeof(int32_t), 0,
+		 STORE_CHUNK * sizeof(uint32_t));
+	}
+	if (fix_epoch(st, i) != an->epoch) {
+	  miss[nmiss++] = m;
+	  continue;
+	}
+	xa = *fix_column(st, i, 0) + an->x0;
+	ya = *fix_column(st, i, 1) + an->y0;
+	if (nf == 4) {
+	  xb = *fix_column(st, i, 2) + an->x0;
+	  yb = *fix_column(st, i, 3) + an->y0;
+	} else {
+	  xb = xa;
+	  yb = ya;
+	}
+	/* where a line is cut depends on where its ends really are */
+	if (cut_short(pl, xa, ya, xb, yb)) {
+	  miss[nmiss++] = m;
+	  continue;
+	}
+	st->win_xa[k + m] = xa;
+	st->win_ya[k + m] = ya;
+	st->win_xb[k + m] = xb;
+	st->win_yb[k + m] = yb;
+      }
+      if (nmiss) {
+	gather(off_xa, xs);
+	map_many_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
+		       buf, nmiss, fresh[0]);
+	gather(off_ya, ys);
+	map_many_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
+		       buf, nmiss, fresh[1]);
+	if (st->off_xb) {
+	  gather(off_xb, xs);
+	  map_many_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
+			 buf, nmiss, fresh[2]);
+	  gather(off_yb, ys);
+	  map_many_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
+			 buf, nmiss, fresh[3]);
+	} else {
+	  memcpy(fresh[2], fresh[0], nmiss * sizeof(double));
+	  memcpy(fresh[3], fresh[1], nmiss * sizeof(double));
+	}
+	for (m = 0; m < nmiss; m++) {
+	  int at = k + miss[m];
+	  int i = st->visible[at];
+
+	  st->win_xa[at] = fresh[0][m];
+	  st->win_ya[at] = fresh[1][m];
+	  st->win_xb[at] = fresh[2][m];
+	  st->win_yb[at] = fresh[3][m];
+	  /* keep it unless it's too far out, or too near halfway */
+	  for (f = 0; f < nf; f++) {
+	    double d = fresh[f][m] - (f % 2 ? an->y0 : an->x0);
+
+	    if (!(fabs(d) < FIX_LIMIT)
+		|| fabs(d - rint(d)) > 0.5 - FIX_TIE)
+	      break;
+	  }
+	  if (f < nf)
+	    continue;
+	  for (f = 0; f < nf; f++)
+	    *fix_column(st, i, f) =
+	      (int32_t) rint(fresh[f][m] - (f % 2 ? an->y0 : an->x0));
+	  fix_epoch(st, i) = an->epoch;
+	}
+      }
     }
+#undef gather
+    if (pl->mapped.lod > 0 && kind != TEXTS)
+      reduce_visible(pl, st, from);
+    st->nwin = st->nvisible;
+  }
+}
 
-    /* Allocate some color cells */
-      
-    if (d_i[d].virgin ) {
-      int ci;
-
-      d_i[d].virgin = 0;
-      
-      d_i[d].xplot_nagle_atom = XInternAtom(pl->dpy, "XPLOT_NAGLE", False);
-
-      d_i[d].clr_map = DefaultColormap(pl->dpy, DefaultScreen(pl->dpy));
-      
-      d_i[d].depth = DisplayPlanes(pl->dpy, DefaultScreen(pl->dpy));
+/* Where the command the MAPPED cursor cur is at is in pl's window,
+   before the origin is added: from map_visible() for one from a store,
+   worked out here for a decoration. */
+static void window_coords(struct plotter *pl, struct cursor *cur,
+			  command *c, dXPoint *a, dXPoint *b)
+{
+  if (c->decoration) {
+    a->x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, c->xa);
+    a->y = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, c->ya);
+    b->x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, c->xb);
+    b->y = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, c->yb);
+  } else {
+    struct store *st = &pl->stores[cur->kind];
 
-      ci = 0;
+    int at = cur->at[cur->kind] - 1;
 
-      /* if display/screen has only 1 bit of depth, don't try to
-       * allocate any colors - just use BlackPixel and WhitePixel
-       */
-      if ( ! option_mono && d_i[d].depth > 1
-	   && XAllocColorCells(pl->dpy, 
-			       d_i[d].clr_map, 0,
-			       &d_i[d].line_plane_mask, 1,
-			       d_i[d].pixel, NColors)
-	   )
-	{
-	  for ( ; ci < NColors; ci++)  {
-	    XParseColor(pl->dpy, d_i[d].clr_map, ColorNames[ci], &d_i[d].clr);
-	    d_i[d].clr.pixel = d_i[d].pixel[ci];
-	    XStoreColor (pl->dpy, d_i[d].clr_map, &d_i[d].clr);
-	    d_i[d].clr.pixel |= d_i[d].line_plane_mask;
-	    XStoreColor (pl->dpy, d_i[d].clr_map, &d_i[d].clr);
-	    d_i[d].Colors[ci] = d_i[d].clr.pixel;
-	  }
+    a->x = st->win_xa[at];
+    a->y = st->win_ya[at];
+    b->x = st->win_xb[at];
+    b->y = st->win_yb[at];
+  }
+  a->y = (pl->size.y - 1) - a->y;
+  b->y = (pl->size.y - 1) - b->y;
+}
 
-	} else if (! option_mono && d_i[d].depth > 1 ) {
-	  /* some visual types (e.g. TrueColor) do not support XAllocColorCells */
+void init_bounds(struct bounds *b)
+{
+  b->empty = TRUE;
+  memset(&b->x_left, 0, sizeof(b->x_left));
+  memset(&b->x_right, 0, sizeof(b->x_right));
+  memset(&b->y_bottom, 0, sizeof(b->y_bottom));
+  memset(&b->y_top, 0, sizeof(b->y_top));
+}
 
-	  for ( ; ci < NColors; ci++) {
-	    XColor exact_return;
+/* Stretch b over c.  Returns whether that moved it. */
+int bound_command(struct plotter *pl, struct bounds *b, command *c)
+{
+  int moved = FALSE;
 
-	    i = XAllocNamedColor(pl->dpy, d_i[d].clr_map, ColorNames[ci],
-				 &exact_return, &d_i[d].clr);
-	    if ( i < 0 )
-	      {
-		fprintf(stderr, "XAllocNamedColor failed for %s: %d\n",
-			ColorNames[ci], i);
-		break;
-	      }
+#define bound(xory, field, v, op) \
+  if (b->empty || ccmp(pl->xory##_type, v, b->field, op)) { \
+    b->field = v; \
+    moved = TRUE; \
+  }
+  switch (c->type) {
+  case TITLE:
+  case XLABEL:
+  case YLABEL:
+    return FALSE;
+  case LINE:
+  case DLINE:
+    bound(x, x_left, c->xb, <);
+    bound(x, x_right, c->xb, >);
+    bound(y, y_bottom, c->yb, <);
+    bound(y, y_top, c->yb, >);
+    b->empty = FALSE;
+    /* fall through */
+  default:
+    bound(x, x_left, c->xa, <);
+    bound(x, x_right, c->xa, >);
+    bound(y, y_bottom, c->ya, <);
+    bound(y, y_top, c->ya, >);
+    b->empty = FALSE;
+    break;
+  }
+#undef bound
+  return moved;
+}
 
-	    /* Here, we should check if the color is close enough. */
-	    d_i[d].Colors[ci] = d_i[d].clr.pixel;
+/* Make view 0 show everything within b. */
+void set_extent(struct plotter *pl, struct bounds *b)
+{
+  pl->views[0].x_left = b->x_left;
+  pl->views[0].x_right = bump_coord(pl->x_type, b->x_right);
+  pl->views[0].y_bottom = b->y_bottom;
+  pl->views[0].y_top = bump_coord(pl->y_type, b->y_top);
+}
 
-#if 0
-	    /***** and on any failure, you should break out of this
-	      loop leaving ci pointing at the first color (perhaps
-	      zero) of the first color you've failed to allocate. */
+/* Make view 0 the extent of what pl has read, and show all of it. */
+void set_views(struct plotter *pl)
+{
+  command *c;
+  int kind;
+
+  init_bounds(&pl->bounds);
+  for (c = pl->decorations; c != NULL; c = c->next)
+    (void) bound_command(pl, &pl->bounds, c);
+  for (kind = 0; kind < NKINDS; kind++)
+    (void) kernels(pl)->bound_items(pl, kind, 0, pl->stores[kind].n,
+				    &pl->bounds);
+  set_extent(pl, &pl->bounds);
+
+  truncate_views(pl, 2);
+  pl->viewno = 1;
+  pl_x_left   = pl->views[0].x_left;
+  pl_x_right  = pl->views[0].x_right;
+  pl_y_top    = pl->views[0].y_top;
+  pl_y_bottom = pl->views[0].y_bottom;
+}
 
-	    /***** need to take care that this does the correct thing
-	      on one-bit-plane displays.    There are two ways that this might occur:
-	    
-	      1. All pixel values obtained in this loop on a
-	      one-bit-plane display are the same as WhitePixelOfScreen()
+/* Clear pl's window and have everything in it drawn again. */
+void redraw_plotter(struct plotter *pl)
+{
+  if (pl->pixmap == None)
+    XClearWindow(pl->dpy, pl->win);
+  pl->pointer_marks_on_screen = FALSE;
+  pl->size_changed = 1;
+}
 
-	      or
-	      
-	      2. On a one-bitplane display we break out of this loop
-	      and leave the loop below to fill in WhitePixelOfScreen()
-	      for each plot color.
-	      */
-#endif
-	  }
-	}
-      for ( ; ci < NColors; ci++) {
+/*
+ * Take in the commands added to pl's stores from n[kind] on, growing
+ * view 0 if need be.  Returns whether anything is to be drawn.
+ */
+int grow_plotter(struct plotter *pl, int n[NKINDS],
+		 char *x_units, char *y_units)
+{
+  struct bounds before;
+  int all_of_it;
+  int redraw_all = FALSE;
+  int kind;
+
+  before = pl->bounds;
+  all_of_it = pl->viewno == 1
+    && xcmp(pl_x_left, pl->views[0].x_left, ==)
+    && xcmp(pl_x_right, pl->views[0].x_right, ==)
+    && ycmp(pl_y_bottom, pl->views[0].y_bottom, ==)
+    && ycmp(pl_y_top, pl->views[0].y_top, ==);
+  for (kind = 0; kind < NKINDS; kind++)
+    if (kernels(pl)->bound_items(pl, kind, n[kind], pl->stores[kind].n,
+				 &pl->bounds))
+      redraw_all = TRUE;
+  if (redraw_all) {
+    set_extent(pl, &pl->bounds);
+    if (all_of_it || before.empty) {
+      pl_x_left = pl->views[0].x_left;
+      pl_x_right = pl->views[0].x_right;
+      pl_y_bottom = pl->views[0].y_bottom;
+      pl_y_top = pl->views[0].y_top;
+    } else
+      redraw_all = FALSE;
+  }
+  if (pl->x_units != x_units || pl->y_units != y_units)
+    redraw_all = TRUE;
 
-	/* probably only one bit plane, or all the color cells are taken
-	   (or option_mono)*/
+  /* index the new commands once there are as many as there were */
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &pl->stores[kind];
 
-	if (!d_i[d].warned_color_alloc_failed && !option_mono) {
-	  fputs("unable to get all desired colors, will substitute white for some or all colors\n",
-		stderr);
-	  d_i[d].warned_color_alloc_failed = 1;
-	}
-	d_i[d].Colors[ci] = WhitePixelOfScreen(pl->screen);
-      }
+    if (st->n - st->indexed > max(st->indexed, STORE_CHUNK)) {
+      build_index(pl);
+      redraw_all = TRUE;
+      break;
     }
-    
-    for (i = 0; i < NColors; i++) {
-
-      pl->gcs[i] = XCreateGC(pl->dpy, pl->win,
-			     GCForeground|GCFont|GCLineWidth|GCCapStyle,
-			     &(pl->gcv));
-    
-      XSetForeground(pl->dpy, pl->gcs[i], d_i[d].Colors[i]);
+  }
 
+  if (pl->win == 0)
+    return FALSE;		/* mapped when it is shown */
+  if (redraw_all) {
+    redraw_plotter(pl);
+    return TRUE;
+  }
+  for (kind = 0; kind < NKINDS; kind++)
+    kernels(pl)->map_items(pl, kind, NULL, n[kind],
+			   pl->stores[kind].n - n[kind]);
+  for (kind = 0; kind < NKINDS; kind++)
+    if (pl->stores[kind].n > n[kind]) {
+      pl->clean = 0;
+      pl->draw_stopped = FALSE;
+      return TRUE;
     }
+  return FALSE;
+}
 
-    pl->xplot_nagle_atom = d_i[d].xplot_nagle_atom;
-#if 0
-    printf("DEBUG: nagle_atom is %ld\n", pl->xplot_nagle_atom);
-#endif
-  }
+/*
+ * With -follow, the file a plotter was read from is kept open, and
+ * the lines added to it are read in as they come, see follow_plotter().
+ */
+struct follow {
+  int fd;
+  off_t offset;			/* read up to here, the start of a line */
+  int lineno;			/* of the line before that */
+  struct input_source *in;	/* the lines read by the last look */
+};
 
+/* how often to look at the files, in milliseconds */
+#define FOLLOW_INTERVAL 200
+/* and how much of one to take in at a time */
+#ifndef FOLLOW_MAX
+#define FOLLOW_MAX (1 << 20)
+#endif
 
-  pl->decgc = XCreateGC(pl->dpy, pl->win,
-			GCForeground|GCFont|GCLineWidth|GCCapStyle,
-			&(pl->gcv));
-  
-  pl->gcv.foreground ^= pl->gcv.background;
-  pl->gcv.function = GXxor;
-  
-  pl->xorgc = XCreateGC(pl->dpy, pl->win,
-			GCForeground|GCFunction|GCFont|GCLineWidth|GCCapStyle,
-			&(pl->gcv));
-  
-  pl->gcv.foreground = pl->gcv.background;
 
-  /* just like dec gc but draws in background color */
-  pl->bacgc = XCreateGC(pl->dpy, pl->win,
-			GCForeground|GCFont|GCLineWidth|GCCapStyle,
-			&(pl->gcv));
+
+static struct plotter *the_plotter_we_are_working_on;    /* C really looses */
 
+void init_tick_cache(struct tick_cache *tc)
+{
+  int k;
+
+  tc->level = -1;
+  tc->units = NULL;
+  tc->cur = 0;
+  tc->probe = 0;
+  for (k = 0; k < 2; k++) {
+    tc->sides[k].n = tc->sides[k].max = 0;
+    tc->sides[k].at = NULL;
+    tc->sides[k].labels = NULL;
+    arena_init(&tc->sides[k].arena, TICK_ARENA_BLOCK);
+  }
 }
 
+/* Get tc ready for axis() to make a new lot of ticks with units. */
+static void start_ticks(struct tick_cache *tc, char *units)
+{
+  struct tick_side *side;
+
+  tc->cur = !tc->cur;
+  side = &tc->sides[tc->cur];
+  side->n = 0;
+  arena_reset(&side->arena);
+  if (units != tc->units)
+    tc->sides[!tc->cur].n = 0;	/* the old labels are no good */
+  tc->units = units;
+  tc->probe = 0;
+}
 
-int undisplay_plotter(PLOTTER pl, int direction)
+/* A tick's label, c and then the units if there are any, made in
+   the new side of tc, or copied there if the old side has it: dragging
+   redoes the ticks at every motion, and that way it takes no malloc()s
+   and next to no unparsing.  Ticks come in order, see cticks(). */
+static char *tick_label(struct tick_cache *tc, coord_type ctype, coord c,
+			char *units)
 {
-  int i;
-  PLOTTER pll;
-  
-  if (direction == 1) {
-    pll = pl->next;
-    if (pll == 0) {
-      pll = the_plotter_list;
-    }
-  } else if (direction == -1) {
-    pll = the_plotter_list; 
-    if (pl != the_plotter_list) {
-      while (pll) {
-	if (pll->next == pl) {
-	  break;
-	}
-	pll = pll->next;
-      }
-    } else {
-      /* go to last plotter on list */
-      while (pll->next)
-	pll = pll->next;
-    }
+  struct tick_side *side = &tc->sides[tc->cur];
+  struct tick_side *old = &tc->sides[!tc->cur];
+  char buf[COORD_TEXT_MAX];
+  char *s;
+  size_t len;
+  size_t ulen;
+  char *r;
+
+  while (tc->probe < old->n && cmp_coord(ctype, old->at[tc->probe], c) < 0)
+    tc->probe++;
+  if (tc->probe < old->n && cmp_coord(ctype, old->at[tc->probe], c) == 0) {
+    s = old->labels[tc->probe];
+    r = arena_strdup(&side->arena, s, strlen(s));
   } else {
-    pll = 0;
+    s = unparse_coord(ctype, c, buf);
+    len = strlen(s);
+    ulen = units ? strlen(units) : 0;
+    r = (char *) arena_alloc(&side->arena, len + 1 + ulen + 1);
+    memcpy(r, s, len);
+    if (ulen) {
+      r[len++] = ' ';
+      memcpy(r + len, units, ulen);
+      len += ulen;
+    }
+    r[len] = '\0';
   }
 
-  /* if previous (next) plotter on list doesn't have a window yet
-     give it our window, GCs, and font_struct and set up all the
-     other stuff that display_plotter() would set up . */ 
+  if (side->n == side->max) {
+    int max = side->max ? 2 * side->max : 16;
+    coord *at = (coord *) malloc(max * sizeof(coord));
+    char **labels = (char **) malloc(max * sizeof(char *));
 
-  if (pll && pll->win == 0) {
-    pll->win = pl->win;
-    for (i = 0; i < NColors; i++)
-      pll->gcs[i] = pl->gcs[i];
-    pll->decgc = pl->decgc;
-    pll->xorgc = pl->xorgc;
-    pll->font_struct = pl->font_struct;
+    if (at == 0 || labels == 0) fatalerror("malloc returned null");
+    if (side->n) {
+      memcpy(at, side->at, side->n * sizeof(coord));
+      memcpy(labels, side->labels, side->n * sizeof(char *));
+    }
+    free(side->at);
+    free(side->labels);
+    side->at = at;
+    side->labels = labels;
+    side->max = max;
+  }
+  side->at[side->n] = c;
+  side->labels[side->n] = r;
+  side->n++;
+  return r;
+}
 
-    pll->xplot_nagle_atom = pl->xplot_nagle_atom;
+void doxtick(coord c,int labelflag)
+{
+  struct plotter *pl = the_plotter_we_are_working_on;
+  command *com = new_decoration(pl);
+  com->type = DTICK;
+  com->xa = c;
+  com->ya = pl_y_bottom;
+  if (labelflag) {
+    com = new_decoration(pl);
+    com->type = TEXT;
+    com->position = BELOW;
+    com->xa = c;
+    com->ya = pl_y_bottom;
+    com->text = tick_label(&pl->x_ticks, pl->x_type, c, pl->x_units);
+  }
+}
+void doytick(coord c,int labelflag)
+{
+  struct plotter *pl = the_plotter_we_are_working_on;
+  command *com = new_decoration(pl);
+  com->type = LTICK;
+  com->xa = pl_x_left;
+  com->ya = c;
+  if (labelflag) {
+    com = new_decoration(pl);
+    com->type = TEXT;
+    com->position = TO_THE_LEFT;
+    com->xa = pl_x_left;
+    com->ya = c;
+    com->text = tick_label(&pl->y_ticks, pl->y_type, c, pl->y_units);
+  }
+}
+void axis(struct plotter *pl)
+{
+  command *com;
 
-    pll->xsh = pl->xsh;  /* unnecessary? */
+  com = new_decoration(pl);
+  com->type = LINE;
+  com->xa = pl_x_left;
+  com->ya = pl_y_top;
+  com->xb = pl_x_left;
+  com->yb = pl_y_bottom;
 
-    pll->visibility = pl->visibility;
+  com = new_decoration(pl);
+  com->type = LINE;
+  com->xa = pl_x_left;
+  com->ya = pl_y_bottom;
+  com->xb = pl_x_right;
+  com->yb = pl_y_bottom;
 
-    pll->gcv = pl->gcv; /* unnecessary? */
+  the_plotter_we_are_working_on = pl;
+  start_ticks(&pl->x_ticks, pl->x_units);
+  cticks(pl->x_type, pl_x_left, pl_x_right, 1, &pl->x_ticks.level, doxtick);
+  start_ticks(&pl->y_ticks, pl->y_units);
+  cticks(pl->y_type, pl_y_bottom, pl_y_top, 0, &pl->y_ticks.level, doytick);
 
-    pll->mainsize = pl->mainsize;
+}
 
-    pll->size_changed = 1; /* will trigger clearing and redisplay */
+void size_window(struct plotter *pl)
+{
+  pl->origin.x = 70;
+  pl->origin.y = 30;
+  pl->size.x = pl->mainsize.x - pl->origin.x - 10;
+  pl->size.y = pl->mainsize.y - pl->origin.y - 30;
+  
+  /*************** CAVEAT abstraction violation in emit_PS() code below,
+    caused mostly by hardwired constants above. */
+  drop_decorations(pl);
 
-    /* take window away from this plotter */
-    pl->win = 0;
-    
-    return 1;
-  } else {
-    XDestroyWindow(pl->dpy, pl->win);
-    for (i = 0; i < NColors; i++)
-      XFreeGC(pl->dpy, pl->gcs[i]);
-    XFreeGC(pl->dpy, pl->decgc);
-    XFreeGC(pl->dpy, pl->xorgc);
-    XFreeFont(pl->dpy, pl->font_struct);
-    pl->win = 0;
-    return 0;
-  }
-    
-#if 0
-  while (pl->commands) {
-    c = pl->commands;
-    pl->commands = pl->commands->next;
-    free_command(c);
-  }
+  axis(pl);
   
-  free(pl);
-#endif
+  map_commands(pl, TRUE);
   
 }
 
-/*
- * compute the bounding box of the current view
- */
-void shrink_to_bbox(struct plotter *pl, int x, int y)
+lXPoint detent(struct plotter *pl, lXPoint xp)
 {
-  command *c;
-  
-  int nmapped = 0;
-  int ndots = 0;
-  int virgin = 1;
-  
-  coord saved_x_left = pl_x_left;
-  coord saved_x_right = pl_x_right;
-  coord saved_y_bottom = pl_y_bottom;
-  coord saved_y_top = pl_y_top;
 
-  /* get mapped indicator set correctly for what new window size
-   * before we scale  the other axis */
-  for (c = pl->commands; c != NULL; c = c->next)
-    compute_window_coords(pl, c);
+  dXPoint dr;
+  dXPoint dxp;
+  
+  dxp = dXPoint_from_lXPoint(xp);
 
-#ifdef LOTS_OF_DEBUGGING_PRINTS
-  fprintf(stderr, "C_S_P: view %d OLD %s %s %s %s\n",
-	  pl->viewno,
-	  unparse_coord(pl->x_type, pl_x_left),
-	  unparse_coord(pl->x_type, pl_x_right),
-	  unparse_coord(pl->y_type, pl_y_bottom),
-	  unparse_coord(pl->y_type, pl_y_top));
-#endif
+  dxp = tosub(pl, dxp);
 
-  for (c = pl->commands; c != NULL; c = c->next)
-    if ( c->mapped && ! c->decoration)
-      {
-	nmapped++;
+  dr.x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
+		   unmap_coord(pl->x_type, pl_x_left, pl_x_right,
+			       pl->size.x, dxp.x));
+  dr.y = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
+		   unmap_coord(pl->y_type, pl_y_bottom, pl_y_top,
+			       pl->size.y, dxp.y));
+  dr = tomain(pl,dr);
 
-	switch(c->type) {
-	case LINE:
-	case DLINE:
-	  if ( x )
-	    {
-	      if (virgin || ccmp(pl->x_type, c->xb, pl_x_left, <))
-		pl_x_left = c->xb;
-	      if (virgin || ccmp(pl->x_type, c->xb, pl_x_right, >))
-		pl_x_right = c->xb;
-	    }
-	  if ( y )
-	    {
-	      if (virgin || ccmp(pl->y_type, c->yb, pl_y_bottom, <))
-		pl_y_bottom = c->yb;
-	      if (virgin || ccmp(pl->y_type, c->yb, pl_y_top, >))
-		pl_y_top = c->yb;
-	    }
-	  virgin = 0;
-	  
-	case X:
-	case DOT:
-	case PLUS:
-	case BOX:
-	case DIAMOND:
-	case UTICK:
-	case DTICK:
-	case LTICK:
-	case RTICK:
-	case HTICK:
-	case VTICK:
-	case UARROW:
-	case DARROW:
-	case LARROW:
-	case RARROW:
-	case INVISIBLE:
-	case TEXT:
-	  ndots++;
-	  if ( x )
-	    {
-	      if (virgin || ccmp(pl->x_type, c->xa, pl_x_left, <))
-		pl_x_left = c->xa;
-	      if (virgin || ccmp(pl->x_type, c->xa, pl_x_right, >))
-		pl_x_right = c->xa;
-	    }
-	  if ( y )
-	    {
-	      if (virgin || ccmp(pl->y_type, c->ya, pl_y_bottom, <))
-		pl_y_bottom = c->ya;
-	      if (virgin || ccmp(pl->y_type, c->ya, pl_y_top, >))
-		pl_y_top = c->ya;
-	    }
-	  virgin = 0;
-	case TITLE:
-	case XLABEL:
-	case YLABEL:
-	  break;
-	}
-	
-      }
+  return lXPoint_from_dXPoint(dr);
+}  
 
-  /* make sure top/bottom are not equal, somehow  */
-  if ( ccmp(pl->x_type, pl_x_left, pl_x_right, ==) )
-    {
-      pl_x_left = saved_x_left;
-      pl_x_right = saved_x_right;
-    }
-  if ( ccmp(pl->y_type, pl_y_bottom, pl_y_top, ==) )
-    {
-      pl_y_bottom = saved_y_bottom;
-      pl_y_top = saved_y_top;
-    }
+lXPoint map_pl_pl(struct plotter *pl_from, struct plotter *pl_to, lXPoint xp)
+{
 
-#if 0  /* this code is broken, round_{down,up} take more than one argument */
-  /* make points 5/95 % rather than extreme - settle for rounding */
-  if ( y )
-    {
-      pl_y_bottom = (impls[(int)pl->y_type]->round_down)(pl_y_bottom);
-      pl_y_top = (impls[(int)pl->y_type]->round_up)(pl_y_top);
-    }
-#endif
+  dXPoint dr;
+  dXPoint dxp;
+  coord x;
+  coord y;
 
+#define pl pl_from
+  dxp = dXPoint_from_lXPoint(xp);
 
-#ifdef LOTS_OF_DEBUGGING_PRINTS
-  fprintf(stderr, "C_S_P: nmapped=%d ndots=%d NEW %s %s %s %s\n",
-	  nmapped, ndots,
-	  unparse_coord(pl->x_type, pl_x_left),
-	  unparse_coord(pl->x_type, pl_x_right),
-	  unparse_coord(pl->y_type, pl_y_top),
-	  unparse_coord(pl->y_type, pl_y_top));
-#endif
-}
+  dxp = tosub(pl, dxp);
 
-void draw_pointer_marks(PLOTTER pl, GC gc)
-{
-  const int x_pm_l = 6;
+  x = unmap_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, dxp.x);
+  y = unmap_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, dxp.y);
+    
+#undef pl
+#define pl pl_to
 
-#if 0
-  printf("draw_pointer_marks, pl->state is %d\n", pl->state);
-#endif
+  dr.x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x, x);
 
-  if (pl->win == 0) return;
+  dr.y = map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y, y);
 
-  XDrawLine(pl->dpy, pl->win, gc,
-	    pl->pointer_marks.x, pl->origin.y + pl->size.y - 1,
-	    pl->pointer_marks.x, pl->origin.y + pl->size.y - 1 - x_pm_l);
-  XDrawLine(pl->dpy, pl->win, gc,
-	    pl->origin.x, pl->pointer_marks.y,
-	    pl->origin.x + x_pm_l, pl->pointer_marks.y);
+  dr = tomain(pl,dr);
+#undef pl
 
-  XDrawLine(pl->dpy, pl->win, gc,
-	    pl->pointer_marks.x - x_pm_l, pl->pointer_marks.y,
-	    pl->pointer_marks.x + x_pm_l, pl->pointer_marks.y);
-  XDrawLine(pl->dpy, pl->win, gc,
-	    pl->pointer_marks.x, pl->pointer_marks.y - x_pm_l,
-	    pl->pointer_marks.x, pl->pointer_marks.y + x_pm_l);
+  return lXPoint_from_dXPoint(dr);
+}
 
-  switch (pl->state == SLAVE? pl->master_state : pl->state) {
-  case ZOOM:
-  case HZOOM:
-  case VZOOM:
-    XDrawRectangle(pl->dpy, pl->win, gc,
-		   min(pl->dragstart.x, pl->dragend.x), 
-		   min(pl->dragstart.y, pl->dragend.y),
-		   abs(pl->dragend.x - pl->dragstart.x),
-		   abs(pl->dragend.y - pl->dragstart.y));
-    break;
-  case HDRAG:
-    XDrawLine(pl->dpy, pl->win, gc,
-	      pl->dragstart.x, pl->dragstart.y,
-	      pl->dragend.x, pl->dragstart.y);
-    break;
-  case VDRAG:
-    XDrawLine(pl->dpy, pl->win, gc,
-	      pl->dragstart.x, pl->dragstart.y,
-	      pl->dragstart.x, pl->dragend.y);
-    break;
-  case DRAG:
-    XDrawLine(pl->dpy, pl->win, gc,
-	      pl->dragstart.x, pl->dragstart.y, pl->dragend.x, pl->dragend.y);
-#ifdef TCPTRACE
-    if (show_dist)
-    {
-	lXPoint p;
-	float pwidth = pl->size.x, pheight = pl->size.y;
-	long pxdist, pydist;
-	coord axdist, aydist;
-	float xscale, yscale;
-	char tmp [100], *s;
-	double xdist, ydist, slope, hyp_dist;
+#ifndef ScreenNumberOfScreen
+/* X.V11R3 is/was missing this functionality.
+   X Consortium people promissed that this will be 
+   done right and defined as a macro eventually.
+   
+   For now, kludge in a hopefully forward compatible way.
+   */
 
-	XDrawLine(pl->dpy, pl->win, gc,
-		  pl->dragstart.x, pl->dragstart.y, pl->dragstart.x, 
-		  pl->dragend.y);
-	XDrawLine(pl->dpy, pl->win, gc,
-		  pl->dragstart.x, pl->dragend.y, pl->dragend.x, 
-		  pl->dragend.y);
+#define ScreenNumberOfScreen X_ScreenNumberOfScreen
+int X_ScreenNumberOfScreen(Screen *scr)
+{
+  Display *dpy;
+  int i;
+  Screen *iscr;
 
-	pxdist = pl->dragend.x - pl->dragstart.x;
-	pydist = pl->dragstart.y - pl->dragend.y;
-	xscale = pxdist / pwidth;
-	yscale = pydist / pheight;
+  dpy = DisplayOfScreen(scr);
 
-	axdist = sub_coord (pl->x_type,pl_x_right,pl_x_left);
-	aydist = sub_coord (pl->y_type,pl_y_top,pl_y_bottom);
+  for (i=0;i<XScreenCount(dpy);i++) {
+    iscr = ScreenOfDisplay(dpy,i);
+    if (iscr == scr)
+      return i;
+  }
+  /* oops */
+  panic("XScreenNumberOfScreen: could not find screen number");
+  return 0;
+}
+#endif
 
-	if (pl->x_type != TIMEVAL)
-	{
-	    s = unparse_coord (pl->x_type,axdist);
-	    xdist = atof (s);
-	    free(s);
-	}
-	else
-	    xdist = axdist.t.tv_sec + axdist.t.tv_usec / 1000000.0;
-	xdist *= xscale;
+
+/*
+ * numwins, nth: specifies how many windows and which one (zero-based)
+ * are desired.  This is a hint to new_plotter, which could check resources.
+ * If tiling, we stack multiple windows vertically and make them smaller.
+ */
 
-	if (pl->y_type != TIMEVAL)
-	{
-	    s = unparse_coord (pl->y_type,aydist);
-	    ydist = atof (s);
-	    free(s);
-	}
-	else
-	    ydist = aydist.t.tv_sec + aydist.t.tv_usec / 1000000.0;
-	ydist *= yscale;
+/* Set up a plotter for reading into. */
+void init_plotter(PLOTTER pl, Display *dpy, int numtiles, int tileno)
+{
 
-	slope = ydist / xdist;
-	hyp_dist = sqrt ((xdist * xdist) + (ydist * ydist));
+  pl->dpy = dpy;
+  /* none for xplot --convert */
+  pl->screen = dpy ? XDefaultScreenOfDisplay(pl->dpy) : NULL;
+
+  pl->numtiles = numtiles;
+  pl->tileno = tileno;
+
+  pl->win = 0;
+
+  pl->aspect_ratio = 0.0;
+  /* what an empty plot shows */
+  init_views(pl);
+  pl->decorations = NULL;
+  pl->data = new_dataset();
+  arena_init(&pl->decoration_arena, DECORATION_ARENA_BLOCK);
+  init_tick_cache(&pl->x_ticks);
+  init_tick_cache(&pl->y_ticks);
+  pl->anchor.epoch = 0;
+  pl->x_type = INT;
+  pl->y_type = INT;
+  pl->x_units = "";
+  pl->y_units = "";
+  pl->mainsize.x = 0;
+  pl->mainsize.y = 0;
+  pl->size_changed = 0;
+  pl->size.x = 0;
+  pl->size.y = 0;
+  pl->origin.x = 0;
+  pl->origin.y = 0;
+  pl->state = NORMAL;
+  pl->raw_dragstart.x = 0;
+  pl->raw_dragstart.y = 0;
+  pl->dragstart.x = 0;
+  pl->dragstart.y = 0;
+  pl->dragend.x = 0;
+  pl->dragend.y = 0;
+  pl->pointer.x = 0;
+  pl->pointer.y = 0;
+  pl->pointer_marks.x = 0;
+  pl->pointer_marks.y = 0;
+  pl->pointer_marks_on_screen = FALSE;
+  pl->xplot_nagle_atom = None;
+  pl->slave_draw_in_progress = FALSE;
+  pl->slave_motion_pending = FALSE;
+  pl->master_pointer.x = 0;
+  pl->master_pointer.y = 0;
+  pl->buttonsdown = 0;
+  pl->new_expose = 0;
+  pl->clean = 0;
+  pl->draw_stopped = FALSE;
+  pl->default_color = -1;
+  pl->current_color = -1;
+  pl->thick = option_thick? TRUE: FALSE; 
+  pl->batch.n = 0;
+  pl->batch.segs = NULL;
+  pl->maxsegs = 0;
+  pl->pixmap = None;
+  pl->pixmap_width = 0;
+  pl->pixmap_height = 0;
+  pl->shift_pending = FALSE;
+  pl->follow = NULL;
+  pl->copy = NULL;
+  pl->raster = NULL;
+  pl->image = NULL;
+  pl->shm = FALSE;
+  pl->text_masks = NULL;
+}
 
-	if (xdist > 0)
-	    p.x = pl->dragstart.x - 65;
-	else
-	    p.x = pl->dragstart.x + 10;
-	p.y = pl->dragstart.y - (pydist / 2);
-	sprintf (tmp,"%.3f %s", ydist,
-		 (pl->y_units&&*pl->y_units)?pl->y_units:
-		 pl->y_type == TIMEVAL?"sec":
-		 "");
-	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
+static int is_binary(struct input_source *in);
+static PLOTTER read_binary(struct input_source *in, Display *dpy,
+			   int numtiles, int tileno);
+static void wait_for_line(FILE *fp);
+static void start_follow(PLOTTER pl, struct input_source *in);
+int follow_plotter(PLOTTER pl, int *more);
+void start_loading(char **names, int n, Display *dpy, int tile);
+int take_loaded(int show, int *more);
 
-	p.x = pl->dragstart.x + (pxdist / 2);
-	if (ydist > 0)
-	    p.y = pl->dragend.y - 5;
-	else
-	    p.y = pl->dragend.y + 15;
-	sprintf (tmp,"%.3f %s", xdist,
-		 (pl->x_units&&*pl->x_units)?pl->x_units:
-		 pl->x_type == TIMEVAL?"sec":
-		 "");
-	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
+/*
+ * Read the plotters in fp, newest first.  Nothing shared is touched, so
+ * several files can be read at once.
+ */
+PLOTTER read_plotters(FILE *fp, Display *dpy, int numtiles, int tileno,
+		      int lineno, int nthreads)
+{
+  int r = 0;
+  PLOTTER pl;
+  PLOTTER list = NULL;
+  struct input_source *in;
+
+  if (option_follow)
+    wait_for_line(fp);
+  in = open_input(fp, nthreads);
+
+  if (is_binary(in)) {
+    list = read_binary(in, dpy, numtiles, tileno);
+    if (option_follow)
+      start_follow(list, in);
+    close_input(in);
+    return list;
+  }
 
-	p.x = ((pl->dragend.x - pl->dragstart.x) / 2) + pl->dragstart.x;
-	p.y = ((pl->dragend.y - pl->dragstart.y) / 2) + pl->dragstart.y;
-	if (xdist > 0)
-	    p.x += 15;
-	else
-	    p.x -= 85;
-	if (ydist > 0)
-	    p.y += 10;
-	else
-	    p.y -= 20;
-	sprintf (tmp,"s = %.3f %s/%s", slope,
-		 ((pl->y_units&&*pl->y_units)?pl->y_units:pl->y_type == TIMEVAL?"sec":"units"),
-                 ((pl->x_units&&*pl->x_units)?pl->x_units:pl->x_type == TIMEVAL?"sec":"units")
-		 );
-//	sprintf (tmp,"s = %.3f", slope);
-	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
-/* Removed the diagonal distance, it is wrong. The value was being calculated
- * without taking into account the units of the x & y axis. Since it is not 
- * always possible to convert the different axis types from one form to the other,
- * it is safe to remove this value all together.
-        p.y += 15;
-	sprintf (tmp,"d = %.3f", hyp_dist);
-	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
- */ 
-    }
-#endif /* TCPTRACE */
-    break;
+  do {
+  
+    pl = (PLOTTER) malloc(sizeof(*pl));
+    if (pl == 0) fatalerror("malloc returned null");
+    pl->next = list;
+    list = pl;
+    init_plotter(pl, dpy, numtiles, tileno);
 
-  default:
-    /* we are called in motion notify */
-    break;
-  }
-  return;
+    r = get_input(in, dpy, lineno, &list);
+    lineno = r;
+  } while (r > 0);
+
+  if (option_follow)
+    start_follow(list, in);
+  close_input(in);
+  return list;
 }
 
-int main(int argc, char *argv[])
+/* Put a list of plotters, newest first, on the front of the_plotter_list. */
+void link_plotters(PLOTTER list)
 {
+  PLOTTER tail;
 
-  command *c;
-  int dummy_int;
-  int option_tile = FALSE;
-  int option_one_at_a_time = FALSE;
-  unsigned int dummy_unsigned_int;
-  Window dummy_window;
-  Display *dpy = 0;
-  Display *dpy2 = 0;
-  Display *dpy_of_event = 0;
-  PLOTTER pl;
-  coord x_synch_bb_left;
-  coord y_synch_bb_bottom;
-  coord x_synch_bb_right;
-  coord y_synch_bb_top;
+  if (list == NULL)
+    return;
+  for (tail = list; tail->next != NULL; tail = tail->next)
+    ;
+  tail->next = the_plotter_list;
+  the_plotter_list = list;
+}
 
-  XEvent event;
-  int i;
-  /* Are x and/or y axis of the various windows locked together? */
-  bool x_synch = FALSE, y_synch = FALSE;
+void new_plotter(FILE *fp, Display *dpy, int numtiles, int tileno, int lineno)
+{
+  link_plotters(read_plotters(fp, dpy, numtiles, tileno, lineno, 1));
+}
 
-  global_argc = argc;
-  global_argv = argv;
+/*
+ * Copy a plotter just read in for another display; they share the dataset.
+ */
+PLOTTER copy_plotter(PLOTTER pl, Display *dpy)
+{
+  PLOTTER cp;
+  int kind, k;
+
+  cp = (PLOTTER) malloc(sizeof(*cp));
+  if (cp == 0) fatalerror("malloc returned null");
+  *cp = *pl;
+  cp->next = NULL;
+  cp->dpy = dpy;
+  cp->screen = XDefaultScreenOfDisplay(dpy);
+  cp->decorations = NULL;
+  cp->draw_stopped = FALSE;
+  cp->follow = NULL;		/* the one on the first display follows */
+  cp->copy = NULL;
+  pl->copy = cp;
+  cp->data->refs++;
+  arena_init(&cp->decoration_arena, DECORATION_ARENA_BLOCK);
+  init_tick_cache(&cp->x_ticks);
+  init_tick_cache(&cp->y_ticks);
+  cp->anchor.epoch = 0;
+  cp->views = (struct view *) malloc(pl->maxviews * sizeof(struct view));
+  if (cp->views == 0) fatalerror("malloc returned null");
+  memcpy(cp->views, pl->views, pl->maxviews * sizeof(struct view));
+  for (k = 0; k < cp->nviews; k++)
+    cp->views[k].seen = NULL;
+  cp->mapped.lod = -1;
+
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &cp->stores[kind];
+
+    st->chunks = (char **) malloc((st->maxchunks + 1) * sizeof(char *));
+    st->flags = (unsigned char **)
+      malloc((st->maxchunks + 1) * sizeof(unsigned char *));
+    if (st->chunks == 0 || st->flags == 0)
+      fatalerror("malloc returned null");
+    if (st->nchunks)
+      memcpy(st->chunks, pl->stores[kind].chunks,
+	     st->nchunks * sizeof(char *));
+    for (k = 0; k < st->nchunks; k++)
+      st->flags[k] = new_flags();
+    st->indexed = 0;
+    st->grid_nx = st->grid_ny = 0;
+    st->cell_start = st->cell_items = st->oversize = NULL;
+    st->noversize = 0;
+    st->index_refs = NULL;
+    st->visible = NULL;
+    st->nvisible = st->maxvisible = 0;
+    st->win_xa = st->win_ya = st->win_xb = st->win_yb = NULL;
+    st->nwin = st->maxwin = 0;
+    st->pixels = NULL;
+    st->npixels = st->maxpixels = 0;
+    st->pixel_gen = 0;
+    st->fix = NULL;
+    st->maxfix = 0;
+  }
+  cp->batch.n = 0;
+  cp->batch.segs = NULL;
+  cp->text_masks = NULL;
+  return cp;
+}
 
-#ifdef TCPTRACE
+/*
+ * Call work(arg, k) for k from 0 to n-1 on up to nthreads threads.
+ */
+struct parallel_work {
+  void (*work)(void *arg, int k);
+  void *arg;
+  int n;
+  int next;			/* the next k nobody has started on */
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_t lock;
+#endif
+};
+
+static void *parallel_worker(void *arg)
+{
+  struct parallel_work *w = (struct parallel_work *) arg;
+  int k;
+
+  for (;;) {
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_lock(&w->lock);
+#endif
+    k = w->next++;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_unlock(&w->lock);
+#endif
+    if (k >= w->n)
+      break;
+    w->work(w->arg, k);
+  }
+  return NULL;
+}
+
+void run_parallel(int n, int nthreads, void (*work)(void *arg, int k),
+		  void *arg)
+{
+  struct parallel_work w;
+
+  w.work = work;
+  w.arg = arg;
+  w.n = n;
+  w.next = 0;
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_init(&w.lock, NULL);
   {
-      extern char* version_string;
-      printf("Based on Tim Shepard's version 0.90.7 xplot\n");
-      printf("Tcptrace-hosted version: %s\n", version_string);
+    pthread_t *tid;
+    int started = 0;
+    int k;
+
+    if (nthreads > n)
+      nthreads = n;
+    tid = (pthread_t *) malloc((nthreads + 1) * sizeof(pthread_t));
+    if (tid != NULL)
+      for (started = 0; started < nthreads - 1; started++)
+	if (pthread_create(&tid[started], NULL, parallel_worker, &w) != 0)
+	  break;
+    parallel_worker(&w);
+    for (k = 0; k < started; k++)
+      pthread_join(tid[k], NULL);
+    free(tid);
   }
-#endif /* TCPTRACE */
+  pthread_mutex_destroy(&w.lock);
+#else
+  parallel_worker(&w);
+#endif
+}
 
-  /* Look for -v or -version argument */
-  for (i = 1; i < argc && *argv[i] == '-'; i++) {
-    if (strcmp ("-v", argv[i]) == 0
-#ifdef TCPTRACE
-	|| (strcmp ("--version", argv[i]) == 0)
-#endif /* TCPTRACE */
-	|| strcmp ("-version", argv[i]) == 0) {
-      extern char* version_string;
-      printf("xplot version %s\n", version_string);
-      exit(0);
+/* How many threads to do things with: one per processor. */
+int ncpus(void)
+{
+  int n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return n < 1 ? 1 : n;
+}
+
+/*
+ * Read the files on the command line on several threads, and list them
+ * in the order reading them one by one would.
+ */
+struct load_job {
+  char *name;
+  int numtiles;
+  int tileno;
+  int nthreads;			/* to parse it with */
+  Display *dpy;
+  PLOTTER plotters;		/* what was read, newest first */
+};
+
+/* The compressed files that are read through a program, as open_input()
+   can't decompress them itself. */
+static struct {
+  char *suffix;
+  char *command;
+} plot_filters[] = {
+#ifndef HAVE_LIBZ
+  { ".gz", "zcat" },
+#endif
+#ifndef HAVE_LIBLZMA
+  { ".xz", "xzcat" },
+#endif
+#ifndef HAVE_LIBZSTD
+  { ".zst", "zstdcat" },
+#endif
+  { NULL, NULL }
+};
+
+/* Open a file to read plotters from.  Compressed files are normally
+   opened as they are, and open_input() decompresses them itself; only
+   a suffix in plot_filters[] is read through a program, and *piped set. */
+FILE *open_plot_file(char *name, int *piped)
+{
+  FILE *fp = 0;
+  int len, slen;
+  int i;
+
+  *piped = FALSE;
+  len = strlen(name);
+  for (i = 0; plot_filters[i].suffix != NULL; i++) {
+    slen = strlen(plot_filters[i].suffix);
+    if (len >= slen && strcmp(&name[len-slen], plot_filters[i].suffix) == 0) {
+      char *command;
+      command = (char *) malloc(50 + len);
+      if (command != 0) {
+	sprintf(command, "%s %s", plot_filters[i].command, name);
+	fp = popen(command, "r");
+	*piped = TRUE;
+	free(command);
+      }
+      return fp;
     }
-#ifdef TCPTRACE
-    if ((strcmp ("-h", argv[i]) == 0)
-	|| (strcmp ("-help", argv[i]) == 0)
-	|| (strcmp ("--help", argv[i]) == 0)) {
-        fprintf(stderr,"\n");
-	fprintf(stderr,"usage: %s [options] file [files]\n", argv[0]);
-       	fprintf(stderr,"------\n\n");
-	fprintf(stderr, "Options:\n");
-	fprintf(stderr, "--------\n");
-	fprintf(stderr, " -x               synchronize the x axis of all displayed files\n");
-	fprintf(stderr, " -y               synchronize the y axis of all displayed files\n");
-	fprintf(stderr, " -tile            adjust initial sizes to fit multiple files on screen\n");
-	fprintf(stderr, " -mono            monochrome output\n");
-	fprintf(stderr, " -1               show each file one at a time, rather than all at once\n");
-        fprintf(stderr, " -d               specify display\n");
-	fprintf(stderr, " -d2              specify second display (for group viewing)\n");
-	fprintf(stderr, " -geometry        WxH[+X+Y] (understands standard X11 geometry)\n");
-	fprintf(stderr, " -display         same as -d\n");
-        fprintf(stderr, " -thick           draw the plots with a thick stroke\n");
-	fprintf(stderr, " -version         print version information\n");
-	fprintf(stderr, " -help            show this help screen\n");
-	fprintf(stderr, "\n");       
-	fprintf(stderr, "Mouse Bindings:\n");
-	fprintf(stderr, "---------------\n");       
-	fprintf(stderr, " left             draw rectangle to zoom in, click to zoom out\n");
-	fprintf(stderr, " middle           drag to scroll window\n");
-	fprintf(stderr, " right            quit\n");
-	fprintf(stderr, " SHIFT + left     drop postscript file\n");
-	fprintf(stderr, " SHIFT + middle   drop postscript file, smaller image\n");
-	fprintf(stderr, " SHIFT + right    drop postscript file, less verticle space\n");
-	fprintf(stderr, " CTRL  + middle   drag out a box showing dimensions\n");
-	fprintf(stderr, "\n");
-	exit(0);
-    }
-#endif /* TCPTRACE */
   }
+  return fopen(name,"r");
+}
 
-  i = 1;
+static void load_one(void *arg, int k)
+{
+  struct load_job *job = (struct load_job *) arg + k;
+  FILE *fp;
+  int piped;
+
+  fp = open_plot_file(job->name, &piped);
+  if (fp) {
+    job->plotters = read_plotters(fp, job->dpy, job->numtiles, job->tileno,
+				  0, job->nthreads);
+    if (piped)
+      pclose(fp);
+    else
+      fclose(fp);
+  }
+}
 
-  /* Look for -x and/or -y options, and look for -t option*/
-  for (; i < argc && *argv[i] == '-'; i++)
-    {
-      if (strcmp ("-x", argv[i]) == 0)
-	x_synch = TRUE;
-      else if (strcmp ("-y", argv[i]) == 0)
-	y_synch = TRUE;
-      else if (strcmp ("-thick", argv[i]) == 0)
-	option_thick = TRUE;
-      else if (strcmp ("-tile", argv[i]) == 0)
-	option_tile = TRUE;
-      else if (strcmp ("-mono", argv[i]) == 0)
-	option_mono = TRUE;
-      else if (strcmp ("-1", argv[i]) == 0)
-	option_one_at_a_time = TRUE;
-      else if (strcmp ("-d", argv[i]) == 0
-	       || strcmp ("-display", argv[i]) == 0) {
-	i++;
-	if (dpy == 0) {
-	  dpy = XOpenDisplay(argv[i]);
-#ifdef TCPTRACE
-	  if (dpy == NULL) fatalerror("could not open display");
-#else /* TCPTRACE */
-	  if (dpy == NULL) panic("could not open display");
-#endif /* TCPTRACE */
-	} else {
-	  if (dpy2 == 0) {
-	    dpy2 = XOpenDisplay(argv[i]);
-#ifdef TCPTRACE
-	    if (dpy2 == NULL) fatalerror("could not open display");
-#else /* TCPTRACE */
-	    if (dpy2 == NULL) panic("could not open display");
-#endif /* TCPTRACE */
-	  } else {
-	    panic("too many displays");
-	  }
-	}
-      }
-      else if (strcmp("-d2", argv[i]) == 0) {
-	i++;
-	if (dpy2 == 0) {
-	  dpy2 = XOpenDisplay(argv[i]);
-#ifdef TCPTRACE
-	  if (dpy2 == NULL) fatalerror("could not open display");
-#else /* TCPTRACE */
-	  if (dpy2 == NULL) panic("could not open display");
-#endif /* TCPTRACE */
-	} else {
-	  panic("too many d2's");
-	}
-      }
-      else
-	/* Give the user the benefit of the doubt and assume that
-	   they want a file that starts with '-' */
-	break;
-    }
-	
-	       
-  if (dpy == 0) {
-    dpy = XOpenDisplay("");
-#ifdef TCPTRACE
-	  if (dpy == NULL) fatalerror("could not open display");
-#else /* TCPTRACE */
-	  if (dpy == NULL) panic("could not open display");
-#endif /* TCPTRACE */
+/* Read the n files in names, for showing on dpy. */
+void load_files(char **names, int n, Display *dpy, int tile)
+{
+  struct load_job *jobs;
+  int nthreads = ncpus();
+  int k;
+
+  jobs = (struct load_job *) malloc((n + 1) * sizeof(struct load_job));
+  if (jobs == 0) fatalerror("malloc returned null");
+  for (k = 0; k < n; k++) {
+    jobs[k].name = names[k];
+    jobs[k].numtiles = tile ? n : 0;
+    jobs[k].tileno = tile ? k : 0;
+    jobs[k].nthreads = nthreads > n ? nthreads / n : 1;
+    jobs[k].dpy = dpy;
+    jobs[k].plotters = NULL;
   }
 
-  {
-    int numbase = i;
-    int numwins = argc - i;
-    int k;
+  /* the readers would race to set this up */
+  index_verbs();
 
-    if (i < argc)
-      for (k = i; k < argc; k++) {
-	/*      for (k = argc-1; k>=i; k--) { */
-	FILE *fp = 0;
-	int len;
-	len = strlen(argv[k]);
-	if (strcmp(&argv[k][len-3],".gz") == 0) {
-	  char *command;
-	  command = (char *) malloc(50 + len);
-	  if (command != 0) {
-	    sprintf(command, "zcat %s", argv[k]);
-	    fp = popen(command, "r");
-	    free(command);
-	  }
-	} else {
-	  fp = fopen(argv[k],"r");
-	}
-	if (fp) {
-	  if (option_tile) {
-	    new_plotter(fp, dpy, numwins, k-numbase, 0);
-	  } else {
-	    new_plotter(fp, dpy, 0, 0, 0);
-	  }
-	  fclose(fp);
-	}
-      }
-    else
-      /* 1 window, 0th */
-      new_plotter(stdin, dpy, 1, 0, 0);
+  run_parallel(n, nthreads, load_one, jobs);
 
-    if (dpy2 != 0) {
+  for (k = 0; k < n; k++)
+    link_plotters(jobs[k].plotters);
+  free(jobs);
+}
 
-      if (i < argc)
-	for (k = i; k < argc; k++) {
-	  /*      for (k = argc-1; k>=i; k--) { */
-	  FILE *fp = 0 ;
-	  int len;
-	  len = strlen(argv[k]);
-	  if (strcmp(&argv[k][len-3],".gz") == 0) {
-	    char *command;
-	    command = (char *) malloc(50 + len);
-	    if (command != 0) {
-	      sprintf(command, "zcat %s", argv[k]);
-	      fp = popen(command, "r");
-	      free(command);
-	    }
-	  } else {
-	    fp = fopen(argv[k],"r");
-	  }
-	  if (fp) {
-	    if (option_tile) {
-	      new_plotter(fp, dpy2, numwins, k-numbase, 0);
-	    } else {
-	      new_plotter(fp, dpy2, 0, 0, 0);
-	    }
-	    fclose(fp);
-	  }
-	}
-      else {
-	/* 1 window, 0th */
-	panic("can't do dpy2 with stdin (yet)");
-	new_plotter(stdin, dpy2, 1, 0, 0);
-      }
+void display_plotter(PLOTTER pl)
+{
+  XSetWindowAttributes attr;
+  Window rootwindow;
 
+  if (pl->win != 0) {
+    fprintf(stderr,
+	    "display_plotter called for already-displayed plotter\n");
+    return;
+  }
 
-    }
+  rootwindow = XRootWindowOfScreen(pl->screen);
 
-  }
+  /* set up foreground/background colors */
 
-  if ( ! the_plotter_list )
-    {
-      fprintf(stderr, "NO PLOTTERS\n");
-      goto doexit;
-    }
+  {
+    Colormap default_cmap = DefaultColormap(pl->dpy, DefaultScreen(pl->dpy));
+    char *foreground_color_name;
+    char *background_color_name;
+    XColor exact_return;
+    int i;
 
-  /* Check that we are dealing with the same coordinate types. */
-  if (the_plotter_list)
+    foreground_color_name = XGetDefault(pl->dpy, global_argv[0], "foreground");
+    if (!foreground_color_name) foreground_color_name = "white";
+    i = XAllocNamedColor(pl->dpy, default_cmap, foreground_color_name,
+			 &exact_return, &pl->foreground_color);
+    if (i < 0)
     {
-#define BUTFIRSTPLOTTERS pl = the_plotter_list->next; pl != NULL; pl = pl->next
-      if (x_synch)
-	{
-	  coord_type t = the_plotter_list->x_type;
-	  for (BUTFIRSTPLOTTERS)
-	    if (pl->x_type != t)
-	      panic ("Attempt to synchronize different coordinate types");
-	}
-      if (y_synch)
-	{
-	  coord_type t = the_plotter_list->y_type;
-	  for (BUTFIRSTPLOTTERS)
-	    if (pl->y_type != t)
-	      panic ("Attempt to synchronize different coordinate types");
-	}
+      fprintf(stderr, "XAllocNamedColor failed for %s: %d\n",
+	      foreground_color_name, i);
+      return;
     }
 
-#define ALLPLOTTERS pl = the_plotter_list ; pl != NULL; pl = pl->next
-  for (ALLPLOTTERS) {
-    int virgin = 1;
-    for (c = pl->commands; c != NULL; c = c->next)
-      switch(c->type) {
-      case LINE:
-      case DLINE:
-	if (virgin || ccmp(pl->x_type, c->xb, pl_x_left, <))
-	  pl_x_left = c->xb;
-	if (virgin || ccmp(pl->x_type, c->xb, pl_x_right, >))
-	  pl_x_right = c->xb;
-	if (virgin || ccmp(pl->y_type, c->yb, pl_y_bottom, <))
-	  pl_y_bottom = c->yb;
-	if (virgin || ccmp(pl->y_type, c->yb, pl_y_top, >))
-	  pl_y_top = c->yb;
-	virgin = 0;
-      case X:
-      case DOT:
-      case PLUS:
-      case BOX:
-      case DIAMOND:
-      case UTICK:
-      case DTICK:
-      case LTICK:
-      case RTICK:
-      case HTICK:
-      case VTICK:
-      case UARROW:
-      case DARROW:
-      case LARROW:
-      case RARROW:
-      case INVISIBLE:
-      case TEXT:
-	if (virgin || ccmp(pl->x_type, c->xa, pl_x_left, <))
-	  pl_x_left = c->xa;
-	if (virgin || ccmp(pl->x_type, c->xa, pl_x_right, >))
-	  pl_x_right = c->xa;
-	if (virgin || ccmp(pl->y_type, c->ya, pl_y_bottom, <))
-	  pl_y_bottom = c->ya;
-	if (virgin || ccmp(pl->y_type, c->ya, pl_y_top, >))
-	  pl_y_top = c->ya;
-	virgin = 0;
-      case TITLE:
-      case XLABEL:
-      case YLABEL:
-	break;
-      }
-
-    pl_x_right = bump_coord(pl->x_type, pl_x_right);
-    pl_y_top   = bump_coord(pl->y_type, pl_y_top);
+#if 0
+    ColorNames[0] = strdup(foreground_color_name);
+#else
+    ColorNames[0] = (char *) malloc(strlen(foreground_color_name) + 1);
+    if (ColorNames[0] == NULL) fatalerror("malloc returned null");
+    strcpy(ColorNames[0], foreground_color_name);
+#endif
 
-    pl->viewno += 1;
-    pl_x_left   = pl->x_left[0];
-    pl_x_right  = pl->x_right[0];
-    pl_y_top    = pl->y_top[0];
-    pl_y_bottom = pl->y_bottom[0];
+    background_color_name = XGetDefault(pl->dpy, global_argv[0], "background");
+    if (!background_color_name) background_color_name = "black";
+    i = XAllocNamedColor(pl->dpy, default_cmap, background_color_name,
+			 &exact_return, &pl->background_color);
+    if (i < 0)
+    {
+      fprintf(stderr, "XAllocNamedColor failed for %s: %d\n",
+	      background_color_name, i);
+      return;
+    }
+  }      
+        
+  attr.background_pixel = pl->background_color.pixel;
+  attr.border_pixel     = pl->foreground_color.pixel;
+  attr.event_mask       = ButtonReleaseMask|ButtonPressMask|ExposureMask|
+    EnterWindowMask|LeaveWindowMask|PointerMotionMask|PointerMotionHintMask|
+    StructureNotifyMask|VisibilityChangeMask;
+#if 1
+  attr.cursor           = XCreateFontCursor(pl->dpy, XC_crosshair);
+#else
+  attr.cursor           = XCreateFontCursor(pl->dpy, XC_tcross);
+#endif
+  
+  {
+    XColor blk,wht;
+    
+    blk.red = blk.green = blk.blue = 0;
+    wht.red = wht.green = wht.blue = -1;
+    wht.flags = blk.flags = DoRed|DoGreen|DoBlue;
+    
+    XRecolorCursor(pl->dpy, attr.cursor, &wht, &blk);
   }
+  
+  {
+    char *geom = XGetDefault (pl->dpy, global_argv[0], "geometry");
+    int x = 10, y = 70, borderw = 1;
+    unsigned int width = 400, height = 400;
+    int flags = 0;
+    int i;
 
-  if (x_synch) {
-    int virgin = 1;
-    for (ALLPLOTTERS) {
-      if (virgin || ccmp(pl->x_type, pl_x_left, x_synch_bb_left, <))
-	x_synch_bb_left = pl_x_left;
-      if (virgin || ccmp(pl->x_type, pl_x_right, x_synch_bb_right, >))
-	x_synch_bb_right = pl_x_right;
-      virgin = 0;
+    for (i = 1 ; i < global_argc ; i++) {
+      if (strcmp("-geometry", global_argv[i]) == 0) {
+	if (i+1 < global_argc) {
+	  geom = global_argv[i+1];
+	  break;
+	} else {
+	  static int virgin = 1;
+	  if (virgin) {
+	    fprintf(stderr, "-geometry on command line without any following argument\n");
+	    virgin = 0;
+	  }
+	}
+      }
     }
-    for (ALLPLOTTERS) {
-      pl_x_left = x_synch_bb_left;
-      pl_x_right = x_synch_bb_right;
+    if (geom)
+     {
+	flags = XParseGeometry (geom, &x, &y, &width, &height);
+	if (flags & XValue)
+	  {
+	    if (flags & XNegative)
+	      x += DisplayWidth (pl->dpy, ScreenNumberOfScreen(pl->screen))
+		- width - borderw*2;
+	    else
+	      x += borderw;
+	  }
+	if (flags & YValue)
+	  {
+	    if (flags & YNegative)
+	      y += DisplayHeight (pl->dpy, ScreenNumberOfScreen(pl->screen))
+		- height - borderw*2;
+	    else
+	      y += borderw;
+	  }
+      }
+    
+    if (pl->numtiles > 0) {
+      /* Now we have geometry in x, y, height, width for total xplot area */
+      y += (height * pl->tileno) / pl->numtiles;
+      height = height / pl->numtiles;
+      /* we have now selected the nth 1/numtiles chunk */
     }
-  }
 
-  if (y_synch) {
-    int virgin = 1;
-    for (ALLPLOTTERS) {
-      if (virgin || ccmp(pl->y_type, pl_y_bottom, y_synch_bb_bottom, <))
-	y_synch_bb_bottom = pl_y_bottom;
-      if (virgin || ccmp(pl->y_type, pl_y_top, y_synch_bb_top, >))
-	y_synch_bb_top = pl_y_top;
-      virgin = 0;
-    }
-    for (ALLPLOTTERS) {
-      pl_y_top = y_synch_bb_top;
-      pl_y_bottom = y_synch_bb_bottom;
-    }
+    pl->win = XCreateWindow(pl->dpy, rootwindow, x, y, width, height, borderw,
+			    DefaultDepth(pl->dpy, ScreenNumberOfScreen(pl->screen)),
+			    CopyFromParent, CopyFromParent,
+			    CWBackPixel|CWBorderPixel|CWEventMask|CWCursor,
+			    &attr);
+    
+    pl->xsh.flags = 0;
+    if (flags & (WidthValue | HeightValue))
+      pl->xsh.flags |= USSize;
+    else
+      pl->xsh.flags |= PSize;
+    if (flags & (XValue | YValue))
+      pl->xsh.flags |= USPosition;
+    else
+      pl->xsh.flags |= PPosition;
+    
+    pl->xsh.width = width;
+    pl->xsh.height = height;
+    pl->xsh.x = x;
+    pl->xsh.y = y;
+    XSetStandardProperties(pl->dpy, pl->win, "xplot", "xplot", None,
+			   global_argv, global_argc, &pl->xsh);
   }
-
-  for (ALLPLOTTERS) {
-    if (option_one_at_a_time == FALSE
-	|| pl->next == 0
-	) {
-      display_plotter(pl);
-    }
+  
+  XMapRaised(pl->dpy, pl->win);
+  
+  pl->visibility = VisibilityFullyObscured; /* initially true */
+  {
+    char *use_font = XGetDefault (pl->dpy, global_argv[0], "font");
+    pl->font_struct = XLoadQueryFont(pl->dpy, use_font ? use_font : "fixed");
   }
-    
-  do {
-    int SAVx, SAVy, SAVc, SAVd;
-    lXPoint a,b;
-    if (XPending(dpy) == 0
-	&& (dpy2 == 0 || XPending(dpy2) == 0)
-	) {
-      int visible_count = 0;
-      for (ALLPLOTTERS) {
+  
+  pl->gcv.foreground = pl->foreground_color.pixel;
+  pl->gcv.background = pl->background_color.pixel;
+  pl->gcv.font = pl->font_struct->fid;
+  pl->gcv.line_width = 0;
+  pl->gcv.cap_style = CapProjecting;
+  if (pl->thick) {
+    pl->gcv.line_width = 3;
+    pl->gcv.cap_style = CapRound;
+  }
+  
+  {
+#define N_DPY_S 2
 
-	/* if option_one_at_a_time, ensure that at least last plotter
-	   on list is visible if no others are */ 
-	if (visible_count == 0
-	    && pl->next == 0
-	    && pl->win == 0
-	    && option_one_at_a_time
-	    ) 
-	  display_plotter(pl);
+    static struct dpy_info {
+      unsigned long line_plane_mask;
+      Colormap clr_map;
+      int depth;
+      XColor clr;
+      unsigned long pixel[NCOLORS];
+      int Colors[NCOLORS];
+      int virgin;
+      int warned_color_alloc_failed;
+      Atom xplot_nagle_atom;
+      Display *saved_dpy;
+    } d_i[N_DPY_S];
 
-	/* if plotter is not yet displayed, do nothing */
-	if (pl->win == 0) continue;
+    int i;
+    int d;
+    
+    for (d = 0; d < N_DPY_S; d++) {
+      if (pl->dpy == d_i[d].saved_dpy)
+	break;
+      if (d_i[d].saved_dpy == 0) {
+	d_i[d].saved_dpy = pl->dpy;
+	d_i[d].virgin = 1;
+	break;
+      }
+    }
+    if (d >= N_DPY_S) {
+      fprintf(stderr, "%s:%d:%s: bug -- pl->dpy != saved_dpy\n",
+	      __FILE__, __LINE__, __FUNCTION__);
+      panic("bug");
+    }
 
-	visible_count++;
-	
-	if (pl->size_changed) {
-	  int i;
-	  XRectangle xr[1];
+    /* Allocate some color cells */
+      
+    if (d_i[d].virgin ) {
+      int ci;
 
-	  pl->size_changed = 0;
-	  pl->clean = 0;
-	  size_window(pl);
-	  XClearWindow(pl->dpy, pl->win);
-	  pl->pointer_marks_on_screen = FALSE;
+      d_i[d].virgin = 0;
+      
+      d_i[d].xplot_nagle_atom = XInternAtom(pl->dpy, "XPLOT_NAGLE", False);
 
-	  xr[0].x = pl->origin.x;
-	  xr[0].y = pl->origin.y - 2;
-	  xr[0].width = pl->size.x + 2;
-	  xr[0].height = pl->size.y + 2;
+      d_i[d].clr_map = DefaultColormap(pl->dpy, DefaultScreen(pl->dpy));
+      
+      d_i[d].depth = DisplayPlanes(pl->dpy, DefaultScreen(pl->dpy));
 
-	  for (i = 0; i < NColors; i++)
-	    XSetClipRectangles(pl->dpy, pl->gcs[i], 0, 0, xr, 1, YXBanded);
+      ci = 0;
 
-	}
-	if (pl->new_expose) {
-	  pl->clean = 0;
-	  for (c = pl->commands; c != NULL; c = c->next) {
-	    if (c->mapped)
-	      c->needs_redraw = TRUE;
+      /* if display/screen has only 1 bit of depth, don't try to
+       * allocate any colors - just use BlackPixel and WhitePixel
+       */
+      if ( ! option_mono && d_i[d].depth > 1
+	   && XAllocColorCells(pl->dpy, 
+			       d_i[d].clr_map, 0,
+			       &d_i[d].line_plane_mask, 1,
+			       d_i[d].pixel, NColors)
+	   )
+	{
+	  for ( ; ci < NColors; ci++)  {
+	    XParseColor(pl->dpy, d_i[d].clr_map, ColorNames[ci], &d_i[d].clr);
+	    d_i[d].clr.pixel = d_i[d].pixel[ci];
+	    XStoreColor (pl->dpy, d_i[d].clr_map, &d_i[d].clr);
+	    d_i[d].clr.pixel |= d_i[d].line_plane_mask;
+	    XStoreColor (pl->dpy, d_i[d].clr_map, &d_i[d].clr);
+	    d_i[d].Colors[ci] = d_i[d].clr.pixel;
 	  }
-	  pl->new_expose = 0;
-	}
-	if (pl->visibility != VisibilityFullyObscured && pl->clean == 0) {
-	  SAVx = -100000; SAVy = -100000; SAVc = SAVd = 0;
-	  for (c = pl->commands; c != NULL; c = c->next)
-	    if (c->mapped)
-	      if (c->needs_redraw) {
-		GC gc;
-		dXPoint da,db;
-		c->needs_redraw = FALSE;
-		if (c->decoration
-		    || c->type == TITLE
-		    || c->type == XLABEL
-		    || c->type == YLABEL)
-		  gc = pl->decgc;
-		else
-		  if ( c->color >= 0 && c->color < NColors)
-		    gc = pl->gcs[c->color];
-		  else
-		    gc = pl->gcs[0];
 
-#ifndef WINDOW_COORDS_IN_COMMAND_STRUCT
-		da.x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
-				 c->xa);
-		da.y = (pl->size.y - 1) -
-		  map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
-			    c->ya);
-
-		db.x = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
-				 c->xb);
-		db.y = (pl->size.y - 1) -
-		  map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
-			    c->yb);
+	} else if (! option_mono && d_i[d].depth > 1 ) {
+	  /* some visual types (e.g. TrueColor) do not support XAllocColorCells */
 
-		da = tomain(pl,da);
-		db = tomain(pl,db);
-#else
-		da.x = c->a.x;
-		da.y = c->a.y;
-		db.x = c->b.x;
-		db.y = c->b.y;
-#endif
-		{
-#if 1 /* Xqdss has bugs, so we need to clamp at just a few thousand */
-#define CLAMP 3000.0
-#else
-#define CLAMP 10000.0
-#endif
-		  if (da.x >  CLAMP) {
-		    if (db.x-da.x != 0)
-		      da.y -= (db.y-da.y)*(da.x-CLAMP)/(db.x-da.x);
-		    da.x =  CLAMP;}
-		  if (da.x < -CLAMP) {
-		    if (db.x-da.x != 0)
-		      da.y -= (db.y-da.y)*(da.x+CLAMP)/(db.x-da.x);
-		    da.x = -CLAMP;}
-		  if (da.y >  CLAMP) {
-		    if (db.y-da.y != 0)
-		      da.x -= (db.x-da.x)*(da.y-CLAMP)/(db.y-da.y);
-		    da.y =  CLAMP;}
-		  if (da.y < -CLAMP) {
-		    if (db.y-da.y != 0)
-		      da.x -= (db.x-da.x)*(da.y+CLAMP)/(db.y-da.y);
-		    da.y = -CLAMP;}
+	  for ( ; ci < NColors; ci++) {
+	    XColor exact_return;
 
-		  if (db.x >  CLAMP) {
-		    if (da.x-db.x != 0)
-		      db.y -= (da.y-db.y)*(db.x-CLAMP)/(da.x-db.x);
-		    db.x =  CLAMP;}
-		  if (db.x < -CLAMP) {
-		    if (da.x-db.x != 0)
-		      db.y -= (da.y-db.y)*(db.x+CLAMP)/(da.x-db.x);
-		    db.x = -CLAMP;}
-		  if (db.y >  CLAMP) {
-		    if (da.y-db.y != 0)
-		      db.x -= (da.x-db.x)*(db.y-CLAMP)/(da.y-db.y);
-		    db.y =  CLAMP;}
-		  if (db.y < -CLAMP) {
-		    if (da.y-db.y != 0)
-		      db.x -= (da.x-db.x)*(db.y+CLAMP)/(da.y-db.y);
-		    db.y = -CLAMP;}
+	    i = XAllocNamedColor(pl->dpy, d_i[d].clr_map, ColorNames[ci],
+				 &exact_return, &d_i[d].clr);
+	    if ( i < 0 )
+	      {
+		fprintf(stderr, "XAllocNamedColor failed for %s: %d\n",
+			ColorNames[ci], i);
+		break;
+	      }
+
+	    /* Here, we should check if the color is close enough. */
+	    d_i[d].Colors[ci] = d_i[d].clr.pixel;
 
-		  a.x = (int) rint(da.x);
-		  a.y = (int) rint(da.y);
-		  b.x = (int) rint(db.x);
-		  b.y = (int) rint(db.y);
-		}
-		
-		switch (c->type) {
-		case DLINE:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y-2, a.x, a.y+2);
-		  XDrawLine(pl->dpy, pl->win, gc, a.x-2, a.y, a.x+2, a.y);
-		  XDrawLine(pl->dpy, pl->win, gc, b.x, b.y-2, b.x, b.y+2);
-		  XDrawLine(pl->dpy, pl->win, gc, b.x-2, b.y, b.x+2, b.y);
-		  /*fall through*/
-		case LINE:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y, b.x, b.y);
-		  break;
-		case X:
-		  XDrawLine(pl->dpy, pl->win, gc,
-			    a.x - 2, a.y - 2, a.x + 2, a.y + 2);
-		  XDrawLine(pl->dpy, pl->win, gc,
-			    a.x - 2, a.y + 2, a.x + 2, a.y - 2);
-		  break;
-		case DOT:
-		  /* Lines are much faster on some displays */
-		  if ( SAVx == a.x && SAVy == a.y )
-		    {
-		      SAVc++;
-		    }
-		  else
-		    {
-		      SAVd++;
-		      SAVx = a.x; SAVy = a.y;
 #if 0
-		      /*    
-		            ***
-			   *****
-                           *****
-                           *****
-                            ***
-		       */
+	    /***** and on any failure, you should break out of this
+	      loop leaving ci pointing at the first color (perhaps
+	      zero) of the first color you've failed to allocate. */
 
-		      XDrawLine(pl->dpy, pl->win, gc,a.x-1,a.y-2, a.x+1,a.y-2);
-		      XDrawLine(pl->dpy, pl->win, gc,a.x-2,a.y-1, a.x+2,a.y-1);
-		      XDrawLine(pl->dpy, pl->win, gc,a.x-2,a.y  , a.x+2,a.y  );
-		      XDrawLine(pl->dpy, pl->win, gc,a.x-2,a.y+1, a.x+2,a.y+1);
-		      XDrawLine(pl->dpy, pl->win, gc,a.x-1,a.y+2, a.x+1,a.y+2);
-#else
-#if 1
-		      /*
-			     *
-			    ***
-			     *
-		       */
+	    /***** need to take care that this does the correct thing
+	      on one-bit-plane displays.    There are two ways that this might occur:
+	    
+	      1. All pixel values obtained in this loop on a
+	      one-bit-plane display are the same as WhitePixelOfScreen()
 
+	      or
+	      
+	      2. On a one-bitplane display we break out of this loop
+	      and leave the loop below to fill in WhitePixelOfScreen()
+	      for each plot color.
+	      */
+#endif
+	  }
+	}
+      for ( ; ci < NColors; ci++) {
 
-		      XDrawLine(pl->dpy, pl->win, gc, a.x, a.y-1, a.x, a.y+1);
-		      XDrawLine(pl->dpy, pl->win, gc, a.x-1, a.y, a.x+1, a.y);
-#else
-		      /*
-			     *                           
-		       */
+	/* probably only one bit plane, or all the color cells are taken
+	   (or option_mono)*/
 
-		      XDrawPoint(pl->dpy, pl->win, gc, a.x, a.y);
-#endif		      
+	if (!d_i[d].warned_color_alloc_failed && !option_mono) {
+	  fputs("unable to get all desired colors, will substitute white for some or all colors\n",
+		stderr);
+	  d_i[d].warned_color_alloc_failed = 1;
+	}
+	d_i[d].Colors[ci] = WhitePixelOfScreen(pl->screen);
+      }
+    }
+    
+    for (i = 0; i < NColors; i++) {
+
+      pl->gcs[i] = XCreateGC(pl->dpy, pl->win,
+			     GCForeground|GCFont|GCLineWidth|GCCapStyle,
+			     &(pl->gcv));
+    
+      XSetForeground(pl->dpy, pl->gcs[i], d_i[d].Colors[i]);
+
+    }
+
+    pl->xplot_nagle_atom = d_i[d].xplot_nagle_atom;
+#if 0
+    printf("DEBUG: nagle_atom is %ld\n", pl->xplot_nagle_atom);
 #endif
-		    }
-		  break;
-		case PLUS:
-		  XDrawLine(pl->dpy, pl->win, gc,
-			    a.x, a.y - 2, a.x, a.y + 2);
-		  XDrawLine(pl->dpy, pl->win, gc,
-			    a.x - 2, a.y, a.x + 2, a.y);
-		  break;
-		case BOX:
-		  { XSegment segs[4];
-		    int x,y;
-		    const int BOXRADIUS=3;
+  }
 
-		    /* use XDrawSegments so that things can
-		       still be collected into one big PolySegment by xlib
-		       
-		       --0-|
-		       |   |
-		       3   1
-		       |   |
-		       |-2--  */
 
-		    x = a.x;
-		    segs[0].x1 = segs[3].x1 = segs[3].x2 = x-BOXRADIUS;
-		    segs[2].x2 = x-(BOXRADIUS-1);
-		    segs[0].x2 = x+(BOXRADIUS-1);
-		    segs[1].x1 = segs[1].x2 = segs[2].x1 = x+BOXRADIUS;
+  pl->decgc = XCreateGC(pl->dpy, pl->win,
+			GCForeground|GCFont|GCLineWidth|GCCapStyle,
+			&(pl->gcv));
+  
+  pl->gcv.foreground ^= pl->gcv.background;
+  pl->gcv.function = GXxor;
+  
+  pl->xorgc = XCreateGC(pl->dpy, pl->win,
+			GCForeground|GCFunction|GCFont|GCLineWidth|GCCapStyle,
+			&(pl->gcv));
+  
+  pl->gcv.foreground = pl->gcv.background;
 
-		    y = a.y;
-		    segs[0].y1 = segs[0].y2 = segs[1].y1 = y-BOXRADIUS;
-		    segs[3].y2 = y-(BOXRADIUS-1);
-		    segs[1].y2 = y+(BOXRADIUS-1);
-		    segs[2].y1 = segs[2].y2 = segs[3].y1 = y+BOXRADIUS;
-		    
-		    XDrawSegments(pl->dpy, pl->win, gc, segs, 4);
-		  }
-		  break;
-		case DIAMOND:
-		  { XSegment segs[4];
-		    int x,y;
-		    /*
-		          /
-		         1 \
-		        /   2
-		       \     \
-		        0   / 
-		         \ 3
-			  /
-			 
-			  */
-		    x = a.x;
-		    y = a.y;
-		    segs[0].x1 = x-1; segs[0].y1 = y+2;
-		    segs[0].x2 = x-3; segs[0].y2 = y;
-		    segs[1].x1 = x-2; segs[1].y1 = y-1;
-		    segs[1].x2 = x;   segs[1].y2 = y-3;
-		    segs[2].x1 = x+1; segs[2].y1 = y-2;
-		    segs[2].x2 = x+3; segs[2].y2 = y;
-		    segs[3].x1 = x+2; segs[3].y1 = y+1;
-		    segs[3].x2 = x;   segs[3].y2 = y+3;
-		    
-		    XDrawSegments(pl->dpy, pl->win, gc, segs, 4);
-		  }
-		  break;
-#define D (pl->thick? 6: 3)
-		case UTICK:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y, a.x, a.y-D);
-		  break;
-		case DTICK:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y, a.x, a.y+D);
-		  break;
-		case RTICK:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y, a.x+D, a.y);
-		  break;
-		case LTICK:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y, a.x-D, a.y);
-		  break;
-		case HTICK:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x-D, a.y, a.x+D, a.y);
-		  break;
-		case VTICK:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x, a.y-D, a.x, a.y+D);
-		  break;
-#undef D
-#define D (pl->thick? 4: 2)
-		case UARROW:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x - D, a.y + D, a.x, a.y);
-		  XDrawLine(pl->dpy, pl->win, gc, a.x + D, a.y + D, a.x, a.y);
-		  break;
-		case DARROW:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x - D, a.y - D, a.x, a.y);
-		  XDrawLine(pl->dpy, pl->win, gc, a.x + D, a.y - D, a.x, a.y);
-		  break;
-		case RARROW:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x - D, a.y - D, a.x, a.y);
-		  XDrawLine(pl->dpy, pl->win, gc, a.x - D, a.y + D, a.x, a.y);
-		  break;
-		case LARROW:
-		  XDrawLine(pl->dpy, pl->win, gc, a.x + D, a.y - D, a.x, a.y);
-		  XDrawLine(pl->dpy, pl->win, gc, a.x + D, a.y + D, a.x, a.y);
-#undef D
-		  break;
-		case TEXT:
-		case TITLE:
-		case XLABEL:
-		case YLABEL:
-		  { 
-		    lXPoint p;
-		    int direction;
-		    int font_ascent;
-		    int font_descent;
-		    XCharStruct xcs;
-		    /* int height; */
-		    int width;
-		    int space = 5;
+  /* just like dec gc but draws in background color */
+  pl->bacgc = XCreateGC(pl->dpy, pl->win,
+			GCForeground|GCFont|GCLineWidth|GCCapStyle,
+			&(pl->gcv));
 
-		    if (c->type == TITLE) {
-		      p.x = (int) rint(pl->size.x / 2);
-		      p.y = 0;
-		      p = lXPoint_from_dXPoint(tomain(pl,
-						      dXPoint_from_lXPoint(p)
-						      ));
-		      c->position = ABOVE;
-		    } else if (c->type == XLABEL) {
-		      p.x = (int) pl->size.x;
-		      p.y = (int) pl->size.y + 22;
-		      p = lXPoint_from_dXPoint(tomain(pl,
-						      dXPoint_from_lXPoint(p)
-						      ));
-		      c->position = TO_THE_LEFT;
-		    } else if (c->type == YLABEL) {
-		      p.x = 0;
-		      p.y = -5;
-		      p = lXPoint_from_dXPoint(tomain(pl,
-						      dXPoint_from_lXPoint(p)
-						      ));
-		      c->position = ABOVE;
-		    } else
-		      p = a;
+}
 
-		    XTextExtents(pl->font_struct, c->text, strlen(c->text),
-				 &direction, &font_ascent, &font_descent, &xcs);
-		    width = xcs.width;
-		    /* height = font_ascent + font_descent; */
-		    switch (c->position) {
-		    case CENTERED:
-		    case ABOVE:
-		    case BELOW:        p.x -= width/2;       break;
-		    case TO_THE_LEFT:  p.x -= width + space; break;
-		    case TO_THE_RIGHT: p.x += space;         break;
-		    default: panic("drawloop, case TEXT: unknown text positioning");
-		    }
-		    switch (c->position) {
-		    case CENTERED:
-		    case TO_THE_LEFT:
-		    case TO_THE_RIGHT: p.y += font_ascent/2;        break;
-		    case ABOVE:        p.y -= space + font_descent; break;
-		    case BELOW:        p.y += space + font_ascent;  break;
-		    default: panic("drawloop, case TEXT: unknown text positioning");
-		    }
+void free_raster(struct plotter *pl);
+void free_text_masks(struct plotter *pl);
+uint32_t raster_gc(struct plotter *pl, int g);
 
-		    XDrawString(pl->dpy, pl->win, gc, p.x, p.y,
-				c->text, strlen(c->text));
-		  }
-		  break;
-		default:
-		  panic("unknown command type");
-		}
-		/* if something has happened, stop drawing and go handle it */
-		if (pl->state != NORMAL) XSync(pl->dpy,False);
-		if (XEventsQueued(dpy, QueuedAlready) != 0) break;
-		if (dpy2 != 0 &&
-		    XEventsQueued(dpy2, QueuedAlready) != 0) break;
-	      }
-	  if (c == NULL) pl->clean = 1;
-/* #define SAVE_PRINTOUTS */
-#ifdef SAVE_PRINTOUTS
-	  fprintf(stderr, "saved %d/%d %f%%\n",
-		  SAVc, SAVc+SAVd, SAVc*100.0/(SAVc+SAVd) );
-#endif
+int undisplay_plotter(PLOTTER pl, int direction)
+{
+  int i;
+  PLOTTER pll;
+  
+  if (direction == 1) {
+    pll = pl->next;
+    if (pll == 0) {
+      pll = the_plotter_list;
+    }
+  } else if (direction == -1) {
+    pll = the_plotter_list; 
+    if (pl != the_plotter_list) {
+      while (pll) {
+	if (pll->next == pl) {
+	  break;
 	}
+	pll = pll->next;
       }
-      if (visible_count == 0) break; /* will exit */
+    } else {
+      /* go to last plotter on list */
+      while (pll->next)
+	pll = pll->next;
     }
+  } else {
+    pll = 0;
+  }
 
-    do {
-      if (XPending(dpy) != 0) {
-	XNextEvent(dpy, &event);	
-	dpy_of_event = dpy;
-	break;
-      } else if (dpy2 != 0 && XPending(dpy2) != 0) {
-	XNextEvent(dpy2, &event);
-	dpy_of_event = dpy2;
-	break;
-      } else {
-	fd_set fds;
-	int maxfd_plus_1 = 0;
-	int r;
+  /* if previous (next) plotter on list doesn't have a window yet
+     give it our window, GCs, and font_struct and set up all the
+     other stuff that display_plotter() would set up . */ 
 
-	FD_ZERO(&fds);
-	FD_SET(ConnectionNumber(dpy), &fds);
-	maxfd_plus_1 = ConnectionNumber(dpy) + 1;
-	if (dpy2 != 0) {
-	  FD_SET(ConnectionNumber(dpy2), &fds);
-	  maxfd_plus_1 = max(maxfd_plus_1, ConnectionNumber(dpy2)+1);
-	}
-	r = select (maxfd_plus_1, &fds, 0, 0, 0);
-	if (r < 0) {
-	  perror("select");
-	  exit(1);
-	}
-      }
-    } while(1);
+  if (pl->pixmap != None) {
+    XFreePixmap(pl->dpy, pl->pixmap);
+    pl->pixmap = None;
+  }
+  free_raster(pl);
+  free_text_masks(pl);
 
-    for (ALLPLOTTERS)
-      if (pl->dpy == dpy_of_event
-	  && pl->win == event.xany.window)
-	break;
-    if (pl == 0)
-      continue; /* this happens when windows get deleted */
+  if (pll && pll->win == 0) {
+    pll->win = pl->win;
+    for (i = 0; i < NColors; i++)
+      pll->gcs[i] = pl->gcs[i];
+    pll->decgc = pl->decgc;
+    pll->xorgc = pl->xorgc;
+    pll->font_struct = pl->font_struct;
+
+    pll->xplot_nagle_atom = pl->xplot_nagle_atom;
+
+    pll->xsh = pl->xsh;  /* unnecessary? */
+
+    pll->visibility = pl->visibility;
+
+    pll->gcv = pl->gcv; /* unnecessary? */
+
+    pll->mainsize = pl->mainsize;
+
+    pll->size_changed = 1; /* will trigger clearing and redisplay */
 
+    /* take window away from this plotter */
+    pl->win = 0;
+    
+    return 1;
+  } else {
+    XDestroyWindow(pl->dpy, pl->win);
+    for (i = 0; i < NColors; i++)
+      XFreeGC(pl->dpy, pl->gcs[i]);
+    XFreeGC(pl->dpy, pl->decgc);
+    XFreeGC(pl->dpy, pl->xorgc);
+    XFreeFont(pl->dpy, pl->font_struct);
+    pl->win = 0;
+    return 0;
+  }
+    
 #if 0
-    fprintf(stderr,"event %d\n", event.type);
+  if (pl->data->indexer == pl)
+    pl->data->indexer = NULL;
+  drop_dataset(pl->data);
+  arena_free(&pl->decoration_arena);
+  free(pl);
 #endif
-    switch(event.type) {
-    case Expose:
-      pl->new_expose = 1;
-      if (pl->pointer_marks_on_screen) {
-	draw_pointer_marks(pl, pl->bacgc);
-	pl->pointer_marks_on_screen = FALSE;
-      }
-      continue;
-    case VisibilityNotify:
-      pl->visibility = event.xvisibility.state;
-      break;
-    case ConfigureNotify:
-      /* see if the window has changed size */
-      if (pl->mainsize.x != event.xconfigure.width ||
-	  pl->mainsize.y != event.xconfigure.height)
-	{
-	  pl->mainsize.x = event.xconfigure.width;
-	  pl->mainsize.y = event.xconfigure.height;
-
-	  pl->size_changed = 1;
-	}
-      break;
-    case MapNotify:
-      if (pl->mainsize.x == 0 && pl->mainsize.y == 0) {
-	pl->mainsize.x = pl->xsh.width;
-	pl->mainsize.y = pl->xsh.height;
-	pl->size_changed = 1;
-      }
-      break;
-    case ButtonPress:
-      if (pl->pointer_marks_on_screen) {
-	draw_pointer_marks(pl, pl->xorgc);
-	pl->pointer_marks_on_screen = FALSE;
-      }
-      if (x_synch && y_synch) {
-	PLOTTER savepl = pl;
-	
-	for (ALLPLOTTERS) {
-	  if (pl == savepl) continue;
-	  if (pl->pointer_marks_on_screen) {
-	    draw_pointer_marks(pl, pl->xorgc);
-	    pl->pointer_marks_on_screen = FALSE;
-	  }
-	}
-	pl = savepl;
-      }
-      pl->buttonsdown += 1;
+  
+}
 
-#ifdef TCPTRACE
-      show_dist = 0;
-#endif /* TCPTRACE */
+/*
+ * With -pixmap a plotter draws off-screen and exposes are an XCopyArea.
+ */
+#define plot_drawable(pl) ((pl)->pixmap != None ? (pl)->pixmap : (pl)->win)
 
-      switch (pl->state) {
-      case NORMAL:
-	switch(event.xbutton.button) {
-	case Button1:
-	  if (event.xbutton.state & ShiftMask)
-	    pl->state = PRINTING;
-	  else
-	    if (event.xbutton.y > pl->size.y + pl->origin.y)
-	      pl->state = HZOOM;
-	    else if (event.xbutton.x < pl->origin.x)
-	      pl->state = VZOOM;
-	    else
-	      pl->state = ZOOM;
-	  break;
-	case Button2:
-	  if (event.xbutton.state & ShiftMask)
-	    pl->state = FIGING;
-#ifdef TCPTRACE
-	  else if (event.xbutton.state & ControlMask)
-	  {
-	      show_dist = 1;
-	      if (event.xbutton.y > pl->size.y + pl->origin.y)
-		  pl->state = HDRAG;
-	      else if (event.xbutton.x < pl->origin.x)
-		  pl->state = VDRAG;
-	      else
-		  pl->state = DRAG;
-	  }
-#endif /* TCPTRACE */
-	  else
-	    if (event.xbutton.y > pl->size.y + pl->origin.y)
-	      pl->state = HDRAG;
-	    else if (event.xbutton.x < pl->origin.x)
-	      pl->state = VDRAG;
-	    else
-	      pl->state = DRAG;
-	  break;
-	case Button3:
-	  if (event.xbutton.state & ControlMask) {
-	    pl->state = EXITING;
-	  } else {
-	    if (option_one_at_a_time) {
-	      if (event.xbutton.state & ShiftMask) {
-		pl->state = BACKINGUP;
-	      } else {
-		pl->state = ADVANCING;
-	      }
-	    } else {
-	      if (event.xbutton.state & ShiftMask) {
-		pl->state = THINFIGING;
-	      } else {
-		pl->state = EXITING;
-	      }
-	    }
-	  }
-	  break;
-	 default:
-	  pl->state = WEDGED;
-	}
+/* Send the queued lines. */
+void flush_batch(struct plotter *pl)
+{
+  struct batch *bt = &pl->batch;
+  int g = bt->g;
 
-	/***** should draw rectangle for HZOOM & VZOOM
-	  For HZOOM, should setup dragend.y with opposite end of
-	  desired rectangle and leave it be during the rest of the
-	  HZOOM operation.  (same for VZOOM) 
+  if (bt->n == 0)
+    return;
+  if (pl->raster != NULL)
+    raster_segments(pl->raster, (struct raster_segment *) bt->segs, bt->n,
+		    raster_gc(pl, g));
+  else
+    XDrawSegments(pl->dpy, plot_drawable(pl),
+		  g == DECORATION_BATCH ? pl->decgc : pl->gcs[g],
+		  bt->segs, bt->n);
+  bt->n = 0;
+}
 
-	  should rethink HDRAG and VDRAG visual feedback
-	  (maybe use filled solid rectangles drawn in xor mode?)
+/* Queue a line to be drawn with GC g (see DECORATION_BATCH). */
+void add_segment(struct plotter *pl, int g, int x1, int y1, int x2, int y2)
+{
+  struct batch *bt = &pl->batch;
+  XSegment *s;
+
+  if (bt->segs == NULL) {
+    if (pl->maxsegs == 0) {
+      /* a PolySegment request is 3 words plus 2 per segment */
+      pl->maxsegs = (XMaxRequestSize(pl->dpy) - 3) / 2;
+      if (pl->maxsegs > 65536)
+	pl->maxsegs = 65536;
+    }
+    bt->segs = (XSegment *) malloc(pl->maxsegs * sizeof(XSegment));
+    if (bt->segs == 0) fatalerror("malloc returned null");
+  }
+  if (bt->n == pl->maxsegs || (bt->n > 0 && bt->g != g))
+    flush_batch(pl);
+
+  bt->g = g;
+  s = &bt->segs[bt->n++];
+  s->x1 = x1;
+  s->y1 = y1;
+  s->x2 = x2;
+  s->y2 = y2;
+}
 
-	  */
+void draw_pointer_marks(PLOTTER pl, GC gc);
 
+/*
+ * With -raster, lines and markers are drawn client-side (raster.c) and
+ * sent as one image, through MIT-SHM when the server has it.
+ */
+void free_raster(struct plotter *pl)
+{
+  if (pl->image != NULL) {
+#ifdef HAVE_LIBXEXT
+    if (pl->shm) {
+      XShmDetach(pl->dpy, &pl->shminfo);
+      XSync(pl->dpy, False);
+      shmdt(pl->shminfo.shmaddr);
+    }
+#endif
+    pl->image->data = NULL;	/* it belongs to the raster, or the segment */
+    XDestroyImage(pl->image);
+    pl->image = NULL;
+  }
+  raster_free(pl->raster);
+  pl->raster = NULL;
+  pl->shm = FALSE;
+}
 
-	pl->raw_dragstart.x = event.xbutton.x;
-	pl->raw_dragstart.y = event.xbutton.y;
+#ifdef HAVE_LIBXEXT
+static int shm_attach_failed;
 
-	pl->dragstart = pl->raw_dragstart;
-	switch(pl->state) {
-	case HZOOM:
-	  pl->dragstart.y = pl->origin.y;
-	  break;
-	case VZOOM:
-	  pl->dragstart.x = pl->origin.x;
-	  break;
-	default:
-	  break;
-	}
-	pl->dragstart = detent(pl, pl->dragstart);
-	switch (pl->state) {
-	case HDRAG:
-	  pl->dragstart.y = pl->origin.y + pl->size.y - 1;
-	  break;
-	case VDRAG:
-	  pl->dragstart.x = pl->origin.x;
-	  break;
-	default:
-	  break;
-	}
-	if (XQueryPointer(pl->dpy, pl->win, &dummy_window, &dummy_window,
-			  &dummy_int, &dummy_int,
-			  &(pl->pointer.x), &(pl->pointer.y),
-			  &dummy_unsigned_int)
-	    == 0) {
-	  pl->state = WEDGED;
-	  break;
-	}
-	pl->pointer_marks = detent(pl, pl->pointer);
+static int shm_attach_error(Display *dpy, XErrorEvent *e)
+{
+  shm_attach_failed = TRUE;
+  return 0;
+}
 
-	pl->dragend = detent(pl, pl->pointer);
-	switch(pl->state) {
-	case HZOOM:
-	  pl->dragend.y = pl->origin.y + pl->size.y;
-	  break;
-	case VZOOM:
-	  pl->dragend.x = pl->origin.x + pl->size.x;
-	  break;
-	default:
-	  break;
+/*
+ * Wait for the answer to an attach, which a remote server turns down,
+ * rather than die of the error.  Returns FALSE if it was no.
+ */
+static int shm_attach(Display *dpy, XShmSegmentInfo *shminfo)
+{
+  int (*handler)(Display *, XErrorEvent *);
+
+  XSync(dpy, False);
+  shm_attach_failed = FALSE;
+  handler = XSetErrorHandler(shm_attach_error);
+  if (!XShmAttach(dpy, shminfo))
+    shm_attach_failed = TRUE;
+  XSync(dpy, False);
+  XSetErrorHandler(handler);
+  return !shm_attach_failed;
+}
+#endif
+
+/* Make sure the plotter's raster is the size of its window, and clear it.
+   Returns FALSE if this screen can't take our pixels. */
+int make_raster(struct plotter *pl)
+{
+  int width = (int) pl->mainsize.x;
+  int height = (int) pl->mainsize.y;
+  int scr = ScreenNumberOfScreen(pl->screen);
+  Visual *visual = DefaultVisual(pl->dpy, scr);
+  int depth = DefaultDepth(pl->dpy, scr);
+
+  if (pl->raster != NULL
+      && (pl->raster->width != width || pl->raster->height != height))
+    free_raster(pl);
+
+  if (pl->raster == NULL) {
+#ifdef HAVE_LIBXEXT
+    if (XShmQueryExtension(pl->dpy)) {
+      pl->image = XShmCreateImage(pl->dpy, visual, depth, ZPixmap, NULL,
+				  &pl->shminfo, width, height);
+      if (pl->image != NULL && pl->image->bits_per_pixel == 32
+	  && pl->image->bytes_per_line == 4 * width) {
+	pl->shminfo.shmid = shmget(IPC_PRIVATE,
+				   pl->image->bytes_per_line * height + 4,
+				   IPC_CREAT | 0600);
+	if (pl->shminfo.shmid >= 0) {
+	  pl->shminfo.shmaddr = shmat(pl->shminfo.shmid, NULL, 0);
+	  /* gone once both sides detach, even if we crash */
+	  shmctl(pl->shminfo.shmid, IPC_RMID, NULL);
+	  if (pl->shminfo.shmaddr != (char *) -1) {
+	    pl->shminfo.readOnly = True;
+	    if (shm_attach(pl->dpy, &pl->shminfo)) {
+	      pl->image->data = pl->shminfo.shmaddr;
+	      pl->raster = raster_new(width, height,
+				      (uint32_t *) pl->shminfo.shmaddr);
+	      pl->shm = TRUE;
+	    } else
+	      shmdt(pl->shminfo.shmaddr);
+	  }
 	}
+      }
+      if (pl->raster == NULL && pl->image != NULL) {
+	XDestroyImage(pl->image);
+	pl->image = NULL;
+      }
+    }
+#endif
+    if (pl->raster == NULL) {
+      pl->raster = raster_new(width, height, NULL);
+      if (pl->raster == NULL)
+	fatalerror("malloc returned null");
+      pl->image = XCreateImage(pl->dpy, visual, depth, ZPixmap, 0,
+			       (char *) pl->raster->pixels, width, height,
+			       32, 4 * width);
+      if (pl->image != NULL) {
+	uint32_t one = 1;
+
+	/* our pixels are in our byte order; Xlib swaps them if need be */
+	pl->image->byte_order = *(unsigned char *) &one ? LSBFirst : MSBFirst;
+      }
+      if (pl->image == NULL || pl->image->bits_per_pixel != 32) {
+	free_raster(pl);
+	return FALSE;
+      }
+    }
+    pl->raster->thick = pl->thick;
+    pl->raster->threads = option_threads;
+  }
+  raster_clear(pl->raster, (uint32_t) pl->background_color.pixel);
+  return TRUE;
+}
 
-	if (x_synch && y_synch) {
-	  PLOTTER savepl = pl;
+/* Clip the raster the way GC g (see DECORATION_BATCH) clips, and
+   return the colour it draws in. */
+uint32_t raster_gc(struct plotter *pl, int g)
+{
+  XGCValues v;
 
-	  for (ALLPLOTTERS) {
-	    if (pl == savepl) continue;
+  if (g == DECORATION_BATCH) {
+    raster_clip(pl->raster, 0, 0, pl->raster->width, pl->raster->height);
+    v.foreground = pl->foreground_color.pixel;
+  } else {
+    raster_clip(pl->raster, (int) pl->origin.x, (int) pl->origin.y - 2,
+		(int) pl->size.x + 2, (int) pl->size.y + 2);
+    XGetGCValues(pl->dpy, pl->gcs[g], GCForeground, &v);
+  }
+  return (uint32_t) v.foreground;
+}
 
-	    if (pl -> state == NORMAL) {
-	      pl->state = SLAVE;
-	      pl->master = savepl;
-	      pl->master_state = savepl->state;
-	      pl->dragstart = map_pl_pl(savepl, pl, savepl->dragstart);
-	      pl->dragend = map_pl_pl(savepl, pl, savepl->dragend);
-	    }
-	  }
-	  pl = savepl;
-	}
+/* The mask of the pixels XDrawString() sets for text, made if need be. */
+struct text_mask *text_mask(struct plotter *pl, char *text)
+{
+  struct text_mask *tm;
+  unsigned h = 0;
+  char *p;
+  int len = strlen(text);
+  int direction, ascent, descent;
+  XCharStruct xcs;
+
+  for (p = text; *p; p++)
+    h = h * 31 + (unsigned char) *p;
+  h %= TEXT_MASK_BUCKETS;
+  if (pl->text_masks == NULL) {
+    pl->text_masks = (struct text_mask **)
+      calloc(TEXT_MASK_BUCKETS, sizeof(struct text_mask *));
+    if (pl->text_masks == 0) fatalerror("malloc returned null");
+  }
+  for (tm = pl->text_masks[h]; tm != NULL; tm = tm->next)
+    if (strcmp(tm->text, text) == 0)
+      return tm;
+
+  tm = (struct text_mask *) malloc(sizeof(*tm) + len + 1);
+  if (tm == 0) fatalerror("malloc returned null");
+  tm->text = (char *) (tm + 1);
+  strcpy(tm->text, text);
+  XTextExtents(pl->font_struct, text, len,
+	       &direction, &ascent, &descent, &xcs);
+  tm->x = xcs.lbearing;
+  tm->y = -xcs.ascent;
+  tm->width = xcs.rbearing - xcs.lbearing;
+  tm->height = xcs.ascent + xcs.descent;
+  tm->bits = NULL;
+  if (tm->width > 0 && tm->height > 0) {
+    Pixmap pm;
+    GC gc;
+    XImage *im;
+    int i, j;
+
+    tm->bits = (unsigned char *) calloc((size_t) tm->width * tm->height, 1);
+    if (tm->bits == 0) fatalerror("malloc returned null");
+    pm = XCreatePixmap(pl->dpy, pl->win, tm->width, tm->height, 1);
+    gc = XCreateGC(pl->dpy, pm, 0, NULL);
+    XSetFont(pl->dpy, gc, pl->font_struct->fid);
+    XSetForeground(pl->dpy, gc, 0);
+    XFillRectangle(pl->dpy, pm, gc, 0, 0, tm->width, tm->height);
+    XSetForeground(pl->dpy, gc, 1);
+    XDrawString(pl->dpy, pm, gc, -tm->x, -tm->y, text, len);
+    im = XGetImage(pl->dpy, pm, 0, 0, tm->width, tm->height, 1, ZPixmap);
+    if (im != NULL) {
+      for (j = 0; j < tm->height; j++)
+	for (i = 0; i < tm->width; i++)
+	  tm->bits[j * tm->width + i] = XGetPixel(im, i, j) != 0;
+      XDestroyImage(im);
+    }
+    XFreeGC(pl->dpy, gc);
+    XFreePixmap(pl->dpy, pm);
+  }
+  tm->next = pl->text_masks[h];
+  pl->text_masks[h] = tm;
+  return tm;
+}
 
-	break;
+void free_text_masks(struct plotter *pl)
+{
+  struct text_mask *tm, *next;
+  int h;
 
-	/* remaining cases of a button down event when not in state NORMAL
-	   in each case, go to state WEDGED after cleaning up the state we
-	   are coming from */
-      case ZOOM:
-      case HZOOM:
-      case VZOOM:
-      case HDRAG:
-      case VDRAG:
-      case DRAG:
-	pl->state = WEDGED; /* this must be after undrawing on slaves */
-	break;
-      case EXITING:
-      case PRINTING:
-      case FIGING:
-      case THINFIGING:
-      case ADVANCING:
-      case BACKINGUP:
-	pl->state = WEDGED;
-	break;
-      case WEDGED:
-	break;
-      case SLAVE:
-	XBell(pl->dpy,100);
-	break;
-      default:
-	panic("unknown state");
-	break;
-      }
-      
-      draw_pointer_marks(pl, pl->xorgc);
-      pl->pointer_marks_on_screen = TRUE;
+  if (pl->text_masks == NULL)
+    return;
+  for (h = 0; h < TEXT_MASK_BUCKETS; h++)
+    for (tm = pl->text_masks[h]; tm != NULL; tm = next) {
+      next = tm->next;
+      free(tm->bits);
+      free(tm);
+    }
+  free(pl->text_masks);
+  pl->text_masks = NULL;
+}
 
-      if (x_synch && y_synch) {
-	PLOTTER savepl = pl;
+/* Draw a string into the raster with GC g, as XDrawString() would. */
+void add_raster_text(struct plotter *pl, int g, int x, int y, char *text)
+{
+  struct text_mask *tm = text_mask(pl, text);
 
-	for (ALLPLOTTERS) {
-	  if (pl == savepl) continue;
+  if (tm->bits != NULL)
+    raster_mask(pl->raster, x + tm->x, y + tm->y, tm->width, tm->height,
+		tm->bits, raster_gc(pl, g));
+}
 
-	  draw_pointer_marks(pl, pl->xorgc);
-	  pl->pointer_marks_on_screen = TRUE;
-	}
-	pl = savepl;
-      }
-      
-      break;
-    case ButtonRelease:
-      pl->buttonsdown -= 1;
-      if (pl->state != SLAVE) {
-	if (pl->pointer_marks_on_screen) {
-	  draw_pointer_marks(pl, pl->xorgc);
-	  pl->pointer_marks_on_screen = FALSE;
-	}
-	if (x_synch && y_synch) {
-	  PLOTTER savepl = pl;
-	  
-	  for (ALLPLOTTERS) {
-	    if (pl == savepl) continue;
-	    if (pl->pointer_marks_on_screen) {
-	      draw_pointer_marks(pl, pl->xorgc);
-	      pl->pointer_marks_on_screen = FALSE;
-	    }
-	  }
-	  pl = savepl;
-	}
-	
-	if (x_synch && y_synch) {
-	  PLOTTER savepl = pl;
-	  for (ALLPLOTTERS) {
-	    if (pl == savepl) continue;
-	    if (pl->state == SLAVE) {
-	      if (pl->buttonsdown == 0)
-		pl->state = NORMAL;
-	      else
-		pl->state = WEDGED;
-	    }
-	  }
-	  pl = savepl;
-	}
+/* Put part of the raster where the plot is drawn. */
+void put_raster(struct plotter *pl, int x, int y, int width, int height)
+{
+  Drawable d = plot_drawable(pl);
+  int marks = d == pl->win && pl->pointer_marks_on_screen;
+
+  raster_finish(pl->raster);
+  if (marks)
+    draw_pointer_marks(pl, pl->xorgc);
+#ifdef HAVE_LIBXEXT
+  if (pl->shm)
+    XShmPutImage(pl->dpy, d, pl->decgc, pl->image,
+		 x, y, x, y, width, height, False);
+  else
+#endif
+    XPutImage(pl->dpy, d, pl->decgc, pl->image, x, y, x, y, width, height);
+  if (marks)
+    draw_pointer_marks(pl, pl->xorgc);
+}
 
-      }
+/* Make sure the plotter's pixmap is the size of its window, and clear it. */
+void clear_pixmap(struct plotter *pl)
+{
+  int width = (int) pl->mainsize.x;
+  int height = (int) pl->mainsize.y;
 
-      switch (pl->state) {
-      case ZOOM:
-      case HZOOM:
-      case VZOOM:
-	pl->dragend.x = event.xbutton.x;
-	pl->dragend.y = event.xbutton.y;
-	switch(pl->state) {
-	case HZOOM:
-	  pl->dragend.y = pl->origin.y + pl->size.y;
-	  break;
-	case VZOOM:
-	  pl->dragend.x = pl->origin.x + pl->size.x;
-	  break;
-	default:
-	  break;
-	}
-	pl->dragend = detent(pl, pl->dragend);
-	break;
-      case HDRAG:
-	pl->dragend.x = event.xbutton.x;
-	pl->dragend.y = pl->dragstart.y;
-	pl->dragend = detent(pl, pl->dragend);
-	break;
-      case VDRAG:
-	pl->dragend.x = pl->dragstart.x;
-	pl->dragend.y = event.xbutton.y;
-	pl->dragend = detent(pl, pl->dragend);
-	break;
-      case DRAG:
-	pl->dragend.x = event.xbutton.x;
-	pl->dragend.y = event.xbutton.y;
-	pl->dragend = detent(pl, pl->dragend);
-	break;
-      default:
-	break;
-      }
-      switch (pl->state) {
-      case ZOOM:
-      case HZOOM:
-      case VZOOM:
-      case DRAG:
-      case HDRAG:
-      case VDRAG:
-	pl->dragstart =
-	  lXPoint_from_dXPoint(tosub(pl, dXPoint_from_lXPoint(pl->dragstart)));
-	pl->dragend =
-	  lXPoint_from_dXPoint(tosub(pl, dXPoint_from_lXPoint(pl->dragend)));
-	break;
-      default:
-	break;
-      }
-      switch (pl->state) {
-      case ZOOM:
-      case HZOOM:
-      case VZOOM:
-	{
-	  lXPoint dragstart, dragend;
-	  PLOTTER savepl = pl;
-	  bool must_pop_others = FALSE, do_x = FALSE, do_y = FALSE;
+  if (pl->pixmap != None
+      && (pl->pixmap_width != width || pl->pixmap_height != height)) {
+    XFreePixmap(pl->dpy, pl->pixmap);
+    pl->pixmap = None;
+  }
+  if (pl->pixmap == None) {
+    pl->pixmap = XCreatePixmap(pl->dpy, pl->win, width, height,
+			       DefaultDepth(pl->dpy,
+					    ScreenNumberOfScreen(pl->screen)));
+    pl->pixmap_width = width;
+    pl->pixmap_height = height;
+    /* decgc does the copying; the pixmap never has anything missing */
+    XSetGraphicsExposures(pl->dpy, pl->decgc, False);
+  }
+  XFillRectangle(pl->dpy, pl->pixmap, pl->bacgc, 0, 0, width, height);
+}
 
-	  dragstart = pl->dragstart;
-	  dragend = pl->dragend;
+/* Copy part of the pixmap to the window, keeping the pointer marks. */
+void show_pixmap(struct plotter *pl, int x, int y, int width, int height)
+{
+  if (pl->pointer_marks_on_screen)
+    draw_pointer_marks(pl, pl->xorgc);
+  XCopyArea(pl->dpy, pl->pixmap, pl->win, pl->decgc,
+	    x, y, width, height, x, y);
+  if (pl->pointer_marks_on_screen)
+    draw_pointer_marks(pl, pl->xorgc);
+}
 
-	  /* Do the plotter in which the button was pressed first, then do
-	     all the others if we are synchronizing (and need to). */
-	  if ((abs(pl->raw_dragstart.x - event.xbutton.x) > 7) ||
-	      (abs(pl->raw_dragstart.y - event.xbutton.y) > 7)) {
+static void set_rect(XRectangle *r, int x, int y, int width, int height)
+{
+  r->x = x;
+  r->y = y;
+  r->width = width;
+  r->height = height;
+}
 
-	    if (((pl->state != VZOOM) && (abs(dragstart.x - dragend.x) > 7))
-		|| ((pl->state != HZOOM) && (abs(dragstart.y - dragend.y) > 7))) {
+static int touches(XRectangle *r, int nr, int x1, int y1, int x2, int y2)
+{
+  int k;
 
-	      int newviewno;
-	      
-	      newviewno = pl->viewno + 1;
-	      if (newviewno == NUMVIEWS) newviewno -= 1;
-	
-	      if (abs(dragstart.x - dragend.x) > 7) {
-		zoom_in_coord(pl->x_type, pl_x_left, pl_x_right,
-			      dragstart.x, dragend.x,
-			      pl->size.x,
-			      &(pl->x_left[newviewno]),
-			      &(pl->x_right[newviewno]));
-		do_x = x_synch;
-	      } else {
-		pl->x_left[newviewno] = pl_x_left;
-		pl->x_right[newviewno] = pl_x_right;
-	      }
-	      if (abs(dragstart.y - dragend.y) > 7) {
-		zoom_in_coord(pl->y_type, pl_y_bottom, pl_y_top,
-			      pl->size.y - dragstart.y,
-			      pl->size.y - dragend.y,
-			      pl->size.y,
-			      &(pl->y_bottom[newviewno]),
-			      &(pl->y_top[newviewno]));
-		do_y = y_synch;
-	      } else {
-		pl->y_bottom[newviewno] = pl_y_bottom;
-		pl->y_top[newviewno] = pl_y_top;
-	      }
-	      pl->viewno = newviewno;
-	    } else {
-	      /* do nothing  (don't zoom and don't pop) */
-	      if (0) goto G0093;
+  for (k = 0; k < nr; k++)
+    if (x2 >= r[k].x && x1 < r[k].x + r[k].width
+	&& y2 >= r[k].y && y1 < r[k].y + r[k].height)
+      return TRUE;
+  return FALSE;
+}
+
+/*
+ * Scroll the pixmap by the whole pixels a drag moved, and mark only the
+ * strips that came into view for redrawing.  FALSE if it can't.
+ */
+int shift_pixmap(struct plotter *pl, XRectangle *area)
+{
+  double fx, fy;
+  int dx, dy;
+  int ax = area->x, ay = area->y;
+  int aw = area->width, ah = area->height;
+  int bottom = (int) (pl->origin.y + pl->size.y - 1);
+  XRectangle margin[4];
+  XRectangle dirty[6];
+  int ndirty = 0;
+  struct cursor cur;
+  command *c;
+  int i;
+
+  fx = map_coord(pl->x_type, pl_x_left, pl_x_right, pl->size.x,
+		 pl->shift_x_left);
+  fy = -map_coord(pl->y_type, pl_y_bottom, pl_y_top, pl->size.y,
+		  pl->shift_y_bottom);
+  if (!(fabs(fx - rint(fx)) < 0.1 && fabs(fy - rint(fy)) < 0.1))
+    return FALSE;
+  dx = (int) rint(fx);
+  dy = (int) rint(fy);
+  if (abs(dx) >= aw || abs(dy) >= ah)
+    return FALSE;
+
+  XCopyArea(pl->dpy, pl->pixmap, pl->pixmap, pl->decgc,
+	    ax + max(0, -dx), ay + max(0, -dy), aw - abs(dx), ah - abs(dy),
+	    ax + max(0, dx), ay + max(0, dy));
+
+  /* the decorations are all redrawn, so clear around the data */
+  set_rect(&margin[0], 0, 0, pl->pixmap_width, ay);
+  set_rect(&margin[1], 0, ay + ah,
+	   pl->pixmap_width, pl->pixmap_height - (ay + ah));
+  set_rect(&margin[2], 0, ay, ax, ah);
+  set_rect(&margin[3], ax + aw, ay, pl->pixmap_width - (ax + aw), ah);
+  XFillRectangles(pl->dpy, pl->pixmap, pl->bacgc, margin, 4);
+
+  /* the strips that came into view */
+  if (dx > 0)
+    set_rect(&dirty[ndirty++], ax, ay, dx, ah);
+  else if (dx < 0)
+    set_rect(&dirty[ndirty++], ax + aw + dx, ay, -dx, ah);
+  if (dy > 0)
+    set_rect(&dirty[ndirty++], ax, ay, aw, dy);
+  else if (dy < 0)
+    set_rect(&dirty[ndirty++], ax, ay + ah + dy, aw, -dy);
+  /* the axes, which were drawn under the data, where they are now */
+  set_rect(&dirty[ndirty++], ax, ay, 2, ah);
+  set_rect(&dirty[ndirty++], ax, bottom - 1, aw, 3);
+  /* and where the copy just moved them to */
+  if (dx > 0)
+    set_rect(&dirty[ndirty++], ax + dx - 1, ay, 3, ah);
+  if (dy < 0)
+    set_rect(&dirty[ndirty++], ax, bottom - 1 + dy, aw, 3);
+  XFillRectangles(pl->dpy, pl->pixmap, pl->bacgc, dirty, ndirty);
+
+  for (i = 0; i < NColors; i++)
+    XSetClipRectangles(pl->dpy, pl->gcs[i], 0, 0, dirty, ndirty, Unsorted);
+
+  /* size_window() marked everything; only keep what touches the strips */
+  map_visible(pl);
+  for (c = first_command(pl, &cur, MAPPED); c != NULL; c = next_command(&cur)) {
+    dXPoint da, db;
+    int x1, y1, x2, y2;
+    int r = 8;			/* more than any marker reaches */
+
+    if (c->decoration
+	|| c->type == TITLE || c->type == XLABEL || c->type == YLABEL)
+      continue;
+    window_coords(pl, &cur, c, &da, &db);
+    da = tomain(pl, da);
+    db = tomain(pl, db);
+    x1 = (int) floor(min(da.x, db.x)) - r;
+    x2 = (int) ceil(max(da.x, db.x)) + r;
+    y1 = (int) floor(min(da.y, db.y)) - r;
+    y2 = (int) ceil(max(da.y, db.y)) + r;
+    if (c->type == TEXT) {
+      /* don't bother working out how wide it is */
+      x1 = 0;
+      x2 = pl->pixmap_width;
+      y1 -= pl->font_struct->ascent + pl->font_struct->descent;
+      y2 += pl->font_struct->ascent + pl->font_struct->descent;
+    }
+    if ( ! touches(dirty, ndirty, x1, y1, x2, y2) ) {
+      c->needs_redraw = FALSE;
+      put_flags(&cur, c);
+    }
+  }
+  return TRUE;
+}
+
+/*
+ * compute the bounding box of the current view
+ */
+void shrink_to_bbox(struct plotter *pl, int x, int y)
+{
+  command *c;
+  struct cursor cur;
+  
+  int nmapped = 0;
+  int ndots = 0;
+  int virgin = 1;
+  
+  coord saved_x_left = pl_x_left;
+  coord saved_x_right = pl_x_right;
+  coord saved_y_bottom = pl_y_bottom;
+  coord saved_y_top = pl_y_top;
+
+  /* get mapped indicator set correctly for what new window size
+   * before we scale  the other axis */
+  /* exactly, not through a level of detail */
+  map_commands(pl, FALSE);
+
+#ifdef LOTS_OF_DEBUGGING_PRINTS
+  {
+    char b[4][COORD_TEXT_MAX];
+
+    fprintf(stderr, "C_S_P: view %d OLD %s %s %s %s\n",
+	    pl->viewno,
+	    unparse_coord(pl->x_type, pl_x_left, b[0]),
+	    unparse_coord(pl->x_type, pl_x_right, b[1]),
+	    unparse_coord(pl->y_type, pl_y_bottom, b[2]),
+	    unparse_coord(pl->y_type, pl_y_top, b[3]));
+  }
+#endif
+
+  for (c = first_command(pl, &cur, MAPPED); c != NULL; c = next_command(&cur))
+    if ( ! c->decoration )
+      {
+	nmapped++;
+
+	switch(c->type) {
+	case LINE:
+	case DLINE:
+	  if ( x )
+	    {
+	      if (virgin || ccmp(pl->x_type, c->xb, pl_x_left, <))
+		pl_x_left = c->xb;
+	      if (virgin || ccmp(pl->x_type, c->xb, pl_x_right, >))
+		pl_x_right = c->xb;
 	    }
-	  } else {
-	    if (pl->viewno > 1)
-	      {
-		/* Only pop the others if the synchronized axis changed. */
-		if ((x_synch
-		     && (xcmp(pl_x_left, pl->x_left[pl->viewno-1], !=)
-			 || xcmp(pl_x_right, pl->x_right[pl->viewno-1], !=)))
-		    || (y_synch
-			&& (ycmp(pl_y_top, pl->y_top[pl->viewno-1], !=)
-			    || ycmp(pl_y_bottom, pl->y_bottom[pl->viewno-1], !=))))
-		  must_pop_others = TRUE;
-		pl->viewno--;
-	      }
-	    else {
-	      pl_x_left   = pl->x_left[0];
-	      pl_x_right  = pl->x_right[0];
-	      pl_y_top    = pl->y_top[0];
-	      pl_y_bottom = pl->y_bottom[0];
+	  if ( y )
+	    {
+	      if (virgin || ccmp(pl->y_type, c->yb, pl_y_bottom, <))
+		pl_y_bottom = c->yb;
+	      if (virgin || ccmp(pl->y_type, c->yb, pl_y_top, >))
+		pl_y_top = c->yb;
 	    }
-	  }
-	  XClearWindow(pl->dpy, pl->win);
-	  pl->pointer_marks_on_screen = FALSE;
-	  pl->size_changed = 1;
-	  pl->state = NORMAL;
-	  /* If we need to, loop through all the plotters. */
-	  if (do_x || do_y || must_pop_others)
-	    for (ALLPLOTTERS)
-	      {
-		if (pl == savepl) continue;
-		if (must_pop_others)
-		  {
-		    if (pl->viewno > 1) pl->viewno--;
-		    if (x_synch)
-		      {
-			pl_x_left   = savepl->x_left[savepl->viewno];
-			pl_x_right  = savepl->x_right[savepl->viewno];
-		      }
-		    if (y_synch)
-		      {
-			pl_y_top    = savepl->y_top[savepl->viewno];
-			pl_y_bottom = savepl->y_bottom[savepl->viewno];
-		      }
-		  }
-		else
-		  {
-		    int newviewno;
-		    newviewno = pl->viewno + 1;
-		    if (newviewno == NUMVIEWS) newviewno -= 1;
+	  virgin = 0;
+	  
+	case X:
+	case DOT:
+	case PLUS:
+	case BOX:
+	case DIAMOND:
+	case UTICK:
+	case DTICK:
+	case LTICK:
+	case RTICK:
+	case HTICK:
+	case VTICK:
+	case UARROW:
+	case DARROW:
+	case LARROW:
+	case RARROW:
+	case INVISIBLE:
+	case TEXT:
+	  ndots++;
+	  if ( x )
+	    {
+	      if (virgin || ccmp(pl->x_type, c->xa, pl_x_left, <))
+		pl_x_left = c->xa;
+	      if (virgin || ccmp(pl->x_type, c->xa, pl_x_right, >))
+		pl_x_right = c->xa;
+	    }
+	  if ( y )
+	    {
+	      if (virgin || ccmp(pl->y_type, c->ya, pl_y_bottom, <))
+		pl_y_bottom = c->ya;
+	      if (virgin || ccmp(pl->y_type, c->ya, pl_y_top, >))
+		pl_y_top = c->ya;
+	    }
+	  virgin = 0;
+	case TITLE:
+	case XLABEL:
+	case YLABEL:
+	  break;
+	}
+	
+      }
 
-		    if (do_x)  {
-		      pl->x_left[newviewno] = savepl->x_left[savepl->viewno];
-		      pl->x_right[newviewno] = savepl->x_right[savepl->viewno];
-		    } else {
-		      pl->x_left[newviewno] = pl_x_left;
-		      pl->x_right[newviewno] = pl_x_right;
-		    }
-		    if (do_y)  {
-		      pl->y_bottom[newviewno] =
-			savepl->y_bottom[savepl->viewno];
-		      pl->y_top[newviewno] = savepl->y_top[savepl->viewno];
-		    } else {
-		      pl->y_bottom[newviewno] = pl_y_bottom;
-		      pl->y_top[newviewno] = pl_y_top;
-		    }
-		    pl->viewno = newviewno;
+  /* make sure top/bottom are not equal, somehow  */
+  if ( ccmp(pl->x_type, pl_x_left, pl_x_right, ==) )
+    {
+      pl_x_left = saved_x_left;
+      pl_x_right = saved_x_right;
+    }
+  if ( ccmp(pl->y_type, pl_y_bottom, pl_y_top, ==) )
+    {
+      pl_y_bottom = saved_y_bottom;
+      pl_y_top = saved_y_top;
+    }
 
-		    if ( do_x && ! y_synch)
-		      shrink_to_bbox(pl,0,1);
+#if 0  /* this code is broken, round_{down,up} take more than one argument */
+  /* make points 5/95 % rather than extreme - settle for rounding */
+  if ( y )
+    {
+      pl_y_bottom = (impls[(int)pl->y_type]->round_down)(pl_y_bottom);
+      pl_y_top = (impls[(int)pl->y_type]->round_up)(pl_y_top);
+    }
+#endif
 
-		  }		
-		pl->size_changed = 1;
-	      }
-	G0093:
-	  pl = savepl;		/* Don't know if I have to do this, but... */
-	}
-        break;
-      case DRAG:
-      case HDRAG:
-      case VDRAG:
-#ifdef TCPTRACE
-	if (!show_dist)
-	{
-#endif /* TCPTRACE */
-	{
-	  PLOTTER savepl = pl;
 
-	  drag_coord(pl->x_type, pl_x_left, pl_x_right,
-		     pl->dragend.x,
-		     pl->dragstart.x,
-		     pl->size.x,
-		     &(pl_x_left), &(pl_x_right));
-	  drag_coord(pl->y_type, pl_y_bottom, pl_y_top,
-		     pl->size.y - pl->dragend.y,
-		     pl->size.y - pl->dragstart.y,
-		     pl->size.y,
-		     &(pl_y_bottom), &(pl_y_top));
-	
-	  pl->size_changed = 1;
-	  if (x_synch || y_synch)
-	    for (ALLPLOTTERS)
-	      {
-		if (pl == savepl) continue;
-		if (x_synch && savepl->state != VDRAG)
-		  {
-		    pl_x_left = savepl->x_left[savepl->viewno];
-		    pl_x_right = savepl->x_right[savepl->viewno];
-		    if (!y_synch) shrink_to_bbox(pl,0,1);
-		    pl->size_changed = 1;
-		  }
-		if (y_synch && savepl->state != HDRAG)
-		  {
-		    pl_y_top = savepl->y_top[savepl->viewno];
-		    pl_y_bottom = savepl->y_bottom[savepl->viewno];
-		    if (!x_synch) shrink_to_bbox(pl,1,0);
-		    pl->size_changed = 1;
-		  }
-	      }
-	  pl = savepl;
-	}
-        XClearWindow(pl->dpy, pl->win);
-#ifdef TCPTRACE
-	}
-#endif /* TCPTRACE */
-	pl->pointer_marks_on_screen = FALSE;
-        pl->state = NORMAL;
-        break;
-      case EXITING:
-	pl->state = NORMAL;  
-	if (undisplay_plotter(pl, option_one_at_a_time?-1:0) == 0) {
-	  /* went past last plotter */
-	  if (option_one_at_a_time == 0) {
-	    
-	    /* old behavior */
+#ifdef LOTS_OF_DEBUGGING_PRINTS
+  {
+    char b[4][COORD_TEXT_MAX];
+
+    fprintf(stderr, "C_S_P: nmapped=%d ndots=%d NEW %s %s %s %s\n",
+	    nmapped, ndots,
+	    unparse_coord(pl->x_type, pl_x_left, b[0]),
+	    unparse_coord(pl->x_type, pl_x_right, b[1]),
+	    unparse_coord(pl->y_type, pl_y_top, b[2]),
+	    unparse_coord(pl->y_type, pl_y_top, b[3]));
+  }
+#endif
+}
 
-	  } else {
-	    /* we'll loop around, and start at the beginning with a
-               new window */
-	  }
-	}
-	break;
-      case PRINTING:
-      case FIGING:
-      case THINFIGING:
-	{
-	  FILE *fp, *make_name_open_file();
-	  if ((fp = make_name_open_file(pl))) {
-	    emit_PS(pl, fp, pl->state);
-	    (void) fclose(fp);
-	    pl->size_changed = 1;
-	  }
-	}
-        pl->state = NORMAL;
-        break;
-      case ADVANCING:
-	pl->state = NORMAL;
-	undisplay_plotter(pl, -1);
-	break;
-      case BACKINGUP:
-	pl->state = NORMAL;
-	if (undisplay_plotter(pl, option_one_at_a_time?1:0) == 0) {
-	  /* trying to back up before first plotter */
+void draw_pointer_marks(PLOTTER pl, GC gc)
+{
+  const int x_pm_l = 6;
+
+#if 0
+  printf("draw_pointer_marks, pl->state is %d\n", pl->state);
+#endif
+
+  if (pl->win == 0) return;
+
+  XDrawLine(pl->dpy, pl->win, gc,
+	    pl->pointer_marks.x, pl->origin.y + pl->size.y - 1,
+	    pl->pointer_marks.x, pl->origin.y + pl->size.y - 1 - x_pm_l);
+  XDrawLine(pl->dpy, pl->win, gc,
+	    pl->origin.x, pl->pointer_marks.y,
+	    pl->origin.x + x_pm_l, pl->pointer_marks.y);
+
+  XDrawLine(pl->dpy, pl->win, gc,
+	    pl->pointer_marks.x - x_pm_l, pl->pointer_marks.y,
+	    pl->pointer_marks.x + x_pm_l, pl->pointer_marks.y);
+  XDrawLine(pl->dpy, pl->win, gc,
+	    pl->pointer_marks.x, pl->pointer_marks.y - x_pm_l,
+	    pl->pointer_marks.x, pl->pointer_marks.y + x_pm_l);
+
+  switch (pl->state == SLAVE? pl->master_state : pl->state) {
+  case ZOOM:
+  case HZOOM:
+  case VZOOM:
+    XDrawRectangle(pl->dpy, pl->win, gc,
+		   min(pl->dragstart.x, pl->dragend.x), 
+		   min(pl->dragstart.y, pl->dragend.y),
+		   abs(pl->dragend.x - pl->dragstart.x),
+		   abs(pl->dragend.y - pl->dragstart.y));
+    break;
+  case HDRAG:
+    XDrawLine(pl->dpy, pl->win, gc,
+	      pl->dragstart.x, pl->dragstart.y,
+	      pl->dragend.x, pl->dragstart.y);
+    break;
+  case VDRAG:
+    XDrawLine(pl->dpy, pl->win, gc,
+	      pl->dragstart.x, pl->dragstart.y,
+	      pl->dragstart.x, pl->dragend.y);
+    break;
+  case DRAG:
+    XDrawLine(pl->dpy, pl->win, gc,
+	      pl->dragstart.x, pl->dragstart.y, pl->dragend.x, pl->dragend.y);
+#ifdef TCPTRACE
+    if (show_dist)
+    {
+	lXPoint p;
+	float pwidth = pl->size.x, pheight = pl->size.y;
+	long pxdist, pydist;
+	coord axdist, aydist;
+	float xscale, yscale;
+	char tmp [100], buf [COORD_TEXT_MAX];
+	double xdist, ydist, slope, hyp_dist;
+
+	XDrawLine(pl->dpy, pl->win, gc,
+		  pl->dragstart.x, pl->dragstart.y, pl->dragstart.x, 
+		  pl->dragend.y);
+	XDrawLine(pl->dpy, pl->win, gc,
+		  pl->dragstart.x, pl->dragend.y, pl->dragend.x, 
+		  pl->dragend.y);
+
+	pxdist = pl->dragend.x - pl->dragstart.x;
+	pydist = pl->dragstart.y - pl->dragend.y;
+	xscale = pxdist / pwidth;
+	yscale = pydist / pheight;
+
+	axdist = sub_coord (pl->x_type,pl_x_right,pl_x_left);
+	aydist = sub_coord (pl->y_type,pl_y_top,pl_y_bottom);
+
+	if (pl->x_type != TIMEVAL && pl->x_type != NSTIME)
+	{
+	    xdist = atof (unparse_coord (pl->x_type,axdist,buf));
+	}
+	else
+	    xdist = axdist.ns / 1e9;
+	xdist *= xscale;
+
+	if (pl->y_type != TIMEVAL && pl->y_type != NSTIME)
+	{
+	    ydist = atof (unparse_coord (pl->y_type,aydist,buf));
+	}
+	else
+	    ydist = aydist.ns / 1e9;
+	ydist *= yscale;
+
+	slope = ydist / xdist;
+	hyp_dist = sqrt ((xdist * xdist) + (ydist * ydist));
+
+	if (xdist > 0)
+	    p.x = pl->dragstart.x - 65;
+	else
+	    p.x = pl->dragstart.x + 10;
+	p.y = pl->dragstart.y - (pydist / 2);
+	sprintf (tmp,"%.3f %s", ydist,
+		 (pl->y_units&&*pl->y_units)?pl->y_units:
+		 (pl->y_type == TIMEVAL || pl->y_type == NSTIME)?"sec":
+		 "");
+	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
+
+	p.x = pl->dragstart.x + (pxdist / 2);
+	if (ydist > 0)
+	    p.y = pl->dragend.y - 5;
+	else
+	    p.y = pl->dragend.y + 15;
+	sprintf (tmp,"%.3f %s", xdist,
+		 (pl->x_units&&*pl->x_units)?pl->x_units:
+		 (pl->x_type == TIMEVAL || pl->x_type == NSTIME)?"sec":
+		 "");
+	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
+
+	p.x = ((pl->dragend.x - pl->dragstart.x) / 2) + pl->dragstart.x;
+	p.y = ((pl->dragend.y - pl->dragstart.y) / 2) + pl->dragstart.y;
+	if (xdist > 0)
+	    p.x += 15;
+	else
+	    p.x -= 85;
+	if (ydist > 0)
+	    p.y += 10;
+	else
+	    p.y -= 20;
+	sprintf (tmp,"s = %.3f %s/%s", slope,
+		 ((pl->y_units&&*pl->y_units)?pl->y_units:(pl->y_type == TIMEVAL || pl->y_type == NSTIME)?"sec":"units"),
+                 ((pl->x_units&&*pl->x_units)?pl->x_units:(pl->x_type == TIMEVAL || pl->x_type == NSTIME)?"sec":"units")
+		 );
+//	sprintf (tmp,"s = %.3f", slope);
+	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
+/* Removed the diagonal distance, it is wrong. The value was being calculated
+ * without taking into account the units of the x & y axis. Since it is not 
+ * always possible to convert the different axis types from one form to the other,
+ * it is safe to remove this value all together.
+        p.y += 15;
+	sprintf (tmp,"d = %.3f", hyp_dist);
+	XDrawString(pl->dpy, pl->win, gc, p.x, p.y, tmp, strlen(tmp));
+ */ 
+    }
+#endif /* TCPTRACE */
+    break;
+
+  default:
+    /* we are called in motion notify */
+    break;
+  }
+  return;
+}
+
+int main(int argc, char *argv[])
+{
+
+  command *c;
+  struct cursor cur;
+  int dummy_int;
+  int option_tile = FALSE;
+  int option_one_at_a_time = FALSE;
+  unsigned int dummy_unsigned_int;
+  Window dummy_window;
+  Display *dpy = 0;
+  Display *dpy2 = 0;
+  Display *dpy_of_event = 0;
+  struct timeval next_follow;	/* when to look at followed files again */
+  PLOTTER pl;
+  coord x_synch_bb_left;
+  coord y_synch_bb_bottom;
+  coord x_synch_bb_right;
+  coord y_synch_bb_top;
+
+  XEvent event;
+  int i;
+  /* Are x and/or y axis of the various windows locked together? */
+  bool x_synch = FALSE, y_synch = FALSE;
+
+  global_argc = argc;
+  global_argv = argv;
+
+#ifdef TCPTRACE
+  {
+      extern char* version_string;
+      printf("Based on Tim Shepard's version 0.90.7 xplot\n");
+      printf("Tcptrace-hosted version: %s\n", version_string);
+  }
+#endif /* TCPTRACE */
+
+  /* Look for -v or -version argument */
+  for (i = 1; i < argc && *argv[i] == '-'; i++) {
+    if (strcmp ("-v", argv[i]) == 0
+#ifdef TCPTRACE
+	|| (strcmp ("--version", argv[i]) == 0)
+#endif /* TCPTRACE */
+	|| strcmp ("-version", argv[i]) == 0) {
+      extern char* version_string;
+      printf("xplot version %s\n", version_string);
+      exit(0);
+    }
+#ifdef TCPTRACE
+    if ((strcmp ("-h", argv[i]) == 0)
+	|| (strcmp ("-help", argv[i]) == 0)
+	|| (strcmp ("--help", argv[i]) == 0)) {
+        fprintf(stderr,"\n");
+	fprintf(stderr,"usage: %s [options] file [files]\n", argv[0]);
+       	fprintf(stderr,"------\n\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "--------\n");
+	fprintf(stderr, " -x               synchronize the x axis of all displayed files\n");
+	fprintf(stderr, " -y               synchronize the y axis of all displayed files\n");
+	fprintf(stderr, "                  (-x, -y and -d2 read the files in full first)\n");
+	fprintf(stderr, " -tile            adjust initial sizes to fit multiple files on screen\n");
+	fprintf(stderr, " -mono            monochrome output\n");
+	fprintf(stderr, " -1               show each file one at a time, rather than all at once\n");
+        fprintf(stderr, " -d               specify display\n");
+	fprintf(stderr, " -d2              specify second display (for group viewing)\n");
+	fprintf(stderr, " -geometry        WxH[+X+Y] (understands standard X11 geometry)\n");
+	fprintf(stderr, " -display         same as -d\n");
+        fprintf(stderr, " -thick           draw the plots with a thick stroke\n");
+	fprintf(stderr, " -pixmap          draw off-screen, redisplay by copying\n");
+	fprintf(stderr, " -raster          draw the lines client-side, send them as an image\n");
+	fprintf(stderr, " -threads N       -raster with N threads (0: one per CPU, at most)\n");
+	fprintf(stderr, " -follow          keep reading the files as they grow\n");
+	fprintf(stderr, " --convert IN OUT write the plots in IN to OUT in binary\n");
+	fprintf(stderr, " -version         print version information\n");
+	fprintf(stderr, " -help            show this help screen\n");
+	fprintf(stderr, "\n");       
+	fprintf(stderr, "Mouse Bindings:\n");
+	fprintf(stderr, "---------------\n");       
+	fprintf(stderr, " left             draw rectangle to zoom in, click to zoom out\n");
+	fprintf(stderr, " middle           drag to scroll window\n");
+	fprintf(stderr, " right            quit\n");
+	fprintf(stderr, " SHIFT + left     drop postscript file\n");
+	fprintf(stderr, " SHIFT + middle   drop postscript file, smaller image\n");
+	fprintf(stderr, " SHIFT + right    drop postscript file, less verticle space\n");
+	fprintf(stderr, " CTRL  + left     go forward to the view zoomed out of\n");
+	fprintf(stderr, " CTRL  + middle   drag out a box showing dimensions\n");
+	fprintf(stderr, "\n");
+	exit(0);
+    }
+#endif /* TCPTRACE */
+  }
+
+  i = 1;
+
+  /* --convert needs no display */
+  if (argc == 4 && strcmp("--convert", argv[1]) == 0) {
+    convert_file(argv[2], argv[3]);
+    exit(0);
+  }
+
+  /* Look for -x and/or -y options, and look for -t option*/
+  for (; i < argc && *argv[i] == '-'; i++)
+    {
+      if (strcmp ("-x", argv[i]) == 0)
+	x_synch = TRUE;
+      else if (strcmp ("-y", argv[i]) == 0)
+	y_synch = TRUE;
+      else if (strcmp ("-thick", argv[i]) == 0)
+	option_thick = TRUE;
+      else if (strcmp ("-tile", argv[i]) == 0)
+	option_tile = TRUE;
+      else if (strcmp ("-mono", argv[i]) == 0)
+	option_mono = TRUE;
+      else if (strcmp ("-pixmap", argv[i]) == 0)
+	option_pixmap = TRUE;
+      else if (strcmp ("-raster", argv[i]) == 0)
+	option_raster = TRUE;
+      else if (strcmp ("-threads", argv[i]) == 0 && i + 1 < argc) {
+	option_raster = TRUE;
+	option_threads = atoi(argv[++i]);
+	/* more threads than processors only get in each other's way */
+	if (option_threads < 1 || option_threads > ncpus())
+	  option_threads = ncpus();
+      }
+      else if (strcmp ("-follow", argv[i]) == 0)
+	option_follow = TRUE;
+      else if (strcmp ("-1", argv[i]) == 0)
+	option_one_at_a_time = TRUE;
+      else if (strcmp ("-d", argv[i]) == 0
+	       || strcmp ("-display", argv[i]) == 0) {
+	i++;
+	if (dpy == 0) {
+	  dpy = XOpenDisplay(argv[i]);
+#ifdef TCPTRACE
+	  if (dpy == NULL) fatalerror("could not open display");
+#else /* TCPTRACE */
+	  if (dpy == NULL) panic("could not open display");
+#endif /* TCPTRACE */
+	} else {
+	  if (dpy2 == 0) {
+	    dpy2 = XOpenDisplay(argv[i]);
+#ifdef TCPTRACE
+	    if (dpy2 == NULL) fatalerror("could not open display");
+#else /* TCPTRACE */
+	    if (dpy2 == NULL) panic("could not open display");
+#endif /* TCPTRACE */
+	  } else {
+	    panic("too many displays");
+	  }
+	}
+      }
+      else if (strcmp("-d2", argv[i]) == 0) {
+	i++;
+	if (dpy2 == 0) {
+	  dpy2 = XOpenDisplay(argv[i]);
+#ifdef TCPTRACE
+	  if (dpy2 == NULL) fatalerror("could not open display");
+#else /* TCPTRACE */
+	  if (dpy2 == NULL) panic("could not open display");
+#endif /* TCPTRACE */
+	} else {
+	  panic("too many d2's");
+	}
+      }
+      else
+	/* Give the user the benefit of the doubt and assume that
+	   they want a file that starts with '-' */
+	break;
+    }
+	
+	       
+  if (dpy == 0) {
+    dpy = XOpenDisplay("");
+#ifdef TCPTRACE
+	  if (dpy == NULL) fatalerror("could not open display");
+#else /* TCPTRACE */
+	  if (dpy == NULL) panic("could not open display");
+#endif /* TCPTRACE */
+  }
+
+  {
+    int numwins = argc - i;
+
+#ifdef HAVE_LIBPTHREAD
+    /* put the windows up before the files are all read, unless the
+       axes are to be lined up or the plots copied to another display */
+    if (!x_synch && !y_synch && dpy2 == 0)
+      start_loading(i < argc ? &argv[i] : NULL, numwins, dpy, option_tile);
+    else
+#endif
+    if (i < argc)
+      load_files(&argv[i], numwins, dpy, option_tile);
+    else
+      /* 1 window, 0th */
+      new_plotter(stdin, dpy, 1, 0, 0);
+
+    if (dpy2 != 0) {
+
+      if (i < argc) {
+	/* the same plotters again, without reading the files again */
+	PLOTTER copies = NULL;
+	PLOTTER *tail = &copies;
+	PLOTTER pl;
+
+	for (pl = the_plotter_list; pl != NULL; pl = pl->next) {
+	  *tail = copy_plotter(pl, dpy2);
+	  tail = &(*tail)->next;
+	}
+	link_plotters(copies);
+      } else {
+	/* 1 window, 0th */
+	panic("can't do dpy2 with stdin (yet)");
+	new_plotter(stdin, dpy2, 1, 0, 0);
+      }
+
+
+    }
+
+  }
+
+  if ( ! the_plotter_list )
+    {
+      fprintf(stderr, "NO PLOTTERS\n");
+      goto doexit;
+    }
+
+  /* Check that we are dealing with the same coordinate types. */
+  if (the_plotter_list)
+    {
+#define BUTFIRSTPLOTTERS pl = the_plotter_list->next; pl != NULL; pl = pl->next
+      if (x_synch)
+	{
+	  coord_type t = the_plotter_list->x_type;
+	  for (BUTFIRSTPLOTTERS)
+	    if (pl->x_type != t)
+	      panic ("Attempt to synchronize different coordinate types");
+	}
+      if (y_synch)
+	{
+	  coord_type t = the_plotter_list->y_type;
+	  for (BUTFIRSTPLOTTERS)
+	    if (pl->y_type != t)
+	      panic ("Attempt to synchronize different coordinate types");
+	}
+    }
+
+#define ALLPLOTTERS pl = the_plotter_list ; pl != NULL; pl = pl->next
+  for (ALLPLOTTERS)
+    set_views(pl);
+
+  if (x_synch) {
+    int virgin = 1;
+    for (ALLPLOTTERS) {
+      if (virgin || ccmp(pl->x_type, pl_x_left, x_synch_bb_left, <))
+	x_synch_bb_left = pl_x_left;
+      if (virgin || ccmp(pl->x_type, pl_x_right, x_synch_bb_right, >))
+	x_synch_bb_right = pl_x_right;
+      virgin = 0;
+    }
+    for (ALLPLOTTERS) {
+      pl_x_left = x_synch_bb_left;
+      pl_x_right = x_synch_bb_right;
+    }
+  }
+
+  if (y_synch) {
+    int virgin = 1;
+    for (ALLPLOTTERS) {
+      if (virgin || ccmp(pl->y_type, pl_y_bottom, y_synch_bb_bottom, <))
+	y_synch_bb_bottom = pl_y_bottom;
+      if (virgin || ccmp(pl->y_type, pl_y_top, y_synch_bb_top, >))
+	y_synch_bb_top = pl_y_top;
+      virgin = 0;
+    }
+    for (ALLPLOTTERS) {
+      pl_y_top = y_synch_bb_top;
+      pl_y_bottom = y_synch_bb_bottom;
+    }
+  }
+
+  for (ALLPLOTTERS)
+    build_index(pl);
+  gettimeofday(&next_follow, NULL);
+
+  for (ALLPLOTTERS) {
+    if (option_one_at_a_time == FALSE
+	|| pl->next == 0
+	) {
+      display_plotter(pl);
+    }
+  }
+    
+  do {
+    int SAVx, SAVy, SAVc, SAVd;
+    struct timeval draw_start;	/* see DRAW_BUDGET */
+    int ndrawn;
+    lXPoint a,b;
+    if (XPending(dpy) == 0
+	&& (dpy2 == 0 || XPending(dpy2) == 0)
+	) {
+      int visible_count = 0;
+      for (ALLPLOTTERS) {
+
+	/* if option_one_at_a_time, ensure that at least last plotter
+	   on list is visible if no others are */ 
+	if (visible_count == 0
+	    && pl->next == 0
+	    && pl->win == 0
+	    && option_one_at_a_time
+	    ) 
+	  display_plotter(pl);
+
+	/* if plotter is not yet displayed, do nothing */
+	if (pl->win == 0) continue;
+
+	visible_count++;
+	
+	if (pl->size_changed) {
+	  int i;
+	  XRectangle xr[1];
+	  int shifted = FALSE;
+
+	  pl->size_changed = 0;
+	  size_window(pl);
+
+	  xr[0].x = pl->origin.x;
+	  xr[0].y = pl->origin.y - 2;
+	  xr[0].width = pl->size.x + 2;
+	  xr[0].height = pl->size.y + 2;
+
+	  if (option_raster && !make_raster(pl)) {
+	    fprintf(stderr, "xplot: -raster needs a 32 bit per pixel screen,"
+		    " not using it\n");
+	    option_raster = FALSE;
+	  }
+
+	  if (option_pixmap) {
+	    /* the window keeps the old picture until the new one is copied */
+	    if (pl->pixmap != None && pl->raster == NULL
+		&& pl->shift_pending && pl->clean
+		&& pl->pixmap_width == (int) pl->mainsize.x
+		&& pl->pixmap_height == (int) pl->mainsize.y)
+	      shifted = shift_pixmap(pl, xr);
+	    if (!shifted)
+	      clear_pixmap(pl);
+	  } else {
+	    XClearWindow(pl->dpy, pl->win);
+	    pl->pointer_marks_on_screen = FALSE;
+	  }
+	  pl->shift_pending = FALSE;
+	  pl->clean = 0;
+
+	  if (!shifted)
+	    for (i = 0; i < NColors; i++)
+	      XSetClipRectangles(pl->dpy, pl->gcs[i], 0, 0, xr, 1, YXBanded);
+
+	}
+	if (pl->new_expose) {
+	  pl->clean = 0;
+	  pl->draw_stopped = FALSE;
+	  if (pl->raster != NULL)
+	    make_raster(pl);	/* everything is drawn again */
+	  for (c = first_command(pl, &cur, MAPPED); c != NULL;
+	       c = next_command(&cur)) {
+	    c->needs_redraw = TRUE;
+	    put_flags(&cur, c);
+	  }
+	  pl->new_expose = 0;
+	}
+	if (pl->visibility != VisibilityFullyObscured && pl->clean == 0) {
+	  int drew = FALSE;
+
+	  SAVx = -100000; SAVy = -100000; SAVc = SAVd = 0;
+	  map_visible(pl);
+	  if (pl->draw_stopped)
+	    c = next_command(&pl->draw);
+	  else
+	    c = first_command(pl, &pl->draw, MAPPED|NEEDS_REDRAW);
+	  pl->draw_stopped = FALSE;
+	  gettimeofday(&draw_start, NULL);
+	  for (ndrawn = 0; c != NULL; c = next_command(&pl->draw))
+	    if (c->mapped)
+	      if (c->needs_redraw) {
+		GC gc;
+		int g;
+		dXPoint da,db;
+		c->needs_redraw = FALSE;
+		put_flags(&pl->draw, c);
+		drew = TRUE;
+		if (c->decoration
+		    || c->type == TITLE
+		    || c->type == XLABEL
+		    || c->type == YLABEL)
+		  g = DECORATION_BATCH;
+		else
+		  if ( c->color >= 0 && c->color < NColors)
+		    g = c->color;
+		  else
+		    g = 0;
+		gc = g == DECORATION_BATCH ? pl->decgc : pl->gcs[g];
+
+#ifndef WINDOW_COORDS_IN_COMMAND_STRUCT
+		window_coords(pl, &pl->draw, c, &da, &db);
+
+		da = tomain(pl,da);
+		db = tomain(pl,db);
+#else
+		da.x = c->a.x;
+		da.y = c->a.y;
+		db.x = c->b.x;
+		db.y = c->b.y;
+#endif
+		{
+		  if (da.x >  CLAMP) {
+		    if (db.x-da.x != 0)
+		      da.y -= (db.y-da.y)*(da.x-CLAMP)/(db.x-da.x);
+		    da.x =  CLAMP;}
+		  if (da.x < -CLAMP) {
+		    if (db.x-da.x != 0)
+		      da.y -= (db.y-da.y)*(da.x+CLAMP)/(db.x-da.x);
+		    da.x = -CLAMP;}
+		  if (da.y >  CLAMP) {
+		    if (db.y-da.y != 0)
+		      da.x -= (db.x-da.x)*(da.y-CLAMP)/(db.y-da.y);
+		    da.y =  CLAMP;}
+		  if (da.y < -CLAMP) {
+		    if (db.y-da.y != 0)
+		      da.x -= (db.x-da.x)*(da.y+CLAMP)/(db.y-da.y);
+		    da.y = -CLAMP;}
+
+		  if (db.x >  CLAMP) {
+		    if (da.x-db.x != 0)
+		      db.y -= (da.y-db.y)*(db.x-CLAMP)/(da.x-db.x);
+		    db.x =  CLAMP;}
+		  if (db.x < -CLAMP) {
+		    if (da.x-db.x != 0)
+		      db.y -= (da.y-db.y)*(db.x+CLAMP)/(da.x-db.x);
+		    db.x = -CLAMP;}
+		  if (db.y >  CLAMP) {
+		    if (da.y-db.y != 0)
+		      db.x -= (da.x-db.x)*(db.y-CLAMP)/(da.y-db.y);
+		    db.y =  CLAMP;}
+		  if (db.y < -CLAMP) {
+		    if (da.y-db.y != 0)
+		      db.x -= (da.x-db.x)*(db.y+CLAMP)/(da.y-db.y);
+		    db.y = -CLAMP;}
+
+		  a.x = (int) rint(da.x);
+		  a.y = (int) rint(da.y);
+		  b.x = (int) rint(db.x);
+		  b.y = (int) rint(db.y);
+		}
+		
+		switch (c->type) {
+		case DLINE:
+		  add_segment(pl, g, a.x, a.y-2, a.x, a.y+2);
+		  add_segment(pl, g, a.x-2, a.y, a.x+2, a.y);
+		  add_segment(pl, g, b.x, b.y-2, b.x, b.y+2);
+		  add_segment(pl, g, b.x-2, b.y, b.x+2, b.y);
+		  /*fall through*/
+		case LINE:
+		  add_segment(pl, g, a.x, a.y, b.x, b.y);
+		  break;
+		case X:
+		  add_segment(pl, g,
+			    a.x - 2, a.y - 2, a.x + 2, a.y + 2);
+		  add_segment(pl, g,
+			    a.x - 2, a.y + 2, a.x + 2, a.y - 2);
+		  break;
+		case DOT:
+		  /* Lines are much faster on some displays */
+		  if ( SAVx == a.x && SAVy == a.y )
+		    {
+		      SAVc++;
+		    }
+		  else
+		    {
+		      SAVd++;
+		      SAVx = a.x; SAVy = a.y;
+#if 0
+		      /*    
+		            ***
+			   *****
+                           *****
+                           *****
+                            ***
+		       */
+
+		      add_segment(pl, g,a.x-1,a.y-2, a.x+1,a.y-2);
+		      add_segment(pl, g,a.x-2,a.y-1, a.x+2,a.y-1);
+		      add_segment(pl, g,a.x-2,a.y  , a.x+2,a.y  );
+		      add_segment(pl, g,a.x-2,a.y+1, a.x+2,a.y+1);
+		      add_segment(pl, g,a.x-1,a.y+2, a.x+1,a.y+2);
+#else
+#if 1
+		      /*
+			     *
+			    ***
+			     *
+		       */
+
+
+		      add_segment(pl, g, a.x, a.y-1, a.x, a.y+1);
+		      add_segment(pl, g, a.x-1, a.y, a.x+1, a.y);
+#else
+		      /*
+			     *                           
+		       */
+
+		      XDrawPoint(pl->dpy, pl->win, gc, a.x, a.y);
+#endif		      
+#endif
+		    }
+		  break;
+		case PLUS:
+		  add_segment(pl, g,
+			    a.x, a.y - 2, a.x, a.y + 2);
+		  add_segment(pl, g,
+			    a.x - 2, a.y, a.x + 2, a.y);
+		  break;
+		case BOX:
+		  { XSegment segs[4];
+		    int x,y;
+		    int n;
+		    const int BOXRADIUS=3;
+
+		    /* queued with everything else of this colour
+		       
+		       --0-|
+		       |   |
+		       3   1
+		       |   |
+		       |-2--  */
+
+		    x = a.x;
+		    segs[0].x1 = segs[3].x1 = segs[3].x2 = x-BOXRADIUS;
+		    segs[2].x2 = x-(BOXRADIUS-1);
+		    segs[0].x2 = x+(BOXRADIUS-1);
+		    segs[1].x1 = segs[1].x2 = segs[2].x1 = x+BOXRADIUS;
+
+		    y = a.y;
+		    segs[0].y1 = segs[0].y2 = segs[1].y1 = y-BOXRADIUS;
+		    segs[3].y2 = y-(BOXRADIUS-1);
+		    segs[1].y2 = y+(BOXRADIUS-1);
+		    segs[2].y1 = segs[2].y2 = segs[3].y1 = y+BOXRADIUS;
+		    
+		    for (n = 0; n < 4; n++)
+		      add_segment(pl, g, segs[n].x1, segs[n].y1,
+				  segs[n].x2, segs[n].y2);
+		  }
+		  break;
+		case DIAMOND:
+		  { XSegment segs[4];
+		    int x,y;
+		    int n;
+		    /*
+		          /
+		         1 \
+		        /   2
+		       \     \
+		        0   / 
+		         \ 3
+			  /
+			 
+			  */
+		    x = a.x;
+		    y = a.y;
+		    segs[0].x1 = x-1; segs[0].y1 = y+2;
+		    segs[0].x2 = x-3; segs[0].y2 = y;
+		    segs[1].x1 = x-2; segs[1].y1 = y-1;
+		    segs[1].x2 = x;   segs[1].y2 = y-3;
+		    segs[2].x1 = x+1; segs[2].y1 = y-2;
+		    segs[2].x2 = x+3; segs[2].y2 = y;
+		    segs[3].x1 = x+2; segs[3].y1 = y+1;
+		    segs[3].x2 = x;   segs[3].y2 = y+3;
+		    
+		    for (n = 0; n < 4; n++)
+		      add_segment(pl, g, segs[n].x1, segs[n].y1,
+				  segs[n].x2, segs[n].y2);
+		  }
+		  break;
+#define D (pl->thick? 6: 3)
+		case UTICK:
+		  add_segment(pl, g, a.x, a.y, a.x, a.y-D);
+		  break;
+		case DTICK:
+		  add_segment(pl, g, a.x, a.y, a.x, a.y+D);
+		  break;
+		case RTICK:
+		  add_segment(pl, g, a.x, a.y, a.x+D, a.y);
+		  break;
+		case LTICK:
+		  add_segment(pl, g, a.x, a.y, a.x-D, a.y);
+		  break;
+		case HTICK:
+		  add_segment(pl, g, a.x-D, a.y, a.x+D, a.y);
+		  break;
+		case VTICK:
+		  add_segment(pl, g, a.x, a.y-D, a.x, a.y+D);
+		  break;
+#undef D
+#define D (pl->thick? 4: 2)
+		case UARROW:
+		  add_segment(pl, g, a.x - D, a.y + D, a.x, a.y);
+		  add_segment(pl, g, a.x + D, a.y + D, a.x, a.y);
+		  break;
+		case DARROW:
+		  add_segment(pl, g, a.x - D, a.y - D, a.x, a.y);
+		  add_segment(pl, g, a.x + D, a.y - D, a.x, a.y);
+		  break;
+		case RARROW:
+		  add_segment(pl, g, a.x - D, a.y - D, a.x, a.y);
+		  add_segment(pl, g, a.x - D, a.y + D, a.x, a.y);
+		  break;
+		case LARROW:
+		  add_segment(pl, g, a.x + D, a.y - D, a.x, a.y);
+		  add_segment(pl, g, a.x + D, a.y + D, a.x, a.y);
+#undef D
+		  break;
+		case TEXT:
+		case TITLE:
+		case XLABEL:
+		case YLABEL:
+		  { 
+		    lXPoint p;
+		    int direction;
+		    int font_ascent;
+		    int font_descent;
+		    XCharStruct xcs;
+		    /* int height; */
+		    int width;
+		    int space = 5;
+
+		    if (c->type == TITLE) {
+		      p.x = (int) rint(pl->size.x / 2);
+		      p.y = 0;
+		      p = lXPoint_from_dXPoint(tomain(pl,
+						      dXPoint_from_lXPoint(p)
+						      ));
+		      c->position = ABOVE;
+		    } else if (c->type == XLABEL) {
+		      p.x = (int) pl->size.x;
+		      p.y = (int) pl->size.y + 22;
+		      p = lXPoint_from_dXPoint(tomain(pl,
+						      dXPoint_from_lXPoint(p)
+						      ));
+		      c->position = TO_THE_LEFT;
+		    } else if (c->type == YLABEL) {
+		      p.x = 0;
+		      p.y = -5;
+		      p = lXPoint_from_dXPoint(tomain(pl,
+						      dXPoint_from_lXPoint(p)
+						      ));
+		      c->position = ABOVE;
+		    } else
+		      p = a;
+
+		    XTextExtents(pl->font_struct, c->text, strlen(c->text),
+				 &direction, &font_ascent, &font_descent, &xcs);
+		    width = xcs.width;
+		    /* height = font_ascent + font_descent; */
+		    switch (c->position) {
+		    case CENTERED:
+		    case ABOVE:
+		    case BELOW:        p.x -= width/2;       break;
+		    case TO_THE_LEFT:  p.x -= width + space; break;
+		    case TO_THE_RIGHT: p.x += space;         break;
+		    default: panic("drawloop, case TEXT: unknown text positioning");
+		    }
+		    switch (c->position) {
+		    case CENTERED:
+		    case TO_THE_LEFT:
+		    case TO_THE_RIGHT: p.y += font_ascent/2;        break;
+		    case ABOVE:        p.y -= space + font_descent; break;
+		    case BELOW:        p.y += space + font_ascent;  break;
+		    default: panic("drawloop, case TEXT: unknown text positioning");
+		    }
+
+		    flush_batch(pl);
+		    if (pl->raster != NULL)
+		      add_raster_text(pl, g, p.x, p.y, c->text);
+		    else
+		      XDrawString(pl->dpy, plot_drawable(pl), gc, p.x, p.y,
+				  c->text, strlen(c->text));
+		  }
+		  break;
+		default:
+		  panic("unknown command type");
+		}
+		/* if something has happened, stop drawing and go handle
+		   it; a drag or zoom is looked after straight away */
+		if (++ndrawn % DRAW_CHECK == 0) {
+		  struct timeval now;
+
+		  gettimeofday(&now, NULL);
+		  if (pl->state != NORMAL
+		      || (now.tv_sec - draw_start.tv_sec) * 1000
+		      + (now.tv_usec - draw_start.tv_usec) / 1000
+		      >= DRAW_BUDGET) {
+		    flush_batch(pl);
+		    if (XEventsQueued(dpy, QueuedAfterFlush) != 0
+			|| (dpy2 != 0
+			    && XEventsQueued(dpy2, QueuedAfterFlush) != 0)) {
+		      pl->draw_stopped = TRUE;
+		      break;
+		    }
+		    draw_start = now;
+		  }
+		}
+	      }
+	  flush_batch(pl);
+	  if (pl->raster != NULL && drew)
+	    put_raster(pl, 0, 0, pl->raster->width, pl->raster->height);
+	  if (pl->pixmap != None && drew)
+	    show_pixmap(pl, 0, 0, pl->pixmap_width, pl->pixmap_height);
+	  if (c == NULL) pl->clean = 1;
+/* #define SAVE_PRINTOUTS */
+#ifdef SAVE_PRINTOUTS
+	  fprintf(stderr, "saved %d/%d %f%%\n",
+		  SAVc, SAVc+SAVd, SAVc*100.0/(SAVc+SAVd) );
+#endif
+	}
+      }
+      if (visible_count == 0) break; /* will exit */
+    }
+
+    dpy_of_event = 0;
+    do {
+      if (XPending(dpy) != 0) {
+	XNextEvent(dpy, &event);	
+	dpy_of_event = dpy;
+	break;
+      } else if (dpy2 != 0 && XPending(dpy2) != 0) {
+	XNextEvent(dpy2, &event);
+	dpy_of_event = dpy2;
+	break;
+      } else {
+	fd_set fds;
+	int maxfd_plus_1 = 0;
+	int r;
+	struct timeval now, timeout;
+	int following = FALSE;
+
+	/* look at the followed files, and take in what has been
+	   loaded, every FOLLOW_INTERVAL, when there's nothing else
+	   to do */
+	for (ALLPLOTTERS)
+	  if (pl->follow != NULL)
+	    following = TRUE;
+	if (nloading > 0)
+	  following = TRUE;
+	if (following) {
+	  gettimeofday(&now, NULL);
+	  if (timercmp(&now, &next_follow, >=)) {
+	    int changed = FALSE;
+	    int more = FALSE;
+
+#ifdef HAVE_LIBPTHREAD
+	    if (nloading > 0 && take_loaded(!option_one_at_a_time, &more))
+	      changed = TRUE;
+#endif
+	    for (ALLPLOTTERS)
+	      if (pl->follow != NULL && follow_plotter(pl, &more))
+		changed = TRUE;
+	    next_follow = now;
+	    if (!more)
+	      next_follow.tv_usec += FOLLOW_INTERVAL * 1000;
+	    if (next_follow.tv_usec >= 1000000) {
+	      next_follow.tv_sec += next_follow.tv_usec / 1000000;
+	      next_follow.tv_usec %= 1000000;
+	    }
+	    if (changed)
+	      break;		/* go draw it */
+	    continue;
+	  }
+	  timersub(&next_follow, &now, &timeout);
+	}
+
+	FD_ZERO(&fds);
+	FD_SET(ConnectionNumber(dpy), &fds);
+	maxfd_plus_1 = ConnectionNumber(dpy) + 1;
+	if (dpy2 != 0) {
+	  FD_SET(ConnectionNumber(dpy2), &fds);
+	  maxfd_plus_1 = max(maxfd_plus_1, ConnectionNumber(dpy2)+1);
+	}
+	r = select (maxfd_plus_1, &fds, 0, 0, following ? &timeout : 0);
+	if (r < 0) {
+	  perror("select");
+	  exit(1);
+	}
+      }
+    } while(1);
+    if (dpy_of_event == 0)
+      continue;			/* no event, just more to draw */
+
+    for (ALLPLOTTERS)
+      if (pl->dpy == dpy_of_event
+	  && pl->win == event.xany.window)
+	break;
+    if (pl == 0)
+      continue; /* this happens when windows get deleted */
+
+#if 0
+    fprintf(stderr,"event %d\n", event.type);
+#endif
+    switch(event.type) {
+    case Expose:
+      if (pl->pixmap != None) {
+	show_pixmap(pl, event.xexpose.x, event.xexpose.y,
+		    event.xexpose.width, event.xexpose.height);
+	continue;
+      }
+      if (pl->raster != NULL && pl->clean) {
+	put_raster(pl, event.xexpose.x, event.xexpose.y,
+		   event.xexpose.width, event.xexpose.height);
+	continue;
+      }
+      pl->new_expose = 1;
+      if (pl->pointer_marks_on_screen) {
+	draw_pointer_marks(pl, pl->bacgc);
+	pl->pointer_marks_on_screen = FALSE;
+      }
+      continue;
+    case VisibilityNotify:
+      pl->visibility = event.xvisibility.state;
+      break;
+    case ConfigureNotify:
+      /* see if the window has changed size */
+      if (pl->mainsize.x != event.xconfigure.width ||
+	  pl->mainsize.y != event.xconfigure.height)
+	{
+	  pl->mainsize.x = event.xconfigure.width;
+	  pl->mainsize.y = event.xconfigure.height;
+
+	  pl->size_changed = 1;
+	}
+      break;
+    case MapNotify:
+      if (pl->mainsize.x == 0 && pl->mainsize.y == 0) {
+	pl->mainsize.x = pl->xsh.width;
+	pl->mainsize.y = pl->xsh.height;
+	pl->size_changed = 1;
+      }
+      break;
+    case ButtonPress:
+      if (pl->pointer_marks_on_screen) {
+	draw_pointer_marks(pl, pl->xorgc);
+	pl->pointer_marks_on_screen = FALSE;
+      }
+      if (x_synch && y_synch) {
+	PLOTTER savepl = pl;
+	
+	for (ALLPLOTTERS) {
+	  if (pl == savepl) continue;
+	  if (pl->pointer_marks_on_screen) {
+	    draw_pointer_marks(pl, pl->xorgc);
+	    pl->pointer_marks_on_screen = FALSE;
+	  }
+	}
+	pl = savepl;
+      }
+      pl->buttonsdown += 1;
+
+#ifdef TCPTRACE
+      show_dist = 0;
+#endif /* TCPTRACE */
+
+      switch (pl->state) {
+      case NORMAL:
+	switch(event.xbutton.button) {
+	case Button1:
+	  if (event.xbutton.state & ShiftMask)
+	    pl->state = PRINTING;
+	  else if (event.xbutton.state & ControlMask)
+	    pl->state = REDOING;
+	  else
+	    if (event.xbutton.y > pl->size.y + pl->origin.y)
+	      pl->state = HZOOM;
+	    else if (event.xbutton.x < pl->origin.x)
+	      pl->state = VZOOM;
+	    else
+	      pl->state = ZOOM;
+	  break;
+	case Button2:
+	  if (event.xbutton.state & ShiftMask)
+	    pl->state = FIGING;
+#ifdef TCPTRACE
+	  else if (event.xbutton.state & ControlMask)
+	  {
+	      show_dist = 1;
+	      if (event.xbutton.y > pl->size.y + pl->origin.y)
+		  pl->state = HDRAG;
+	      else if (event.xbutton.x < pl->origin.x)
+		  pl->state = VDRAG;
+	      else
+		  pl->state = DRAG;
+	  }
+#endif /* TCPTRACE */
+	  else
+	    if (event.xbutton.y > pl->size.y + pl->origin.y)
+	      pl->state = HDRAG;
+	    else if (event.xbutton.x < pl->origin.x)
+	      pl->state = VDRAG;
+	    else
+	      pl->state = DRAG;
+	  break;
+	case Button3:
+	  if (event.xbutton.state & ControlMask) {
+	    pl->state = EXITING;
+	  } else {
+	    if (option_one_at_a_time) {
+	      if (event.xbutton.state & ShiftMask) {
+		pl->state = BACKINGUP;
+	      } else {
+		pl->state = ADVANCING;
+	      }
+	    } else {
+	      if (event.xbutton.state & ShiftMask) {
+		pl->state = THINFIGING;
+	      } else {
+		pl->state = EXITING;
+	      }
+	    }
+	  }
+	  break;
+	 default:
+	  pl->state = WEDGED;
+	}
+
+	/***** should draw rectangle for HZOOM & VZOOM
+	  For HZOOM, should setup dragend.y with opposite end of
+	  desired rectangle and leave it be during the rest of the
+	  HZOOM operation.  (same for VZOOM) 
+
+	  should rethink HDRAG and VDRAG visual feedback
+	  (maybe use filled solid rectangles drawn in xor mode?)
+
+	  */
+
+
+	pl->raw_dragstart.x = event.xbutton.x;
+	pl->raw_dragstart.y = event.xbutton.y;
+
+	pl->dragstart = pl->raw_dragstart;
+	switch(pl->state) {
+	case HZOOM:
+	  pl->dragstart.y = pl->origin.y;
+	  break;
+	case VZOOM:
+	  pl->dragstart.x = pl->origin.x;
+	  break;
+	default:
+	  break;
+	}
+	pl->dragstart = detent(pl, pl->dragstart);
+	switch (pl->state) {
+	case HDRAG:
+	  pl->dragstart.y = pl->origin.y + pl->size.y - 1;
+	  break;
+	case VDRAG:
+	  pl->dragstart.x = pl->origin.x;
+	  break;
+	default:
+	  break;
+	}
+	if (XQueryPointer(pl->dpy, pl->win, &dummy_window, &dummy_window,
+			  &dummy_int, &dummy_int,
+			  &(pl->pointer.x), &(pl->pointer.y),
+			  &dummy_unsigned_int)
+	    == 0) {
+	  pl->state = WEDGED;
+	  break;
+	}
+	pl->pointer_marks = detent(pl, pl->pointer);
+
+	pl->dragend = detent(pl, pl->pointer);
+	switch(pl->state) {
+	case HZOOM:
+	  pl->dragend.y = pl->origin.y + pl->size.y;
+	  break;
+	case VZOOM:
+	  pl->dragend.x = pl->origin.x + pl->size.x;
+	  break;
+	default:
+	  break;
+	}
+
+	if (x_synch && y_synch) {
+	  PLOTTER savepl = pl;
+
+	  for (ALLPLOTTERS) {
+	    if (pl == savepl) continue;
+
+	    if (pl -> state == NORMAL) {
+	      pl->state = SLAVE;
+	      pl->master = savepl;
+	      pl->master_state = savepl->state;
+	      pl->dragstart = map_pl_pl(savepl, pl, savepl->dragstart);
+	      pl->dragend = map_pl_pl(savepl, pl, savepl->dragend);
+	    }
+	  }
+	  pl = savepl;
+	}
+
+	break;
+
+	/* remaining cases of a button down event when not in state NORMAL
+	   in each case, go to state WEDGED after cleaning up the state we
+	   are coming from */
+      case ZOOM:
+      case HZOOM:
+      case VZOOM:
+      case HDRAG:
+      case VDRAG:
+      case DRAG:
+	pl->state = WEDGED; /* this must be after undrawing on slaves */
+	break;
+      case EXITING:
+      case PRINTING:
+      case FIGING:
+      case THINFIGING:
+      case ADVANCING:
+      case BACKINGUP:
+      case REDOING:
+	pl->state = WEDGED;
+	break;
+      case WEDGED:
+	break;
+      case SLAVE:
+	XBell(pl->dpy,100);
+	break;
+      default:
+	panic("unknown state");
+	break;
+      }
+      
+      draw_pointer_marks(pl, pl->xorgc);
+      pl->pointer_marks_on_screen = TRUE;
+
+      if (x_synch && y_synch) {
+	PLOTTER savepl = pl;
+
+	for (ALLPLOTTERS) {
+	  if (pl == savepl) continue;
+
+	  draw_pointer_marks(pl, pl->xorgc);
+	  pl->pointer_marks_on_screen = TRUE;
+	}
+	pl = savepl;
+      }
+      
+      break;
+    case ButtonRelease:
+      pl->buttonsdown -= 1;
+      if (pl->state != SLAVE) {
+	if (pl->pointer_marks_on_screen) {
+	  draw_pointer_marks(pl, pl->xorgc);
+	  pl->pointer_marks_on_screen = FALSE;
+	}
+	if (x_synch && y_synch) {
+	  PLOTTER savepl = pl;
+	  
+	  for (ALLPLOTTERS) {
+	    if (pl == savepl) continue;
+	    if (pl->pointer_marks_on_screen) {
+	      draw_pointer_marks(pl, pl->xorgc);
+	      pl->pointer_marks_on_screen = FALSE;
+	    }
+	  }
+	  pl = savepl;
+	}
+	
+	if (x_synch && y_synch) {
+	  PLOTTER savepl = pl;
+	  for (ALLPLOTTERS) {
+	    if (pl == savepl) continue;
+	    if (pl->state == SLAVE) {
+	      if (pl->buttonsdown == 0)
+		pl->state = NORMAL;
+	      else
+		pl->state = WEDGED;
+	    }
+	  }
+	  pl = savepl;
+	}
+
+      }
+
+      switch (pl->state) {
+      case ZOOM:
+      case HZOOM:
+      case VZOOM:
+	pl->dragend.x = event.xbutton.x;
+	pl->dragend.y = event.xbutton.y;
+	switch(pl->state) {
+	case HZOOM:
+	  pl->dragend.y = pl->origin.y + pl->size.y;
+	  break;
+	case VZOOM:
+	  pl->dragend.x = pl->origin.x + pl->size.x;
+	  break;
+	default:
+	  break;
+	}
+	pl->dragend = detent(pl, pl->dragend);
+	break;
+      case HDRAG:
+	pl->dragend.x = event.xbutton.x;
+	pl->dragend.y = pl->dragstart.y;
+	pl->dragend = detent(pl, pl->dragend);
+	break;
+      case VDRAG:
+	pl->dragend.x = pl->dragstart.x;
+	pl->dragend.y = event.xbutton.y;
+	pl->dragend = detent(pl, pl->dragend);
+	break;
+      case DRAG:
+	pl->dragend.x = event.xbutton.x;
+	pl->dragend.y = event.xbutton.y;
+	pl->dragend = detent(pl, pl->dragend);
+	break;
+      default:
+	break;
+      }
+      switch (pl->state) {
+      case ZOOM:
+      case HZOOM:
+      case VZOOM:
+      case DRAG:
+      case HDRAG:
+      case VDRAG:
+	pl->dragstart =
+	  lXPoint_from_dXPoint(tosub(pl, dXPoint_from_lXPoint(pl->dragstart)));
+	pl->dragend =
+	  lXPoint_from_dXPoint(tosub(pl, dXPoint_from_lXPoint(pl->dragend)));
+	break;
+      default:
+	break;
+      }
+      switch (pl->state) {
+      case ZOOM:
+      case HZOOM:
+      case VZOOM:
+	{
+	  lXPoint dragstart, dragend;
+	  PLOTTER savepl = pl;
+	  bool must_pop_others = FALSE, do_x = FALSE, do_y = FALSE;
+
+	  dragstart = pl->dragstart;
+	  dragend = pl->dragend;
+
+	  /* Do the plotter in which the button was pressed first, then do
+	     all the others if we are synchronizing (and need to). */
+	  if ((abs(pl->raw_dragstart.x - event.xbutton.x) > 7) ||
+	      (abs(pl->raw_dragstart.y - event.xbutton.y) > 7)) {
+
+	    if (((pl->state != VZOOM) && (abs(dragstart.x - dragend.x) > 7))
+		|| ((pl->state != HZOOM) && (abs(dragstart.y - dragend.y) > 7))) {
+
+	      /* the new view starts out as a copy of this one */
+	      push_view(pl);
+	      if (abs(dragstart.x - dragend.x) > 7) {
+		zoom_in_coord(pl->x_type, pl_x_left, pl_x_right,
+			      dragstart.x, dragend.x,
+			      pl->size.x,
+			      &(pl_x_left), &(pl_x_right));
+		do_x = x_synch;
+	      }
+	      if (abs(dragstart.y - dragend.y) > 7) {
+		zoom_in_coord(pl->y_type, pl_y_bottom, pl_y_top,
+			      pl->size.y - dragstart.y,
+			      pl->size.y - dragend.y,
+			      pl->size.y,
+			      &(pl_y_bottom), &(pl_y_top));
+		do_y = y_synch;
+	      }
+	    } else {
+	      /* do nothing  (don't zoom and don't pop) */
+	      if (0) goto G0093;
+	    }
+	  } else {
+	    if (pl->viewno > 1)
+	      {
+		/* Only pop the others if the synchronized axis changed. */
+		if ((x_synch
+		     && (xcmp(pl_x_left, pl->views[pl->viewno-1].x_left, !=)
+			 || xcmp(pl_x_right, pl->views[pl->viewno-1].x_right, !=)))
+		    || (y_synch
+			&& (ycmp(pl_y_top, pl->views[pl->viewno-1].y_top, !=)
+			    || ycmp(pl_y_bottom, pl->views[pl->viewno-1].y_bottom, !=))))
+		  must_pop_others = TRUE;
+		pop_view(pl);
+	      }
+	    else {
+	      pl_x_left   = pl->views[0].x_left;
+	      pl_x_right  = pl->views[0].x_right;
+	      pl_y_top    = pl->views[0].y_top;
+	      pl_y_bottom = pl->views[0].y_bottom;
+	    }
+	  }
+	  if (pl->pixmap == None)
+	    XClearWindow(pl->dpy, pl->win);
+	  pl->pointer_marks_on_screen = FALSE;
+	  pl->size_changed = 1;
+	  pl->state = NORMAL;
+	  /* If we need to, loop through all the plotters. */
+	  if (do_x || do_y || must_pop_others)
+	    for (ALLPLOTTERS)
+	      {
+		if (pl == savepl) continue;
+		if (must_pop_others)
+		  {
+		    if (pl->viewno > 1) pop_view(pl);
+		    if (x_synch)
+		      {
+			pl_x_left   = savepl->views[savepl->viewno].x_left;
+			pl_x_right  = savepl->views[savepl->viewno].x_right;
+		      }
+		    if (y_synch)
+		      {
+			pl_y_top    = savepl->views[savepl->viewno].y_top;
+			pl_y_bottom = savepl->views[savepl->viewno].y_bottom;
+		      }
+		  }
+		else
+		  {
+		    push_view(pl);
+		    if (do_x)  {
+		      pl_x_left = savepl->views[savepl->viewno].x_left;
+		      pl_x_right = savepl->views[savepl->viewno].x_right;
+		    }
+		    if (do_y)  {
+		      pl_y_bottom = savepl->views[savepl->viewno].y_bottom;
+		      pl_y_top = savepl->views[savepl->viewno].y_top;
+		    }
+
+		    if ( do_x && ! y_synch)
+		      shrink_to_bbox(pl,0,1);
+
+		  }		
+		pl->size_changed = 1;
+	      }
+	G0093:
+	  pl = savepl;		/* Don't know if I have to do this, but... */
+	}
+        break;
+      case REDOING:
+	pl->state = NORMAL;
+	if (redo_view(the_plotter_list, pl, x_synch, y_synch)) {
+	  PLOTTER savepl = pl;
+
+	  redraw_plotter(pl);
+	  if (x_synch || y_synch)
+	    for (ALLPLOTTERS)
+	      if (pl != savepl)
+		redraw_plotter(pl);
+	  pl = savepl;
+	}
+	break;
+      case DRAG:
+      case HDRAG:
+      case VDRAG:
+#ifdef TCPTRACE
+	if (!show_dist)
+	{
+#endif /* TCPTRACE */
+	{
+	  PLOTTER savepl = pl;
+
+	  pl->shift_x_left = pl_x_left;
+	  pl->shift_y_bottom = pl_y_bottom;
+	  pl->shift_pending = TRUE;
+	  drag_coord(pl->x_type, pl_x_left, pl_x_right,
+		     pl->dragend.x,
+		     pl->dragstart.x,
+		     pl->size.x,
+		     &(pl_x_left), &(pl_x_right));
+	  drag_coord(pl->y_type, pl_y_bottom, pl_y_top,
+		     pl->size.y - pl->dragend.y,
+		     pl->size.y - pl->dragstart.y,
+		     pl->size.y,
+		     &(pl_y_bottom), &(pl_y_top));
+	
+	  pl->size_changed = 1;
+	  if (x_synch || y_synch)
+	    for (ALLPLOTTERS)
+	      {
+		if (pl == savepl) continue;
+		if (x_synch && savepl->state != VDRAG)
+		  {
+		    pl_x_left = savepl->views[savepl->viewno].x_left;
+		    pl_x_right = savepl->views[savepl->viewno].x_right;
+		    if (!y_synch) shrink_to_bbox(pl,0,1);
+		    pl->size_changed = 1;
+		  }
+		if (y_synch && savepl->state != HDRAG)
+		  {
+		    pl_y_top = savepl->views[savepl->viewno].y_top;
+		    pl_y_bottom = savepl->views[savepl->viewno].y_bottom;
+		    if (!x_synch) shrink_to_bbox(pl,1,0);
+		    pl->size_changed = 1;
+		  }
+	      }
+	  pl = savepl;
+	}
+	if (pl->pixmap == None)
+	  XClearWindow(pl->dpy, pl->win);
+#ifdef TCPTRACE
+	}
+#endif /* TCPTRACE */
+	pl->pointer_marks_on_screen = FALSE;
+        pl->state = NORMAL;
+        break;
+      case EXITING:
+	pl->state = NORMAL;  
+	if (undisplay_plotter(pl, option_one_at_a_time?-1:0) == 0) {
+	  /* went past last plotter */
+	  if (option_one_at_a_time == 0) {
+	    
+	    /* old behavior */
+
+	  } else {
+	    /* we'll loop around, and start at the beginning with a
+               new window */
+	  }
+	}
+	break;
+      case PRINTING:
+      case FIGING:
+      case THINFIGING:
+	{
+	  FILE *fp, *make_name_open_file();
+	  if ((fp = make_name_open_file(pl))) {
+	    emit_PS(pl, fp, pl->state);
+	    (void) fclose(fp);
+	    pl->size_changed = 1;
+	  }
+	}
+        pl->state = NORMAL;
+        break;
+      case ADVANCING:
+	pl->state = NORMAL;
+	undisplay_plotter(pl, -1);
+	break;
+      case BACKINGUP:
+	pl->state = NORMAL;
+	if (undisplay_plotter(pl, option_one_at_a_time?1:0) == 0) {
+	  /* trying to back up before first plotter */
+
+	  /* display the last plotter (the first on the list) */
+	  if (option_one_at_a_time) 
+	    display_plotter(the_plotter_list);
+	}
+	break;
+      case WEDGED:
+	if (pl->buttonsdown == 0)
+	  pl->state = NORMAL;
+	break;
+      case SLAVE:
+	/* do nothing */
+	break;
+      default:
+	/* Do nothing.  Note that this really can happen due to the semantics
+	 * of the implicit grab associated with a button press event.
+	 */
+	break;
+	
+      }
+      break;
+    case EnterNotify:
+      /*      printf("enter %d\n", pl->win); */
+      break;
+    case LeaveNotify:
+      /*      printf("leave %d\n", pl->win); */
+      if (pl->pointer_marks_on_screen) {
+	draw_pointer_marks(pl, pl->xorgc);
+	pl->pointer_marks_on_screen = FALSE;
+      }
+      if (x_synch && y_synch) {
+	PLOTTER savepl = pl;
+
+	for (ALLPLOTTERS) {
+	  if (pl == savepl) continue;
+
+	  if (pl->pointer_marks_on_screen) {
+	    draw_pointer_marks(pl, pl->xorgc);
+	    pl->pointer_marks_on_screen = FALSE;
+	  }
+	}
+	pl = savepl;
+      }
+
+      break;
+    case MotionNotify:
+      if (pl->pointer_marks_on_screen) {
+	draw_pointer_marks(pl, pl->xorgc);
+	pl->pointer_marks_on_screen = FALSE;
+      }
+      if (XQueryPointer(pl->dpy, pl->win, &dummy_window, &dummy_window,
+			&dummy_int, &dummy_int,
+			&(pl->pointer.x), &(pl->pointer.y),
+			&dummy_unsigned_int)
+	  == 0) {
+	pl->state = WEDGED;
+	break;
+      }
+      if ( pl->size.x == 0 || pl->size.y == 0 )
+	{
+	  fprintf(stderr, "MotionNotify while size is zero ignored.\n");
+	  break;
+	}
+      pl->pointer_marks = detent(pl, pl->pointer);
+
+      if (pl->state != SLAVE) {
+	pl->dragend = detent(pl, pl->pointer);
+	switch(pl->state) {
+	case HZOOM:
+	  pl->dragend.y = pl->origin.y + pl->size.y;
+	  break;
+	case VZOOM:
+	  pl->dragend.x = pl->origin.x + pl->size.x;
+	  break;
+	default:
+	  break;
+	}
+
+      }
+
+      draw_pointer_marks(pl, pl->xorgc);
+      pl->pointer_marks_on_screen = TRUE;
+
+      if (x_synch && y_synch) {
+	PLOTTER savepl = pl;
+	
+	for (ALLPLOTTERS) {
+	  if (pl == savepl) continue;
+	  if (pl->win == 0) continue; /* -1 commandline option. Is this correct? */
+
+	  if (pl->slave_draw_in_progress) {
+	    pl->slave_motion_pending = TRUE;
+	    pl->master_pointer = map_pl_pl(savepl, pl, savepl->pointer_marks);
+	  } else {
+	    if (pl->pointer_marks_on_screen) {
+	      draw_pointer_marks(pl, pl->xorgc);
+	      pl->pointer_marks_on_screen = FALSE;
+	    }
+	    pl->pointer_marks = map_pl_pl(savepl, pl, savepl->pointer_marks);
+	    pl->dragend = pl->pointer_marks;
+	    switch(pl->master_state) {
+	    case HZOOM:
+	      pl->dragend.y = pl->origin.y + pl->size.y;
+	      break;
+	    case VZOOM:
+	      pl->dragend.x = pl->origin.x + pl->size.x;
+	      break;
+	    default:
+	      break;
+	    }
+	    draw_pointer_marks(pl, pl->xorgc);
+	    pl->pointer_marks_on_screen = TRUE;
+	    pl->slave_draw_in_progress = TRUE;
+	    {
+	      XEvent e;
+	      int r; 
+
+	      e.xclient.type = ClientMessage;
+	      e.xclient.serial = 0;
+	      e.xclient.send_event = 1;
+	      e.xclient.display = pl->dpy;
+	      e.xclient.window = pl->win;
+	      e.xclient.message_type = pl->xplot_nagle_atom;
+	      e.xclient.format = 8;
+
+	      r = XSendEvent(pl->dpy, pl->win, False, 0, &e);
+	      if (r != 1)
+		printf("DEBUG: XSendEvent returned %d\n", r);
+	    }
+	  }
+	}
+	pl = savepl;
+      }
+      
+      break;
+    case ClientMessage:
+      if (event.xclient.message_type == pl->xplot_nagle_atom) {
+
+#if 0
+	printf("XPLOT_NAGLE\n");
+#endif
+	pl->slave_draw_in_progress = FALSE;
+
+	if (pl->slave_motion_pending) {
+	  if (pl->pointer_marks_on_screen) {
+	    draw_pointer_marks(pl, pl->xorgc);
+	    pl->pointer_marks_on_screen = FALSE;
+	  }
+	  pl->pointer_marks = pl->master_pointer;
+	  pl->dragend = pl->master_pointer;
+	  switch(pl->master_state) {
+	  case HZOOM:
+	    pl->dragend.y = pl->origin.y + pl->size.y;
+	    break;
+	  case VZOOM:
+	    pl->dragend.x = pl->origin.x + pl->size.x;
+	    break;
+	  default:
+	    break;
+	  }
+	  draw_pointer_marks(pl, pl->xorgc);
+	  pl->pointer_marks_on_screen = TRUE;
+	  pl->slave_motion_pending = FALSE;
+	  pl->slave_draw_in_progress = TRUE;
+	  {
+	    XEvent e;
+	    int r; 
+
+	    e.xclient.type = ClientMessage;
+	    e.xclient.serial = 0;
+	    e.xclient.send_event = 1;
+	    e.xclient.display = pl->dpy;
+	    e.xclient.window = pl->win;
+	    e.xclient.message_type = pl->xplot_nagle_atom;
+	    e.xclient.format = 8;
+
+	    r = XSendEvent(pl->dpy, pl->win, False, 0, &e);
+	    if (r != 1)
+	      printf("DEBUG: XSendEvent returned %d\n", r);
+	  }
+	}
+
+      } else {
+	printf("event ClientMessage unknown type %ld, %s\n",
+	       event.xclient.message_type,
+	       XGetAtomName(pl->dpy, event.xclient.message_type)
+	       );
+      }
+      break;
+    default:
+#if 0      
+      /* other events do happen (for example, ReparentNotify)
+	 so just silently ignore them */ 
+      printf("unknown event type %d\n", event.type);
+#endif
+      break;
+    }
+  } while (the_plotter_list != 0);
+
+ doexit:
+  if (dpy2 != 0) XCloseDisplay(dpy2);
+  XCloseDisplay(dpy);
+  return 0;
+}
+
+/*
+ * The binary format: a struct xpb_file, then blocks of a struct
+ * xpb_block and size bytes (a multiple of 8).  XPB_PLOTTER starts a
+ * plotter; XPB_SEGMENTS, XPB_POINTS and XPB_TEXTS hold n commands a
+ * column at a time, as the stores do, each column padded to 8 bytes.
+ * A text is the offset of a string in an XPB_STRINGS block.  Files
+ * before version 3 lack seq, and version 1 has timevals in microseconds.
+ */
+#define XPB_MAGIC "\211xplot\r\n"
+#define XPB_VERSION 3
+#define XPB_BYTE_ORDER 0x01020304
+#define XPB_PAD(n) (((n) + 7) & ~(uint64_t) 7)
+
+struct xpb_file {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+};
+
+enum xpb_kind { XPB_PLOTTER = 1, XPB_SEGMENTS, XPB_POINTS, XPB_TEXTS,
+		XPB_STRINGS };
+
+struct xpb_block {
+  uint32_t kind;
+  uint32_t n;			/* records in it */
+  uint64_t size;		/* bytes of payload after this */
+};
+
+struct xpb_plotter {
+  char x_type[16];		/* coord type names, '\0' padded */
+  char y_type[16];
+  double aspect_ratio;
+  uint64_t x_units;		/* strings, or 0 for none */
+  uint64_t y_units;
+};
+
+/*
+ * Lines come from an input_source as tokens.  Regular files are mmap()ed
+ * and their tokens end at whitespace, not '\0' (see tokcmp()).
+ */
+#define MAXTOKENS 1000
+
+/* files smaller than two of these are parsed on one thread */
+#ifndef PARSE_CHUNK_MIN
+#define PARSE_CHUNK_MIN (1 << 20)
+#endif
+
+struct input_source {
+  FILE *fp;
+  char *map;			/* start of the mapping, 0 when streaming */
+  size_t maplen;
+  char *cp;			/* next unread byte of the mapping */
+  char *end;
+  int threads;			/* how many to parse it with */
+  int buffered;			/* map is read into memory, not mapped */
+  int kept;			/* map is pointed into, don't let it go */
+  int go;			/* it ended with "go" */
+  struct feed *feed;		/* what map is decompressed from, or NULL */
+  char buf[1000];
+  char *tokens[MAXTOKENS];
+};
+
+#define istokend(ch) ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\0')
+
+/*
+ * Compressed files are decompressed by a thread of their own, up to
+ * FEED_AHEAD blocks ahead of the parser, each ending at a line end.
+ */
+#ifndef FEED_BLOCK
+#define FEED_BLOCK (4 << 20)
+#endif
+#define FEED_AHEAD 4
+
+enum feed_format { FEED_GZIP, FEED_XZ, FEED_ZSTD };
+
+struct feed_block {
+  struct feed_block *next;
+  char *data;
+  size_t len;
+  int last;			/* there are no more after it */
+};
+
+struct feed {
+  enum feed_format format;
+  unsigned char *src;		/* the compressed file, mapped */
+  size_t srclen;
+  int own_src;			/* src was read in, not mapped */
+  size_t srcpos;		/* how much of it is handed to the library */
+  int ended;			/* it has all been decompressed */
+  char *carry;			/* the part line after the last block */
+  size_t ncarry;
+#ifdef HAVE_LIBZ
+  z_stream z;
+#endif
+#ifdef HAVE_LIBLZMA
+  lzma_stream x;
+#endif
+#ifdef HAVE_LIBZSTD
+  ZSTD_DStream *zs;
+  size_t zret;			/* 0 between frames */
+#endif
+  /* the blocks decompressed and not yet taken */
+  struct feed_block *blocks;
+  struct feed_block **tail;
+  int nblocks;
+  int stop;			/* the parser wants no more */
+#ifdef HAVE_LIBPTHREAD
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+  /* the parser's side */
+  int drained;			/* it has taken the last block */
+  char *prev;			/* the block before, still pointed into */
+};
+
+/* Whether a file starting with ch might be compressed in a way that
+   this xplot can undo. */
+static int feed_magic(int ch)
+{
+#ifdef HAVE_LIBZ
+  if (ch == 0x1f)
+    return TRUE;
+#endif
+#ifdef HAVE_LIBLZMA
+  if (ch == 0xfd)
+    return TRUE;
+#endif
+#ifdef HAVE_LIBZSTD
+  if (ch == 0x28)
+    return TRUE;
+#endif
+  return FALSE;
+}
+
+/* Which compression, that this xplot can undo, the file in p uses. */
+static int feed_format(unsigned char *p, size_t len)
+{
+#ifdef HAVE_LIBZ
+  if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+    return FEED_GZIP;
+#endif
+#ifdef HAVE_LIBLZMA
+  if (len >= 6 && memcmp(p, "\3757zXZ\0", 6) == 0)
+    return FEED_XZ;
+#endif
+#ifdef HAVE_LIBZSTD
+  if (len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f
+      && p[3] == 0xfd)
+    return FEED_ZSTD;
+#endif
+  return -1;
+}
+
+/*
+ * Decompress up to n bytes into out; fewer only at the end.
+ */
+static size_t inflate_some(struct feed *f, char *out, size_t n)
+{
+  size_t got = 0;
+  char *error = NULL;
+
+  if (f->ended)
+    return 0;
+  switch (f->format) {
+#ifdef HAVE_LIBZ
+  case FEED_GZIP:
+    f->z.next_out = (Bytef *) out;
+    f->z.avail_out = n;
+    while (f->z.avail_out > 0) {
+      int r;
+
+      if (f->z.avail_in == 0) {
+	if (f->srcpos == f->srclen) {
+	  error = "unexpected end of gzip data";
+	  break;
+	}
+	/* avail_in is only an int */
+	f->z.next_in = f->src + f->srcpos;
+	f->z.avail_in = min(f->srclen - f->srcpos, 1 << 30);
+	f->srcpos += f->z.avail_in;
+      }
+      r = inflate(&f->z, Z_NO_FLUSH);
+      if (r == Z_STREAM_END) {
+	/* gzip files can be several put one after the other */
+	if (f->z.avail_in == 0 && f->srcpos == f->srclen) {
+	  f->ended = TRUE;
+	  break;
+	}
+	inflateReset(&f->z);
+      } else if (r != Z_OK) {
+	error = f->z.msg ? f->z.msg : "corrupt gzip data";
+	break;
+      }
+    }
+    got = n - f->z.avail_out;
+    break;
+#endif
+#ifdef HAVE_LIBLZMA
+  case FEED_XZ:
+    f->x.next_out = (uint8_t *) out;
+    f->x.avail_out = n;
+    while (f->x.avail_out > 0) {
+      lzma_ret r = lzma_code(&f->x, LZMA_FINISH);
+
+      if (r == LZMA_STREAM_END) {
+	f->ended = TRUE;
+	break;
+      } else if (r != LZMA_OK) {
+	error = r == LZMA_BUF_ERROR ? "unexpected end of xz data"
+	  : "corrupt xz data";
+	break;
+      }
+    }
+    got = n - f->x.avail_out;
+    break;
+#endif
+#ifdef HAVE_LIBZSTD
+  case FEED_ZSTD:
+    {
+      ZSTD_inBuffer zin;
+      ZSTD_outBuffer zout;
+
+      zin.src = f->src;
+      zin.size = f->srclen;
+      zin.pos = f->srcpos;
+      zout.dst = out;
+      zout.size = n;
+      zout.pos = 0;
+      while (zout.pos < zout.size) {
+	if (zin.pos == zin.size && f->zret == 0) {
+	  f->ended = TRUE;
+	  break;
+	}
+	f->zret = ZSTD_decompressStream(f->zs, &zout, &zin);
+	if (ZSTD_isError(f->zret)) {
+	  error = (char *) ZSTD_getErrorName(f->zret);
+	  break;
+	}
+	if (zin.pos == zin.size && zout.pos < zout.size && f->zret != 0) {
+	  error = "unexpected end of zstd data";
+	  break;
+	}
+      }
+      f->srcpos = zin.pos;
+      got = zout.pos;
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+  if (error != NULL) {
+    fprintf(stderr, "xplot: %s\n", error);
+    f->ended = TRUE;
+  }
+  return got;
+}
+
+/* Decompress the next block.  At the end of the file there is always
+   a last one, which may be empty. */
+static struct feed_block *decompress_block(struct feed *f)
+{
+  struct feed_block *b;
+  size_t size = FEED_BLOCK;
+  size_t len = 0;
+  char *buf;
+  char *nl;
+
+  while (size <= f->ncarry)
+    size *= 2;			/* after a line longer than a block */
+  b = (struct feed_block *) malloc(sizeof(*b));
+  buf = (char *) malloc(size);
+  if (b == 0 || buf == 0) fatalerror("malloc returned null");
+  if (f->ncarry) {
+    memcpy(buf, f->carry, f->ncarry);
+    len = f->ncarry;
+    f->ncarry = 0;
+  }
+
+  for (;;) {
+    len += inflate_some(f, buf + len, size - len);
+    if (len < size)
+      break;			/* that's the end of it */
+    for (nl = buf + len; nl > buf && nl[-1] != '\n'; nl--)
+      ;
+    if (nl > buf) {
+      /* the part line after the last one starts the next block */
+      f->ncarry = buf + len - nl;
+      if (f->ncarry) {
+	free(f->carry);
+	f->carry = (char *) malloc(f->ncarry);
+	if (f->carry == 0) fatalerror("malloc returned null");
+	memcpy(f->carry, nl, f->ncarry);
+      }
+      len = nl - buf;
+      break;
+    } else {
+      /* a line longer than a block */
+      char *p = (char *) malloc(2 * size);
+
+      if (p == 0) fatalerror("malloc returned null");
+      memcpy(p, buf, len);
+      free(buf);
+      buf = p;
+      size *= 2;
+    }
+  }
+  b->next = NULL;
+  b->data = buf;
+  b->len = len;
+  b->last = f->ended && f->ncarry == 0;
+  return b;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *feed_thread(void *arg)
+{
+  struct feed *f = (struct feed *) arg;
+  struct feed_block *b;
+  int last;
+
+  do {
+    b = decompress_block(f);
+    last = b->last;
+    pthread_mutex_lock(&f->lock);
+    while (f->nblocks >= FEED_AHEAD && !f->stop)
+      pthread_cond_wait(&f->cond, &f->lock);
+    if (f->stop) {
+      pthread_mutex_unlock(&f->lock);
+      free(b->data);
+      free(b);
+      break;
+    }
+    *f->tail = b;
+    f->tail = &b->next;
+    f->nblocks++;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+  } while (!last);
+  return NULL;
+}
+#endif
+
+/* The next block, waiting for it if need be. */
+static struct feed_block *next_block(struct feed *f)
+{
+#ifdef HAVE_LIBPTHREAD
+  struct feed_block *b;
+
+  pthread_mutex_lock(&f->lock);
+  while (f->blocks == NULL)
+    pthread_cond_wait(&f->cond, &f->lock);
+  b = f->blocks;
+  f->blocks = b->next;
+  if (f->blocks == NULL)
+    f->tail = &f->blocks;
+  f->nblocks--;
+  pthread_cond_broadcast(&f->cond);
+  pthread_mutex_unlock(&f->lock);
+  return b;
+#else
+  return decompress_block(f);
+#endif
+}
+
+/*
+ * Move in on to its feed's next block, keeping the one before, which the
+ * last line's tokens may point into.  Returns FALSE at the end.
+ */
+static int refill(struct input_source *in)
+{
+  struct feed *f = in->feed;
+  struct feed_block *b;
+  size_t left = in->end - in->cp;
+  char *map;
+
+  if (f->drained)
+    return FALSE;
+  b = next_block(f);
+  f->drained = b->last;
+  if (b->len == 0 && b->last) {
+    free(b->data);
+    free(b);
+    return FALSE;
+  }
+  if (left > 0) {
+    map = (char *) malloc(left + b->len);
+    if (map == 0) fatalerror("malloc returned null");
+    memcpy(map, in->cp, left);
+    memcpy(map + left, b->data, b->len);
+    free(b->data);
+  } else
+    map = b->data;
+  free(f->prev);
+  f->prev = in->map;
+  in->map = in->cp = map;
+  in->maplen = left + b->len;
+  in->end = map + in->maplen;
+  free(b);
+  return TRUE;
+}
+
+/* Start decompressing the file in, of the given format, and have in
+   read the first block.  in's map is the file's mapping, or if own_src
+   is set a buffer it was read into, which is the feed's to free. */
+static void open_feed(struct input_source *in, int format, int own_src)
+{
+  struct feed *f;
+
+  f = (struct feed *) malloc(sizeof(*f));
+  if (f == 0) fatalerror("malloc returned null");
+  memset(f, 0, sizeof(*f));
+  f->format = format;
+  f->src = (unsigned char *) in->map;
+  f->srclen = in->maplen;
+  f->own_src = own_src;
+  f->tail = &f->blocks;
+  switch (format) {
+#ifdef HAVE_LIBZ
+  case FEED_GZIP:
+    /* 32: a gzip header, not a zlib one */
+    if (inflateInit2(&f->z, 15 + 32) != Z_OK)
+      fatalerror("can't start decompressing");
+    break;
+#endif
+#ifdef HAVE_LIBLZMA
+  case FEED_XZ:
+    {
+      lzma_stream init = LZMA_STREAM_INIT;
+
+      f->x = init;
+      if (lzma_stream_decoder(&f->x, UINT64_MAX, LZMA_CONCATENATED)
+	  != LZMA_OK)
+	fatalerror("can't start decompressing");
+      f->x.next_in = f->src;
+      f->x.avail_in = f->srclen;
+    }
+    break;
+#endif
+#ifdef HAVE_LIBZSTD
+  case FEED_ZSTD:
+    f->zs = ZSTD_createDStream();
+    if (f->zs == NULL || ZSTD_isError(ZSTD_initDStream(f->zs)))
+      fatalerror("can't start decompressing");
+    break;
+#endif
+  default:
+    break;
+  }
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_init(&f->lock, NULL);
+  pthread_cond_init(&f->cond, NULL);
+  if (pthread_create(&f->thread, NULL, feed_thread, f) != 0)
+    fatalerror("can't start a thread to decompress the file");
+#endif
+
+  in->feed = f;
+  in->buffered = TRUE;
+  /* an empty block to start from */
+  in->map = in->cp = in->end = (char *) malloc(1);
+  if (in->map == 0) fatalerror("malloc returned null");
+  in->maplen = 0;
+  (void) refill(in);
+}
+
+static void close_feed(struct feed *f)
+{
+  struct feed_block *b;
+
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_lock(&f->lock);
+  f->stop = TRUE;
+  pthread_cond_broadcast(&f->cond);
+  pthread_mutex_unlock(&f->lock);
+  pthread_join(f->thread, NULL);
+  pthread_mutex_destroy(&f->lock);
+  pthread_cond_destroy(&f->cond);
+#endif
+  while ((b = f->blocks) != NULL) {
+    f->blocks = b->next;
+    free(b->data);
+    free(b);
+  }
+  switch (f->format) {
+#ifdef HAVE_LIBZ
+  case FEED_GZIP:
+    inflateEnd(&f->z);
+    break;
+#endif
+#ifdef HAVE_LIBLZMA
+  case FEED_XZ:
+    lzma_end(&f->x);
+    break;
+#endif
+#ifdef HAVE_LIBZSTD
+  case FEED_ZSTD:
+    ZSTD_freeDStream(f->zs);
+    break;
+#endif
+  default:
+    break;
+  }
+  free(f->carry);
+  free(f->prev);
+  if (f->own_src)
+    free(f->src);
+#ifdef _POSIX_MAPPED_FILES
+  else
+    (void) munmap(f->src, f->srclen);
+#endif
+  free(f);
+}
+
+/* A binary file is read all at once, so decompress all of it. */
+static void slurp_feed(struct input_source *in)
+{
+  struct feed *f = in->feed;
+  struct feed_block *b;
+  size_t size = in->maplen;
+  size_t len = in->maplen;
+  char *buf = in->map;
+
+  while (!f->drained) {
+    b = next_block(f);
+    f->drained = b->last;
+    if (len + b->len > size) {
+      char *p;
+
+      while (len + b->len > size)
+	size *= 2;
+      p = (char *) malloc(size);
+      if (p == 0) fatalerror("malloc returned null");
+      memcpy(p, buf, len);
+      free(buf);
+      buf = p;
+    }
+    memcpy(buf + len, b->data, b->len);
+    len += b->len;
+    free(b->data);
+    free(b);
+  }
+  in->map = in->cp = buf;
+  in->maplen = len;
+  in->end = buf + len;
+  in->feed = NULL;
+  close_feed(f);
+}
+
+#ifdef HAVE_LIBZSTD
+/*
+ * A zstd file whose frames all give their sizes is decompressed a frame
+ * per thread into in's map.  Returns FALSE if it can't be.
+ */
+struct zstd_frame {
+  const unsigned char *src;
+  size_t srclen;
+  char *dst;
+  size_t dstlen;
+  int bad;
+};
+
+static void unzstd_frame(void *arg, int k)
+{
+  struct zstd_frame *fr = (struct zstd_frame *) arg + k;
+  size_t r;
+
+  if (fr->dstlen == 0)
+    return;
+  r = ZSTD_decompress(fr->dst, fr->dstlen, fr->src, fr->srclen);
+  fr->bad = ZSTD_isError(r) || r != fr->dstlen;
+}
+
+static int unzstd_frames(struct input_source *in, int own_src)
+{
+  unsigned char *src = (unsigned char *) in->map;
+  size_t len = in->maplen;
+  size_t pos = 0, total = 0;
+  struct zstd_frame *frames = NULL;
+  int n = 0, max = 0;
+  int k, ok = TRUE;
+  char *buf;
+
+  while (ok && pos < len) {
+    size_t size = ZSTD_findFrameCompressedSize(src + pos, len - pos);
+    unsigned long long content;
+
+    if (ZSTD_isError(size))
+      break;
+    /* skippable frames' magic numbers are 0x184D2A50 to 0x184D2A5F */
+    if (size >= 4 && (src[pos] & 0xf0) == 0x50 && src[pos + 1] == 0x2a
+	&& src[pos + 2] == 0x4d && src[pos + 3] == 0x18)
+      content = 0;
+    else {
+      content = ZSTD_getFrameContentSize(src + pos, size);
+      if (content == ZSTD_CONTENTSIZE_UNKNOWN
+	  || content == ZSTD_CONTENTSIZE_ERROR
+	  || content > (size_t) -2 - total)
+	break;
+    }
+    if (n == max) {
+      struct zstd_frame *p;
+
+      max = max ? 2 * max : 64;
+      p = (struct zstd_frame *) malloc(max * sizeof(*p));
+      if (p == 0) fatalerror("malloc returned null");
+      if (n)
+	memcpy(p, frames, n * sizeof(*p));
+      free(frames);
+      frames = p;
+    }
+    frames[n].src = src + pos;
+    frames[n].srclen = size;
+    frames[n].dstlen = (size_t) content;
+    frames[n].bad = FALSE;
+    n++;
+    total += (size_t) content;
+    pos += size;
+  }
+  if (pos < len || n < 2) {
+    free(frames);
+    return FALSE;
+  }
+
+  buf = (char *) malloc(total + 1);
+  if (buf == 0) fatalerror("malloc returned null");
+  for (pos = 0, k = 0; k < n; k++) {
+    frames[k].dst = buf + pos;
+    pos += frames[k].dstlen;
+  }
+  run_parallel(n, in->threads, unzstd_frame, frames);
+  for (k = 0; k < n; k++)
+    if (frames[k].bad)
+      ok = FALSE;
+  free(frames);
+  if (!ok) {
+    free(buf);
+    return FALSE;
+  }
+
+  if (own_src)
+    free(in->map);
+#ifdef _POSIX_MAPPED_FILES
+  else
+    (void) munmap(in->map, in->maplen);
+#endif
+  in->map = in->cp = buf;
+  in->maplen = total;
+  in->end = buf + total;
+  in->buffered = TRUE;
+  return TRUE;
+}
+#endif
+
+/* Decompress in's file, of the given format: see open_feed(). */
+static void decompress_input(struct input_source *in, int format,
+			     int own_src)
+{
+#ifdef HAVE_LIBZSTD
+  if (format == FEED_ZSTD && in->threads > 1 && unzstd_frames(in, own_src))
+    return;
+#endif
+  open_feed(in, format, own_src);
+  /* a binary file is read all at once */
+  if (in->maplen != 0 && in->map[0] == XPB_MAGIC[0])
+    slurp_feed(in);
+}
+
+struct input_source *open_input(FILE *fp, int nthreads)
+{
+  struct input_source *in;
+  int ch;
+
+  in = (struct input_source *) malloc(sizeof(*in));
+  in->fp = fp;
+  in->map = 0;
+  in->maplen = 0;
+  in->cp = in->end = 0;
+  in->threads = nthreads;
+  in->buffered = FALSE;
+  in->kept = FALSE;
+  in->go = FALSE;
+  in->feed = NULL;
+
+#ifdef _POSIX_MAPPED_FILES
+  {
+    struct stat st;
+    void *p;
+
+    if (fp != stdin
+	&& fstat(fileno(fp), &st) == 0
+	&& S_ISREG(st.st_mode)
+	&& st.st_size != 0
+	&& (p = mmap(0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+		     fileno(fp), 0)) != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+      (void) madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+      in->map = in->cp = (char *) p;
+      in->maplen = (size_t) st.st_size;
+      in->end = in->map + in->maplen;
+      if ((ch = feed_format((unsigned char *) p, in->maplen)) >= 0)
+	decompress_input(in, ch, FALSE);
+      return in;
+    }
+  }
+#endif
+
+  /* a binary file can't be read a line at a time, so take all of it;
+     and a compressed one, to decompress as if it had been mapped */
+  ch = getc(fp);
+  if (ch == EOF)
+    return in;
+  (void) ungetc(ch, fp);
+  if (ch == (unsigned char) XPB_MAGIC[0] || feed_magic(ch)) {
+    size_t size = 64 * 1024;
+    size_t len = 0;
+    char *buf = NULL;
+
+    for (;;) {
+      char *p = (char *) malloc(size);
+
+      if (p == 0) fatalerror("malloc returned null");
+      if (len)
+	memcpy(p, buf, len);
+      free(buf);
+      buf = p;
+      len += fread(buf + len, 1, size - len, fp);
+      if (len < size)
+	break;
+      size *= 2;
+    }
+    in->map = in->cp = buf;
+    in->maplen = len;
+    in->end = in->map + len;
+    in->buffered = TRUE;
+    if ((ch = feed_format((unsigned char *) buf, len)) >= 0)
+      decompress_input(in, ch, TRUE);
+  }
+  return in;
+}
+
+void close_input(struct input_source *in)
+{
+  if (in->feed != NULL)
+    close_feed(in->feed);
+  if (in->map != 0 && !in->kept) {
+    if (in->buffered)
+      free(in->map);
+#ifdef _POSIX_MAPPED_FILES
+    else
+      (void) munmap(in->map, in->maplen);
+#endif
+  }
+  free(in);
+}
+
+#ifdef __GNUC__
+inline
+#endif
+static char **stream_gettokens(struct input_source *in)
+{
+  char *buf = in->buf;
+  char **tokens = in->tokens;
+  char *cp;
+  int i;
+
+  if (fgets(buf, sizeof(in->buf), in->fp) == NULL)
+    return 0;
+
+  i=0;
+  cp=buf; 
+
+  while (*cp != '\0') {
+    while (*cp == ' ' || *cp == '\t') cp++;
+    if (*cp == '\n') break;
+    tokens[i++] = cp;
+    while (*cp != ' ' && *cp != '\t' && *cp != '\n' && *cp != '\0') cp++;
+    if (*cp == '\n' || *cp == '\0') {
+      break;
+    }
+    *cp = '\0';
+    cp++;
+  }
+  if (*cp == '\0') return 0;
+  else *cp = '\0';
+  tokens[i] = 0;
+  return tokens;
+}
+
+#ifdef __GNUC__
+inline
+#endif
+static char **mapped_gettokens(struct input_source *in)
+{
+  char **tokens = in->tokens;
+  char *cp = in->cp;
+  char *nl;
+  int i;
+
+  /* like fgets() above, a last line without a newline is not a line */
+  while (cp >= in->end
+	 || (nl = memchr(cp, '\n', (size_t) (in->end - cp))) == NULL) {
+    if (in->feed == NULL || !refill(in))
+      return 0;
+    cp = in->cp;
+  }
+
+  i = 0;
+  while (cp < nl && i < MAXTOKENS - 1) {
+    while (*cp == ' ' || *cp == '\t') cp++;
+    if (cp == nl) break;
+    tokens[i++] = cp;
+    while (*cp != ' ' && *cp != '\t' && *cp != '\n') cp++;
+  }
+  tokens[i] = 0;
+  in->cp = nl + 1;
+  return tokens;
+}
+
+#define gettokens(in) ((in)->map ? mapped_gettokens(in) : stream_gettokens(in))
+
+/* Return the next whole line (without its newline), copied into arena
+   a.  Used for the bodies of title, label, units and text commands. */
+static char *gettextline(struct input_source *in, struct arena *a)
+{
+  char *cp;
+  size_t len;
+
+  if (in->map) {
+    if (in->cp >= in->end && in->feed != NULL)
+      (void) refill(in);
+    cp = in->cp;
+    for (len = 0; cp + len < in->end && cp[len] != '\n'; len++)
+      ;
+    in->cp = cp + len + (cp + len < in->end);
+  } else {
+    in->buf[0] = '\0';
+    (void) fgets(in->buf, sizeof(in->buf), in->fp);
+    cp = in->buf;
+    for (len = 0; cp[len] != '\0' && cp[len] != '\n'; len++)
+      ;
+  }
+  return arena_strdup(a, cp, len);
+}
+
+/* compare a (whitespace terminated) token against a word */
+#ifdef __GNUC__
+static inline
+#else
+static
+#endif
+int tokcmp(char *tok, char *word)
+{
+  while (*word != '\0' && *tok == *word) {
+    tok++;
+    word++;
+  }
+  return !(*word == '\0' && istokend(*tok));
+}
+
+static void fputtok(char *tok, FILE *fp)
+{
+  while (!istokend(*tok))
+    fputc(*tok++, fp);
+}
+
+xpcolor_t parse_color(char *s)
+{
+  int atoi();
+  int i;
+
+  if (isdigit(*s))
+    return (xpcolor_t) atoi(s);
+  for (i=0; i < NCOLORS; ++i)
+    if (tokcmp(s,ColorNames[i]) == 0)
+      return(i);
+  return(-1);  /* not a color name */
+}
+
+/*
+ * The verbs, grouped by first character for lookup_verb().
+ */
+enum verb_kind { V_ASPECT, V_POINT, V_LINE, V_TEXT, V_TITLE, V_XUNITS,
+		 V_YUNITS, V_GO, V_NEW_PLOTTER };
+
+static struct verb {
+  char *name;
+  enum verb_kind kind;
+  enum plot_command_type type;
+  position position;
+} verbs[] = {
+  { "+",            V_POINT,       PLUS,      CENTERED },
+  { ".",            V_POINT,       DOT,       CENTERED },
+  { "aspect_ratio", V_ASPECT,      INVISIBLE, CENTERED },
+  { "atext",        V_TEXT,        TEXT,      ABOVE },
+  { "box",          V_POINT,       BOX,       CENTERED },
+  { "btext",        V_TEXT,        TEXT,      BELOW },
+  { "ctext",        V_TEXT,        TEXT,      CENTERED },
+  { "dot",          V_POINT,       DOT,       CENTERED },
+  { "diamond",      V_POINT,       DIAMOND,   CENTERED },
+  { "dtick",        V_POINT,       DTICK,     CENTERED },
+  { "darrow",       V_POINT,       DARROW,    CENTERED },
+  { "dline",        V_LINE,        DLINE,     CENTERED },
+  { "go",           V_GO,          INVISIBLE, CENTERED },
+  { "htick",        V_POINT,       HTICK,     CENTERED },
+  { "invisible",    V_POINT,       INVISIBLE, CENTERED },
+  { "line",         V_LINE,        LINE,      CENTERED },
+  { "ltick",        V_POINT,       LTICK,     CENTERED },
+  { "larrow",       V_POINT,       LARROW,    CENTERED },
+  { "ltext",        V_TEXT,        TEXT,      TO_THE_LEFT },
+  { "new_plotter",  V_NEW_PLOTTER, INVISIBLE, CENTERED },
+  { "plus",         V_POINT,       PLUS,      CENTERED },
+  { "rtick",        V_POINT,       RTICK,     CENTERED },
+  { "rarrow",       V_POINT,       RARROW,    CENTERED },
+  { "rtext",        V_TEXT,        TEXT,      TO_THE_RIGHT },
+  { "title",        V_TITLE,       TITLE,     CENTERED },
+  { "utick",        V_POINT,       UTICK,     CENTERED },
+  { "uarrow",       V_POINT,       UARROW,    CENTERED },
+  { "vtick",        V_POINT,       VTICK,     CENTERED },
+  { "x",            V_POINT,       X,         CENTERED },
+  { "xlabel",       V_TITLE,       XLABEL,    CENTERED },
+  { "xunits",       V_XUNITS,      INVISIBLE, CENTERED },
+  { "ylabel",       V_TITLE,       YLABEL,    CENTERED },
+  { "yunits",       V_YUNITS,      INVISIBLE, CENTERED },
+  { 0 }
+};
+
+static short verb_first[256];
+
+static void index_verbs(void)
+{
+  static int virgin = 1;
+  int i;
+
+  if (virgin) {
+    for (i = sizeof(verbs)/sizeof(verbs[0]) - 2; i >= 0; i--)
+      verb_first[(unsigned char) verbs[i].name[0]] = i + 1;
+    virgin = 0;
+  }
+}
+
+static struct verb *lookup_verb(char *tok)
+{
+  struct verb *v;
+  int i;
+
+  index_verbs();
+  i = verb_first[(unsigned char) *tok];
+  if (i == 0)
+    return 0;
+  for (v = &verbs[i - 1]; v->name && v->name[0] == *tok; v++)
+    if (tokcmp(tok, v->name) == 0)
+      return v;
+  return 0;
+}
+
+
+/* Whether the line just read from in is a command whose text, on the
+   line after it, isn't all there yet.  A file being written with
+   -follow can end like that. */
+static int text_pending(struct input_source *in, char **tokens)
+{
+  struct verb *v;
+
+  if (tokens[0] == 0 || (v = lookup_verb(tokens[0])) == 0)
+    return FALSE;
+  switch (v->kind) {
+  case V_TEXT:
+  case V_TITLE:
+  case V_XUNITS:
+  case V_YUNITS:
+    return memchr(in->cp, '\n', in->end - in->cp) == NULL;
+  default:
+    return FALSE;
+  }
+}
+
+/* What parse_line() made of a line. */
+enum parsed { PARSED, PARSE_ERROR, PARSED_GO, PARSED_NEW_PLOTTER };
+
+/*
+ * Read the coord types that start a plotter, skipping any new_plotter
+ * lines before them.  Returns NULL, or what is wrong with the input.
+ */
+static char *parse_header(struct input_source *in, struct plotter *pl,
+			  int *lineno, char ***tokensp, int *ntokensp)
+{
+  char **tokens;
+  int ntokens;
+
+  do {
+    (*lineno)++;
+    tokens = gettokens(in);
+    *tokensp = tokens;
+    *ntokensp = 0;
+    if (tokens == 0) return "EOF before first line of input";
+    for (ntokens = 0; tokens[ntokens] != 0; ntokens++);
+    *ntokensp = ntokens;
+  } while (ntokens == 1 && tokcmp(tokens[0], "new_plotter") == 0);
+  
+  if (ntokens != 2)
+    return "invalid input format -- expecting coord type names";
+
+  pl->x_type = parse_coord_name(tokens[0]);
+  pl->y_type = parse_coord_name(tokens[1]);
+
+  if (((int) pl->x_type) < 0 || ((int) pl->y_type) < 0)
+    return "unknown coord type";
+
+  init_stores(pl);
+  return NULL;
+}
+
+/*
+ * Act on one line of input.  On PARSE_ERROR *error says why.
+ */
+static enum parsed parse_line(struct input_source *in, struct plotter *pl,
+			      struct arena *texts,
+			      char **tokens, int ntokens, char **error)
+{
+  command newcom;
+  command *com;
+  struct verb *v;
+
+  if (ntokens == 0) return PARSED;
+  if (tokens[0][0] == ';') return PARSED;
+    
+  /* check for color key alone on a line */
+  if (ntokens == 1) {
+    xpcolor_t c;
+
+    c = parse_color(tokens[0]);
+    if (c != -1) {
+      /* color keyword */
+      pl->default_color = pl->current_color = c;
+      return PARSED;
+    }
+  }
+
+  if (ntokens == 2 &&
+      parse_coord_name(tokens[0]) == pl->x_type &&
+      parse_coord_name(tokens[1]) == pl->y_type)
+    return PARSED;
+
+#define lineerror(s) { *error = (s); return PARSE_ERROR; }
+#define coordinate(c, type, tok) \
+  if (!parse_coord(type, tok, &(c))) lineerror("bad coordinate")
+#define not_ntokens_equal_to_3_or_4	(ntokens != 3 && ntokens != 4)
+#define COLORfromTOK3  (com->color = ntokens == 4 ?\
+			parse_color(tokens[3]) : pl->current_color)
+
+  v = lookup_verb(tokens[0]);
+  if (v == 0)
+    lineerror("input format error");
+
+  switch (v->kind) {
+  case V_ASPECT:
+    if (ntokens != 2) lineerror("input format error");
+    if (pl->x_type != pl->y_type)
+      lineerror("aspect_ratio requires identical coordinate types");
+    pl->aspect_ratio = atof(tokens[1]);
+    break;
+  case V_POINT:
+    if (not_ntokens_equal_to_3_or_4) lineerror("input format error");
+    com = new_command(pl, &newcom);
+    com->type = v->type;
+    coordinate(com->xa, pl->x_type, tokens[1]);
+    coordinate(com->ya, pl->y_type, tokens[2]);
+    COLORfromTOK3;
+    add_command(pl, com);
+    break;
+  case V_LINE:
+    if (ntokens != 5 && ntokens != 6) lineerror("input format error");
+    com = new_command(pl, &newcom);
+    com->type = v->type;
+    coordinate(com->xa, pl->x_type, tokens[1]);
+    coordinate(com->ya, pl->y_type, tokens[2]);
+    coordinate(com->xb, pl->x_type, tokens[3]);
+    coordinate(com->yb, pl->y_type, tokens[4]);
+    com->color = ntokens == 6 ? parse_color(tokens[5]) : pl->current_color;
+    add_command(pl, com);
+    break;
+  case V_TEXT:
+    if (not_ntokens_equal_to_3_or_4) lineerror("input format error");
+    com = new_command(pl, &newcom);
+    com->type = TEXT;
+    coordinate(com->xa, pl->x_type, tokens[1]);
+    coordinate(com->ya, pl->y_type, tokens[2]);
+    COLORfromTOK3;
+    com->text = gettextline(in, texts);
+    com->position = v->position;
+    add_command(pl, com);
+    break;
+  case V_TITLE:
+    com = new_command(pl, &newcom);
+    com->type = v->type;
+    com->text = gettextline(in, texts);
+    add_command(pl, com);
+    break;
+  case V_XUNITS:
+    pl->x_units = gettextline(in, texts);
+    break;
+  case V_YUNITS:
+    pl->y_units = gettextline(in, texts);
+    break;
+  case V_GO:
+#if 0
+    fprintf(stderr,"xplot pid %d go!\n",getpid());
+#endif
+    return PARSED_GO;
+  case V_NEW_PLOTTER:
+    return PARSED_NEW_PLOTTER;
+  }
+  return PARSED;
+#undef coordinate
+#undef lineerror
+}
+
+static int parse_in_parallel(struct input_source *in, Display *dpy,
+			     int lineno, PLOTTER *list);
+
+/* Say what is wrong with line lineno, which was tokens, and give up. */
+static void parse_error(int lineno, char *error, char **tokens)
+{
+  fprintf(stderr, "in line number %d: %s\noffending line: ", lineno, error);
+  for (; tokens != 0 && *tokens != 0; tokens++) {
+    fputtok(*tokens, stderr);
+    fputc(' ', stderr);
+  }
+  fputc('\n', stderr);
+  fflush(stderr);
+  exit(1);
+}
+
+/*
+ * Read the plotter at the front of *list.  Returns 0 at the end, or the
+ * line number of the new_plotter that starts the next one.
+ */
+int get_input(struct input_source *in, Display *dpy, int lineno,
+	      PLOTTER *list)
+{
+  struct plotter *pl = *list;
+  char **tokens;
+  int ntokens = 0;
+  char *error;
+
+#define parseerror(s) parse_error(lineno, s, tokens)
+  error = parse_header(in, pl, &lineno, &tokens, &ntokens);
+  if (error) parseerror(error);
+
+  if (in->threads > 1 && in->map != 0
+      && in->end - in->cp >= 2 * PARSE_CHUNK_MIN)
+    return parse_in_parallel(in, dpy, lineno, list);
+  
+  for (;;) {
+    char *line = in->cp;
+
+    lineno++;
+    tokens = gettokens(in);
+    if (tokens == 0) break;
+    if (option_follow && in->map && !in->feed && text_pending(in, tokens)) {
+      in->cp = line;		/* the rest of it is read when it comes */
+      break;
+    }
+    for (ntokens = 0; tokens[ntokens] != 0; ntokens++);
+
+    switch (parse_line(in, pl, &pl->data->arena, tokens, ntokens, &error)) {
+    case PARSE_ERROR:
+      parseerror(error);
+    case PARSED_GO:
+      in->go = TRUE;
+      return 0;
+    case PARSED_NEW_PLOTTER:
+      return lineno;
+    case PARSED:
+      break;
+    }
+  }
+  return 0;
+}
+
+/*
+ * A big file is cut into chunks at line ends, each parsed on its own
+ * with the coord types the prescan found and the colour left unknown
+ * until the chunks are put together.
+ */
+#define COLOR_UNKNOWN (-2)
+
+struct parse_chunk {
+  struct input_source *in;	/* the whole file */
+  char *start;			/* the lines this chunk is to parse */
+  char *end;
+  char *stop;			/* where the next line it didn't read starts */
+  int eof;			/* it read to the end of the input */
+  coord_type x_type, y_type;	/* what it took the coord types to be */
+  int switches;			/* has a new_plotter, the last switching */
+  coord_type to_x_type;		/* to these */
+  coord_type to_y_type;
+  PLOTTER *parts;		/* the plotters it read, in file order */
+  int nparts;
+  int maxparts;
+  struct arena texts;		/* the strings they point to */
+  int lines;			/* how many it parsed */
+  int go;			/* it ended with "go" */
+  char *error;			/* or what went wrong, */
+  char *error_line;		/* and where */
+  int error_lineno;
+};
+
+/* A scratch plotter for a chunk to parse into.  The first one of a
+   chunk doesn't know the colour, and changes nothing it isn't told to. */
+static PLOTTER new_part(struct parse_chunk *ch, coord_type x_type,
+			coord_type y_type)
+{
+  PLOTTER part;
+
+  if (ch->nparts == ch->maxparts) {
+    PLOTTER *parts = ch->parts;
+
+    ch->maxparts = ch->maxparts ? 2 * ch->maxparts : 4;
+    ch->parts = (PLOTTER *) malloc(ch->maxparts * sizeof(PLOTTER));
+    if (ch->parts == 0) fatalerror("malloc returned null");
+    if (ch->nparts)
+      memcpy(ch->parts, parts, ch->nparts * sizeof(PLOTTER));
+    free(parts);
+  }
+  part = (PLOTTER) malloc(sizeof(*part));
+  if (part == 0) fatalerror("malloc returned null");
+  ch->parts[ch->nparts] = part;
+
+  part->data = new_dataset();
+  part->x_type = x_type;
+  part->y_type = y_type;
+  init_stores(part);		/* again by parse_header() after the first */
+  if (ch->nparts == 0) {
+    part->aspect_ratio = -HUGE_VAL;
+    part->x_units = NULL;
+    part->y_units = NULL;
+    part->default_color = part->current_color = COLOR_UNKNOWN;
+  } else {
+    part->aspect_ratio = 0.0;
+    part->x_units = "";
+    part->y_units = "";
+    part->default_color = part->current_color = -1;
+  }
+  ch->nparts++;
+  return part;
+}
+
+static void free_parts(struct parse_chunk *ch)
+{
+  int k, kind;
 
-	  /* display the last plotter (the first on the list) */
-	  if (option_one_at_a_time) 
-	    display_plotter(the_plotter_list);
-	}
-	break;
-      case WEDGED:
-	if (pl->buttonsdown == 0)
-	  pl->state = NORMAL;
-	break;
-      case SLAVE:
-	/* do nothing */
-	break;
-      default:
-	/* Do nothing.  Note that this really can happen due to the semantics
-	 * of the implicit grab associated with a button press event.
-	 */
-	break;
-	
+  for (k = 0; k < ch->nparts; k++) {
+    PLOTTER part = ch->parts[k];
+
+    for (kind = 0; kind < NKINDS; kind++)
+      free_flags(&part->stores[kind]);
+    drop_dataset(part->data);
+    free(part);
+  }
+  ch->nparts = 0;
+}
+
+/* See whether a chunk has a new_plotter line in it, and what the coord
+   types are after the last one. */
+static void scan_chunk(void *arg, int k)
+{
+  struct parse_chunk *ch = (struct parse_chunk *) arg + k;
+  struct input_source in;
+  char *cp = ch->start;
+  char *nl;
+  char **tokens;
+
+  ch->switches = FALSE;
+  while (cp < ch->end && (nl = memchr(cp, '\n', ch->end - cp)) != NULL) {
+    if (nl - cp >= 11 && strncmp(cp, "new_plotter", 11) == 0
+	&& istokend(cp[11])) {
+      in = *ch->in;
+      in.feed = NULL;
+      in.cp = nl + 1;
+      do
+	tokens = gettokens(&in);
+      while (tokens != 0 && tokens[0] != 0 && tokens[1] == 0
+	     && tokcmp(tokens[0], "new_plotter") == 0);
+      if (tokens != 0 && tokens[0] != 0 && tokens[1] != 0 && tokens[2] == 0
+	  && (int) parse_coord_name(tokens[0]) >= 0
+	  && (int) parse_coord_name(tokens[1]) >= 0) {
+	ch->switches = TRUE;
+	ch->to_x_type = parse_coord_name(tokens[0]);
+	ch->to_y_type = parse_coord_name(tokens[1]);
       }
+    }
+    cp = nl + 1;
+  }
+}
+
+/*
+ * A stream is parsed LOAD_LINES lines to a chunk.
+ */
+#define LOAD_LINES 20000
+
+static void parse_chunk(void *arg, int k)
+{
+  struct parse_chunk *ch = (struct parse_chunk *) arg + k;
+  struct input_source copy;
+  struct input_source *in = ch->in;
+  PLOTTER part;
+  char **tokens;
+  char *line;
+  int ntokens;
+  char *error = NULL;
+
+  if (in->map) {
+    copy = *in;
+    in = &copy;
+    in->feed = NULL;		/* the chunk ends in this block */
+    in->cp = ch->start;
+  }
+  ch->lines = 0;
+  ch->eof = FALSE;
+  ch->go = FALSE;
+  ch->error = NULL;
+  part = new_part(ch, ch->x_type, ch->y_type);
+
+  while (in->map ? in->cp < ch->end : ch->lines < LOAD_LINES) {
+    line = in->cp;
+    ch->lines++;
+    tokens = gettokens(in);
+    if (tokens == 0) {
+      ch->eof = TRUE;
       break;
-    case EnterNotify:
-      /*      printf("enter %d\n", pl->win); */
+    }
+    if (option_follow && in->map && text_pending(in, tokens)) {
+      in->cp = line;
       break;
-    case LeaveNotify:
-      /*      printf("leave %d\n", pl->win); */
-      if (pl->pointer_marks_on_screen) {
-	draw_pointer_marks(pl, pl->xorgc);
-	pl->pointer_marks_on_screen = FALSE;
-      }
-      if (x_synch && y_synch) {
-	PLOTTER savepl = pl;
+    }
+    for (ntokens = 0; tokens[ntokens] != 0; ntokens++);
 
-	for (ALLPLOTTERS) {
-	  if (pl == savepl) continue;
+    switch (parse_line(in, part, &ch->texts, tokens, ntokens, &error)) {
+    case PARSE_ERROR:
+      break;
+    case PARSED_GO:
+      ch->go = TRUE;
+      break;
+    case PARSED_NEW_PLOTTER:
+      part = new_part(ch, ch->x_type, ch->y_type);
+      line = in->cp;
+      error = parse_header(in, part, &ch->lines, &tokens, &ntokens);
+      break;
+    case PARSED:
+      continue;
+    }
+    if (error != NULL) {
+      ch->error = error;
+      ch->error_line = line;
+      ch->error_lineno = ch->lines;
+    }
+    if (error != NULL || ch->go)
+      break;
+  }
+  ch->stop = in->cp;
+}
 
-	  if (pl->pointer_marks_on_screen) {
-	    draw_pointer_marks(pl, pl->xorgc);
-	    pl->pointer_marks_on_screen = FALSE;
-	  }
-	}
-	pl = savepl;
-      }
+/* Append the commands in store from, which is laid out the same, to
+   the same kind of store of pl.  Those of COLOR_UNKNOWN get color, and
+   their places in the input are moved on by seq. */
+static void append_store(struct plotter *pl, int kind, struct store *from,
+			 xpcolor_t color, int32_t seq)
+{
+  struct store *st = &pl->stores[kind];
+  int xs = coord_size[(int) pl->x_type];
+  int ys = coord_size[(int) pl->y_type];
+  int s = 0;
+
+  while (s < from->n) {
+    int d = st->n & STORE_CHUNK_MASK;
+    int j = s & STORE_CHUNK_MASK;
+    int run = min(STORE_CHUNK - d, STORE_CHUNK - j);
+    char *dst, *src;
+    xpcolor_t *colors;
+    int32_t *seqs;
+    int i;
+
+    run = min(run, from->n - s);
+    if (d == 0)
+      new_store_chunk(pl, st);
+    dst = st->chunks[st->nchunks - 1];
+    src = from->chunks[s >> STORE_CHUNK_SHIFT];
+#define copy_column(off, width) \
+    memcpy(dst + st->off + d * (width), src + st->off + j * (width), \
+	   run * (width))
+    copy_column(off_xa, xs);
+    copy_column(off_ya, ys);
+    if (st->off_xb) {
+      copy_column(off_xb, xs);
+      copy_column(off_yb, ys);
+    }
+    if (st->off_text) {
+      copy_column(off_text, sizeof(char *));
+      copy_column(off_position, 1);
+    }
+    copy_column(off_seq, sizeof(int32_t));
+    copy_column(off_color, sizeof(xpcolor_t));
+    copy_column(off_type, 1);
+#undef copy_column
+    colors = (xpcolor_t *) (dst + st->off_color);
+    seqs = (int32_t *) (dst + st->off_seq);
+    for (i = d; i < d + run; i++) {
+      if (colors[i] == COLOR_UNKNOWN)
+	colors[i] = color;
+      seqs[i] += seq;
+    }
+    st->n += run;
+    s += run;
+  }
+}
+
+/* Add what a chunk read into a scratch plotter to the real one. */
+static void merge_part(PLOTTER pl, PLOTTER part)
+{
+  int32_t seq = plotter_seq(pl);
+  int kind;
+
+  for (kind = 0; kind < NKINDS; kind++)
+    append_store(pl, kind, &part->stores[kind], pl->current_color, seq);
+  if (part->current_color != COLOR_UNKNOWN) {
+    pl->current_color = part->current_color;
+    pl->default_color = part->default_color;
+  }
+  if (part->aspect_ratio != -HUGE_VAL)
+    pl->aspect_ratio = part->aspect_ratio;
+  if (part->x_units != NULL)
+    pl->x_units = part->x_units;
+  if (part->y_units != NULL)
+    pl->y_units = part->y_units;
+}
+
+/* Where the line that ends at end starts, going no further back than
+   in->cp. */
+static char *line_start(struct input_source *in, char *end)
+{
+  char *cp = end - 1;
 
+  while (cp > in->cp && cp[-1] != '\n')
+    cp--;
+  return cp;
+}
+
+/*
+ * How far chunks of in may go: the end, or if more is to come, short of
+ * the last line and any new_plotter lines just before it.
+ */
+static char *chunk_limit(struct input_source *in)
+{
+  char *limit = in->end;
+  char *cp;
+
+  if (in->feed == NULL || in->feed->drained)
+    return limit;
+  if (limit > in->cp)
+    limit = line_start(in, limit);
+  while (limit > in->cp) {
+    cp = line_start(in, limit);
+    while (*cp == ' ' || *cp == '\t')
+      cp++;
+    if (limit - cp < 12 || strncmp(cp, "new_plotter", 11) != 0
+	|| !istokend(cp[11]))
       break;
-    case MotionNotify:
-      if (pl->pointer_marks_on_screen) {
-	draw_pointer_marks(pl, pl->xorgc);
-	pl->pointer_marks_on_screen = FALSE;
-      }
-      if (XQueryPointer(pl->dpy, pl->win, &dummy_window, &dummy_window,
-			&dummy_int, &dummy_int,
-			&(pl->pointer.x), &(pl->pointer.y),
-			&dummy_unsigned_int)
-	  == 0) {
-	pl->state = WEDGED;
-	break;
-      }
-      if ( pl->size.x == 0 || pl->size.y == 0 )
-	{
-	  fprintf(stderr, "MotionNotify while size is zero ignored.\n");
-	  break;
-	}
-      pl->pointer_marks = detent(pl, pl->pointer);
+    limit = line_start(in, limit);
+  }
+  return limit;
+}
 
-      if (pl->state != SLAVE) {
-	pl->dragend = detent(pl, pl->pointer);
-	switch(pl->state) {
-	case HZOOM:
-	  pl->dragend.y = pl->origin.y + pl->size.y;
-	  break;
-	case VZOOM:
-	  pl->dragend.x = pl->origin.x + pl->size.x;
-	  break;
-	default:
-	  break;
-	}
+/* Cut the next size bytes of in (or all that is left) into n chunks,
+   each ending at the end of a line. */
+static struct parse_chunk *cut_chunks(struct input_source *in, size_t size,
+				      int n)
+{
+  struct parse_chunk *chunks;
+  char *p = in->cp;
+  int k;
+
+  if (size > (size_t) (in->end - in->cp))
+    size = in->end - in->cp;
+  chunks = (struct parse_chunk *) malloc(n * sizeof(struct parse_chunk));
+  if (chunks == 0) fatalerror("malloc returned null");
+  for (k = 0; k < n; k++) {
+    struct parse_chunk *ch = &chunks[k];
+    char *end = in->cp + size / n * (k + 1);
+    char *nl;
+
+    if (k == n - 1)
+      end = in->cp + size;
+    if (end < p)
+      end = p;
+    if (end < in->end) {
+      /* an end just after a newline stays where it is */
+      if (end > p)
+	end--;
+      nl = memchr(end, '\n', in->end - end);
+      end = nl ? nl + 1 : in->end;
+    }
+    ch->in = in;
+    ch->start = p;
+    ch->end = end;
+    ch->parts = NULL;
+    ch->nparts = ch->maxparts = 0;
+    arena_init(&ch->texts, COMMAND_ARENA_BLOCK);
+    p = end;
+  }
+  return chunks;
+}
 
+/*
+ * Parse n chunks of in in parallel, again for any that guessed wrong.
+ * Returns how many to take (fewer after a "go"), or -1 with *lineno,
+ * *error and *tokens set.
+ */
+static int parse_chunks(struct input_source *in, struct parse_chunk *chunks,
+			int n, coord_type *x_type, coord_type *y_type,
+			int *lineno, char **error, char ***tokens)
+{
+  char *p;
+  int k, j;
+
+  run_parallel(n, in->threads, scan_chunk, chunks);
+  for (k = 0; k < n; k++) {
+    struct parse_chunk *ch = &chunks[k];
+
+    ch->x_type = k == 0 ? *x_type : chunks[k - 1].x_type;
+    ch->y_type = k == 0 ? *y_type : chunks[k - 1].y_type;
+    if (k > 0 && chunks[k - 1].switches) {
+      ch->x_type = chunks[k - 1].to_x_type;
+      ch->y_type = chunks[k - 1].to_y_type;
+    }
+  }
+  run_parallel(n, in->threads, parse_chunk, chunks);
+
+  p = in->cp;
+  for (k = 0; k < n; k++) {
+    struct parse_chunk *ch = &chunks[k];
+    PLOTTER last;
+
+    if (ch->start != p || ch->x_type != *x_type || ch->y_type != *y_type) {
+      free_parts(ch);
+      ch->start = p;
+      if (ch->end < p)
+	ch->end = p;
+      ch->x_type = *x_type;
+      ch->y_type = *y_type;
+      parse_chunk(ch, 0);
+    }
+    if (ch->error != NULL) {
+      struct input_source at;
+
+      at = *in;
+      at.feed = NULL;
+      at.cp = ch->error_line;
+      *lineno += ch->error_lineno;
+      *error = ch->error;
+      *tokens = gettokens(&at);
+      return -1;
+    }
+    last = ch->parts[ch->nparts - 1];
+    *x_type = last->x_type;
+    *y_type = last->y_type;
+    *lineno += ch->lines;
+    p = ch->stop;
+
+    if (ch->go) {
+      in->go = TRUE;
+      for (j = k + 1; j < n; j++) {
+	free_parts(&chunks[j]);
+	free(chunks[j].parts);
+	arena_free(&chunks[j].texts);
       }
+      n = k + 1;
+      break;
+    }
+  }
+  in->cp = p;
+  return n;
+}
 
-      draw_pointer_marks(pl, pl->xorgc);
-      pl->pointer_marks_on_screen = TRUE;
+/* Add what a chunk read to the plotter at the front of *list, putting
+   any plotters that start in it on *list too. */
+static void merge_chunk(PLOTTER *list, struct parse_chunk *ch, Display *dpy)
+{
+  PLOTTER pl = *list;
+  int j;
 
-      if (x_synch && y_synch) {
-	PLOTTER savepl = pl;
-	
-	for (ALLPLOTTERS) {
-	  if (pl == savepl) continue;
-	  if (pl->win == 0) continue; /* -1 commandline option. Is this correct? */
+  merge_part(pl, ch->parts[0]);
+  for (j = 1; j < ch->nparts; j++) {
+    PLOTTER part = ch->parts[j];
 
-	  if (pl->slave_draw_in_progress) {
-	    pl->slave_motion_pending = TRUE;
-	    pl->master_pointer = map_pl_pl(savepl, pl, savepl->pointer_marks);
-	  } else {
-	    if (pl->pointer_marks_on_screen) {
-	      draw_pointer_marks(pl, pl->xorgc);
-	      pl->pointer_marks_on_screen = FALSE;
-	    }
-	    pl->pointer_marks = map_pl_pl(savepl, pl, savepl->pointer_marks);
-	    pl->dragend = pl->pointer_marks;
-	    switch(pl->master_state) {
-	    case HZOOM:
-	      pl->dragend.y = pl->origin.y + pl->size.y;
-	      break;
-	    case VZOOM:
-	      pl->dragend.x = pl->origin.x + pl->size.x;
-	      break;
-	    default:
-	      break;
-	    }
-	    draw_pointer_marks(pl, pl->xorgc);
-	    pl->pointer_marks_on_screen = TRUE;
-	    pl->slave_draw_in_progress = TRUE;
-	    {
-	      XEvent e;
-	      int r; 
+    pl = (PLOTTER) malloc(sizeof(*pl));
+    if (pl == 0) fatalerror("malloc returned null");
+    init_plotter(pl, dpy, (*list)->numtiles, (*list)->tileno);
+    pl->next = *list;
+    *list = pl;
+    pl->x_type = part->x_type;
+    pl->y_type = part->y_type;
+    init_stores(pl);
+    merge_part(pl, part);
+  }
+  arena_adopt(&pl->data->arena, &ch->texts);
+  free_parts(ch);
+  free(ch->parts);
+}
 
-	      e.xclient.type = ClientMessage;
-	      e.xclient.serial = 0;
-	      e.xclient.send_event = 1;
-	      e.xclient.display = pl->dpy;
-	      e.xclient.window = pl->win;
-	      e.xclient.message_type = pl->xplot_nagle_atom;
-	      e.xclient.format = 8;
+/*
+ * Parse the rest of in in parallel.  Returns 0, as get_input() does at
+ * the end.
+ */
+static int parse_in_parallel(struct input_source *in, Display *dpy,
+			     int lineno, PLOTTER *list)
+{
+  struct parse_chunk *chunks;
+  coord_type x_type = (*list)->x_type;
+  coord_type y_type = (*list)->y_type;
+  char **tokens;
+  char *error;
+  size_t left;
+  int nchunks;
+  int k;
 
-	      r = XSendEvent(pl->dpy, pl->win, False, 0, &e);
-	      if (r != 1)
-		printf("DEBUG: XSendEvent returned %d\n", r);
-	    }
-	  }
-	}
-	pl = savepl;
-      }
-      
+  /* the readers would race to set this up */
+  index_verbs();
+
+  /* a compressed file is parsed a block at a time */
+  do {
+    left = chunk_limit(in) - in->cp;
+    nchunks = in->threads * 4;
+    if ((size_t) nchunks > left / PARSE_CHUNK_MIN)
+      nchunks = max(left / PARSE_CHUNK_MIN, 1);
+
+    chunks = cut_chunks(in, left, nchunks);
+    nchunks = parse_chunks(in, chunks, nchunks, &x_type, &y_type, &lineno,
+			   &error, &tokens);
+    if (nchunks < 0)
+      parse_error(lineno, error, tokens);
+    for (k = 0; k < nchunks; k++)
+      merge_chunk(list, &chunks[k], dpy);
+    free(chunks);
+  } while (!in->go && in->feed != NULL && refill(in));
+  return 0;
+}
+
+
+/*
+ * Reading and writing the binary format.  The file stays mapped and its
+ * strings are used where they are.
+ */
+enum xpb_column { XPB_XA, XPB_YA, XPB_XB, XPB_YB, XPB_TEXT, XPB_COLOR,
+		  XPB_TYPE, XPB_POSITION, XPB_SEQ, XPB_NCOLUMNS };
+
+/* Work out where the columns of n records of a kind start in a block
+   of a file of the given version, 0 for those the kind lacks, and
+   return how big the block is. */
+static uint64_t xpb_columns(struct plotter *pl, int kind, uint64_t n,
+			    int version, uint64_t *off)
+{
+  uint64_t size = 0;
+  int c;
+
+  for (c = 0; c < XPB_NCOLUMNS; c++) {
+    int width = 0;
+
+    switch (c) {
+    case XPB_XA: width = coord_size[(int) pl->x_type]; break;
+    case XPB_YA: width = coord_size[(int) pl->y_type]; break;
+    case XPB_XB: if (kind == SEGMENTS) width = coord_size[(int) pl->x_type];
       break;
-    case ClientMessage:
-      if (event.xclient.message_type == pl->xplot_nagle_atom) {
+    case XPB_YB: if (kind == SEGMENTS) width = coord_size[(int) pl->y_type];
+      break;
+    case XPB_TEXT: if (kind == TEXTS) width = sizeof(uint64_t); break;
+    case XPB_COLOR: width = sizeof(int16_t); break;
+    case XPB_TYPE: width = 1; break;
+    case XPB_POSITION: if (kind == TEXTS) width = 1; break;
+    case XPB_SEQ: if (version >= 3) width = sizeof(int32_t); break;
+    }
+    off[c] = width ? size : 0;
+    size += XPB_PAD(n * width);
+  }
+  return size;
+}
 
-#if 0
-	printf("XPLOT_NAGLE\n");
-#endif
-	pl->slave_draw_in_progress = FALSE;
+static int is_binary(struct input_source *in)
+{
+  return in->map != 0 && in->maplen >= sizeof(struct xpb_file)
+    && memcmp(in->map, XPB_MAGIC, sizeof(((struct xpb_file *) 0)->magic)) == 0;
+}
 
-	if (pl->slave_motion_pending) {
-	  if (pl->pointer_marks_on_screen) {
-	    draw_pointer_marks(pl, pl->xorgc);
-	    pl->pointer_marks_on_screen = FALSE;
-	  }
-	  pl->pointer_marks = pl->master_pointer;
-	  pl->dragend = pl->master_pointer;
-	  switch(pl->master_state) {
-	  case HZOOM:
-	    pl->dragend.y = pl->origin.y + pl->size.y;
-	    break;
-	  case VZOOM:
-	    pl->dragend.x = pl->origin.x + pl->size.x;
-	    break;
-	  default:
-	    break;
-	  }
-	  draw_pointer_marks(pl, pl->xorgc);
-	  pl->pointer_marks_on_screen = TRUE;
-	  pl->slave_motion_pending = FALSE;
-	  pl->slave_draw_in_progress = TRUE;
-	  {
-	    XEvent e;
-	    int r; 
+/* The string at offset off in the file, or NULL if there is none. */
+static char *xpb_string(struct input_source *in, uint64_t off)
+{
+  if (off >= in->maplen
+      || memchr(in->map + off, '\0', in->maplen - off) == NULL)
+    return NULL;
+  return in->map + off;
+}
+
+/* Scale the n timevals at col of a version 1 file to nanoseconds. */
+static void xpb_timevals(coord_type ctype, char *col, int n)
+{
+  int64_t *t = (int64_t *) col;
+  int i;
+
+  if (ctype == TIMEVAL)
+    for (i = 0; i < n; i++)
+      t[i] *= 1000;
+}
+
+/* Add the n records of a block, from a file of the given version, to
+   the store for kind.  Returns NULL, or what is wrong with them. */
+static char *xpb_append(struct input_source *in, struct plotter *pl,
+			int kind, char *block, int n, int version)
+{
+  struct store *st = &pl->stores[kind];
+  int xs = coord_size[(int) pl->x_type];
+  int ys = coord_size[(int) pl->y_type];
+  uint64_t off[XPB_NCOLUMNS];
+  int32_t seq = plotter_seq(pl);
+  int32_t last = -1;
+  int s = 0;
+
+  (void) xpb_columns(pl, kind, n, version, off);
+  if (st->n > 0)
+    last = store_seq(st, st->n - 1);
+
+  while (s < n) {
+    int d = st->n & STORE_CHUNK_MASK;
+    int run = min(STORE_CHUNK - d, n - s);
+    unsigned char *types, *positions = NULL;
+    char **texts = NULL;
+    int32_t *seqs;
+    char *dst;
+    int i;
+
+    if (d == 0)
+      new_store_chunk(pl, st);
+    dst = st->chunks[st->nchunks - 1];
+#define copy_column(c, field, width) \
+    memcpy(dst + st->field + d * (width), block + off[c] + s * (width), \
+	   run * (width))
+    copy_column(XPB_XA, off_xa, xs);
+    copy_column(XPB_YA, off_ya, ys);
+    if (st->off_xb) {
+      copy_column(XPB_XB, off_xb, xs);
+      copy_column(XPB_YB, off_yb, ys);
+    }
+    if (st->off_text) {
+      copy_column(XPB_POSITION, off_position, 1);
+      positions = (unsigned char *) (dst + st->off_position) + d;
+      texts = (char **) (dst + st->off_text) + d;
+    }
+    copy_column(XPB_COLOR, off_color, sizeof(xpcolor_t));
+    copy_column(XPB_TYPE, off_type, 1);
+    seqs = (int32_t *) (dst + st->off_seq) + d;
+    if (off[XPB_SEQ])
+      copy_column(XPB_SEQ, off_seq, sizeof(int32_t));
+    else
+      for (i = 0; i < run; i++)
+	seqs[i] = seq + s + i;
+#undef copy_column
+    if (version == 1) {
+      xpb_timevals(pl->x_type, dst + st->off_xa + d * xs, run);
+      xpb_timevals(pl->y_type, dst + st->off_ya + d * ys, run);
+      if (st->off_xb) {
+	xpb_timevals(pl->x_type, dst + st->off_xb + d * xs, run);
+	xpb_timevals(pl->y_type, dst + st->off_yb + d * ys, run);
+      }
+    }
 
-	    e.xclient.type = ClientMessage;
-	    e.xclient.serial = 0;
-	    e.xclient.send_event = 1;
-	    e.xclient.display = pl->dpy;
-	    e.xclient.window = pl->win;
-	    e.xclient.message_type = pl->xplot_nagle_atom;
-	    e.xclient.format = 8;
+    types = (unsigned char *) (dst + st->off_type) + d;
+    for (i = 0; i < run; i++) {
+      if (types[i] > YLABEL
+	  || kind_of_type((enum plot_command_type) types[i]) != kind)
+	return "unknown command type";
+      if (seqs[i] <= last)
+	return "commands out of order";
+      last = seqs[i];
+      if (texts) {
+	if (positions[i] > TO_THE_RIGHT)
+	  return "unknown text position";
+	texts[i] = xpb_string(in, ((uint64_t *) (block + off[XPB_TEXT]))[s + i]);
+	if (texts[i] == NULL)
+	  return "text outside the file";
+      }
+    }
+    st->n += run;
+    s += run;
+  }
+  return NULL;
+}
 
-	    r = XSendEvent(pl->dpy, pl->win, False, 0, &e);
-	    if (r != 1)
-	      printf("DEBUG: XSendEvent returned %d\n", r);
-	  }
-	}
+/*
+ * Read the plotters in a binary file, and return them newest first,
+ * as read_plotters() does.
+ */
+static PLOTTER read_binary(struct input_source *in, Display *dpy,
+			   int numtiles, int tileno)
+{
+  struct xpb_file *f = (struct xpb_file *) in->map;
+  PLOTTER list = NULL;
+  PLOTTER pl = NULL;
+  char *cp = in->map;
+  char *error = NULL;
 
-      } else {
-	printf("event ClientMessage unknown type %ld, %s\n",
-	       event.xclient.message_type,
-	       XGetAtomName(pl->dpy, event.xclient.message_type)
-	       );
+#define binaryerror(s) \
+  { \
+      fprintf(stderr, "at byte %lu of binary input: %s\n", \
+	      (unsigned long) (cp - in->map), s); \
+      fflush(stderr); \
+      exit(1); \
+  }
+  if (f->byte_order != XPB_BYTE_ORDER)
+    binaryerror("written on a machine of another byte order");
+  if (f->version < 1 || f->version > XPB_VERSION)
+    binaryerror("unknown version of the binary format");
+  cp += sizeof(*f);
+
+  while (cp < in->end) {
+    struct xpb_block b;
+    uint64_t off[XPB_NCOLUMNS];
+    char *payload;
+
+    if ((size_t) (in->end - cp) < sizeof(b))
+      binaryerror("truncated block");
+    memcpy(&b, cp, sizeof(b));
+    payload = cp + sizeof(b);
+    if (b.size % 8 != 0 || b.size > (uint64_t) (in->end - payload))
+      binaryerror("bad block size");
+
+    switch (b.kind) {
+    case XPB_PLOTTER:
+      {
+	struct xpb_plotter h;
+
+	if (b.size < sizeof(h))
+	  binaryerror("bad block size");
+	memcpy(&h, payload, sizeof(h));
+	h.x_type[sizeof(h.x_type) - 1] = '\0';
+	h.y_type[sizeof(h.y_type) - 1] = '\0';
+
+	pl = (PLOTTER) malloc(sizeof(*pl));
+	if (pl == 0) fatalerror("malloc returned null");
+	pl->next = list;
+	list = pl;
+	init_plotter(pl, dpy, numtiles, tileno);
+	pl->x_type = parse_coord_name(h.x_type);
+	pl->y_type = parse_coord_name(h.y_type);
+	if (((int) pl->x_type) < 0 || ((int) pl->y_type) < 0)
+	  binaryerror("unknown coord type");
+	init_stores(pl);
+	pl->aspect_ratio = h.aspect_ratio;
+	if (pl->aspect_ratio != 0.0 && pl->x_type != pl->y_type)
+	  binaryerror("aspect_ratio requires identical coordinate types");
+	if (h.x_units && (pl->x_units = xpb_string(in, h.x_units)) == NULL)
+	  binaryerror("units outside the file");
+	if (h.y_units && (pl->y_units = xpb_string(in, h.y_units)) == NULL)
+	  binaryerror("units outside the file");
+      }
+      break;
+    case XPB_SEGMENTS:
+    case XPB_POINTS:
+    case XPB_TEXTS:
+      {
+	int kind = b.kind == XPB_SEGMENTS ? SEGMENTS
+	  : b.kind == XPB_POINTS ? POINTS : TEXTS;
+
+	if (pl == NULL)
+	  binaryerror("commands before the first plotter");
+	if (b.n > (uint32_t) (INT_MAX - pl->stores[kind].n)
+	    || xpb_columns(pl, kind, b.n, f->version, off) != b.size)
+	  binaryerror("bad block size");
+	error = xpb_append(in, pl, kind, payload, (int) b.n, f->version);
+	if (error)
+	  binaryerror(error);
       }
       break;
     default:
-#if 0      
-      /* other events do happen (for example, ReparentNotify)
-	 so just silently ignore them */ 
-      printf("unknown event type %d\n", event.type);
-#endif
       break;
     }
-  } while (the_plotter_list != 0);
+    cp = payload + b.size;
+  }
+  if (list == NULL)
+    binaryerror("no plotters");
+#undef binaryerror
 
- doexit:
-  if (dpy2 != 0) XCloseDisplay(dpy2);
-  XCloseDisplay(dpy);
-  return 0;
+  /* the strings are still in it */
+  in->kept = TRUE;
+  return list;
 }
 
-#ifdef __GNUC__
-inline
-#endif
-static char **gettokens(FILE *fp)
+/* Writes a binary file, keeping track of how much has been written. */
+struct xpb_writer {
+  FILE *fp;
+  uint64_t off;
+};
+
+static void xpb_write(struct xpb_writer *w, void *p, size_t n)
 {
-  static char buf[1000];
-  static char *tokens[1000];
-  char *cp;
+  if (n && fwrite(p, 1, n, w->fp) != n)
+    fatalerror("write failed");
+  w->off += n;
+}
+
+static void xpb_pad(struct xpb_writer *w)
+{
+  static char zeros[8];
+
+  xpb_write(w, zeros, XPB_PAD(w->off) - w->off);
+}
+
+static void xpb_block(struct xpb_writer *w, int kind, uint32_t n,
+		      uint64_t size)
+{
+  struct xpb_block b;
+
+  b.kind = kind;
+  b.n = n;
+  b.size = size;
+  xpb_write(w, &b, sizeof(b));
+}
+
+/* Write strs[0..n-1] in a block of strings, and their offsets in the
+   file to offs[]. */
+static void xpb_strings(struct xpb_writer *w, char **strs, int n,
+			uint64_t *offs)
+{
+  uint64_t size = 0;
   int i;
 
-  if (fgets(buf, sizeof(buf), fp) == NULL)
-    return 0;
+  for (i = 0; i < n; i++)
+    size += strlen(strs[i]) + 1;
+  xpb_block(w, XPB_STRINGS, n, XPB_PAD(size));
+  for (i = 0; i < n; i++) {
+    offs[i] = w->off;
+    xpb_write(w, strs[i], strlen(strs[i]) + 1);
+  }
+  xpb_pad(w);
+}
 
-  i=0;
-  cp=buf; 
+/* Write a store's commands as one block of records. */
+static void xpb_store(struct xpb_writer *w, struct plotter *pl, int kind)
+{
+  static int block_kind[NKINDS] = { XPB_SEGMENTS, XPB_POINTS, XPB_TEXTS };
+  struct store *st = &pl->stores[kind];
+  uint64_t off[XPB_NCOLUMNS];
+  uint64_t *text_offs = NULL;
+  int xs = coord_size[(int) pl->x_type];
+  int ys = coord_size[(int) pl->y_type];
+  int c, i;
+
+  if (st->n == 0)
+    return;
+  if (kind == TEXTS) {
+    char **texts;
+
+    texts = (char **) malloc(st->n * sizeof(char *));
+    text_offs = (uint64_t *) malloc(st->n * sizeof(uint64_t));
+    if (texts == 0 || text_offs == 0) fatalerror("malloc returned null");
+    for (i = 0; i < st->n; i++) {
+      texts[i] = ((char **) store_column(st, i, off_text))[i & STORE_CHUNK_MASK];
+      if (texts[i] == NULL)
+	texts[i] = "";
+    }
+    xpb_strings(w, texts, st->n, text_offs);
+    free(texts);
+  }
 
-  while (*cp != '\0') {
-    while (*cp == ' ' || *cp == '\t') cp++;
-    if (*cp == '\n') break;
-    tokens[i++] = cp;
-    while (*cp != ' ' && *cp != '\t' && *cp != '\n' && *cp != '\0') cp++;
-    if (*cp == '\n' || *cp == '\0') {
+  xpb_block(w, block_kind[kind], st->n,
+	    xpb_columns(pl, kind, st->n, XPB_VERSION, off));
+  for (c = 0; c < XPB_NCOLUMNS; c++) {
+    size_t field = 0;
+    int width = 0;
+
+    switch (c) {
+    case XPB_XA: field = st->off_xa; width = xs; break;
+    case XPB_YA: field = st->off_ya; width = ys; break;
+    case XPB_XB: field = st->off_xb; width = xs; break;
+    case XPB_YB: field = st->off_yb; width = ys; break;
+    case XPB_TEXT:
+      if (text_offs)
+	xpb_write(w, text_offs, st->n * sizeof(uint64_t));
       break;
+    case XPB_COLOR: field = st->off_color; width = sizeof(xpcolor_t); break;
+    case XPB_TYPE: field = st->off_type; width = 1; break;
+    case XPB_POSITION: field = st->off_position; width = 1; break;
+    case XPB_SEQ: field = st->off_seq; width = sizeof(int32_t); break;
     }
-    *cp = '\0';
-    cp++;
+    if (field || c == XPB_XA)
+      for (i = 0; i < st->n; i += STORE_CHUNK)
+	xpb_write(w, st->chunks[i >> STORE_CHUNK_SHIFT] + field,
+		  min(STORE_CHUNK, st->n - i) * width);
+    xpb_pad(w);
   }
-  if (*cp == '\0') return 0;
-  else *cp = '\0';
-  tokens[i] = 0;
-  return tokens;
+  free(text_offs);
 }
 
-#ifdef __GNUC__
-static inline
-int mystrcmp(char *s1, char *s2)
+/* Write the plotters on list, newest first, to fp in the binary format. */
+void write_binary(PLOTTER list, FILE *fp)
 {
-  while (*s1 == *s2++)
-    if (*s1++ == '\0')
-      return 0;
-  return 1;
+  struct xpb_writer w;
+  struct xpb_file f;
+  PLOTTER *pls;
+  PLOTTER pl;
+  int n = 0;
+  int k, kind;
+
+  for (pl = list; pl != NULL; pl = pl->next)
+    n++;
+  pls = (PLOTTER *) malloc((n + 1) * sizeof(PLOTTER));
+  if (pls == 0) fatalerror("malloc returned null");
+  for (pl = list, k = n; pl != NULL; pl = pl->next)
+    pls[--k] = pl;
+
+  w.fp = fp;
+  w.off = 0;
+  memset(&f, 0, sizeof(f));
+  memcpy(f.magic, XPB_MAGIC, sizeof(f.magic));
+  f.version = XPB_VERSION;
+  f.byte_order = XPB_BYTE_ORDER;
+  xpb_write(&w, &f, sizeof(f));
+
+  for (k = 0; k < n; k++) {
+    struct xpb_plotter h;
+    char *units[2];
+    uint64_t offs[2];
+
+    pl = pls[k];
+    memset(&h, 0, sizeof(h));
+    strncpy(h.x_type, coord_name(pl->x_type), sizeof(h.x_type) - 1);
+    strncpy(h.y_type, coord_name(pl->y_type), sizeof(h.y_type) - 1);
+    h.aspect_ratio = pl->aspect_ratio;
+    if (*pl->x_units || *pl->y_units) {
+      units[0] = pl->x_units;
+      units[1] = pl->y_units;
+      xpb_strings(&w, units, 2, offs);
+      h.x_units = offs[0];
+      h.y_units = offs[1];
+    }
+    xpb_block(&w, XPB_PLOTTER, 0, sizeof(h));
+    xpb_write(&w, &h, sizeof(h));
+    for (kind = 0; kind < NKINDS; kind++)
+      xpb_store(&w, pl, kind);
+  }
+  free(pls);
+  if (fflush(fp) != 0 || ferror(fp))
+    fatalerror("write failed");
 }
-#else
-#define mystrcmp strcmp
-#endif
 
-xpcolor_t parse_color(char *s)
+/* xplot --convert: read the plotters in one file and write them to
+   another in the binary format. */
+void convert_file(char *from, char *to)
 {
-  int atoi();
-  int i;
+  PLOTTER list;
+  FILE *fp;
+  int piped;
 
-  if (isdigit(*s))
-    return (xpcolor_t) atoi(s);
-  for (i=0; i < NCOLORS; ++i)
-    if (mystrcmp(s,ColorNames[i]) == 0)
-      return(i);
-  return(-1);  /* not a color name */
+  fp = open_plot_file(from, &piped);
+  if (fp == NULL) {
+    perror(from);
+    exit(1);
+  }
+  list = read_plotters(fp, NULL, 0, 0, 0, ncpus());
+  if (piped)
+    pclose(fp);
+  else
+    fclose(fp);
+
+  fp = fopen(to, "w");
+  if (fp == NULL) {
+    perror(to);
+    exit(1);
+  }
+  write_binary(list, fp);
+  if (fclose(fp) != 0)
+    fatalerror("write failed");
 }
- 
 
-int get_input(FILE *fp, Display *dpy, int lineno, struct plotter *pl)
+
+/*
+ * -follow.  A file that is still being written may not even have its
+ * first line yet; wait for it, as there is nothing to show until then.
+ */
+static void wait_for_line(FILE *fp)
 {
-  
-  char **tokens;
-  int ntokens = 0;
-  command *com;
+  struct stat st;
+  char buf[256];
+  ssize_t got;
 
-#define parseerror(s) \
-  { \
-      int i; \
-      fprintf(stderr, \
-	      "in line number %d: %s\noffending line: ", lineno, s); \
-      for (i = 0; i < ntokens; i++) \
-      { \
-	  fputs(tokens[i], stderr); \
-	  fputc(' ', stderr); \
-      } \
-      fputc('\n', stderr); \
-      fflush(stderr); \
-      exit(1); \
+  if (fp == stdin || fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode))
+    return;
+  while ((got = pread(fileno(fp), buf, sizeof(buf), 0)) >= 0
+	 && memchr(buf, '\n', (size_t) got) == NULL
+	 && got < (ssize_t) sizeof(buf))
+    usleep(FOLLOW_INTERVAL * 1000);
+}
+
+/* Keep on reading what is added to the file in, which has been read
+   into the plotters from pl on, into pl, unless it said "go". */
+static void start_follow(PLOTTER pl, struct input_source *in)
+{
+  struct follow *f;
+  char *cp;
+
+  if (in->go)
+    return;
+  if (in->map == 0 || in->feed != NULL || is_binary(in)) {
+    fprintf(stderr,
+	    "xplot: -follow can't follow a pipe, a compressed or a binary file\n");
+    return;
   }
-  do {
-    lineno++;
-    tokens = gettokens(fp);
-    if (tokens == 0) parseerror("EOF before first line of input");
-    for (ntokens = 0; tokens[ntokens] != 0; ntokens++);
-  } while (ntokens == 1 && mystrcmp(tokens[0], "new_plotter") == 0);
-  
-  if (ntokens != 2)
-    parseerror("invalid input format -- expecting coord type names");
+  f = (struct follow *) malloc(sizeof(*f));
+  if (f == 0) fatalerror("malloc returned null");
+  f->fd = dup(fileno(in->fp));
+  if (f->fd < 0) {
+    perror("xplot: -follow");
+    free(f);
+    return;
+  }
+  f->offset = in->cp - in->map;
+  f->lineno = 0;
+  for (cp = in->map; (cp = memchr(cp, '\n', in->cp - cp)) != NULL; cp++)
+    f->lineno++;
+
+  /* the lines read are put in here and parsed like a mapped file */
+  f->in = (struct input_source *) malloc(sizeof(*f->in));
+  if (f->in == 0) fatalerror("malloc returned null");
+  *f->in = *in;
+  f->in->fp = NULL;
+  f->in->map = (char *) malloc(FOLLOW_MAX);
+  if (f->in->map == 0) fatalerror("malloc returned null");
+  f->in->maplen = FOLLOW_MAX;
+  f->in->cp = f->in->end = f->in->map;
+  f->in->threads = 1;
+  f->in->buffered = TRUE;
+  f->in->kept = FALSE;
+  pl->follow = f;
+}
 
-  pl->x_type = parse_coord_name(tokens[0]);
-  pl->y_type = parse_coord_name(tokens[1]);
+static void stop_follow(PLOTTER pl)
+{
+  struct follow *f = pl->follow;
 
-  if (((int) pl->x_type) < 0 || ((int) pl->y_type) < 0)
-    parseerror("unknown coord type");
-  
-  for (;;) {
+  close(f->fd);
+  close_input(f->in);
+  free(f);
+  pl->follow = NULL;
+}
 
-    lineno++;
-    tokens = gettokens(fp);
+/*
+ * Tell the copy on the second display about the commands added to the
+ * plotter since it last looked, with flags for them.
+ */
+static int follow_copy(PLOTTER cp, PLOTTER pl)
+{
+  int n[NKINDS];
+  char *x_units = cp->x_units;
+  char *y_units = cp->y_units;
+  int kind, k;
+
+  for (kind = 0; kind < NKINDS; kind++) {
+    struct store *st = &cp->stores[kind];
+    struct store *from = &pl->stores[kind];
+
+    n[kind] = st->n;
+    if (from->nchunks > st->maxchunks)
+      grow_chunks(st, from->maxchunks);
+    for (k = st->nchunks; k < from->nchunks; k++) {
+      st->chunks[k] = from->chunks[k];
+      st->flags[k] = new_flags();
+    }
+    st->nchunks = from->nchunks;
+    st->n = from->n;
+  }
+  cp->x_units = pl->x_units;
+  cp->y_units = pl->y_units;
+  return grow_plotter(cp, n, x_units, y_units);
+}
+
+/*
+ * Read up to FOLLOW_MAX new bytes of a followed plotter's file, setting
+ * *more if there are more.  Returns whether anything is to be drawn.
+ */
+int follow_plotter(PLOTTER pl, int *more)
+{
+  struct follow *f = pl->follow;
+  struct input_source *in = f->in;
+  struct stat st;
+  int n[NKINDS];
+  char *x_units = pl->x_units;
+  char *y_units = pl->y_units;
+  int done = FALSE;
+  int drew;
+  ssize_t got;
+  char *nl;
+  int kind, i;
+
+  if (fstat(f->fd, &st) != 0)
+    return FALSE;
+  if (st.st_size < f->offset) {
+    fprintf(stderr, "xplot: followed file got shorter, not following it\n");
+    stop_follow(pl);
+    return FALSE;
+  }
+  if (st.st_size == f->offset)
+    return FALSE;
+  got = pread(f->fd, in->map, (size_t) min(st.st_size - f->offset,
+					   FOLLOW_MAX), f->offset);
+  if (got <= 0)
+    return FALSE;
+  if (f->offset + got < st.st_size)
+    *more = TRUE;
+
+  /* only whole lines */
+  for (nl = in->map + got; nl > in->map && nl[-1] != '\n'; nl--)
+    ;
+  in->cp = in->map;
+  in->end = nl;
+
+  for (kind = 0; kind < NKINDS; kind++)
+    n[kind] = pl->stores[kind].n;
+
+  while (!done) {
+    char *line = in->cp;
+    char **tokens;
+    int ntokens;
+    char *error;
+
+    tokens = gettokens(in);
     if (tokens == 0) break;
+    if (text_pending(in, tokens)) {
+      in->cp = line;
+      break;
+    }
+    f->lineno++;
     for (ntokens = 0; tokens[ntokens] != 0; ntokens++);
-    if (ntokens == 0) continue;
-    if (tokens[0][0] == ';') continue;
-    
-    /* check for color key alone on a line */
-    if (ntokens == 1) {
-      xpcolor_t c;
-
-      c = parse_color(tokens[0]);
-      if (c != -1) {
-	/* color keyword */
-	pl->default_color = pl->current_color = c;
-	continue;
+
+    switch (parse_line(in, pl, &pl->data->arena, tokens, ntokens, &error)) {
+    case PARSE_ERROR:
+      fprintf(stderr, "in line number %d: %s\noffending line: ",
+	      f->lineno, error);
+      for (i = 0; i < ntokens; i++) {
+	fputtok(tokens[i], stderr);
+	fputc(' ', stderr);
       }
+      fputc('\n', stderr);
+      fprintf(stderr, "xplot: not following the file any further\n");
+      done = TRUE;
+      break;
+    case PARSED_NEW_PLOTTER:
+      fprintf(stderr, "xplot: can't follow a file past new_plotter\n");
+      done = TRUE;
+      break;
+    case PARSED_GO:
+      done = TRUE;
+      break;
+    case PARSED:
+      break;
     }
+  }
+  f->offset += in->cp - in->map;
+
+  if (done)
+    stop_follow(pl);
+  drew = grow_plotter(pl, n, x_units, y_units);
+  if (pl->copy != NULL && follow_copy(pl->copy, pl))
+    drew = TRUE;
+  return drew;
+}
 
-    if (ntokens == 2 &&
-	parse_coord_name(tokens[0]) == pl->x_type &&
-	parse_coord_name(tokens[1]) == pl->y_type)
-      continue;
 
-#define BUFSIZE 1024     
-#define not_ntokens_equal_to_3_or_4	(ntokens != 3 && ntokens != 4)
-#define COLORfromTOK3  (com->color = ntokens == 4 ?\
-			parse_color(tokens[3]) : pl->current_color)
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Loading in the background: a thread per file hands over batches of
+ * parsed commands, and take_loaded() adds them between events.
+ */
+struct load_batch {
+  struct load_batch *next;
+  PLOTTER plotters;		/* a file's first plotters, newest first, */
+  struct parse_chunk *chunk;	/* or what comes after them */
+};
 
-    if (mystrcmp(tokens[0],"aspect_ratio") == 0) {
-      if (ntokens != 2) parseerror("input format error");
-      if (pl->x_type != pl->y_type)
-	parseerror("aspect_ratio requires identical coordinate types");
-      pl->aspect_ratio = atof(tokens[1]);
-    } else if (mystrcmp(tokens[0],"x") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = X;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],".") == 0
-	       || mystrcmp(tokens[0],"dot") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = DOT;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"+") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = PLUS;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"plus") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = PLUS;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"box") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = BOX;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"diamond") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = DIAMOND;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"utick") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = UTICK;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"dtick") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = DTICK;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-    } else if (mystrcmp(tokens[0],"ltick") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = LTICK;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"rtick") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = RTICK;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"htick") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = HTICK;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"vtick") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = VTICK;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"uarrow") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = UARROW;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"darrow") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = DARROW;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"larrow") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = LARROW;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"rarrow") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = RARROW;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"line") == 0) {
-      if (ntokens != 5 && ntokens != 6) parseerror("input format error");
-      com = new_command(pl);
-      com->type = LINE;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->xb = parse_coord(pl->x_type, tokens[3]);
-      com->yb = parse_coord(pl->y_type, tokens[4]);
-      com->color = ntokens == 6 ? parse_color(tokens[5]) : pl->current_color;
-    } else if (mystrcmp(tokens[0],"dline") == 0) {
-      if (ntokens != 5 && ntokens != 6) parseerror("input format error");
-      com = new_command(pl);
-      com->type = DLINE;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->xb = parse_coord(pl->x_type, tokens[3]);
-      com->yb = parse_coord(pl->y_type, tokens[4]);
-      com->color = ntokens == 6 ? parse_color(tokens[5]) : pl->current_color;
-    } else if (mystrcmp(tokens[0], "title") == 0) {
-      char buf[BUFSIZE];
-      char *cp;
-      buf[0] = '\0';
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-
-      com = new_command(pl);
-      com->type = TITLE;
-      com->text = cp;
-    } else if (mystrcmp(tokens[0], "ctext") == 0) {
-      char buf[BUFSIZE];
-      char *cp;
-      buf[0] = '\0';
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-      com = new_command(pl);
-      com->type = TEXT;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->text = cp;
-      com->position = CENTERED;
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0], "atext") == 0) {
-      char buf[BUFSIZE];
-      char *cp;
-      buf[0] = '\0';
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-      com = new_command(pl);
-      com->type = TEXT;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->text = cp;
-      com->position = ABOVE;
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0], "btext") == 0) {
-      char buf[BUFSIZE];
-      char *cp;
-      buf[0] = '\0';
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-      com = new_command(pl);
-      com->type = TEXT;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->text = cp;
-      com->position = BELOW;
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0], "ltext") == 0) {
-      char buf[BUFSIZE];
-      char *cp;
-      buf[0] = '\0';
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-      com = new_command(pl);
-      com->type = TEXT;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->text = cp;
-      com->position = TO_THE_LEFT;
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0], "rtext") == 0) {
-      char buf[BUFSIZE];
-      char *cp;
-      buf[0] = '\0';
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-      com = new_command(pl);
-      com->type = TEXT;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      com->text = cp;
-      com->position = TO_THE_RIGHT;
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0], "xlabel") == 0) {
-      char buf[1024];
-      char *cp;
-      buf[0] = '\0';
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-
-      com = new_command(pl);
-      com->type = XLABEL;
-      com->text = cp;
-    } else if (mystrcmp(tokens[0], "ylabel") == 0) {
-      char buf[1024];
-      char *cp;
-      buf[0] = '\0';
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-
-      com = new_command(pl);
-      com->type = YLABEL;
-      com->text = cp;
-    } else if (mystrcmp(tokens[0], "xunits") == 0) {
-      char buf[1024];
-      char *cp;
-      buf[0] = '\0';
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-
-      pl->x_units = cp;
-    } else if (mystrcmp(tokens[0], "yunits") == 0) {
-      char buf[1024];
-      char *cp;
-      buf[0] = '\0';
-      (void) fgets(buf, sizeof(buf), fp);
-      for (cp=buf;*cp != '\0';cp++)
-	if (*cp == '\n') { *cp = '\0'; break; }
-      cp = malloc((unsigned)strlen(buf) + 1);
-      if (cp == 0) fatalerror("malloc returned null");
-      (void) strcpy(cp, buf);
-
-      pl->y_units = cp;
-    } else if (mystrcmp(tokens[0],"invisible") == 0) {
-      if (not_ntokens_equal_to_3_or_4) parseerror("input format error");
-      com = new_command(pl);
-      com->type = INVISIBLE;
-      com->xa = parse_coord(pl->x_type, tokens[1]);
-      com->ya = parse_coord(pl->y_type, tokens[2]);
-      COLORfromTOK3;
-    } else if (mystrcmp(tokens[0],"go") == 0) {
-#if 0
-      fprintf(stderr,"xplot pid %d go!\n",getpid());
-#endif
+struct loader {
+  char *name;			/* NULL for the standard input */
+  FILE *fp;
+  int piped;
+  struct input_source *in;
+  Display *dpy;
+  int numtiles;
+  int tileno;
+  int nthreads;			/* to parse it with */
+  pthread_t thread;
+  struct load_batch *batches;	/* handed over and not yet taken, */
+  struct load_batch **tail;
+  int nbatches;
+  int done;			/* and whether that is all of them */
+  int finished;			/* all taken in, and the file closed */
+  PLOTTER newest;		/* the newest of its plotters on the list */
+  char *error;			/* what stopped it short, if anything, */
+  int error_lineno;		/* and where */
+  char **error_tokens;
+};
+
+/* how far a loader may get ahead of the event loop, in batches */
+#define LOAD_QUEUE_MAX 64
+/* how long to spend taking batches in between events, in milliseconds */
+#define LOAD_SLICE 50
+
+static struct loader *loaders;
+static int nloaders;
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t load_cond = PTHREAD_COND_INITIALIZER;
+
+/* Queue a batch for the event loop, waiting if it is far behind. */
+static void hand_over(struct loader *ld, PLOTTER plotters,
+		      struct parse_chunk *chunk)
+{
+  struct load_batch *b;
+
+  b = (struct load_batch *) malloc(sizeof(*b));
+  if (b == 0) fatalerror("malloc returned null");
+  b->next = NULL;
+  b->plotters = plotters;
+  b->chunk = chunk;
+  pthread_mutex_lock(&load_lock);
+  while (ld->nbatches >= LOAD_QUEUE_MAX)
+    pthread_cond_wait(&load_cond, &load_lock);
+  *ld->tail = b;
+  ld->tail = &b->next;
+  ld->nbatches++;
+  pthread_cond_broadcast(&load_cond);
+  pthread_mutex_unlock(&load_lock);
+}
+
+/* The next batch from ld, if there is one yet, and whether ld is done. */
+static struct load_batch *next_batch(struct loader *ld, int *done)
+{
+  struct load_batch *b;
+
+  pthread_mutex_lock(&load_lock);
+  b = ld->batches;
+  if (b != NULL) {
+    ld->batches = b->next;
+    if (ld->batches == NULL)
+      ld->tail = &ld->batches;
+    ld->nbatches--;
+    pthread_cond_broadcast(&load_cond);
+  }
+  *done = ld->done;
+  pthread_mutex_unlock(&load_lock);
+  return b;
+}
+
+/*
+ * The loader.  An error in the input is left in ld for the event loop.
+ */
+static void *load_file(void *arg)
+{
+  struct loader *ld = (struct loader *) arg;
+  struct input_source *in;
+  struct parse_chunk *chunks, *ch;
+  PLOTTER pl;
+  coord_type x_type, y_type;
+  size_t chunk_size = PARSE_CHUNK_MIN / 4;
+  char **tokens;
+  int ntokens;
+  char *error;
+  int lineno = 0;
+  int n, k, eof;
+
+  if (ld->name == NULL)
+    ld->fp = stdin;
+  else
+    ld->fp = open_plot_file(ld->name, &ld->piped);
+  if (ld->fp == 0)
+    goto done;
+  if (option_follow)
+    wait_for_line(ld->fp);
+  in = ld->in = open_input(ld->fp, ld->nthreads);
+
+  if (is_binary(in)) {
+    pl = read_binary(in, ld->dpy, ld->numtiles, ld->tileno);
+    if (pl != NULL)
+      hand_over(ld, pl, NULL);
+    goto done;
+  }
+
+  pl = (PLOTTER) malloc(sizeof(*pl));
+  if (pl == 0) fatalerror("malloc returned null");
+  pl->next = NULL;
+  init_plotter(pl, ld->dpy, ld->numtiles, ld->tileno);
+  error = parse_header(in, pl, &lineno, &tokens, &ntokens);
+  if (error)
+    goto failed;
+  x_type = pl->x_type;
+  y_type = pl->y_type;
+  hand_over(ld, pl, NULL);
+
+  while (!in->go) {
+    if (in->map) {
+      char *from = in->cp;
+      char *limit = chunk_limit(in);
+
+      n = in->threads * 4;
+      if ((size_t) n > (size_t) (limit - in->cp) / chunk_size)
+	n = max((size_t) (limit - in->cp) / chunk_size, 1);
+      chunks = cut_chunks(in, min(n * chunk_size, limit - in->cp), n);
+      n = parse_chunks(in, chunks, n, &x_type, &y_type, &lineno, &error,
+		       &tokens);
+      if (n < 0)
+	goto failed;
+      for (k = 0; k < n; k++) {
+	ch = (struct parse_chunk *) malloc(sizeof(*ch));
+	if (ch == 0) fatalerror("malloc returned null");
+	*ch = chunks[k];
+	hand_over(ld, NULL, ch);
+      }
+      free(chunks);
+      /* stopped short of the end only at a line it can't read yet,
+	 or of a block only where the next is to take over */
+      if (in->cp == from || in->cp >= limit) {
+	if (in->feed == NULL || !refill(in))
+	  break;
+      }
+      if (chunk_size < 4 * PARSE_CHUNK_MIN)
+	chunk_size *= 2;
+    } else {
+      ch = (struct parse_chunk *) malloc(sizeof(*ch));
+      if (ch == 0) fatalerror("malloc returned null");
+      ch->in = in;
+      ch->start = ch->end = NULL;
+      ch->x_type = x_type;
+      ch->y_type = y_type;
+      ch->parts = NULL;
+      ch->nparts = ch->maxparts = 0;
+      arena_init(&ch->texts, COMMAND_ARENA_BLOCK);
+      parse_chunk(ch, 0);
+      if (ch->error != NULL) {
+	lineno += ch->error_lineno;
+	error = ch->error;
+	tokens = in->tokens;
+	goto failed;
+      }
+      x_type = ch->parts[ch->nparts - 1]->x_type;
+      y_type = ch->parts[ch->nparts - 1]->y_type;
+      lineno += ch->lines;
+      in->go = ch->go;
+      eof = ch->eof;
+      hand_over(ld, NULL, ch);
+      if (eof)
+	break;
+    }
+  }
+
+  goto done;
+ failed:
+  ld->error = error;
+  ld->error_lineno = lineno;
+  ld->error_tokens = tokens;
+ done:
+  pthread_mutex_lock(&load_lock);
+  ld->done = TRUE;
+  pthread_cond_broadcast(&load_cond);
+  pthread_mutex_unlock(&load_lock);
+  return NULL;
+}
+
+/*
+ * Start loading the n files in names (stdin if NULL) in the background.
+ * Returns once each has its first plotters on the_plotter_list.
+ */
+void start_loading(char **names, int n, Display *dpy, int tile)
+{
+  int nthreads = ncpus();
+  int k;
+
+  if (names == NULL) {
+    n = 1;
+    tile = TRUE;
+  }
+  loaders = (struct loader *) malloc(n * sizeof(struct loader));
+  if (loaders == 0) fatalerror("malloc returned null");
+  nloaders = n;
+
+  /* the loaders would race to set this up */
+  index_verbs();
+
+  for (k = 0; k < n; k++) {
+    struct loader *ld = &loaders[k];
+
+    ld->name = names ? names[k] : NULL;
+    ld->fp = NULL;
+    ld->piped = FALSE;
+    ld->in = NULL;
+    ld->dpy = dpy;
+    ld->numtiles = tile ? n : 0;
+    ld->tileno = tile ? k : 0;
+    ld->nthreads = nthreads > n ? nthreads / n : 1;
+    ld->batches = NULL;
+    ld->tail = &ld->batches;
+    ld->nbatches = 0;
+    ld->done = FALSE;
+    ld->finished = FALSE;
+    ld->newest = NULL;
+    ld->error = NULL;
+    if (pthread_create(&ld->thread, NULL, load_file, ld) != 0)
+      fatalerror("can't start a thread to read the file");
+    nloading++;
+  }
+
+  for (k = 0; k < n; k++) {
+    struct loader *ld = &loaders[k];
+    struct load_batch *b;
+    int done;
+
+    pthread_mutex_lock(&load_lock);
+    while (ld->batches == NULL && !ld->done)
+      pthread_cond_wait(&load_cond, &load_lock);
+    pthread_mutex_unlock(&load_lock);
+    if ((b = next_batch(ld, &done)) != NULL) {
+      ld->newest = b->plotters;
+      link_plotters(b->plotters);
+      free(b);
+    } else if (ld->error != NULL)
+      parse_error(ld->error_lineno, ld->error, ld->error_tokens);
+  }
+}
+
+/* pl has all it is going to get: index what grow_plotter() left
+   unindexed.  Returns whether anything is to be drawn. */
+static int index_rest(PLOTTER pl)
+{
+  int kind;
+
+  for (kind = 0; kind < NKINDS; kind++)
+    if (pl->stores[kind].indexed < pl->stores[kind].n)
       break;
-    } else if (mystrcmp(tokens[0],"new_plotter") == 0) {
-      return lineno;
-    } else
-      parseerror("input format error");
+  if (kind == NKINDS)
+    return FALSE;
+  build_index(pl);
+  if (pl->win == 0)
+    return FALSE;
+  redraw_plotter(pl);
+  return TRUE;
+}
+
+/* Everything a loader read has been taken in: follow the file with
+   -follow, and let go of it otherwise.  Returns whether anything is
+   to be drawn. */
+static int finish_loading(struct loader *ld)
+{
+  int drew = FALSE;
+
+  pthread_join(ld->thread, NULL);
+  if (ld->error != NULL)
+    parse_error(ld->error_lineno, ld->error, ld->error_tokens);
+  if (ld->newest != NULL)
+    drew = index_rest(ld->newest);
+  if (ld->in != NULL) {
+    if (option_follow && ld->newest != NULL)
+      start_follow(ld->newest, ld->in);
+    close_input(ld->in);
   }
-  return 0;
+  if (ld->fp != NULL && ld->fp != stdin) {
+    if (ld->piped)
+      pclose(ld->fp);
+    else
+      fclose(ld->fp);
+  }
+  ld->finished = TRUE;
+  nloading--;
+  return drew;
+}
+
+/* Add a chunk a loader has read to its plotters.  Any plotters that
+   start in it are put up too, and shown if show is set. */
+static int take_chunk(struct loader *ld, struct parse_chunk *ch, int show)
+{
+  PLOTTER pl = ld->newest;
+  PLOTTER first = pl;
+  PLOTTER *p;
+  char *x_units = pl->x_units;
+  char *y_units = pl->y_units;
+  int n[NKINDS];
+  int drew;
+  int kind;
+
+  for (kind = 0; kind < NKINDS; kind++)
+    n[kind] = pl->stores[kind].n;
+  merge_chunk(&first, ch, ld->dpy);
+  free(ch);
+  drew = grow_plotter(pl, n, x_units, y_units);
+  if (first == pl)
+    return drew;
+  if (index_rest(pl))
+    drew = TRUE;
+
+  /* the new ones point at pl already; put them where it was */
+  for (p = &the_plotter_list; *p != pl; p = &(*p)->next)
+    ;
+  *p = first;
+  ld->newest = first;
+  for (; first != pl; first = first->next) {
+    set_views(first);
+    build_index(first);
+    if (show)
+      display_plotter(first);
+  }
+  return drew;
+}
+
+/*
+ * Take in the loaders' batches for up to LOAD_SLICE ms, setting *more
+ * if some are left.  Returns whether anything is to be drawn.
+ */
+int take_loaded(int show, int *more)
+{
+  struct timeval start, now;
+  int drew = FALSE;
+  int took;
+  int k;
+
+  gettimeofday(&start, NULL);
+  do {
+    took = FALSE;
+    for (k = 0; k < nloaders; k++) {
+      struct loader *ld = &loaders[k];
+      struct load_batch *b;
+      int done;
+
+      if (ld->finished)
+	continue;
+      b = next_batch(ld, &done);
+      if (b == NULL) {
+	if (done && finish_loading(ld))
+	  drew = TRUE;
+	continue;
+      }
+      if (take_chunk(ld, b->chunk, show))
+	drew = TRUE;
+      free(b);
+      took = TRUE;
+    }
+    gettimeofday(&now, NULL);
+    if (took && (now.tv_sec - start.tv_sec) * 1000
+	+ (now.tv_usec - start.tv_usec) / 1000 >= LOAD_SLICE) {
+      *more = TRUE;
+      break;
+    }
+  } while (took);
+  return drew;
 }
+#endif /* HAVE_LIBPTHREAD */
 
 
 static char *esc_paren(char *s)
@@ -3368,7 +8214,9 @@ static char *esc_paren(char *s)
 void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
 {
   struct plotter pspl;
-  command *c, *cc;
+  struct cursor cur;
+  command *c;
+  int pass;
   int counter;
   int currentcolor;
   bool finished_decoration, output_decoration;
@@ -3379,40 +8227,11 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
   double limit_height;
   dXPoint a,b;
 
-  /* Make a copy of both the plotter and its commands. */
-  pspl = *pl;
-
-#if 0
-  /* Copy list of commands.  This is somewhat kludgy because the
-   * order of the commands is important (at least all the decoration
-   * commands must come first), so I can't use new_command().
-   * It always puts the new command at the head of the list,
-   * and I can only walk the old list head->tail.
-   */
-
-  /* The next statement is only possible because next is the
-     first item in the command structure.  */
-  cc = (command *) &pspl.commands;
-  for (c = pl->commands; c != NULL; c = c->next)  {
-    cc->next = (command *) malloc(sizeof(command));
-    if (cc->next == 0) fatalerror("malloc returned null");
-    *cc->next = *c;
-    cc = cc->next;
-    cc->next = NULL;
-    /* If it is text, copy that too. */
-    if (c->type == TEXT || c->type == TITLE)  {
-      cc->text = malloc((unsigned)strlen(c->text) + 1);
-      if (cc->text == 0) fatalerror("malloc returned null");
-      (void) strcpy(cc->text, c->text);
-    }
-  }
-#else
-  /* Instead of copying we use the same commands.
-   * Now the caller above recomputes everything when we return.
+  /* Make a copy of the plotter.  Instead of copying the commands we
+   * use the same ones.  Now the caller above recomputes everything when
+   * we return.
    */
-  cc = pl->commands;
-  pspl.commands = cc;
-#endif
+  pspl = *pl;
 
   /* Because xplot only deals with integer output coords, use PS units
    * which are a multiple of the pixels per inch of the actual printer.
@@ -3425,7 +8244,6 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
 
   /* Calculate new window coordinates for everything. */
   { 
-    command *c;
     switch(state) {
     default:
       panic("emit_PS: unexpected state");
@@ -3493,16 +8311,11 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
 
     /*************** abstraction violation!!! */
     /* code copied from size_window above */
-    while (pspl.commands && pspl.commands->decoration) {
-      c = pspl.commands;
-      pspl.commands = pspl.commands->next;
-      free_command(c);
-    };
+    drop_decorations(&pspl);
     
     axis(&pspl);
     
-    for (c = pspl.commands; c != NULL; c = c->next)
-      compute_window_coords(&pspl, c);
+    map_commands(&pspl, FALSE);
   }
   
 
@@ -3734,13 +8547,12 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
   finished_decoration = output_decoration = FALSE;
   counter = 0;
   currentcolor = 0;		/* black */
+  map_visible(&pspl);
   /* loop twice - once for decoration, once for data */
-  for (c = pspl.commands; c != NULL; 
-       c = c->next
-       ? c->next
-       : (finished_decoration == FALSE
-	  ? (finished_decoration = TRUE, pspl.commands)
-	  : NULL))
+  for (pass = 0; pass < 2; pass++) {
+    finished_decoration = pass ? TRUE : FALSE;
+    for (c = first_command(&pspl, &cur, MAPPED); c != NULL;
+	 c = next_command(&cur))
     {
     if ( finished_decoration && output_decoration == FALSE )  {
       /* Thinner lines for the actual drawing. */
@@ -3787,17 +8599,7 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
       }
 
 #ifndef WINDOW_COORDS_IN_COMMAND_STRUCT
-      a.x = map_coord(pspl.x_type, pspl_x_left, pspl_x_right, pspl.size.x,
-		       c->xa);
-      a.y = (pspl.size.y - 1) -
-	map_coord(pspl.y_type, pspl_y_bottom, pspl_y_top, pspl.size.y,
-		  c->ya);
-      
-      b.x = map_coord(pspl.x_type, pspl_x_left, pspl_x_right, pspl.size.x,
-		       c->xb);
-      b.y = (pspl.size.y - 1) -
-	map_coord(pspl.y_type, pspl_y_bottom, pspl_y_top, pspl.size.y,
-		  c->yb);
+      window_coords(&pspl, &cur, c, &a, &b);
 
       a = tomain(&pspl, a);
       b = tomain(&pspl, b);
@@ -3903,6 +8705,7 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
       }
     }
   }
+  }
   
   fputs("stroke ", fp);
   if (state == PRINTING)
@@ -3912,8 +8715,15 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
   fputs("grestore\n", fp);
   (void) fflush(fp);
   
-  /* return our list of commands to the caller... */
-  pl->commands = pspl.commands;
+  /* return our decorations and visible lists to the caller... */
+  memcpy(pl->stores, pspl.stores, sizeof(pl->stores));
+  pl->decorations = pspl.decorations;
+  pl->decoration_arena = pspl.decoration_arena;
+  pl->x_ticks = pspl.x_ticks;
+  pl->y_ticks = pspl.y_ticks;
+  pl->anchor = pspl.anchor;
+  pl->mapped = pspl.mapped;
+  pl->draw_stopped = pspl.draw_stopped;
   
 }    
 
@@ -3924,12 +8734,13 @@ void emit_PS(struct plotter *pl, FILE *fp, enum plstate state)
 FILE *
 make_name_open_file(struct plotter *pl)
 {
+  struct cursor cur;
   command *c;
   char *name = NULL, *versionp;
   static int version = 0;
   FILE *fp;
 
-  for (c = pl->commands; c != NULL; c = c->next)  {
+  for (c = first_command(pl, &cur, 0); c != NULL; c = next_command(&cur))  {
     if (c->type == TITLE && name == NULL)  {
       /* Allow space for the number. */
       name = malloc((unsigned)strlen(c->text) + 15);
@@ -3980,7 +8791,7 @@ make_name_open_file(struct plotter *pl)
 #ifdef TCPTRACE
 #undef malloc
 void *
-MALLOC(int nbytes)
+MALLOC(size_t nbytes)
 {
     char *ptr;
 
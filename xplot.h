@@ -35,6 +35,8 @@ to preserve same.
 #define _xplot_h_
 
 #include <sys/time.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "config.h"
 
 #ifdef HAVE_LIBX11
@@ -62,11 +64,11 @@ double rint();     /* YMUL! some versions of ultrix omit this from math.h! */
 typedef union coord_u {
   int i;
   unsigned int u;
-  struct timeval t;
+  int64_t ns;			/* TIMEVAL and NSTIME, see timeval.c */
   double d;
 } coord;
 
-typedef enum { U_INT, INT, TIMEVAL, DOUBLE, DTIME} coord_type;
+typedef enum { U_INT, INT, TIMEVAL, DOUBLE, DTIME, NSTIME} coord_type;
 
 #include "coord.h"
 
@@ -75,7 +77,7 @@ double rint();     /* YMUL! some versions of ultrix omit this from math.h! */
 #endif
 
 /* allow error checking on all malloc() calls */
-void *MALLOC(int nbytes);
+void *MALLOC(size_t nbytes);
 #define malloc MALLOC
 
 /* prototypes */